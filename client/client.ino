@@ -1,32 +1,38 @@
 #include <SoftwareSerial.h>
+#include <ClayCastFrame.h>
+#include <ClayCastModbus.h>
+#include <ClayCastHC12.h>
 
 #define DEBUG 1 // Set to 1 to enable debug messages, 0 to disable
 
+#define MODBUS_ADDRESS 1 // Slave address
+
 // HC12 module pins
 const int hc12RxPin = A5;
 const int hc12TxPin = A4;
 const int hc12SetPin = A3;
 
-const int hc12Channel = 50; // Channel number (1–100)
+const int hc12Channel = radioChannel(radioPort(MODBUS_ADDRESS)); // Channel of the radio port the address is routed to (ClayCastHC12.h)
 
 // Create SoftwareSerial for HC12
 SoftwareSerial hc12(hc12TxPin, hc12RxPin); // RX, TX
-
-#define START_BYTE 0xAA
-#define END_BYTE 0x55
-#define MAX_DATA_SIZE 260
+HC12Link hc12Link(hc12, hc12SetPin);
 
 #define BAUD_RATE 9600
 
-uint8_t hc12_buffer[MAX_DATA_SIZE + 10]; // buffer for HC12 to serial
-bool hc12_receiving = false;
-uint16_t hc12_recvIndex = 0;
+// Single frame buffer: requests are unwrapped, processed and the response
+// wrapped again in place around framePayload(frameBuffer)
+uint8_t frameBuffer[FRAME_BUFFER_SIZE];
+FrameParser hc12Parser(frameBuffer);
 uint32_t hc12_lastByteTime = 0;
-uint8_t hc12_frameTime = 40; // Frame time in ms
+uint32_t hc12_frameMicros = 0; // micros() when the last frame completed
+uint8_t hc12_frameTime = 40; // Broken frame timeout in ms
 
-uint8_t packetBuffer[MAX_DATA_SIZE + 10]; // Buffer for transfer data packet
+// Link rate requested by the controller, applied after the current frame
+uint32_t pendingLinkBaud = 0;
+uint32_t lastFrameTime = 0; // Last valid frame heard from any node
 
-uint32_t trigger_timmer = 0;
+volatile uint32_t trigger_timmer = 0;
 
 // Define pins for shoot and success signals
 #define DO1 7
@@ -36,105 +42,211 @@ uint32_t trigger_timmer = 0;
 #define CONTACT_TIME 500 // Time to wait for contact closure (in ms)
 #define NEXTCAST_TIME 4000 // Time to wait for next cast (in ms)
 
-// Modbus constants
-#define MODBUS_ADDRESS 1 // Slave address
+// Contact capture: IN1/IN2 are sampled every millisecond from the Timer2
+// compare interrupt, so neither SoftwareSerial traffic nor debug prints can
+// make the loop miss a short pulse. (Pin change interrupts are not available:
+// SoftwareSerial owns the PCINT vectors, and its RX pin shares port C with
+// A0/A1.) A level counts once it has been stable for CONTACT_DEBOUNCE_SAMPLES.
+// The first closure of each input after a fire is latched with its delay
+// from the trigger pulse until the next fire. The interrupt reads both inputs
+// from PINC at once and returns after that while they are at their debounced
+// levels: SoftwareSerial's receive interrupt waits for it, and at 38400 baud
+// a bit lasts 26 us.
+#define CONTACT_INPUTS 2
+#define CONTACT_ACTIVE_LEVEL HIGH // Level of a closed contact
+#define CONTACT_DEBOUNCE_SAMPLES 5 // Samples (ms) a new level must hold
+#define CONTACT_DELAY_UNIT 100 // Delay register resolution (us)
+#define CONTACT_DELAY_NONE 0xFFFF // No closure since the last fire
+
+const uint8_t contactPins[CONTACT_INPUTS] = {IN1, IN2};
+const uint8_t contactBits[CONTACT_INPUTS] = {_BV(IN1 - A0), _BV(IN2 - A0)}; // In PINC (A0-A5)
+volatile uint8_t contactLevel[CONTACT_INPUTS]; // Debounced levels
+uint8_t contactSamples[CONTACT_INPUTS]; // Samples at a level other than contactLevel (ISR only)
+uint32_t contactEdgeTime[CONTACT_INPUTS]; // micros() of the first of them (ISR only)
+volatile bool contactLatched[CONTACT_INPUTS];
+volatile uint32_t contactDelay[CONTACT_INPUTS]; // Trigger to closure (us)
+volatile uint32_t triggerMicros = 0; // Start of the last trigger pulse
+volatile bool triggerArmed = false; // A fire happened since startup
+volatile bool triggerActive = false; // DO1 is high
+
+// Scheduled fire: a fire time from the controller (FIRE_AT_REGISTER) is turned
+// into local micros() with the synced clock below. The Timer2 compare A
+// interrupt that samples the contacts hands it to compare B once it falls into
+// the current 1 ms cycle, and compare B starts the trigger pulse, so neither
+// the loop nor the serial traffic delays it. Without a synced clock, or if the
+// time has already passed, the client fires at once like on a group fire. The
+// clock counts as synced once a full window of SYNC_WINDOW beacons is in: a
+// single sample still holds the whole delay of the loop that noticed it.
+#define TIMER2_TICK_MICROS 4 // 16 MHz / 64
+#define FIRE_AT_MAX_LEAD 2000000L // Later fire times are not trusted (us)
+
+volatile uint32_t fireAtMicros = 0; // Local micros() of the scheduled fire
+volatile bool fireAtPending = false; // Waiting for its Timer2 cycle
+
+// Time sync: every controller beacon (TIME_SYNC_REGISTER) gives a sample of the
+// offset between the local clock and the controller's, plus the radio delay
+// and however long the loop took to notice the frame. The delay only ever
+// adds, so the lowest samples are the best ones: the offset is taken from the
+// lowest sample of the current or the previous window of SYNC_WINDOW beacons.
+// Lowest means after drift correction, so a sample is compared with the
+// window's best one carried forward to its time. The drift between the clocks
+// is measured from an anchor, an earlier window's lowest sample, to the
+// latest: the longer the span, the less the radio jitter left in those two
+// samples matters. The anchor moves on to one half as old when it gets
+// SYNC_ANCHOR_SPAN old, so slow changes of the crystals are followed. The
+// part of the delay shared by all clients (most of the radio's) shifts every
+// fire time alike and does not add to the skew.
+#define SYNC_WINDOW 8 // Beacons per window
+#define SYNC_MIN_SPAN 10000000L // Shortest span for a drift measurement (us)
+#define SYNC_ANCHOR_SPAN 600000000L // Longest span before the anchor moves on (us)
+#define SYNC_RESET_MICROS 20000L // A sample this far off the estimate is an outlier...
+#define SYNC_RESET_SAMPLES 3 // ...and this many in a row start over (controller reset)
+#define SYNC_TIMEOUT 30000 // Fire at once if no beacon was heard for this long (ms)
+
+struct SyncPoint {
+  uint32_t controllerTime; // Controller micros() of the beacon
+  int32_t offset; // Local micros() at reception minus controllerTime
+};
+
+SyncPoint syncLowest[2]; // Lowest sample of the previous and the current window
+SyncPoint syncAnchor; // Start of the drift measurement
+SyncPoint syncNextAnchor; // Window minimum half way to SYNC_ANCHOR_SPAN
+bool syncStarted = false; // Samples are being taken; the clock is synced once the first window is complete (syncPreviousValid)
+bool syncPreviousValid = false;
+bool syncNextAnchorValid = false;
+uint8_t syncSamples = 0; // Samples in the current window
+uint8_t syncOutliers = 0; // Outliers in a row
+int32_t syncDriftPpb = 0; // Local clock against the controller's (1e-9)
+uint32_t syncTime = 0; // millis() of the last beacon
+
+// Retransmits: a sequenced request (see ClayCastFrame.h) that repeats the
+// number and CRC of the last one is a retransmit of it. It is not run again,
+// so a repeated fire is a no-op; the cached answer is sent instead. Answers
+// longer than REPLY_CACHE_SIZE (reads) are not kept: a retransmitted read is
+// run again, and a retransmitted 0x17 only has its read part rebuilt, without
+// the write.
+#define REPLY_CACHE_SIZE 16
+#define REPLY_CACHE_TIMEOUT 2000 // The same number and CRC later than this is a new request (ms)
+
+uint8_t replyData[REPLY_CACHE_SIZE]; // Last answer to a sequenced request
+bool replyValid = false; // replySequence and replyRequestCrc belong to an answered request
+uint8_t replySize = 0; // 0: answer too long to keep
+uint8_t replySequence = 0;
+uint16_t replyRequestCrc = 0;
+uint32_t replyTime = 0; // millis() of the answer
+
+// Report by exception: a superframe beacon from the controller (see
+// ClayCastModbus.h) gives this client a transmit slot. In it, registers
+// 0..reportRegisters - 1 are sent if they differ from the last report, or as a
+// heartbeat after reportHeartbeat superframes without one. Slot 0 is left to
+// the clients handling the beacon. A report that no longer fits the rest of
+// the slot (loop held up) waits for the next one.
+#define REPORT_MAX_REGISTERS 8
+#define SLOT_GUARD_MICROS 5000L // Left free at the end of a slot for the HC12 latency
+
+uint16_t reportedRegisters[REPORT_MAX_REGISTERS]; // Values of the last report
+bool reportSent = false; // reportedRegisters is valid
+uint8_t reportRegisters = 0; // Registers per report, 0 without a slot
+uint8_t reportHeartbeat = 0;
+uint8_t superframesSinceReport = 0;
+uint32_t slotStartMicros = 0; // micros() at the start of the next own slot
+uint32_t slotMicros = 0; // Slot length
+bool slotPending = false; // The next own slot has not come yet
+bool slotCompact = false; // Framing of the beacon, used for the report
+bool slotFec = false;
+
+// Event log: a ring of the last EVENT_LOG_SIZE events, so the master can poll
+// slowly and still see every fire and contact change. Each event gets the next
+// sequence number; the master writes the first sequence it has not seen yet
+// to EVENT_CURSOR and reads the window behind it, which then starts at that
+// event (or at the oldest one kept, if it has been overwritten). Both fit in
+// one 0x17 request, and a repeated request returns the same events.
+#define EVENT_LOG_SIZE 16 // Power of two
+#define EVENT_ENTRY_REGISTERS 4 // Sequence, type/detail, time high, time low
+
+enum EventType {
+  EVENT_NONE = 0, // Window entry with no event (yet)
+  EVENT_FIRE_RECEIVED = 1, // FIRE written by the master; detail FIRE_SCHEDULED if it waits for its time
+  EVENT_FIRE_REJECTED = 2, // Within NEXTCAST_TIME of the last shot
+  EVENT_TRIGGER_START = 3, // DO1 high
+  EVENT_TRIGGER_END = 4, // DO1 low again after CONTACT_TIME
+  EVENT_CONTACT_CLOSED = 5, // Detail: input (1 = IN1, 2 = IN2)
+  EVENT_CONTACT_OPENED = 6
+};
 
-#define MODBUS_FUNCTION_READ_HOLDING_REGISTERS 0x03
-#define MODBUS_FUNCTION_WRITE_SINGLE_REGISTER 0x06
-#define MODBUS_EXCEPTION_ILLEGAL_FUNCTION 0x01
-#define MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS 0x02
-#define MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE 0x03
+#define FIRE_SCHEDULED 1 // EVENT_FIRE_RECEIVED detail: fired by the timer at the controller's time
 
+struct EventEntry {
+  uint16_t sequence;
+  uint8_t type;
+  uint8_t detail;
+  uint32_t time; // millis()
+};
+
+EventEntry eventLog[EVENT_LOG_SIZE]; // Written from the contact ISR too
+volatile uint16_t eventNext = 0; // Sequence number of the next event
+
+// Modbus constants
 #define RS485_DE 2 // RS485 DE pin
 
-// Holding registers array (3 registers)
+#define MAX_WRITE_QUANTITY 123 // Registers per 0x10 request (Modbus limit)
+#define MAX_READ_WRITE_QUANTITY 121 // Registers written per 0x17 request
+
+// Holding registers array
 enum RegisterIndex {
   DEVICE_ID = 0,
     FIRE = 1,
     CONTACT1 = 2,
     CONTACT2 = 3,
+    CONTACT1_LATCH = 4, // IN1 closed since the last fire
+    CONTACT1_DELAY = 5, // Fire to IN1 closure, CONTACT_DELAY_UNIT
+    CONTACT2_LATCH = 6,
+    CONTACT2_DELAY = 7,
+    EVENT_NEXT = 8, // Sequence number of the next event (read only)
+    EVENT_CURSOR = 9, // First sequence number shown in the event window
+    REGISTER_COUNT
 };
-uint16_t holdingRegisters[3] = {
+// The event window follows the stored registers (see eventRegisterValue)
+#define EVENT_WINDOW REGISTER_COUNT
+#define READABLE_REGISTER_COUNT (EVENT_WINDOW + EVENT_LOG_SIZE * EVENT_ENTRY_REGISTERS)
+uint16_t holdingRegisters[REGISTER_COUNT] = {
   MODBUS_ADDRESS,
   0,
+  0,
+  0,
+  0,
+  CONTACT_DELAY_NONE,
+  0,
+  CONTACT_DELAY_NONE,
+  0,
   0
 }; // Initialize registers
 
-uint16_t wrapModbusRTU(const uint8_t * data, uint16_t dataSize, uint8_t * outBuffer) {
-  if (dataSize > MAX_DATA_SIZE) return 0;
-
-  uint16_t checksum = (dataSize >> 8) + (dataSize & 0xFF);
-  for (uint16_t i = 0; i < dataSize; i++) checksum += data[i];
-
-  uint16_t index = 0;
-  outBuffer[index++] = START_BYTE;
-  outBuffer[index++] = (dataSize >> 8) & 0xFF;
-  outBuffer[index++] = dataSize & 0xFF;
-  for (uint16_t i = 0; i < dataSize; i++) outBuffer[index++] = data[i];
-  outBuffer[index++] = (checksum >> 8) & 0xFF;
-  outBuffer[index++] = checksum & 0xFF;
-  outBuffer[index++] = END_BYTE;
-
-  return index;
-}
-
-bool unwrapModbusRTU(const uint8_t * packet, uint16_t packetSize, uint8_t * dataOut, uint16_t * dataSizeOut) {
-  if (packetSize < 6 || packet[0] != START_BYTE || packet[packetSize - 1] != END_BYTE) return false;
-
-  uint16_t size = (packet[1] << 8) | packet[2];
-  if (size > MAX_DATA_SIZE || packetSize != size + 6) return false;
-
-  uint16_t checksum = (size >> 8) + (size & 0xFF);
-  for (uint16_t i = 0; i < size; i++) {
-    dataOut[i] = packet[3 + i];
-    checksum += dataOut[i];
-  }
+// Bring the module to the network defaults. It keeps its baud across resets,
+// so a client restarted after a rate change finds it first.
+void configureHC12() {
+  uint32_t foundBaud = hc12Link.detect();
+  bool ok = foundBaud != 0 &&
+    hc12Link.setBaud(HC12_DEFAULT_BAUD) &&
+    hc12Link.setTransmitMode(HC12_TRANSMIT_MODE) &&
+    hc12Link.setChannel(hc12Channel);
 
-  uint16_t receivedChecksum = (packet[3 + size] << 8) | packet[4 + size];
-  if (checksum != receivedChecksum) return false;
-
-  * dataSizeOut = size;
-  return true;
-}
-
-void setHC12Channel(uint8_t channel) {
-  if (channel < 1 || channel > 100) return; // Out of range
-
-  char cmd[10];
-  sprintf(cmd, "AT+C%03d", channel); // Format: AT+C005, AT+C100, etc.
   #if DEBUG
-  Serial.print("Setting HC12 to channel: ");
-  Serial.println(cmd);
+  Serial.print("HC12 found at ");
+  Serial.print(foundBaud);
+  Serial.print(" baud, configured: ");
+  Serial.println(ok ? "OK" : hc12Link.lastReply());
   #endif
-
-  digitalWrite(hc12SetPin, LOW); // Enter AT command mode
-  delay(50);
-
-  hc12.print(cmd);
-  delay(100); // Give HC12 time to process
-
-  // Optional: Wait for OK response
-  while (hc12.available()) {
-    char c = hc12.read();
-    // Optionally print to Serial for debug
-    #if DEBUG
-    Serial.print(c);
-    #endif
-  }
-
-  digitalWrite(hc12SetPin, HIGH); // Back to transparent mode
-  delay(50);
 }
 
 void setup() {
   pinMode(DO1, OUTPUT); // DO1 pin for shoot signal
   pinMode(RS485_DE, OUTPUT); // RS485 DE pin
   digitalWrite(RS485_DE, LOW); // Set to receive mode
-  pinMode(hc12SetPin, OUTPUT);
-  digitalWrite(hc12SetPin, HIGH); // Default mode
+  startContactCapture();
 
   Serial.begin(BAUD_RATE); // Modbus RTU side
-  hc12.begin(BAUD_RATE); // HC12 communication
+  hc12Link.begin(HC12_DEFAULT_BAUD); // HC12 communication
 
   // Debug output
   #if DEBUG
@@ -142,101 +254,138 @@ void setup() {
   Serial.println("HC-12 and Modbus RTU setup complete.");
   #endif
 
-  setHC12Channel(hc12Channel); // Set channel before any data is sent
-
+  configureHC12(); // Set channel and rate before any data is sent
+  lastFrameTime = millis();
 }
 
 void loop() {
-  // Receive and buffer data from HC12
+  // 1. Receive data from HC12; a frame is complete as soon as its last byte arrives
+  bool frameReady = false;
   while (hc12.available()) {
-    uint8_t byteIn = hc12.read();
     hc12_lastByteTime = millis();
-
-    if (!hc12_receiving && byteIn == START_BYTE) {
-      hc12_receiving = true;
-      hc12_recvIndex = 0;
-      hc12_buffer[hc12_recvIndex++] = byteIn;
-    } else if (hc12_receiving) {
-      if (hc12_recvIndex < sizeof(hc12_buffer)) {
-        hc12_buffer[hc12_recvIndex++] = byteIn;
-        if (byteIn == END_BYTE) break; // Possible end of packet
-      } else {
-        hc12_receiving = false; // Overflow
-      }
+    if (hc12Parser.feed(hc12.read())) {
+      hc12_frameMicros = micros();
+      frameReady = true;
+      break; // Leave following bytes for the next pass
     }
   }
 
-  // 2. Timeout: process if no new byte for 10ms
-  if (hc12_receiving && (millis() - hc12_lastByteTime > hc12_frameTime)) {
-    hc12_receiving = false;
+  // 2. Timeout: fallback for a broken frame that never completes
+  if (!frameReady && hc12Parser.receiving() && (millis() - hc12_lastByteTime > hc12_frameTime)) {
+    frameReady = hc12Parser.expire();
+    #if DEBUG
+    if (!frameReady) Serial.println("Invalid packet received.");
+    #endif
+  }
 
-    uint16_t unwrappedLen = 0;
-    if (unwrapModbusRTU(hc12_buffer, hc12_recvIndex, packetBuffer, & unwrappedLen)) {
-      #if DEBUG
+  if (frameReady) {
+    lastFrameTime = millis();
+    FramePayload payload = hc12Parser.payload();
+    #if DEBUG
+    // Only own and broadcast frames, and no superframe beacons: printing every
+    // poll and report on air, or a beacon before the first slots, would hold
+    // the loop up on the serial output
+    if ((payload.data[0] == MODBUS_ADDRESS || payload.data[0] == MODBUS_BROADCAST_ADDRESS) && !isSuperframe(payload)) {
       Serial.print("Received valid packet (");
-      for (int i = 0; i < unwrappedLen; i++) {
+      for (int i = 0; i < payload.size; i++) {
         // Print each byte in hex format, with leading zero if needed
-        if ((uint8_t) packetBuffer[i] < 0x10) Serial.print('0'); // Leading zero for single-digit hex
-        Serial.print((uint8_t) packetBuffer[i], HEX);
+        if ((uint8_t) payload.data[i] < 0x10) Serial.print('0'); // Leading zero for single-digit hex
+        Serial.print((uint8_t) payload.data[i], HEX);
         Serial.print(' '); // Optional: space between hex values
       }
       Serial.println(")");
-      #endif
+    }
+    #endif
 
-      // 3. Process Modbus request
-      int responseSize = processModbusRequest(packetBuffer, unwrappedLen, packetBuffer);
-
-      // 4. Wrap and send the response if valid
-      if (responseSize > 0) {
-        uint16_t wrappedSize = wrapModbusRTU(packetBuffer, responseSize, hc12_buffer);
-        hc12.write(hc12_buffer, wrappedSize);
-
-        #if DEBUG
-        Serial.print("Sent response (");
-        for (int i = 0; i < wrappedSize; i++) {
-          // Print each byte in hex format, with leading zero if needed
-          if ((uint8_t) hc12_buffer[i] < 0x10) Serial.print('0'); // Leading zero for single-digit hex
-          Serial.print((uint8_t) hc12_buffer[i], HEX);
-          Serial.print(' '); // Optional: space between hex values
-        }
-        Serial.println(")");
-        #endif
-      }
+    // 3. Process Modbus request (response is built over the request), unless
+    // it is a retransmit of the last one
+    if (payload.data[0] == MODBUS_ADDRESS) hc12Parser.claim();
+    uint16_t requestCrc = hc12Parser.sequenced() ? (payload.data[payload.size - 2] << 8) | payload.data[payload.size - 1] : 0;
+    int responseSize = replayResponse(payload, requestCrc);
+    if (responseSize < 0) {
+      responseSize = processModbusRequest(payload.data, payload.size, payload.data);
+      if (hc12Parser.sequenced() && payload.data[0] == MODBUS_ADDRESS) rememberResponse(payload.data, responseSize, requestCrc);
+    }
+
+    // 4. Wrap and send the response if valid, in the format of the request
+    if (responseSize > 0) {
+      uint16_t wrappedSize = wrapResponse(responseSize);
+      uint8_t * wrapped = frameStart(frameBuffer, hc12Parser.compact());
+      hc12.write(wrapped, wrappedSize);
 
-    } else {
       #if DEBUG
-      Serial.println("Invalid packet received.");
+      Serial.print("Sent response (");
+      for (int i = 0; i < wrappedSize; i++) {
+        // Print each byte in hex format, with leading zero if needed
+        if (wrapped[i] < 0x10) Serial.print('0'); // Leading zero for single-digit hex
+        Serial.print(wrapped[i], HEX);
+        Serial.print(' '); // Optional: space between hex values
+      }
+      Serial.println(")");
       #endif
     }
   }
 
+  sendSlotReport();
+  updateLinkRate();
   set_trigger_back();
 
   // 5. Modbus-side logic (as before)
   if (holdingRegisters[FIRE] == 1) {
+    logEvent(EVENT_FIRE_RECEIVED, 0);
     holdingRegisters[CONTACT1] = 0;
     triggerShoot();
     holdingRegisters[FIRE] = 0;
   }
 
   if (holdingRegisters[FIRE] == 0) {
-    holdingRegisters[CONTACT1] = digitalRead(IN1);
+    holdingRegisters[CONTACT1] = contactLevel[0];
   }
 
-  holdingRegisters[CONTACT2] = digitalRead(IN2);
+  holdingRegisters[CONTACT2] = contactLevel[1];
+  updateContactRegisters();
+}
+
+// Apply a link rate change requested by the controller, or fall back to the
+// default rate once nothing has been heard at the current one for a while
+void updateLinkRate() {
+  uint32_t targetBaud = pendingLinkBaud;
+  pendingLinkBaud = 0;
+  if (targetBaud == 0) {
+    if (hc12Link.baud() == HC12_DEFAULT_BAUD || millis() - lastFrameTime < LINK_SILENCE_TIMEOUT) return;
+    targetBaud = HC12_DEFAULT_BAUD;
+  }
+  if (targetBaud == hc12Link.baud()) return;
+
+  bool ok = hc12Link.setBaud(targetBaud);
+  hc12Parser.reset();
+  lastFrameTime = millis();
+
+  #if DEBUG
+  Serial.print("HC12 link rate ");
+  Serial.print(targetBaud);
+  Serial.println(ok ? " set" : " refused");
+  #endif
 }
 
 // Set the trigger back to LOW after a delay
 void set_trigger_back() {
-  if (millis() - CONTACT_TIME > trigger_timmer) {
+  noInterrupts(); // The pulse may have been started from the timer
+  bool expired = triggerActive && millis() - CONTACT_TIME > trigger_timmer;
+  if (expired) triggerActive = false;
+  interrupts();
+
+  if (expired) {
       digitalWrite(DO1, LOW);
+      logEvent(EVENT_TRIGGER_END, 0);
   }
 }
 
-// Process a Modbus RTU request and generate a response
+// Process a Modbus RTU request and generate a response.
+// request and response may point to the same buffer.
 int processModbusRequest(uint8_t * request, int requestLength, uint8_t * response) {
   // Validate CRC
-  if (!validateCRC(request, requestLength)) {
+  if (!modbusCheckCRC(request, requestLength)) {
     return 0; // Invalid CRC, ignore request
   }
 
@@ -244,6 +393,12 @@ int processModbusRequest(uint8_t * request, int requestLength, uint8_t * respons
   uint8_t address = request[0];
   uint8_t functionCode = request[1];
 
+  // Broadcasts are executed but never answered
+  if (address == MODBUS_BROADCAST_ADDRESS) {
+    handleBroadcast(request, requestLength);
+    return 0;
+  }
+
   // Check if the request is for this slave
   if (address != MODBUS_ADDRESS) {
     return 0; // Ignore requests not addressed to this slave
@@ -254,6 +409,10 @@ int processModbusRequest(uint8_t * request, int requestLength, uint8_t * respons
     return handleReadHoldingRegisters(request, requestLength, response);
   case MODBUS_FUNCTION_WRITE_SINGLE_REGISTER:
     return handleWriteSingleRegister(request, requestLength, response);
+  case MODBUS_FUNCTION_WRITE_MULTIPLE_REGISTERS:
+    return handleWriteMultipleRegisters(request, requestLength, response);
+  case MODBUS_FUNCTION_READ_WRITE_MULTIPLE_REGISTERS:
+    return handleReadWriteMultipleRegisters(request, requestLength, response);
   default:
     return generateExceptionResponse(request, response, MODBUS_EXCEPTION_ILLEGAL_FUNCTION);
   }
@@ -261,24 +420,39 @@ int processModbusRequest(uint8_t * request, int requestLength, uint8_t * respons
 
 // Handle Read Holding Registers (Function Code 0x03)
 int handleReadHoldingRegisters(uint8_t * request, int requestLength, uint8_t * response) {
+  // Address + function + start + quantity + CRC
+  if (requestLength < 8) {
+    return generateExceptionResponse(request, response, MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE);
+  }
+
   uint16_t startAddress = (request[2] << 8) | request[3];
   uint16_t quantity = (request[4] << 8) | request[5];
 
-  if (startAddress + quantity > sizeof(holdingRegisters) / sizeof(holdingRegisters[0])) {
+  if (quantity == 0) {
+    return generateExceptionResponse(request, response, MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE);
+  }
+
+  if (startAddress + quantity > READABLE_REGISTER_COUNT) {
     return generateExceptionResponse(request, response, MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS);
   }
 
   response[0] = MODBUS_ADDRESS;
   response[1] = MODBUS_FUNCTION_READ_HOLDING_REGISTERS;
+  return buildReadResponse(response, startAddress, quantity);
+}
+
+// Fill in byte count, register values and CRC behind address + function code
+int buildReadResponse(uint8_t * response, uint16_t startAddress, uint16_t quantity) {
   response[2] = quantity * 2;
 
   int index = 3;
   for (int i = 0; i < quantity; i++) {
-    response[index++] = holdingRegisters[startAddress + i] >> 8;
-    response[index++] = holdingRegisters[startAddress + i] & 0xFF;
+    uint16_t value = registerValue(startAddress + i);
+    response[index++] = value >> 8;
+    response[index++] = value & 0xFF;
   }
 
-  appendCRC(response, index);
+  modbusAppendCRC(response, index);
   return index + 2;
 }
 
@@ -292,64 +466,521 @@ int handleWriteSingleRegister(uint8_t * request, int requestLength, uint8_t * re
   uint16_t address = (request[2] << 8) | request[3];
   uint16_t value = (request[4] << 8) | request[5];
 
-  if (address >= sizeof(holdingRegisters) / sizeof(holdingRegisters[0])) {
+  if (address >= REGISTER_COUNT) {
     return generateExceptionResponse(request, response, MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS);
   }
 
-  if (address == DEVICE_ID || address == CONTACT1 || address == CONTACT2) {
+  if (!isWritableRegister(address)) {
     return generateExceptionResponse(request, response, MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE);
   }
 
   holdingRegisters[address] = value;
 
-  memcpy(response, request, 6);
-  appendCRC(response, 6);
+  memmove(response, request, 6); // Echo request (may be the same buffer)
+  modbusAppendCRC(response, 6);
+  return 8;
+}
+
+// Handle Write Multiple Registers (Function Code 0x10)
+int handleWriteMultipleRegisters(uint8_t * request, int requestLength, uint8_t * response) {
+  // Address + function + start + quantity + byte count + values + CRC
+  if (requestLength < 9) {
+    return generateExceptionResponse(request, response, MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE);
+  }
+
+  uint16_t startAddress = (request[2] << 8) | request[3];
+  uint16_t quantity = (request[4] << 8) | request[5];
+  uint8_t byteCount = request[6];
+
+  if (quantity == 0 || quantity > MAX_WRITE_QUANTITY || byteCount != quantity * 2 || requestLength != 9 + byteCount) {
+    return generateExceptionResponse(request, response, MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE);
+  }
+
+  if (startAddress + quantity > REGISTER_COUNT) {
+    return generateExceptionResponse(request, response, MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS);
+  }
+
+  if (!isWritableRange(startAddress, quantity)) {
+    return generateExceptionResponse(request, response, MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE);
+  }
+
+  writeRegisters(startAddress, quantity, request + 7);
+
+  // Response echoes address, function, start and quantity
+  memmove(response, request, 6);
+  modbusAppendCRC(response, 6);
   return 8;
 }
 
+// Handle Read/Write Multiple Registers (Function Code 0x17)
+// The write is applied first, so e.g. FIRE can be set and the contacts read back in one transaction.
+int handleReadWriteMultipleRegisters(uint8_t * request, int requestLength, uint8_t * response) {
+  // Address + function + read start/quantity + write start/quantity + byte count + values + CRC
+  if (requestLength < 13) {
+    return generateExceptionResponse(request, response, MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE);
+  }
+
+  uint16_t readAddress = (request[2] << 8) | request[3];
+  uint16_t readQuantity = (request[4] << 8) | request[5];
+  uint16_t writeAddress = (request[6] << 8) | request[7];
+  uint16_t writeQuantity = (request[8] << 8) | request[9];
+  uint8_t byteCount = request[10];
+
+  if (readQuantity == 0 || readQuantity > READABLE_REGISTER_COUNT || writeQuantity == 0 || writeQuantity > MAX_READ_WRITE_QUANTITY ||
+    byteCount != writeQuantity * 2 || requestLength != 13 + byteCount) {
+    return generateExceptionResponse(request, response, MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE);
+  }
+
+  if (readAddress + readQuantity > READABLE_REGISTER_COUNT || writeAddress + writeQuantity > REGISTER_COUNT) {
+    return generateExceptionResponse(request, response, MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS);
+  }
+
+  if (!isWritableRange(writeAddress, writeQuantity)) {
+    return generateExceptionResponse(request, response, MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE);
+  }
+
+  // Values are consumed before the response overwrites them
+  writeRegisters(writeAddress, writeQuantity, request + 11);
+
+  response[0] = MODBUS_ADDRESS;
+  response[1] = MODBUS_FUNCTION_READ_WRITE_MULTIPLE_REGISTERS;
+  return buildReadResponse(response, readAddress, readQuantity);
+}
+
+// Handle a broadcast request (slave address 0). Only group fire, link rate,
+// time sync and scheduled fire writes are accepted, anything else is dropped.
+void handleBroadcast(uint8_t * request, int requestLength) {
+  uint16_t startAddress = (request[2] << 8) | request[3];
+
+  if (request[1] == MODBUS_FUNCTION_WRITE_SINGLE_REGISTER && requestLength == 8) {
+    uint16_t value = (request[4] << 8) | request[5];
+    applyGroupFire(startAddress, value);
+    if (startAddress == LINK_RATE_REGISTER && hc12UsableBaud(value * 100UL)) {
+      pendingLinkBaud = value * 100UL;
+    }
+  } else if (request[1] == MODBUS_FUNCTION_WRITE_MULTIPLE_REGISTERS && requestLength >= 9) {
+    uint16_t quantity = (request[4] << 8) | request[5];
+    if (request[6] != quantity * 2 || requestLength != 9 + request[6]) return;
+    const uint8_t * values = request + 7;
+    uint32_t time = ((uint32_t) values[0] << 24) | ((uint32_t) values[1] << 16) | (values[2] << 8) | values[3];
+
+    if (startAddress == TIME_SYNC_REGISTER && quantity == 2) {
+      syncClock(time, hc12_frameMicros);
+      return;
+    }
+    if (startAddress == SUPERFRAME_REGISTER && quantity == SUPERFRAME_REGISTER_COUNT) {
+      startSuperframe(values);
+      return;
+    }
+    if (startAddress == FIRE_AT_REGISTER && quantity > 2) {
+      for (uint16_t i = 2; i < quantity; i++) {
+        if (machineSelected(FIRE_AT_REGISTER + i, (values[2 * i] << 8) | values[2 * i + 1], FIRE_AT_MASK_REGISTER)) {
+          scheduleFire(time);
+        }
+      }
+      return;
+    }
+    for (uint16_t i = 0; i < quantity; i++) {
+      applyGroupFire(startAddress + i, (values[2 * i] << 8) | values[2 * i + 1]);
+    }
+  }
+}
+
+// Wrap the answer at framePayload(frameBuffer) in the format of the request
+// (sequenced if too long for FEC). Returns the frame length.
+uint16_t wrapResponse(int responseSize) {
+  uint8_t sequence = hc12Parser.sequence();
+  if (hc12Parser.fec()) {
+    uint16_t wrappedSize = wrapFecFrame(frameBuffer, responseSize, sequence);
+    if (wrappedSize > 0) return wrappedSize;
+  }
+  if (hc12Parser.sequenced()) return wrapSequencedFrame(frameBuffer, responseSize, sequence);
+  return wrapFrame(frameBuffer, responseSize, hc12Parser.compact());
+}
+
+// The answer, built over the request, if the request is a retransmit of the
+// last sequenced one; -1 otherwise (run it as a new request)
+int replayResponse(FramePayload payload, uint16_t requestCrc) {
+  if (!hc12Parser.sequenced() || !replyValid || payload.data[0] != MODBUS_ADDRESS) return -1;
+  if (hc12Parser.sequence() != replySequence || requestCrc != replyRequestCrc || millis() - replyTime > REPLY_CACHE_TIMEOUT) {
+    return -1;
+  }
+
+  if (replySize > 0) {
+    memcpy(payload.data, replyData, replySize);
+    return replySize;
+  }
+
+  // Too long to keep: a read, which may run again, or the read part of a
+  // 0x17, which must not repeat its write (it was valid, or the exception
+  // would have been kept)
+  if (payload.data[1] == MODBUS_FUNCTION_READ_WRITE_MULTIPLE_REGISTERS) {
+    uint16_t readAddress = (payload.data[2] << 8) | payload.data[3];
+    uint16_t readQuantity = (payload.data[4] << 8) | payload.data[5];
+    return buildReadResponse(payload.data, readAddress, readQuantity);
+  }
+  return -1;
+}
+
+// Note a sequenced request for its retransmits, with its answer if that fits
+void rememberResponse(const uint8_t * response, int responseSize, uint16_t requestCrc) {
+  replyValid = responseSize > 0;
+  if (!replyValid) return;
+
+  replySize = responseSize <= REPLY_CACHE_SIZE ? responseSize : 0;
+  if (replySize > 0) memcpy(replyData, response, replySize);
+  replySequence = hc12Parser.sequence();
+  replyRequestCrc = requestCrc;
+  replyTime = millis();
+}
+
+bool isSuperframe(FramePayload payload) {
+  return payload.size > 4 && payload.data[0] == MODBUS_BROADCAST_ADDRESS &&
+    payload.data[1] == MODBUS_FUNCTION_WRITE_MULTIPLE_REGISTERS && ((payload.data[2] << 8) | payload.data[3]) == SUPERFRAME_REGISTER;
+}
+
+// A superframe beacon: take the own slot, if there is one
+void startSuperframe(const uint8_t * values) {
+  uint16_t slotTime = (values[2 * SUPERFRAME_SLOT_TIME] << 8) | values[2 * SUPERFRAME_SLOT_TIME + 1];
+  uint16_t slots = (values[2 * SUPERFRAME_SLOTS] << 8) | values[2 * SUPERFRAME_SLOTS + 1];
+  uint16_t heartbeat = (values[2 * SUPERFRAME_HEARTBEAT] << 8) | values[2 * SUPERFRAME_HEARTBEAT + 1];
+  uint16_t registers = (values[2 * SUPERFRAME_REPORT_REGISTERS] << 8) | values[2 * SUPERFRAME_REPORT_REGISTERS + 1];
+
+  slotPending = false;
+  if (MODBUS_ADDRESS > slots || registers == 0 || registers > REPORT_MAX_REGISTERS || heartbeat == 0 || heartbeat > 255) {
+    return;
+  }
+  if (registers != reportRegisters) reportSent = false; // The controller wants another block
+  reportRegisters = registers;
+  reportHeartbeat = heartbeat;
+  slotMicros = slotTime * 1000UL;
+  slotStartMicros = hc12_frameMicros + MODBUS_ADDRESS * slotMicros;
+  slotFec = hc12Parser.fec();
+  slotCompact = hc12Parser.compact() || (hc12Parser.sequenced() && !slotFec);
+  slotPending = true;
+}
+
+// Send a report in the own slot, if anything changed or a heartbeat is due
+void sendSlotReport() {
+  if (!slotPending || hc12Parser.receiving()) return;
+  int32_t intoSlot = micros() - slotStartMicros;
+  if (intoSlot < 0) return;
+  slotPending = false;
+
+  bool due = !reportSent || ++superframesSinceReport >= reportHeartbeat;
+  for (uint8_t i = 0; i < reportRegisters && !due; i++) {
+    if (registerValue(i) != reportedRegisters[i]) due = true;
+  }
+  if (!due) return;
+
+  uint8_t * response = framePayload(frameBuffer);
+  response[0] = MODBUS_ADDRESS;
+  response[1] = MODBUS_FUNCTION_READ_HOLDING_REGISTERS;
+  int responseSize = buildReadResponse(response, 0, reportRegisters);
+  uint16_t wrappedSize = slotFec ? wrapFecFrame(frameBuffer, responseSize, 0) : wrapFrame(frameBuffer, responseSize, slotCompact);
+  uint32_t airMicros = wrappedSize * (10000000UL / hc12Link.baud());
+  if (intoSlot + airMicros > slotMicros - SLOT_GUARD_MICROS) return; // Too late, next superframe
+
+  hc12.write(frameStart(frameBuffer, slotCompact), wrappedSize);
+  for (uint8_t i = 0; i < reportRegisters; i++) {
+    reportedRegisters[i] = (response[3 + 2 * i] << 8) | response[4 + 2 * i];
+  }
+  reportSent = true;
+  superframesSinceReport = 0;
+
+  #if DEBUG
+  Serial.println("Sent report.");
+  #endif
+}
+
+// Fire if this machine's bit is set in a group fire mask register
+void applyGroupFire(uint16_t registerAddress, uint16_t mask) {
+  if (machineSelected(registerAddress, mask, GROUP_FIRE_REGISTER)) {
+    holdingRegisters[FIRE] = 1;
+  }
+}
+
+// True if this machine's bit is set in a machine bitmask register. Bit n of
+// register firstRegister + k selects slave address 16 * k + n + 1.
+bool machineSelected(uint16_t registerAddress, uint16_t mask, uint16_t firstRegister) {
+  uint16_t bitIndex = MODBUS_ADDRESS - 1;
+  return registerAddress == firstRegister + bitIndex / 16 && (mask & (1u << (bitIndex % 16)));
+}
+
+// Only the control registers may be written by the master
+bool isWritableRegister(uint16_t address) {
+  return address == FIRE || address == EVENT_CURSOR;
+}
+
+bool isWritableRange(uint16_t startAddress, uint16_t quantity) {
+  for (uint16_t i = 0; i < quantity; i++) {
+    if (!isWritableRegister(startAddress + i)) return false;
+  }
+  return true;
+}
+
+// Store big-endian register values
+void writeRegisters(uint16_t startAddress, uint16_t quantity, const uint8_t * values) {
+  for (uint16_t i = 0; i < quantity; i++) {
+    holdingRegisters[startAddress + i] = (values[2 * i] << 8) | values[2 * i + 1];
+  }
+}
+
 // Generate an exception response
 int generateExceptionResponse(uint8_t * request, uint8_t * response, uint8_t exceptionCode) {
   response[0] = MODBUS_ADDRESS;
   response[1] = request[1] | 0x80; // Add error flag
   response[2] = exceptionCode;
-  appendCRC(response, 3);
+  modbusAppendCRC(response, 3);
   return 5;
 }
 
-// Validate CRC
-bool validateCRC(uint8_t * buffer, int length) {
-  uint16_t calculatedCRC = calculateCRC(buffer, length - 2);
-  uint16_t receivedCRC = (buffer[length - 1] << 8) | buffer[length - 2];
-  return calculatedCRC == receivedCRC;
+// Trigger the shoot mechanism by setting the SHOOT_PIN
+void triggerShoot() {
+  noInterrupts();
+  startTrigger();
+  interrupts();
 }
 
-// Append CRC to a Modbus packet
-void appendCRC(uint8_t * buffer, int length) {
-  uint16_t crc = calculateCRC(buffer, length);
-  buffer[length] = crc & 0xFF;
-  buffer[length + 1] = crc >> 8;
+// Start the trigger pulse, unless the last one was less than NEXTCAST_TIME ago.
+// Times the contacts from its start and clears their latches. Interrupts off.
+void startTrigger() {
+  uint32_t now = millis();
+  if (!(now - NEXTCAST_TIME > trigger_timmer)) {
+    pushEvent(EVENT_FIRE_REJECTED, 0, now);
+    return;
+  }
+
+  digitalWrite(DO1, HIGH);
+  triggerMicros = micros();
+  trigger_timmer = now;
+  triggerActive = true;
+  triggerArmed = true;
+  for (uint8_t i = 0; i < CONTACT_INPUTS; i++) contactLatched[i] = false;
+  pushEvent(EVENT_TRIGGER_START, 0, now);
 }
 
-// Calculate CRC-16
-uint16_t calculateCRC(uint8_t * buffer, int length) {
-  uint16_t crc = 0xFFFF;
-  for (int i = 0; i < length; i++) {
-    crc ^= buffer[i];
-    for (int j = 0; j < 8; j++) {
-      if (crc & 1) {
-        crc = (crc >> 1) ^ 0xA001;
-      } else {
-        crc >>= 1;
-      }
-    }
+// Fire at a controller time from the timer, or at once without a usable time
+void scheduleFire(uint32_t controllerTime) {
+  uint32_t localTime = controllerTime + syncOffset(controllerTime);
+  int32_t lead = localTime - micros();
+  if (!syncPreviousValid || millis() - syncTime > SYNC_TIMEOUT || lead <= 0 || lead > FIRE_AT_MAX_LEAD) {
+    holdingRegisters[FIRE] = 1;
+    return;
   }
-  return crc;
+
+  noInterrupts();
+  fireAtMicros = localTime;
+  fireAtPending = true;
+  interrupts();
+  logEvent(EVENT_FIRE_RECEIVED, FIRE_SCHEDULED);
 }
 
-// Trigger the shoot mechanism by setting the SHOOT_PIN
-void triggerShoot() {
-  if (millis() - NEXTCAST_TIME > trigger_timmer) {
-    trigger_timmer = millis();
-    digitalWrite(DO1, HIGH);
+// Timer2 in CTC mode at 1 kHz (16 MHz / 64 / 250); compare A samples the
+// contacts, compare B starts a scheduled fire. It is not used otherwise.
+void startContactCapture() {
+  for (uint8_t i = 0; i < CONTACT_INPUTS; i++) {
+    pinMode(contactPins[i], INPUT);
+    contactLevel[i] = digitalRead(contactPins[i]);
+  }
+
+  noInterrupts();
+  TCCR2A = _BV(WGM21);
+  TCCR2B = _BV(CS22);
+  OCR2A = 249;
+  TIMSK2 |= _BV(OCIE2A);
+  interrupts();
+}
+
+ISR(TIMER2_COMPA_vect) {
+  uint8_t inputs = PINC;
+  if (fireAtPending) armFireCompare(micros());
+
+  bool changing = false;
+  for (uint8_t i = 0; i < CONTACT_INPUTS; i++) {
+    if (((inputs & contactBits[i]) ? HIGH : LOW) != contactLevel[i] || contactSamples[i] != 0) changing = true;
+  }
+  if (!changing) return;
+
+  uint32_t now = micros();
+  for (uint8_t i = 0; i < CONTACT_INPUTS; i++) sampleContact(i, (inputs & contactBits[i]) ? HIGH : LOW, now);
+}
+
+ISR(TIMER2_COMPB_vect) {
+  TIMSK2 &= ~_BV(OCIE2B);
+  startTrigger();
+}
+
+// Hand the scheduled fire to compare B once it falls into the cycle that just
+// started (interrupt context). Too close for a compare match, it fires here.
+void armFireCompare(uint32_t now) {
+  uint8_t count = TCNT2;
+  int32_t target = count + ((int32_t)(fireAtMicros - now)) / TIMER2_TICK_MICROS;
+  if (target > OCR2A) return; // A later cycle
+
+  fireAtPending = false;
+  if (target <= count + 1) {
+    startTrigger();
+    return;
+  }
+  OCR2B = target;
+  TIFR2 = _BV(OCF2B); // Drop a match from earlier in the cycle
+  TIMSK2 |= _BV(OCIE2B);
+}
+
+// Debounce one input sampled at level (interrupt context). The edge time is
+// that of the first sample of the run that made it through the debounce.
+void sampleContact(uint8_t input, uint8_t level, uint32_t now) {
+  if (level == contactLevel[input]) {
+    contactSamples[input] = 0; // Bounce, or no change
+    return;
+  }
+
+  if (contactSamples[input]++ == 0) contactEdgeTime[input] = now;
+  if (contactSamples[input] < CONTACT_DEBOUNCE_SAMPLES) return;
+
+  contactLevel[input] = level;
+  contactSamples[input] = 0;
+  pushEvent(level == CONTACT_ACTIVE_LEVEL ? EVENT_CONTACT_CLOSED : EVENT_CONTACT_OPENED, input + 1,
+    millis() - (now - contactEdgeTime[input]) / 1000);
+  if (level != CONTACT_ACTIVE_LEVEL || !triggerArmed || contactLatched[input]) return;
+
+  int32_t sinceTrigger = contactEdgeTime[input] - triggerMicros;
+  if (sinceTrigger < 0) return; // Closed before the trigger pulse
+  contactLatched[input] = true;
+  contactDelay[input] = sinceTrigger;
+}
+
+// Copy the latched results into the holding registers
+void updateContactRegisters() {
+  for (uint8_t i = 0; i < CONTACT_INPUTS; i++) {
+    noInterrupts();
+    bool latched = contactLatched[i];
+    uint32_t sinceTrigger = contactDelay[i];
+    interrupts();
+
+    uint32_t units = sinceTrigger / CONTACT_DELAY_UNIT;
+    holdingRegisters[CONTACT1_LATCH + 2 * i] = latched;
+    holdingRegisters[CONTACT1_DELAY + 2 * i] = !latched ? CONTACT_DELAY_NONE : units < CONTACT_DELAY_NONE ? units : CONTACT_DELAY_NONE - 1;
   }
-}
\ No newline at end of file
+}
+// Append an event, overwriting the oldest one (interrupts off)
+void pushEvent(uint8_t type, uint8_t detail, uint32_t time) {
+  EventEntry & entry = eventLog[eventNext % EVENT_LOG_SIZE];
+  entry.sequence = eventNext;
+  entry.type = type;
+  entry.detail = detail;
+  entry.time = time;
+  eventNext = eventNext + 1;
+}
+
+// Append an event from the main loop
+void logEvent(uint8_t type, uint8_t detail) {
+  noInterrupts();
+  pushEvent(type, detail, millis());
+  interrupts();
+}
+
+// Value of a readable register: the stored ones, the event counter or the event window
+uint16_t registerValue(uint16_t address) {
+  if (address >= EVENT_WINDOW) return eventRegisterValue(address - EVENT_WINDOW);
+  if (address == EVENT_NEXT) {
+    noInterrupts();
+    uint16_t next = eventNext;
+    interrupts();
+    return next;
+  }
+  return holdingRegisters[address];
+}
+
+// Register of the event window at an offset. The window starts at EVENT_CURSOR,
+// moved up to the oldest event kept; entries past the newest event read as EVENT_NONE.
+uint16_t eventRegisterValue(uint16_t offset) {
+  noInterrupts();
+  uint16_t next = eventNext;
+  uint16_t first = holdingRegisters[EVENT_CURSOR];
+  if ((uint16_t)(next - first) > EVENT_LOG_SIZE) first = next - EVENT_LOG_SIZE; // Overwritten, or a cursor ahead of the log
+  uint16_t sequence = first + offset / EVENT_ENTRY_REGISTERS;
+  EventEntry entry = eventLog[sequence % EVENT_LOG_SIZE];
+  interrupts();
+
+  // Not logged yet, or (before the log first fills up) never
+  if ((uint16_t)(sequence - first) >= (uint16_t)(next - first) || entry.sequence != sequence) {
+    entry.type = EVENT_NONE;
+    entry.detail = 0;
+    entry.time = 0;
+  }
+
+  switch (offset % EVENT_ENTRY_REGISTERS) {
+  case 0:
+    return sequence;
+  case 1:
+    return (entry.type << 8) | entry.detail;
+  case 2:
+    return entry.time >> 16;
+  default:
+    return entry.time & 0xFFFF;
+  }
+}
+
+// Offset (local - controller) at a controller time, carried forward with the
+// drift from the lowest sample of a window (0: previous, 1: current)
+int32_t projectOffset(uint8_t window, uint32_t controllerTime) {
+  int32_t elapsed = controllerTime - syncLowest[window].controllerTime;
+  return syncLowest[window].offset + (int32_t)((int64_t) elapsed * syncDriftPpb / 1000000000L);
+}
+
+// Best offset at a controller time: the lower of the two window minima
+int32_t syncOffset(uint32_t controllerTime) {
+  int32_t offset = projectOffset(1, controllerTime);
+  if (syncPreviousValid) {
+    int32_t previous = projectOffset(0, controllerTime);
+    if (previous < offset) offset = previous;
+  }
+  return offset;
+}
+
+// A time beacon from the controller, received at local micros() receivedMicros
+void syncClock(uint32_t controllerTime, uint32_t receivedMicros) {
+  SyncPoint sample = {controllerTime, (int32_t)(receivedMicros - controllerTime)};
+  syncTime = millis();
+  if (syncStarted && labs(sample.offset - syncOffset(controllerTime)) > SYNC_RESET_MICROS) {
+    if (++syncOutliers < SYNC_RESET_SAMPLES) return; // Noticed late by a busy loop
+    syncStarted = false;
+  }
+  syncOutliers = 0;
+
+  if (!syncStarted) {
+    syncLowest[1] = sample;
+    syncSamples = 1;
+    syncPreviousValid = false;
+    syncNextAnchorValid = false;
+    syncDriftPpb = 0;
+    syncStarted = true;
+    return;
+  }
+
+  if (syncSamples == 0 || sample.offset <= projectOffset(1, controllerTime)) syncLowest[1] = sample;
+  if (++syncSamples < SYNC_WINDOW) return;
+
+  // Window complete: drift from the anchor to its lowest sample
+  if (!syncPreviousValid) {
+    syncAnchor = syncLowest[1];
+  } else {
+    int32_t span = syncLowest[1].controllerTime - syncAnchor.controllerTime;
+    if (span >= SYNC_MIN_SPAN) {
+      syncDriftPpb = (int64_t)(syncLowest[1].offset - syncAnchor.offset) * 1000000000L / span;
+    }
+    if (!syncNextAnchorValid && span >= SYNC_ANCHOR_SPAN / 2) {
+      syncNextAnchor = syncLowest[1];
+      syncNextAnchorValid = true;
+    }
+    if (span >= SYNC_ANCHOR_SPAN) {
+      syncAnchor = syncNextAnchor;
+      syncNextAnchorValid = false;
+    }
+  }
+  syncLowest[0] = syncLowest[1];
+  syncPreviousValid = true;
+  syncSamples = 0;
+}
@@ -1,4 +1,8 @@
 #include <SoftwareSerial.h>
+#include <ClayCastFrame.h>
+#include <ClayCastModbus.h>
+#include <ClayCastHC12.h>
+#include <ClayCastEcho.h>
 
 #define DEBUG 0 // Set to 1 to enable debug messages, 0 to disable
 
@@ -7,109 +11,360 @@ const int hc12RxPin = 13;
 const int hc12TxPin = 12;
 const int hc12SetPin = 11;
 
-const int hc12Channel = 50; // Channel number (1–100)
+// Radio port served by this board (see RADIO_ROUTES in ClayCastHC12.h). With
+// RADIO_PORTS above 1 there is one board per port on the RS485 bus, each
+// forwarding only the requests for the slave addresses routed to its port.
+#define RADIO_PORT 0
+
+#if RADIO_PORT >= RADIO_PORTS
+#error "RADIO_PORT must be below RADIO_PORTS"
+#endif
+
+const int hc12Channel = radioChannel(RADIO_PORT); // Channel number (1–100)
 
 // Create SoftwareSerial for HC12
 SoftwareSerial hc12(hc12TxPin, hc12RxPin); // RX, TX
-
-#define START_BYTE 0xAA
-#define END_BYTE 0x55
-#define MAX_DATA_SIZE 260
+HC12Link hc12Link(hc12, hc12SetPin);
 
 #define BAUD_RATE 9600
 #define RS485_DE 2 // RS485 DE pin
 
-uint8_t hc12_buffer[MAX_DATA_SIZE + 10]; // buffer for HC12 to serial
-bool hc12_receiving = false;
-uint16_t hc12_recvIndex = 0;
+// Single frame buffer shared by both directions. The payload always sits at
+// framePayload(frameBuffer), so RS485 requests are wrapped and HC12 responses
+// unwrapped in place. Modbus RTU is strictly request/response, so a new request
+// from the master takes the buffer over from a stale radio frame.
+uint8_t frameBuffer[FRAME_BUFFER_SIZE];
+
+FrameParser hc12Parser(frameBuffer);
 uint32_t hc12_lastByteTime = 0;
-uint8_t hc12_frameTime = 40; // Frame time in ms
+uint8_t hc12_frameTime = 40; // Broken frame timeout in ms
 
-uint8_t serial_buffer[MAX_DATA_SIZE]; // buffer for serial to HC12
 bool serial_receiving = false;
+bool serial_frameReady = false;
 uint16_t serial_recvIndex = 0;
-uint32_t serial_lastByteTime = 0;
-uint8_t serial_frameTime = 4; // Frame time in ms (Modbus RTU standard)
+uint32_t serial_lastByteMicros = 0;
+const uint32_t serial_frameMicros = modbusInterFrameMicros(BAUD_RATE); // Modbus RTU t3.5 gap
 
-bool testMode = false;
-uint32_t lastTestSendTime = 0;
-uint16_t testCounter = 0;
+// Radio link: a client answer is expected after every request except broadcasts
+#define COMPACT_FRAMING 0 // Set to 1 to send requests in the compact frame format (clients answer in kind)
+#define RADIO_RESPONSE_TIMEOUT 250 // Give up waiting for a client answer (ms)
 
-uint8_t packetBuffer[MAX_DATA_SIZE + 10]; // Buffer for transfer data packet
+enum RadioState {
+  RADIO_IDLE,
+  RADIO_FORWARDED, // Master request sent, answer goes back to RS485
+  RADIO_POLLING, // Background cache poll sent
+  RADIO_SUPERFRAME, // Superframe beacon sent, client slots running
+  RADIO_QUEUED // Queued fire sent, answer goes to the fire queue
+};
+uint8_t radioState = RADIO_IDLE;
+uint8_t radioTarget = 0; // Slave address of the last request sent
+uint16_t radioAnswerWait = 0; // radioAnswerTime() of the last request sent (ms)
+uint32_t radioSentTime = 0;
+uint32_t radioIdleSince = 0;
 
-uint16_t wrapModbusRTU(const uint8_t * data, uint16_t dataSize, uint8_t * outBuffer) {
-  if (dataSize > MAX_DATA_SIZE) return 0;
+// Retransmits (ARQ): requests go out in the sequenced frame format (see
+// ClayCastFrame.h; update the clients first), each under a new number. A
+// master request without an answer after the airtime of it and its longest
+// possible answer plus ARQ_TURNAROUND is sent again under the same number, up
+// to ARQ_RETRIES times, well before the master would time out and retry. The
+// client answers a retransmit it has already run from its cache, so a repeated
+// fire does not fire twice. Answers with another number are late answers to a
+// request already dealt with and are dropped.
+#define ARQ_ENABLED 0 // Set to 1 to number requests and retransmit unanswered master requests
+#define ARQ_RETRIES 2 // Retransmits of a master request
+#define ARQ_TURNAROUND 80 // HC12 latency both ways plus the client's loop, its debug output included (ms)
+#define ARQ_MAX_FRAME 64 // Longer master requests are not kept for a retransmit
 
-  uint16_t checksum = (dataSize >> 8) + (dataSize & 0xFF);
-  for (uint16_t i = 0; i < dataSize; i++) checksum += data[i];
+// Forward error correction: frames go out in the FEC format (see
+// ClayCastFrame.h; update the clients first), which the receiver repairs from
+// one wrong byte per 16 instead of dropping, and the clients answer in kind.
+// It numbers requests like the sequenced format, so it combines with
+// ARQ_ENABLED. Payloads over FEC_MAX_DATA_SIZE go out sequenced.
+#define FEC_ENABLED 0 // Set to 1 to send requests in the FEC frame format
 
-  uint16_t index = 0;
-  outBuffer[index++] = START_BYTE;
-  outBuffer[index++] = (dataSize >> 8) & 0xFF;
-  outBuffer[index++] = dataSize & 0xFF;
-  for (uint16_t i = 0; i < dataSize; i++) outBuffer[index++] = data[i];
-  outBuffer[index++] = (checksum >> 8) & 0xFF;
-  outBuffer[index++] = checksum & 0xFF;
-  outBuffer[index++] = END_BYTE;
+uint8_t radioSequence = 0; // Number of the last request sent
+#if ARQ_ENABLED
+uint8_t arqFrame[ARQ_MAX_FRAME]; // The last master request as sent
+uint8_t arqFrameSize = 0;
+uint8_t arqRetries = 0; // Retransmits left
+#endif
 
-  return index;
-}
+// HC12 link rate: after startup the controller moves every client to
+// HC12_LINK_BAUD, and back to HC12_DEFAULT_BAUD if they stop answering
+#define HC12_LINK_BAUD 9600 // 19200 or 38400 for a faster air rate, HC12_DEFAULT_BAUD to disable
+#define LINK_PROBE_CLIENTS 10 // Clients probed (slave addresses 1..LINK_PROBE_CLIENTS, max 16)
+#define LINK_SWITCH_REPEATS 3 // Rate change broadcasts, the clients cannot answer them
+#define LINK_SWITCH_GAP 50 // Between rate change broadcasts (ms)
+#define LINK_SWITCH_SETTLE 400 // Clients finishing their AT commands (ms)
+#define LINK_FAIL_LIMIT 3 // Consecutive timeouts of probed clients before falling back
+#define LINK_KEEPALIVE_INTERVAL 1000 // Rate broadcast on an idle radio, keeps clients from falling back (ms)
 
-bool unwrapModbusRTU(const uint8_t * packet, uint16_t packetSize, uint8_t * dataOut, uint16_t * dataSizeOut) {
-  if (packetSize < 6 || packet[0] != START_BYTE || packet[packetSize - 1] != END_BYTE) return false;
+#if LINK_PROBE_CLIENTS > 16
+#error "LINK_PROBE_CLIENTS must fit the 16 bit client mask"
+#endif
 
-  uint16_t size = (packet[1] << 8) | packet[2];
-  if (size > MAX_DATA_SIZE || packetSize != size + 6) return false;
+uint16_t linkClients = 0; // Bit n: slave address n + 1 answered the probe
+uint8_t linkFailures = 0;
 
-  uint16_t checksum = (size >> 8) + (size & 0xFF);
-  for (uint16_t i = 0; i < size; i++) {
-    dataOut[i] = packet[3 + i];
-    checksum += dataOut[i];
-  }
+// Time sync and scheduled fire (see ClayCastModbus.h): a time beacon goes out
+// every TIME_SYNC_INTERVAL, and a group fire from the master goes on to the
+// clients as a fire at FIRE_AT_LEAD after the frame has left, which every
+// selected client starts from a timer at the same moment. Clients time a
+// beacon from their loop, which debug output of the frames before it holds
+// up, so polls stop once a beacon is due and it goes out after
+// TIME_SYNC_QUIET of radio silence. Until a scheduled fire the controller
+// sends nothing of its own: SoftwareSerial holds off a client's interrupts
+// for every byte it receives, the fire timer's included.
+#define TIME_SYNC_ENABLED 0 // Set to 1 to send time beacons and schedule group fires, 0 to forward group fires as they are
+#define TIME_SYNC_INTERVAL 1000 // Between beacons (ms)
+#define TIME_SYNC_QUIET 150 // Radio idle time before a beacon (ms)
+#define FIRE_AT_LEAD 150 // Fire time after the frame has left (ms): radio latency plus a client loop held up by debug output
+#define FIRE_AT_QUIET 20 // No polls or beacons until this long after the fire time (ms)
+
+uint32_t timeSyncSent = 0; // millis() of the last beacon
+uint32_t fireAtTime = 0; // micros() of the last scheduled fire
+bool fireAtPending = false; // Its time (plus FIRE_AT_QUIET) has not passed yet
+
+// Register cache: clients are polled in the background over HC12 and the master
+// reads all of them in one request from CACHE_SLAVE_ADDRESS, without the radio.
+// Client n occupies registers (n - 1) * CACHE_BLOCK_SIZE + 0..CACHE_REGISTERS - 1,
+// followed by its age register (time since the last answer, CACHE_AGE_UNIT ms units).
+// A client that has not answered yet, or missed CACHE_MISS_LIMIT polls in a
+// row, is absent: it is polled at most once per CACHE_ABSENT_INTERVAL (all
+// absent clients taking turns) until it answers again. A master request arriving during a poll ends the
+// wait for an absent client at once, and for any other client after the
+// poll's airtime both ways plus ARQ_TURNAROUND.
+#define CACHE_ENABLED 0 // Set to 1 to poll clients and answer CACHE_SLAVE_ADDRESS, 0 to disable
+#define CACHE_SLAVE_ADDRESS (247 - 2 * RADIO_PORT) // Virtual slave answered by the controller (245, 243, ... on further radio ports)
+#define CACHE_CLIENTS 10 // Clients polled: those of slave addresses 1..CACHE_CLIENTS on this radio port
+#define CACHE_REGISTERS 4 // Holding registers polled from each client (from 0)
+#define CACHE_BLOCK_SIZE (CACHE_REGISTERS + 1) // Client registers + age register
+#define CACHE_POLL_INTERVAL 20 // Radio idle time left to the master between polls (ms)
+#define CACHE_AGE_UNIT 100 // Age register resolution (ms)
+#define CACHE_AGE_UNKNOWN 0xFFFF // Client has never answered
+#define CACHE_MISS_LIMIT 3 // Unanswered polls in a row before a client counts as absent
+#define CACHE_ABSENT_INTERVAL 1000 // Between polls of absent clients (ms)
+
+#if CACHE_ENABLED
+uint16_t cacheRegisters[CACHE_CLIENTS][CACHE_REGISTERS];
+uint32_t cacheUpdateTime[CACHE_CLIENTS];
+bool cacheValid[CACHE_CLIENTS];
+uint8_t cacheMisses[CACHE_CLIENTS]; // Unanswered polls in a row, up to CACHE_MISS_LIMIT
+uint8_t pollAddress = 0; // Last polled slave address
+uint32_t absentPollTime = 0; // millis() of the last poll of an absent client
+bool pollGivenUp = false; // The last poll timed out, its answer may still come
+#endif
+
+// Report by exception (TDMA): instead of polling, the controller broadcasts a
+// superframe beacon (see ClayCastModbus.h) every TDMA_INTERVAL, which gives
+// client n the TDMA_SLOT_TIME long slot n after it (slot 0 is for the
+// clients to take the beacon in). A client answers in its
+// slot only if its registers changed, or every TDMA_HEARTBEAT superframes, and
+// the answers go into the register cache. Master requests wait in the UART
+// buffer while the slots run, like during a poll.
+#define TDMA_ENABLED 0 // Set to 1 to fill the cache from client reports, 0 to poll
+#define TDMA_SLOT_TIME 30 // Slot length: a report's airtime plus the HC12 latency (ms)
+#define TDMA_INTERVAL 1000 // Between superframe beacons (ms)
+#define TDMA_HEARTBEAT 4 // Superframes between reports of an unchanged client
+
+#if TDMA_ENABLED && !CACHE_ENABLED
+#error "TDMA_ENABLED needs the register cache (CACHE_ENABLED)"
+#endif
+
+uint32_t superframeSent = 0; // millis() of the last superframe beacon
+
+// Write-behind fire: a write (0x06) to a client's FIRE_QUEUE_REGISTER is
+// answered to the master at once with the echo the client would send, and
+// queued. The queue goes on air ahead of polls and beacons once the master
+// has been quiet for FIRE_QUEUE_HOLDOFF after the answer, so the next fire of
+// a double or triple is taken in first; a fire without an answer is sent
+// again, up to FIRE_QUEUE_ATTEMPTS times. The master follows the delivery in
+// the client's fire status register (see STATS_FIRE_BASE). A full queue
+// answers SLAVE DEVICE BUSY and the master retries.
+#define FIRE_QUEUE_ENABLED 0 // Set to 1 to answer fires locally and deliver them from a queue
+#define FIRE_QUEUE_REGISTER 1 // Client fire register (client.ino)
+#define FIRE_QUEUE_SIZE 8 // Fires waiting for the radio
+#define FIRE_QUEUE_ATTEMPTS 3 // Sends of a fire before it is given up
+#define FIRE_QUEUE_HOLDOFF 20 // Master silence after an answered fire before the queue goes on air (ms)
+
+enum FireStatus {
+  FIRE_NONE, // Nothing queued since startup
+  FIRE_QUEUED, // Waiting for the radio or the client's answer
+  FIRE_DELIVERED, // The client answered the write
+  FIRE_FAILED // No answer after FIRE_QUEUE_ATTEMPTS sends, or an exception
+};
+
+#if FIRE_QUEUE_ENABLED
+struct QueuedFire {
+  uint8_t address;
+  uint8_t attempts; // Sends so far
+  uint16_t value;
+};
+
+QueuedFire fireQueue[FIRE_QUEUE_SIZE]; // Ring buffer, oldest at fireQueueHead
+uint8_t fireQueueHead = 0;
+uint8_t fireQueueCount = 0;
+uint32_t fireQueueHold = 0; // micros() before which the queue stays off air
+#endif
+
+// Link statistics: counters of both directions, read by the master from the
+// virtual slave STATS_SLAVE_ADDRESS without the radio (register map below).
+// Counters wrap at 65535; the master works with differences between reads.
+#define STATS_SLAVE_ADDRESS (246 - 2 * RADIO_PORT) // Virtual slave answered by the controller (244, 242, ... on further radio ports)
+#define STATS_CLIENTS 10 // Per client statistics for slave addresses 1..STATS_CLIENTS
+#define STATS_CLIENT_BLOCK 2 // Registers per client: last RTT (ms), response timeouts
+#define STATS_RTT_UNKNOWN 0xFFFF // Client has never answered
 
-  uint16_t receivedChecksum = (packet[3 + size] << 8) | packet[4 + size];
-  if (checksum != receivedChecksum) return false;
+enum StatsRegister {
+  STATS_RS485_REQUESTS, // Complete master frames
+  STATS_RS485_CRC_ERRORS, // Master frames with a bad CRC (still forwarded, the client drops them)
+  STATS_RS485_OVERFLOWS, // Master frames longer than MAX_DATA_SIZE
+  STATS_RS485_SHORT_FRAMES, // Master frames below the minimum size, dropped
+  STATS_RS485_RESPONSES, // Frames written to the master
+  STATS_RADIO_SENT, // Frames sent over HC12, including polls and broadcasts
+  STATS_RADIO_RECEIVED, // Valid frames received over HC12
+  STATS_RADIO_DROPPED, // Broken frames: bad size, checksum, end byte or CRC
+  STATS_RADIO_FRAME_TIMEOUTS, // Frames that stopped mid-way (hc12_frameTime)
+  STATS_RADIO_RESPONSE_TIMEOUTS, // Requests without an answer (RADIO_RESPONSE_TIMEOUT)
+  STATS_RADIO_DISCARDED_BYTES, // Radio bytes ignored while a master request was arriving
+  STATS_LOOP_MAX_HIGH, // Slowest loop() pass in us, high word
+  STATS_LOOP_MAX_LOW,
+  STATS_UPTIME_HIGH, // Seconds since startup, high word
+  STATS_UPTIME_LOW,
+  STATS_RESET, // Write (0x06) to clear the counters, reads 0
+  STATS_CLIENT_BASE // Client n: STATS_CLIENT_BASE + (n - 1) * STATS_CLIENT_BLOCK
+};
 
-  *dataSizeOut = size;
-  return true;
+// With FIRE_QUEUE_ENABLED, client n's fire status follows the client blocks at
+// STATS_FIRE_BASE + n - 1: a FireStatus in the low byte, fires queued for it
+// (wrapping) in the high byte
+#define STATS_FIRE_BASE (STATS_CLIENT_BASE + STATS_CLIENTS * STATS_CLIENT_BLOCK)
+#define STATS_REGISTER_COUNT (STATS_FIRE_BASE + (FIRE_QUEUE_ENABLED ? STATS_CLIENTS : 0))
+
+struct LinkStats {
+  uint16_t rs485Requests;
+  uint16_t rs485CrcErrors;
+  uint16_t rs485Overflows;
+  uint16_t rs485ShortFrames;
+  uint16_t rs485Responses;
+  uint16_t radioSent;
+  uint16_t radioReceived;
+  uint16_t radioFrameTimeouts;
+  uint16_t radioResponseTimeouts;
+  uint16_t radioDiscardedBytes;
+  uint32_t loopMaxMicros;
+  uint16_t clientRtt[STATS_CLIENTS];
+  uint16_t clientTimeouts[STATS_CLIENTS];
+};
+LinkStats linkStats;
+
+#if FIRE_QUEUE_ENABLED
+uint8_t fireStatus[STATS_CLIENTS]; // FireStatus of the last fire queued for each client
+uint8_t fireCount[STATS_CLIENTS];
+#endif
+
+// Test mode (A0 high at startup): echo test against test/test.ino. Round trips
+// for each payload size, then a saturation sweep that shortens the send interval
+// until the loss exceeds TEST_SWEEP_MAX_LOSS. Results go to Serial.
+#define TEST_FRAMES 100 // Round trips per payload size
+#define TEST_PAYLOAD_SIZES {8, 16, 32, 64, 128} // Echo payload sizes (ECHO_HEADER_SIZE..MAX_DATA_SIZE)
+#define TEST_ECHO_TIMEOUT 1000 // Later replies count as lost (ms)
+#define TEST_PING_GAP 20 // Pause between round trips (ms)
+#define TEST_SWEEP_PAYLOAD 32 // Payload size of the saturation sweep
+#define TEST_SWEEP_FRAMES 50 // Frames sent at each interval
+#define TEST_SWEEP_START_INTERVAL 500 // First send interval (ms)
+#define TEST_SWEEP_STEP_PERCENT 80 // Each interval is this percentage of the previous one
+#define TEST_SWEEP_MAX_LOSS 2 // Highest loss of a sustainable rate (%)
+
+// RTTs are counted in a histogram instead of being stored: 0.1 ms bins up to
+// 0.8 ms, then 8 bins per doubling (12.5 % wide), which covers RTTs up to
+// 1638 ms in 96 bytes
+#define RTT_BIN_SHIFT 3 // 1 << RTT_BIN_SHIFT bins per doubling
+#define RTT_BINS 96
+
+#if TEST_SWEEP_FRAMES > TEST_FRAMES
+#error "TEST_SWEEP_FRAMES must not exceed TEST_FRAMES"
+#endif
+#if TEST_FRAMES > 255
+#error "TEST_FRAMES must fit the 8 bit RTT bin counts"
+#endif
+#if TEST_ECHO_TIMEOUT > 1638
+#error "TEST_ECHO_TIMEOUT must fit the RTT histogram"
+#endif
+
+struct EchoStats {
+  uint16_t sent;
+  uint16_t received;
+  uint16_t corrupted; // Reply with damaged fill bytes
+  uint16_t late; // Reply after TEST_ECHO_TIMEOUT
+  uint16_t rttMin; // RTTs of the received replies in 0.1 ms
+  uint16_t rttMax;
+  uint32_t rttSum;
+};
+
+bool testMode = false;
+const uint16_t testPayloadSizes[] = TEST_PAYLOAD_SIZES;
+uint16_t testSequence = 0; // Next echo sequence number
+uint16_t testFirstSequence = 0; // First sequence number of the running step
+EchoStats testStats;
+uint8_t testAnswered[(TEST_FRAMES + 7) / 8]; // Bit n: request testFirstSequence + n answered
+uint8_t rttBins[RTT_BINS]; // RTT histogram of the running step (see rttBin)
+
+// Take the RS485 bus. Any pending release from a previous frame is cancelled.
+void rs485BeginTransmit() {
+  UCSR0B &= ~_BV(TXCIE0);
+  digitalWrite(RS485_DE, HIGH); // Set to transmit mode
 }
 
-void setHC12Channel(uint8_t channel) {
-  if (channel < 1 || channel > 100) return; // Out of range
+// Release the RS485 bus once everything written to Serial has left the line.
+// Returns immediately; the USART TX complete interrupt drops DE.
+void rs485EndTransmit() {
+  UCSR0B |= _BV(TXCIE0);
+}
 
-  char cmd[10];
-  sprintf(cmd, "AT+C%03d", channel); // Format: AT+C005, AT+C100, etc.
-  if (DEBUG) {
-    digitalWrite(RS485_DE, HIGH); // Set to transmit mode
-    Serial.print("Setting HC12 to channel: ");
-    Serial.println(cmd);
-    digitalWrite(RS485_DE, LOW); // Set to receive mode
-  }
+void rs485Write(const uint8_t * data, uint16_t size) {
+  linkStats.rs485Responses++;
+  rs485BeginTransmit();
+  Serial.write(data, size);
+  rs485EndTransmit();
+}
 
-  digitalWrite(hc12SetPin, LOW); // Enter AT command mode
-  delay(50);
+// Shift register empty and no byte waiting in UDR
+ISR(USART_TX_vect) {
+  // A late UDRE interrupt (SoftwareSerial blocks interrupts for a whole byte)
+  // can leave the line idle mid-frame; wait while Serial still has data queued.
+  if (UCSR0B & _BV(UDRIE0)) return;
 
-  hc12.print(cmd);
-  delay(100); // Give HC12 time to process
+  UCSR0B &= ~_BV(TXCIE0);
+  digitalWrite(RS485_DE, LOW); // Set back to receive mode
+}
 
-  // Optional: Wait for OK response
-  while (hc12.available()) {
-    char c = hc12.read();
-    // Optionally print to Serial for debug
-    if (DEBUG) {
-      Serial.print(c);
+// Bring the module to the network defaults. It keeps its baud across resets,
+// so a controller restarted after a rate change finds it first.
+void configureHC12() {
+  uint32_t foundBaud = hc12Link.detect();
+  bool ok = foundBaud != 0 &&
+    hc12Link.setBaud(HC12_DEFAULT_BAUD) &&
+    hc12Link.setTransmitMode(HC12_TRANSMIT_MODE) &&
+    hc12Link.setChannel(hc12Channel);
+
+  if (DEBUG) {
+    rs485BeginTransmit();
+    Serial.print(F("HC12 found at "));
+    Serial.print(foundBaud);
+    Serial.print(F(" baud, configured: "));
+    if (ok) {
+      Serial.println(F("OK"));
+    } else {
+      Serial.println(hc12Link.lastReply());
     }
+    rs485EndTransmit();
   }
-
-  digitalWrite(hc12SetPin, HIGH); // Back to transparent mode
-  delay(50);
 }
 
 void setup() {
   pinMode(RS485_DE, OUTPUT); // RS485 DE pin
   digitalWrite(RS485_DE, LOW); // Set to receive mode
-  pinMode(hc12SetPin, OUTPUT);
-  digitalWrite(hc12SetPin, HIGH); // Default mode
 
   pinMode(A0, INPUT); // Enable A0 as input to check test trigger
   pinMode(A1, OUTPUT); // Enable A0 as input to check test trigger
@@ -117,108 +372,1105 @@ void setup() {
   testMode = (digitalRead(A0) == HIGH); // Activate test mode if A0 is HIGH at startup
 
   Serial.begin(BAUD_RATE); // Modbus RTU side
-  hc12.begin(BAUD_RATE); // HC12 communication
+  hc12Link.begin(HC12_DEFAULT_BAUD); // HC12 communication
 
   // Debug output
   if (DEBUG || testMode) {
-    digitalWrite(RS485_DE, HIGH); // Set to transmit mode
-    Serial.println("ClayCast Modbus RTU Controller");
-    Serial.println("HC-12 and Modbus RTU setup complete.");
-    digitalWrite(RS485_DE, LOW); // Set back to receive mode
-    delay(5);
+    rs485BeginTransmit();
+    Serial.println(F("ClayCast Modbus RTU Controller"));
+    Serial.println(F("HC-12 and Modbus RTU setup complete."));
+    rs485EndTransmit();
   }
 
   if (testMode) {
-    digitalWrite(RS485_DE, HIGH);
-    Serial.println("Test mode activated. Sending test data every 500ms.");
-    digitalWrite(RS485_DE, LOW);
+    rs485BeginTransmit();
+    Serial.println(F("Test mode activated. Echo test against test.ino, one line per step."));
+    rs485EndTransmit();
   }
 
-  setHC12Channel(hc12Channel); // Set channel before any data is sent
+  clearLinkStats();
+  #if CACHE_ENABLED && !TDMA_ENABLED
+  memset(cacheMisses, CACHE_MISS_LIMIT, sizeof(cacheMisses)); // Absent until first heard
+  #endif
+  configureHC12(); // Set channel and rate before any data is sent
+  if (!testMode) negotiateLinkRate();
 }
 
 void loop() {
 
   if (testMode) {
-    uint32_t now = millis();
-    if (now - lastTestSendTime >= 500) {
-      lastTestSendTime = now;
-
-      // Create test message
-      char message[50];
-      sprintf(message, "Testing in progress: %u", testCounter++);
-
-      // Wrap and send
-      uint16_t wrappedLen = wrapModbusRTU((uint8_t *)message, strlen(message), packetBuffer);
-      if (wrappedLen > 0) {
-        hc12.write(packetBuffer, wrappedLen);
-        hc12.flush();
-      }
-    }
+    runEchoTest();
     return; // Skip normal loop logic in test mode
   }
 
-  // Receive and buffer data from Serial
-  while (Serial.available()) {
+  uint32_t loopStart = micros();
+
+  // Receive and buffer data from Serial. While a cache poll or a queued fire
+  // is in flight the request waits in the UART buffer, so it cannot collide
+  // with the answer.
+  while (radioState != RADIO_POLLING && radioState != RADIO_SUPERFRAME && radioState != RADIO_QUEUED &&
+    Serial.available() && !serial_frameReady) {
     uint8_t byteIn = Serial.read();
-    serial_lastByteTime = millis();
+    serial_lastByteMicros = micros();
 
     if (!serial_receiving) {
       serial_receiving = true;
+      hc12Parser.reset(); // Master request takes over the buffer
       serial_recvIndex = 0;
-      serial_buffer[serial_recvIndex++] = byteIn;
-    } else if (serial_receiving) {
-      if (serial_recvIndex < sizeof(serial_buffer)) {
-        serial_buffer[serial_recvIndex++] = byteIn;
+      framePayload(frameBuffer)[serial_recvIndex++] = byteIn;
+    } else {
+      if (serial_recvIndex < MAX_DATA_SIZE) {
+        framePayload(frameBuffer)[serial_recvIndex++] = byteIn;
       } else {
         serial_receiving = false; // Overflow
+        linkStats.rs485Overflows++;
       }
     }
+
+    // Complete as soon as the length implied by the function code has arrived
+    // with a valid CRC; anything else waits for the inter-frame gap. Traffic
+    // of another board (its requests and answers) ends at its first valid
+    // CRC: the gap is lost while it waits in the UART buffer during a poll.
+    uint8_t * request = framePayload(frameBuffer);
+    if (serial_receiving && !servesAddress(request[0])) {
+      serial_frameReady = serial_recvIndex >= 4 && modbusCheckCRC(request, serial_recvIndex);
+    } else if (serial_receiving && modbusRequestLength(request, serial_recvIndex) == serial_recvIndex) {
+      serial_frameReady = modbusCheckCRC(request, serial_recvIndex);
+    }
   }
 
-  // Receive and buffer data from HC12
+  // Receive data from HC12; a frame is complete as soon as its end byte arrives
+  bool hc12_frameReady = false;
   while (hc12.available()) {
     uint8_t byteIn = hc12.read();
     hc12_lastByteTime = millis();
 
-    if (!hc12_receiving && byteIn == START_BYTE) {
-      hc12_receiving = true;
-      hc12_recvIndex = 0;
-      hc12_buffer[hc12_recvIndex++] = byteIn;
-    } else if (hc12_receiving) {
-      if (hc12_recvIndex < sizeof(hc12_buffer)) {
-        hc12_buffer[hc12_recvIndex++] = byteIn;
-        if (byteIn == END_BYTE) break; // Possible end of packet
-      } else {
-        hc12_receiving = false; // Overflow
-      }
+    if (serial_receiving) { // Buffer is busy with a master request
+      linkStats.radioDiscardedBytes++;
+      continue;
+    }
+
+    if (hc12Parser.feed(byteIn)) {
+      hc12_frameReady = true;
+      break; // Leave following bytes for the next pass
     }
   }
 
-  // Timeout: process if no new byte on Serial
-  if (serial_receiving && (millis() - serial_lastByteTime > serial_frameTime)) {
+  // Frame end: known length reached, or t3.5 of silence on Serial
+  if (serial_receiving && (serial_frameReady || micros() - serial_lastByteMicros > serial_frameMicros)) {
     serial_receiving = false;
-    if (serial_recvIndex < 6) return; // Minimum packet size
+    serial_frameReady = false;
+    if (serial_recvIndex >= 6) { // Minimum packet size
+      handleMasterRequest(framePayload(frameBuffer), serial_recvIndex);
+    } else if (servesAddress(framePayload(frameBuffer)[0])) {
+      linkStats.rs485ShortFrames++;
+    }
+  }
+
+  // Timeout: fallback for a broken HC12 frame that never completes
+  if (!hc12_frameReady && hc12Parser.receiving() && (millis() - hc12_lastByteTime > hc12_frameTime)) {
+    hc12_frameReady = hc12Parser.expire();
+    linkStats.radioFrameTimeouts++;
+  }
+
+  if (hc12_frameReady) {
+    handleRadioFrame(hc12Parser.payload());
+  }
+
+  // End of the last slot, with one slot to spare for the HC12 latency
+  if (radioState == RADIO_SUPERFRAME && millis() - radioSentTime > (CACHE_CLIENTS + 2) * TDMA_SLOT_TIME) {
+    setRadioIdle();
+  }
+
+  #if ARQ_ENABLED
+  if ((radioState == RADIO_FORWARDED || radioState == RADIO_QUEUED) && arqRetries > 0 && millis() - radioSentTime > radioAnswerWait && !hc12Parser.receiving()) {
+    retransmitRequest();
+  }
+  #endif
+
+  // No answer from the client. A poll given up early for the master says
+  // nothing about the link.
+  uint16_t responseTimeout = radioResponseTimeout();
+  if (radioState != RADIO_IDLE && radioState != RADIO_SUPERFRAME && millis() - radioSentTime > responseTimeout) {
+    countResponseTimeout();
+    #if CACHE_ENABLED && !TDMA_ENABLED
+    if (radioState == RADIO_POLLING) pollTimeout();
+    #endif
+    #if FIRE_QUEUE_ENABLED
+    if (radioState == RADIO_QUEUED) fireQueueTimeout();
+    #endif
+    setRadioIdle();
+    if (responseTimeout == RADIO_RESPONSE_TIMEOUT) countLinkFailure();
+  }
+
+  #if FIRE_QUEUE_ENABLED
+  sendQueuedFire();
+  #endif
+
+  #if TIME_SYNC_ENABLED
+  sendTimeSync();
+  #endif
+
+  #if TDMA_ENABLED
+  startSuperframe();
+  #elif CACHE_ENABLED
+  pollClients();
+  #endif
+
+  keepLinkRate();
+
+  uint32_t loopTime = micros() - loopStart;
+  if (loopTime > linkStats.loopMaxMicros) linkStats.loopMaxMicros = loopTime;
+}
+
+// Wrap the payload in frameBuffer, send it over HC12 and note what answer is expected
+void radioSend(uint16_t payloadSize, uint8_t nextState) {
+  // Read before wrapping, which moves the payload in the FEC format
+  uint8_t target = framePayload(frameBuffer)[0];
+  uint16_t answerWait = radioAnswerTime(framePayload(frameBuffer), radioFrameSize(payloadSize));
+
+  #if ARQ_ENABLED || FEC_ENABLED
+  radioSequence++;
+  uint16_t wrappedLen = FEC_ENABLED ? wrapFecFrame(frameBuffer, payloadSize, radioSequence) : 0;
+  if (wrappedLen == 0) wrappedLen = wrapSequencedFrame(frameBuffer, payloadSize, radioSequence);
+  uint8_t * wrapped = frameBuffer;
+  #else
+  uint16_t wrappedLen = wrapFrame(frameBuffer, payloadSize, COMPACT_FRAMING);
+  uint8_t * wrapped = frameStart(frameBuffer, COMPACT_FRAMING);
+  #endif
+  if (wrappedLen == 0) return;
+
+  hc12.write(wrapped, wrappedLen);
+  linkStats.radioSent++;
+  #if CACHE_ENABLED && !TDMA_ENABLED
+  pollGivenUp = false;
+  #endif
+  radioTarget = target;
+  radioAnswerWait = answerWait;
+  radioSentTime = millis();
+  if (nextState == RADIO_IDLE) {
+    setRadioIdle();
+  } else {
+    radioState = nextState;
+  }
+
+  #if ARQ_ENABLED
+  // Keep a master request or queued fire for its retransmits
+  arqRetries = 0;
+  if ((nextState == RADIO_FORWARDED || nextState == RADIO_QUEUED) && wrappedLen <= ARQ_MAX_FRAME) {
+    memcpy(arqFrame, wrapped, wrappedLen);
+    arqFrameSize = wrappedLen;
+    arqRetries = ARQ_RETRIES;
+  }
+  #endif
+}
+
+// Length on air of a payload in the radio frame format
+uint16_t radioFrameSize(uint16_t payloadSize) {
+  if (FEC_ENABLED && payloadSize <= FEC_MAX_DATA_SIZE) return fecFrameSize(payloadSize);
+  if (ARQ_ENABLED || FEC_ENABLED) return payloadSize + FRAME_HEADER_SIZE;
+  return payloadSize + (COMPACT_FRAMING ? FRAME_HEADER_SIZE - COMPACT_FRAME_OFFSET : FRAME_OVERHEAD);
+}
+
+// Time a request can take to be answered (ms): airtime of the request and of
+// its longest answer, plus ARQ_TURNAROUND
+uint16_t radioAnswerTime(const uint8_t * request, uint16_t wrappedLen) {
+  uint16_t answerSize = 8; // Write echo, exception
+  // The read quantity of a 0x17 is where a read request has it
+  if (request[1] == MODBUS_FUNCTION_READ_HOLDING_REGISTERS || request[1] == MODBUS_FUNCTION_READ_INPUT_REGISTERS ||
+    request[1] == MODBUS_FUNCTION_READ_WRITE_MULTIPLE_REGISTERS) {
+    answerSize = 5 + 2 * ((request[4] << 8) | request[5]);
+  }
+  uint32_t airMicros = (wrappedLen + radioFrameSize(answerSize)) * (10000000UL / hc12Link.baud());
+  return airMicros / 1000 + ARQ_TURNAROUND;
+}
+
+// Time after which the outstanding request counts as unanswered (ms). A poll
+// is not worth holding up a master request waiting in the UART buffer for.
+uint16_t radioResponseTimeout() {
+  #if CACHE_ENABLED && !TDMA_ENABLED
+  if (radioState == RADIO_POLLING && Serial.available()) {
+    if (cacheMisses[pollAddress - 1] >= CACHE_MISS_LIMIT) return 0;
+    return radioAnswerWait;
+  }
+  #endif
+  return RADIO_RESPONSE_TIMEOUT;
+}
+
+#if ARQ_ENABLED
+// No answer yet: the kept request again, under the same number
+void retransmitRequest() {
+  arqRetries--;
+  hc12.write(arqFrame, arqFrameSize);
+  linkStats.radioSent++;
+  radioSentTime = millis();
+}
+#endif
+
+void setRadioIdle() {
+  radioState = RADIO_IDLE;
+  radioIdleSince = millis();
+}
+
+// Slave addresses this board answers or forwards: its virtual slaves,
+// broadcasts and the clients routed to its radio port
+bool servesAddress(uint8_t address) {
+  if (address == STATS_SLAVE_ADDRESS || address == CACHE_SLAVE_ADDRESS || address == MODBUS_BROADCAST_ADDRESS) return true;
+  if (address >= 248 - 2 * RADIO_PORTS && address <= 247) return false; // Virtual slave of another board
+  return radioPort(address) == RADIO_PORT;
+}
+
+// A complete request from the Modbus master (payload area of frameBuffer)
+void handleMasterRequest(uint8_t * request, uint16_t length) {
+  if (!servesAddress(request[0])) return; // For another board, or its answer heard on the bus
+  linkStats.rs485Requests++;
+  bool crcValid = modbusCheckCRC(request, length);
+  if (!crcValid) linkStats.rs485CrcErrors++;
+
+  if (request[0] == STATS_SLAVE_ADDRESS) {
+    if (!crcValid) return; // Corrupted, the master retries
+    rs485Write(request, processStatsRequest(request, length)); // Answered locally
+    return;
+  }
+
+  #if CACHE_ENABLED
+  if (request[0] == CACHE_SLAVE_ADDRESS) {
+    if (!crcValid) return; // Corrupted, the master retries
+    rs485Write(request, processCacheRequest(request, length)); // Answered locally
+    return;
+  }
+  #endif
+
+  #if FIRE_QUEUE_ENABLED
+  if (crcValid && isQueuedFire(request, length)) {
+    queueFire(request, length);
+    return;
+  }
+  #endif
+
+  #if TIME_SYNC_ENABLED
+  if (crcValid && isGroupFire(request, length)) {
+    fireAtTime = radioSendStamped(scheduleGroupFire(request), 7, FIRE_AT_LEAD * 1000UL);
+    fireAtPending = true;
+    return;
+  }
+  #endif
+
+  // Broadcasts are never answered
+  radioSend(length, request[0] == MODBUS_BROADCAST_ADDRESS ? RADIO_IDLE : RADIO_FORWARDED);
+}
+
+// Send a broadcast with a controller time in the 4 bytes at timeOffset: the
+// micros() at which the frame's last byte will have left for the HC12, plus
+// lead (us). size: payload without the CRC, which is appended here.
+// Returns the time sent.
+uint32_t radioSendStamped(uint16_t size, uint16_t timeOffset, uint32_t lead) {
+  uint8_t * request = framePayload(frameBuffer);
+  uint16_t frameSize = radioFrameSize(size + 2);
+  uint32_t time = micros() + frameSize * (10000000UL / hc12Link.baud()) + lead;
+
+  request[timeOffset] = time >> 24;
+  request[timeOffset + 1] = (time >> 16) & 0xFF;
+  request[timeOffset + 2] = (time >> 8) & 0xFF;
+  request[timeOffset + 3] = time & 0xFF;
+  modbusAppendCRC(request, size);
+  radioSend(size + 2, RADIO_IDLE);
+  return time;
+}
+
+#if TIME_SYNC_ENABLED
+// A group fire broadcast (0x06 / 0x10 from GROUP_FIRE_REGISTER)
+bool isGroupFire(const uint8_t * request, uint16_t length) {
+  if (request[0] != MODBUS_BROADCAST_ADDRESS || ((request[2] << 8) | request[3]) != GROUP_FIRE_REGISTER) return false;
+  if (request[1] == MODBUS_FUNCTION_WRITE_SINGLE_REGISTER) return length == 8;
+  uint16_t quantity = (request[4] << 8) | request[5];
+  return request[1] == MODBUS_FUNCTION_WRITE_MULTIPLE_REGISTERS && quantity > 0 && quantity <= GROUP_FIRE_REGISTER_COUNT &&
+    request[6] == quantity * 2 && length == 9 + request[6];
+}
+
+// Turn a group fire into a scheduled fire of the same machines, in place.
+// Returns its size without the CRC; the time is filled in when it is sent.
+uint16_t scheduleGroupFire(uint8_t * request) {
+  uint16_t masks = 1;
+  if (request[1] == MODBUS_FUNCTION_WRITE_SINGLE_REGISTER) {
+    memmove(request + 11, request + 4, 2);
+  } else {
+    masks = (request[4] << 8) | request[5];
+    memmove(request + 11, request + 7, 2 * masks);
+  }
+
+  request[1] = MODBUS_FUNCTION_WRITE_MULTIPLE_REGISTERS;
+  request[2] = FIRE_AT_REGISTER >> 8;
+  request[3] = FIRE_AT_REGISTER & 0xFF;
+  request[4] = 0; // Quantity: time + masks
+  request[5] = masks + 2;
+  request[6] = (masks + 2) * 2;
+  return 11 + 2 * masks;
+}
+
+// Broadcast the controller's clock while the radio and the master are idle
+void sendTimeSync() {
+  if (radioState != RADIO_IDLE || serial_receiving || hc12Parser.receiving() || fireAtWaiting() || fireQueueWaiting()) return;
+  if (!timeSyncDue() || millis() - radioIdleSince < TIME_SYNC_QUIET) return;
+  timeSyncSent = millis();
+
+  uint8_t * request = framePayload(frameBuffer);
+  request[0] = MODBUS_BROADCAST_ADDRESS;
+  request[1] = MODBUS_FUNCTION_WRITE_MULTIPLE_REGISTERS;
+  request[2] = TIME_SYNC_REGISTER >> 8;
+  request[3] = TIME_SYNC_REGISTER & 0xFF;
+  request[4] = 0; // Quantity
+  request[5] = 2;
+  request[6] = 4; // Byte count
+  radioSendStamped(11, 7, 0);
+}
+#endif
+
+// A scheduled fire is still to come (or less than FIRE_AT_QUIET ago); the
+// radio is kept quiet until then
+bool fireAtWaiting() {
+  if (fireAtPending && (int32_t)(micros() - fireAtTime) >= FIRE_AT_QUIET * 1000L) fireAtPending = false;
+  return fireAtPending;
+}
+
+bool timeSyncDue() {
+  #if TIME_SYNC_ENABLED
+  return millis() - timeSyncSent >= TIME_SYNC_INTERVAL;
+  #else
+  return false;
+  #endif
+}
+
+// A fire is waiting in the fire queue
+bool fireQueueWaiting() {
+  #if FIRE_QUEUE_ENABLED
+  return fireQueueCount > 0;
+  #else
+  return false;
+  #endif
+}
+
+// Nothing but master requests may go out: a scheduled fire, a queued fire or
+// a beacon is waiting
+bool radioReserved() {
+  return fireAtWaiting() || fireQueueWaiting() || timeSyncDue();
+}
+
+#if FIRE_QUEUE_ENABLED
+// A write to a client's fire register, answered and delivered by the queue
+bool isQueuedFire(const uint8_t * request, uint16_t length) {
+  return request[0] != MODBUS_BROADCAST_ADDRESS && length == 8 && request[1] == MODBUS_FUNCTION_WRITE_SINGLE_REGISTER &&
+    ((request[2] << 8) | request[3]) == FIRE_QUEUE_REGISTER;
+}
+
+// Answer the fire to the master and queue it, or answer busy if the queue is full
+void queueFire(uint8_t * request, uint16_t length) {
+  if (fireQueueCount == FIRE_QUEUE_SIZE) {
+    rs485Write(request, modbusExceptionResponse(request, MODBUS_EXCEPTION_SLAVE_DEVICE_BUSY));
+    return;
+  }
+
+  QueuedFire & fire = fireQueue[(fireQueueHead + fireQueueCount++) % FIRE_QUEUE_SIZE];
+  fire.address = request[0];
+  fire.attempts = 0;
+  fire.value = (request[4] << 8) | request[5];
+  setFireStatus(fire.address, FIRE_QUEUED);
+  if (fire.address <= STATS_CLIENTS) fireCount[fire.address - 1]++;
+
+  rs485Write(request, length); // The echo the client would send
+  fireQueueHold = micros() + length * modbusCharMicros(BAUD_RATE) + FIRE_QUEUE_HOLDOFF * 1000UL;
+}
+
+// Send the oldest queued fire while the radio is idle and the master quiet
+void sendQueuedFire() {
+  if (fireQueueCount == 0 || radioState != RADIO_IDLE || serial_receiving || hc12Parser.receiving() || fireAtWaiting()) return;
+  if ((int32_t)(micros() - fireQueueHold) < 0) return;
+
+  QueuedFire & fire = fireQueue[fireQueueHead];
+  fire.attempts++;
+
+  uint8_t * request = framePayload(frameBuffer);
+  request[0] = fire.address;
+  request[1] = MODBUS_FUNCTION_WRITE_SINGLE_REGISTER;
+  request[2] = FIRE_QUEUE_REGISTER >> 8;
+  request[3] = FIRE_QUEUE_REGISTER & 0xFF;
+  request[4] = fire.value >> 8;
+  request[5] = fire.value & 0xFF;
+  modbusAppendCRC(request, 6);
+
+  radioSend(8, RADIO_QUEUED);
+}
+
+// The client answered the oldest queued fire: its echo, or an exception
+void fireQueueAnswered(FramePayload payload) {
+  bool echo = payload.size == 8 && payload.data[1] == MODBUS_FUNCTION_WRITE_SINGLE_REGISTER &&
+    modbusCheckCRC(payload.data, payload.size);
+  setFireStatus(fireQueue[fireQueueHead].address, echo ? FIRE_DELIVERED : FIRE_FAILED);
+  popQueuedFire();
+}
+
+// The oldest queued fire got no answer; it is sent again unless out of attempts
+void fireQueueTimeout() {
+  if (fireQueue[fireQueueHead].attempts < FIRE_QUEUE_ATTEMPTS) return;
+  setFireStatus(fireQueue[fireQueueHead].address, FIRE_FAILED);
+  popQueuedFire();
+}
+
+void popQueuedFire() {
+  fireQueueHead = (fireQueueHead + 1) % FIRE_QUEUE_SIZE;
+  fireQueueCount--;
+}
+
+void setFireStatus(uint8_t address, uint8_t status) {
+  if (address >= 1 && address <= STATS_CLIENTS) fireStatus[address - 1] = status;
+}
+#endif
+
+// A complete and valid frame from HC12
+void handleRadioFrame(FramePayload payload) {
+  linkFailures = 0; // The link works at the current rate
+  linkStats.radioReceived++;
+
+  #if ARQ_ENABLED
+  // Nothing outstanding, or the number of another request: the answer to a
+  // request already answered or given up on (reports carry no number)
+  if (radioState != RADIO_SUPERFRAME &&
+    (radioState == RADIO_IDLE || !hc12Parser.sequenced() || hc12Parser.sequence() != radioSequence)) {
+    return;
+  }
+  #endif
+
+  if (radioState != RADIO_IDLE && payload.data[0] == radioTarget) recordClientRtt(radioTarget, millis() - radioSentTime);
+
+  #if CACHE_ENABLED && !TDMA_ENABLED
+  // A poll answer after its timeout still goes into the cache, not to the master
+  if (radioState == RADIO_IDLE && pollGivenUp) {
+    storeClientRegisters(payload, pollAddress);
+    pollGivenUp = false;
+    return;
+  }
+  #endif
+
+  // Only the addressed client answers a master request; anything else is a
+  // late answer to an earlier request
+  if (radioState == RADIO_FORWARDED && payload.data[0] != radioTarget) return;
+
+  #if FIRE_QUEUE_ENABLED
+  // The master already has its answer; only the fire status needs it
+  if (radioState == RADIO_QUEUED) {
+    if (payload.data[0] != radioTarget) return; // Stale, keep waiting
+    fireQueueAnswered(payload);
+    setRadioIdle();
+    return;
+  }
+  #endif
+
+  #if CACHE_ENABLED
+  // Anything other than the poll answer is stale; the master is not waiting for it
+  if (radioState == RADIO_POLLING) {
+    storeClientRegisters(payload, pollAddress);
+    setRadioIdle();
+    return;
+  }
+  // Reports keep coming until the last slot is over
+  if (radioState == RADIO_SUPERFRAME) {
+    storeClientRegisters(payload, payload.data[0]);
+    return;
+  }
+  #endif
+
+  setRadioIdle();
+  rs485Write(payload.data, payload.size); // Returns before the line is released
+}
+
+// Broadcast a link rate change to the clients (no answer)
+void sendLinkRate(uint32_t baud) {
+  uint8_t * request = framePayload(frameBuffer);
+  uint16_t value = baud / 100;
+  request[0] = MODBUS_BROADCAST_ADDRESS;
+  request[1] = MODBUS_FUNCTION_WRITE_SINGLE_REGISTER;
+  request[2] = LINK_RATE_REGISTER >> 8;
+  request[3] = LINK_RATE_REGISTER & 0xFF;
+  request[4] = value >> 8;
+  request[5] = value & 0xFF;
+  modbusAppendCRC(request, 6);
+
+  radioSend(8, RADIO_IDLE);
+}
+
+// Move the clients to a new rate, then follow with the own module.
+// Blocks for the AT exchange; a master request meanwhile waits in the UART buffer.
+bool switchLinkRate(uint32_t baud) {
+  for (uint8_t i = 0; i < LINK_SWITCH_REPEATS; i++) {
+    sendLinkRate(baud);
+    delay(LINK_SWITCH_GAP); // Let the module finish sending before the next one
+  }
+
+  bool ok = hc12Link.setBaud(baud);
+  hc12Parser.reset();
+  linkFailures = 0;
+
+  if (DEBUG) {
+    rs485BeginTransmit();
+    Serial.print(F("HC12 link rate "));
+    Serial.print(baud);
+    Serial.println(ok ? F(" set") : F(" refused"));
+    rs485EndTransmit();
+  }
+  return ok;
+}
+
+// Blocking read of a client's first register, used while negotiating only
+bool probeClient(uint8_t address) {
+  uint8_t * request = framePayload(frameBuffer);
+  request[0] = address;
+  request[1] = MODBUS_FUNCTION_READ_HOLDING_REGISTERS;
+  request[2] = 0; // Start address
+  request[3] = 0;
+  request[4] = 0; // Quantity
+  request[5] = 1;
+  modbusAppendCRC(request, 6);
+
+  hc12Parser.reset();
+  radioSend(8, RADIO_FORWARDED);
+  while (millis() - radioSentTime <= RADIO_RESPONSE_TIMEOUT) {
+    if (!hc12.available() || !hc12Parser.feed(hc12.read())) continue;
 
-    uint16_t wrappedLen = wrapModbusRTU(serial_buffer, serial_recvIndex, packetBuffer);
-    if (wrappedLen > 0) {
-      hc12.write(packetBuffer, wrappedLen);
-      hc12.flush(); // Ensure all data is sent
+    FramePayload payload = hc12Parser.payload();
+    if (payload.data[0] == address && payload.data[1] == MODBUS_FUNCTION_READ_HOLDING_REGISTERS &&
+      modbusCheckCRC(payload.data, payload.size)) {
+      setRadioIdle();
+      return true;
     }
   }
+  setRadioIdle();
+  return false;
+}
+
+// Bitmask of the clients answering at the current rate
+uint16_t probeClients() {
+  uint16_t answered = 0;
+  for (uint8_t address = 1; address <= LINK_PROBE_CLIENTS; address++) {
+    if (radioPort(address) != RADIO_PORT) continue; // On another board's channel
+    if (probeClient(address)) answered |= 1u << (address - 1);
+  }
+  return answered;
+}
+
+// Move the network to HC12_LINK_BAUD at startup. The faster rate is kept only
+// if every client that answered at the default rate answers at it too.
+void negotiateLinkRate() {
+  if (HC12_LINK_BAUD == HC12_DEFAULT_BAUD || !hc12UsableBaud(HC12_LINK_BAUD)) return;
 
-  // Timeout: process if no new byte on HC12
-  if (hc12_receiving && (millis() - hc12_lastByteTime > hc12_frameTime)) {
-    hc12_receiving = false;
+  linkClients = probeClients();
+  if (linkClients == 0) {
+    // Clients may still be at the faster rate from before a controller reset
+    if (hc12Link.setBaud(HC12_LINK_BAUD)) linkClients = probeClients();
+    if (linkClients == 0) hc12Link.setBaud(HC12_DEFAULT_BAUD);
+    return;
+  }
+
+  if (!switchLinkRate(HC12_LINK_BAUD)) {
+    delay(LINK_SILENCE_TIMEOUT); // Clients that switched fall back on their own
+    return;
+  }
+  delay(LINK_SWITCH_SETTLE);
 
-    uint16_t unwrappedLen = 0;
-    if (unwrapModbusRTU(hc12_buffer, hc12_recvIndex, packetBuffer, & unwrappedLen)) {
-      digitalWrite(RS485_DE, HIGH); // Set to transmit mode
-      delay(5); // Allow time for RS485 to switch
-      Serial.write(packetBuffer, unwrappedLen);
-      Serial.flush();
-      delay(5); // Allow time for RS485 to switch back
-      digitalWrite(RS485_DE, LOW); // Set back to receive mode
+  if ((probeClients() & linkClients) != linkClients) {
+    switchLinkRate(HC12_DEFAULT_BAUD);
+  }
+}
+
+// A probed client did not answer; fall back once the link looks broken
+void countLinkFailure() {
+  if (radioTarget == MODBUS_BROADCAST_ADDRESS || radioTarget > LINK_PROBE_CLIENTS) return;
+  if (!(linkClients & (1u << (radioTarget - 1)))) return; // Never answered, not a link problem
+
+  if (++linkFailures >= LINK_FAIL_LIMIT && hc12Link.baud() != HC12_DEFAULT_BAUD) {
+    switchLinkRate(HC12_DEFAULT_BAUD);
+  }
+}
+
+// Repeat the current rate on an idle radio, so the clients know the
+// controller is still there and do not fall back
+void keepLinkRate() {
+  if (hc12Link.baud() == HC12_DEFAULT_BAUD) return;
+  if (radioState != RADIO_IDLE || serial_receiving || hc12Parser.receiving() || radioReserved()) return;
+  if (millis() - radioSentTime < LINK_KEEPALIVE_INTERVAL) return;
+
+  sendLinkRate(hc12Link.baud());
+}
+
+#if CACHE_ENABLED
+#if TDMA_ENABLED
+// Broadcast a superframe beacon while the radio and the master are idle
+void startSuperframe() {
+  if (radioState != RADIO_IDLE || serial_receiving || hc12Parser.receiving() || radioReserved()) return;
+  if (millis() - superframeSent < TDMA_INTERVAL) return;
+  superframeSent = millis();
+
+  uint8_t * request = framePayload(frameBuffer);
+  uint16_t values[SUPERFRAME_REGISTER_COUNT];
+  values[SUPERFRAME_SLOT_TIME] = TDMA_SLOT_TIME;
+  values[SUPERFRAME_SLOTS] = CACHE_CLIENTS;
+  values[SUPERFRAME_HEARTBEAT] = TDMA_HEARTBEAT;
+  values[SUPERFRAME_REPORT_REGISTERS] = CACHE_REGISTERS;
+
+  request[0] = MODBUS_BROADCAST_ADDRESS;
+  request[1] = MODBUS_FUNCTION_WRITE_MULTIPLE_REGISTERS;
+  request[2] = SUPERFRAME_REGISTER >> 8;
+  request[3] = SUPERFRAME_REGISTER & 0xFF;
+  request[4] = 0; // Quantity
+  request[5] = SUPERFRAME_REGISTER_COUNT;
+  request[6] = SUPERFRAME_REGISTER_COUNT * 2; // Byte count
+  for (uint8_t i = 0; i < SUPERFRAME_REGISTER_COUNT; i++) {
+    request[7 + 2 * i] = values[i] >> 8;
+    request[8 + 2 * i] = values[i] & 0xFF;
+  }
+  modbusAppendCRC(request, 7 + SUPERFRAME_REGISTER_COUNT * 2);
+
+  radioSend(9 + SUPERFRAME_REGISTER_COUNT * 2, RADIO_SUPERFRAME);
+}
+#else
+// Poll the next client while the radio and the master are idle
+void pollClients() {
+  if (radioState != RADIO_IDLE || serial_receiving || hc12Parser.receiving() || radioReserved()) return;
+  if (millis() - radioIdleSince < CACHE_POLL_INTERVAL) return;
+
+  // Next client on this board's radio port, absent ones only when their turn is due
+  bool absentDue = millis() - absentPollTime >= CACHE_ABSENT_INTERVAL;
+  uint8_t address = pollAddress;
+  bool found = false;
+  for (uint8_t i = 0; i < CACHE_CLIENTS && !found; i++) {
+    address = address % CACHE_CLIENTS + 1;
+    found = radioPort(address) == RADIO_PORT && (absentDue || cacheMisses[address - 1] < CACHE_MISS_LIMIT);
+  }
+  if (!found) return;
+
+  pollAddress = address;
+  if (cacheMisses[address - 1] >= CACHE_MISS_LIMIT) absentPollTime = millis();
+
+  uint8_t * request = framePayload(frameBuffer);
+  request[0] = pollAddress;
+  request[1] = MODBUS_FUNCTION_READ_HOLDING_REGISTERS;
+  request[2] = 0; // Start address
+  request[3] = 0;
+  request[4] = 0; // Quantity
+  request[5] = CACHE_REGISTERS;
+  modbusAppendCRC(request, 6);
+
+  radioSend(8, RADIO_POLLING);
+}
+
+// The polled client did not answer in time
+void pollTimeout() {
+  if (cacheMisses[pollAddress - 1] < CACHE_MISS_LIMIT) cacheMisses[pollAddress - 1]++;
+  pollGivenUp = true;
+}
+#endif
+
+// Store a poll answer or report from the client at address, ignore anything else
+void storeClientRegisters(FramePayload payload, uint8_t address) {
+  uint8_t * response = payload.data;
+  if (address < 1 || address > CACHE_CLIENTS || payload.size != 5 + CACHE_REGISTERS * 2 || response[0] != address ||
+    response[1] != MODBUS_FUNCTION_READ_HOLDING_REGISTERS || response[2] != CACHE_REGISTERS * 2 ||
+    !modbusCheckCRC(response, payload.size)) {
+    return;
+  }
+
+  uint8_t client = address - 1;
+  for (uint8_t i = 0; i < CACHE_REGISTERS; i++) {
+    cacheRegisters[client][i] = (response[3 + 2 * i] << 8) | response[4 + 2 * i];
+  }
+  cacheUpdateTime[client] = millis();
+  cacheValid[client] = true;
+  cacheMisses[client] = 0;
+}
+
+// Value of one register of the virtual cache slave
+uint16_t cacheRegisterValue(uint16_t address) {
+  uint8_t client = address / CACHE_BLOCK_SIZE;
+  uint8_t offset = address % CACHE_BLOCK_SIZE;
+
+  if (offset < CACHE_REGISTERS) return cacheRegisters[client][offset];
+
+  if (!cacheValid[client]) return CACHE_AGE_UNKNOWN;
+  uint32_t age = (millis() - cacheUpdateTime[client]) / CACHE_AGE_UNIT;
+  return age < CACHE_AGE_UNKNOWN ? age : CACHE_AGE_UNKNOWN - 1;
+}
+
+// Answer a request to CACHE_SLAVE_ADDRESS in place. Returns the response length.
+uint16_t processCacheRequest(uint8_t * request, uint16_t length) {
+  if (request[1] != MODBUS_FUNCTION_READ_HOLDING_REGISTERS) {
+    return modbusExceptionResponse(request, MODBUS_EXCEPTION_ILLEGAL_FUNCTION);
+  }
+
+  uint16_t startAddress = (request[2] << 8) | request[3];
+  uint16_t quantity = (request[4] << 8) | request[5];
+
+  if (length != 8 || quantity == 0 || quantity > MODBUS_MAX_READ_QUANTITY) {
+    return modbusExceptionResponse(request, MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE);
+  }
+
+  if (startAddress + quantity > CACHE_CLIENTS * CACHE_BLOCK_SIZE) {
+    return modbusExceptionResponse(request, MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS);
+  }
+
+  request[2] = quantity * 2;
+  uint16_t index = 3;
+  for (uint16_t i = 0; i < quantity; i++) {
+    uint16_t value = cacheRegisterValue(startAddress + i);
+    request[index++] = value >> 8;
+    request[index++] = value & 0xFF;
+  }
+
+  modbusAppendCRC(request, index);
+  return index + 2;
+}
+#endif
+// Echo test: every step prints one line, "name key=value ...", RTTs in ms
+void runEchoTest() {
+  rs485BeginTransmit();
+  Serial.print(F("test channel="));
+  Serial.print(hc12Channel);
+  Serial.print(F(" baud="));
+  Serial.print(hc12Link.baud());
+  Serial.print(F(" frames="));
+  Serial.print(TEST_FRAMES);
+  Serial.print(F(" timeout_ms="));
+  Serial.println(TEST_ECHO_TIMEOUT);
+  rs485EndTransmit();
+
+  for (uint8_t i = 0; i < sizeof(testPayloadSizes) / sizeof(testPayloadSizes[0]); i++) {
+    runRoundTrips(testPayloadSizes[i]);
+  }
+  runSaturationSweep();
+}
+
+// Send an echo request and wait for its reply before the next one
+void runRoundTrips(uint16_t size) {
+  size = constrain(size, ECHO_HEADER_SIZE, MAX_DATA_SIZE);
+  startEchoStep();
+
+  for (uint16_t i = 0; i < TEST_FRAMES; i++) {
+    sendEchoRequest(size);
+    uint32_t sentTime = millis();
+    while (!echoAnswered(i) && millis() - sentTime < TEST_ECHO_TIMEOUT) pollEcho();
+    waitEcho(TEST_PING_GAP);
+  }
+
+  printEchoResult(F("echo"), size, 0);
+  printRttHistogram(size);
+}
+
+// Send TEST_SWEEP_FRAMES at a fixed interval regardless of the replies, with
+// shorter intervals until the loss is too high or the frames no longer fit
+void runSaturationSweep() {
+  uint16_t minInterval = (TEST_SWEEP_PAYLOAD + FRAME_OVERHEAD) * 10000UL / hc12Link.baud() + 1; // One frame on the serial line
+  uint16_t sustainable = 0;
+
+  for (uint16_t interval = TEST_SWEEP_START_INTERVAL; interval >= minInterval && interval > 0;
+    interval = (uint32_t) interval * TEST_SWEEP_STEP_PERCENT / 100) {
+    startEchoStep();
+
+    uint32_t nextSend = millis();
+    while (testStats.sent < TEST_SWEEP_FRAMES) {
+      if ((int32_t)(millis() - nextSend) >= 0) {
+        sendEchoRequest(TEST_SWEEP_PAYLOAD);
+        nextSend += interval;
+      }
+      pollEcho();
     }
+
+    uint32_t lastSendTime = millis();
+    while (testStats.received < testStats.sent && millis() - lastSendTime < TEST_ECHO_TIMEOUT) pollEcho();
+
+    printEchoResult(F("sweep"), TEST_SWEEP_PAYLOAD, interval);
+    if (lossPermille() > TEST_SWEEP_MAX_LOSS * 10) break;
+    sustainable = interval;
   }
-}
\ No newline at end of file
+
+  rs485BeginTransmit();
+  Serial.print(F("sustainable size="));
+  Serial.print(TEST_SWEEP_PAYLOAD);
+  Serial.print(F(" interval_ms="));
+  Serial.print(sustainable);
+  Serial.print(F(" rate_fps="));
+  printTenths(sustainable ? 10000UL / sustainable : 0);
+  Serial.println();
+  rs485EndTransmit();
+}
+
+void startEchoStep() {
+  testFirstSequence = testSequence;
+  memset(&testStats, 0, sizeof(testStats));
+  memset(testAnswered, 0, sizeof(testAnswered));
+  memset(rttBins, 0, sizeof(rttBins));
+}
+
+bool echoAnswered(uint16_t offset) {
+  return testAnswered[offset / 8] & (1 << (offset % 8));
+}
+
+// Stream an echo request to the radio. It is not built in frameBuffer, so
+// replies to earlier requests can be received meanwhile.
+void sendEchoRequest(uint16_t size) {
+  uint16_t sequence = testSequence++;
+  uint8_t header[ECHO_HEADER_SIZE];
+  echoHeader(header, ECHO_REQUEST, sequence, micros());
+
+  uint16_t checksum = (size >> 8) + (size & 0xFF);
+  hc12.write(START_BYTE);
+  hc12.write(size >> 8);
+  hc12.write(size & 0xFF);
+  for (uint16_t i = 0; i < size; i++) {
+    uint8_t value = echoByte(header, sequence, i);
+    checksum += value;
+    hc12.write(value);
+  }
+  hc12.write(checksum >> 8);
+  hc12.write(checksum & 0xFF);
+  hc12.write(END_BYTE);
+
+  testStats.sent++;
+}
+
+// Keep receiving replies for a while
+void waitEcho(uint16_t duration) {
+  uint32_t start = millis();
+  while (millis() - start < duration) pollEcho();
+}
+
+void pollEcho() {
+  bool frameReady = false;
+  while (hc12.available()) {
+    hc12_lastByteTime = millis();
+    if (hc12Parser.feed(hc12.read())) {
+      frameReady = true;
+      break;
+    }
+  }
+
+  if (!frameReady && hc12Parser.receiving() && (millis() - hc12_lastByteTime > hc12_frameTime)) {
+    frameReady = hc12Parser.expire();
+  }
+
+  if (frameReady) recordEcho(hc12Parser.payload());
+}
+
+void recordEcho(FramePayload payload) {
+  uint32_t received = micros();
+  if (!isEchoFrame(payload, ECHO_REPLY)) return;
+
+  uint16_t offset = echoSequence(payload.data) - testFirstSequence;
+  if (offset >= testStats.sent || echoAnswered(offset)) return; // Earlier step or duplicate
+
+  if (!echoFillIntact(payload)) {
+    testStats.corrupted++;
+    return;
+  }
+
+  testAnswered[offset / 8] |= 1 << (offset % 8);
+  uint32_t rtt = received - echoTimestamp(payload.data);
+  if (rtt > TEST_ECHO_TIMEOUT * 1000UL) {
+    testStats.late++;
+    return;
+  }
+
+  uint16_t sample = rtt / 100;
+  if (testStats.received == 0 || sample < testStats.rttMin) testStats.rttMin = sample;
+  if (sample > testStats.rttMax) testStats.rttMax = sample;
+  testStats.rttSum += sample;
+  testStats.received++;
+  rttBins[rttBin(sample)]++;
+}
+
+// Histogram bin of an RTT in 0.1 ms: the value itself below 8, above that the
+// position of its highest bit and the 3 bits behind it
+uint8_t rttBin(uint16_t sample) {
+  if (sample < (1 << RTT_BIN_SHIFT)) return sample;
+  uint8_t shift = 0;
+  while ((sample >> shift) >= (2 << RTT_BIN_SHIFT)) shift++;
+  return ((shift + 1) << RTT_BIN_SHIFT) + (sample >> shift) - (1 << RTT_BIN_SHIFT);
+}
+
+// Lowest RTT in 0.1 ms that falls into a bin
+uint16_t rttBinStart(uint8_t bin) {
+  if (bin < (1 << RTT_BIN_SHIFT)) return bin;
+  uint8_t shift = (bin >> RTT_BIN_SHIFT) - 1;
+  return ((1 << RTT_BIN_SHIFT) + (bin & ((1 << RTT_BIN_SHIFT) - 1))) << shift;
+}
+
+// Requests of the running step without a good, timely reply, in 0.1 %
+uint16_t lossPermille() {
+  if (testStats.sent == 0) return 0;
+  return (uint32_t)(testStats.sent - testStats.received) * 1000 / testStats.sent;
+}
+
+// Nearest-rank percentile of the running step's RTTs: the middle of the bin
+// holding that rank, within the observed minimum and maximum
+uint16_t rttPercentile(uint8_t percent) {
+  uint16_t rank = ((uint32_t) testStats.received * percent + 99) / 100;
+  uint16_t count = 0;
+  uint8_t bin = 0;
+  while (bin < RTT_BINS - 1 && count + rttBins[bin] < rank) count += rttBins[bin++];
+
+  uint16_t value = (rttBinStart(bin) + rttBinStart(bin + 1)) / 2;
+  return constrain(value, testStats.rttMin, testStats.rttMax);
+}
+
+void printTenths(uint32_t value) {
+  Serial.print(value / 10);
+  Serial.print('.');
+  Serial.print(value % 10);
+}
+
+void printEchoResult(const __FlashStringHelper * name, uint16_t size, uint16_t interval) {
+  rs485BeginTransmit();
+  Serial.print(name);
+  Serial.print(F(" size="));
+  Serial.print(size);
+  if (interval) {
+    Serial.print(F(" interval_ms="));
+    Serial.print(interval);
+    Serial.print(F(" rate_fps="));
+    printTenths(10000UL / interval);
+  }
+  Serial.print(F(" sent="));
+  Serial.print(testStats.sent);
+  Serial.print(F(" received="));
+  Serial.print(testStats.received);
+  Serial.print(F(" corrupted="));
+  Serial.print(testStats.corrupted);
+  Serial.print(F(" late="));
+  Serial.print(testStats.late);
+  Serial.print(F(" loss_pct="));
+  printTenths(lossPermille());
+  if (testStats.received > 0) {
+    Serial.print(F(" rtt_min_ms="));
+    printTenths(testStats.rttMin);
+    Serial.print(F(" rtt_avg_ms="));
+    printTenths(testStats.rttSum / testStats.received);
+    Serial.print(F(" rtt_p50_ms="));
+    printTenths(rttPercentile(50));
+    Serial.print(F(" rtt_p95_ms="));
+    printTenths(rttPercentile(95));
+    Serial.print(F(" rtt_p99_ms="));
+    printTenths(rttPercentile(99));
+    Serial.print(F(" rtt_max_ms="));
+    printTenths(testStats.rttMax);
+  }
+  Serial.println();
+  rs485EndTransmit();
+}
+
+// Reply counts of the occupied bins, "start_ms:count,...", in 0.1 ms from the
+// lowest RTT of each bin
+void printRttHistogram(uint16_t size) {
+  if (testStats.received == 0) return;
+
+  rs485BeginTransmit();
+  Serial.print(F("echo_hist size="));
+  Serial.print(size);
+  Serial.print(F(" bins="));
+
+  bool first = true;
+  for (uint8_t bin = 0; bin < RTT_BINS; bin++) {
+    if (rttBins[bin] == 0) continue;
+    if (!first) Serial.print(',');
+    printTenths(rttBinStart(bin));
+    Serial.print(':');
+    Serial.print(rttBins[bin]);
+    first = false;
+  }
+  Serial.println();
+  rs485EndTransmit();
+}
+
+void clearLinkStats() {
+  memset(&linkStats, 0, sizeof(linkStats));
+  for (uint8_t i = 0; i < STATS_CLIENTS; i++) linkStats.clientRtt[i] = STATS_RTT_UNKNOWN;
+  hc12Parser.clearDropped();
+}
+
+void recordClientRtt(uint8_t address, uint32_t rtt) {
+  if (address < 1 || address > STATS_CLIENTS) return;
+  linkStats.clientRtt[address - 1] = rtt < STATS_RTT_UNKNOWN ? rtt : STATS_RTT_UNKNOWN - 1;
+}
+
+// The request in flight got no answer
+void countResponseTimeout() {
+  linkStats.radioResponseTimeouts++;
+  if (radioTarget >= 1 && radioTarget <= STATS_CLIENTS) linkStats.clientTimeouts[radioTarget - 1]++;
+}
+
+uint16_t statsRegisterValue(uint16_t address) {
+  uint32_t uptime = millis() / 1000;
+
+  switch (address) {
+  case STATS_RS485_REQUESTS: return linkStats.rs485Requests;
+  case STATS_RS485_CRC_ERRORS: return linkStats.rs485CrcErrors;
+  case STATS_RS485_OVERFLOWS: return linkStats.rs485Overflows;
+  case STATS_RS485_SHORT_FRAMES: return linkStats.rs485ShortFrames;
+  case STATS_RS485_RESPONSES: return linkStats.rs485Responses;
+  case STATS_RADIO_SENT: return linkStats.radioSent;
+  case STATS_RADIO_RECEIVED: return linkStats.radioReceived;
+  case STATS_RADIO_DROPPED: return hc12Parser.dropped();
+  case STATS_RADIO_FRAME_TIMEOUTS: return linkStats.radioFrameTimeouts;
+  case STATS_RADIO_RESPONSE_TIMEOUTS: return linkStats.radioResponseTimeouts;
+  case STATS_RADIO_DISCARDED_BYTES: return linkStats.radioDiscardedBytes;
+  case STATS_LOOP_MAX_HIGH: return linkStats.loopMaxMicros >> 16;
+  case STATS_LOOP_MAX_LOW: return linkStats.loopMaxMicros & 0xFFFF;
+  case STATS_UPTIME_HIGH: return uptime >> 16;
+  case STATS_UPTIME_LOW: return uptime & 0xFFFF;
+  case STATS_RESET: return 0;
+  }
+
+  #if FIRE_QUEUE_ENABLED
+  if (address >= STATS_FIRE_BASE) {
+    uint8_t client = address - STATS_FIRE_BASE;
+    return (fireCount[client] << 8) | fireStatus[client];
+  }
+  #endif
+
+  uint16_t client = (address - STATS_CLIENT_BASE) / STATS_CLIENT_BLOCK;
+  return (address - STATS_CLIENT_BASE) % STATS_CLIENT_BLOCK == 0 ?
+    linkStats.clientRtt[client] : linkStats.clientTimeouts[client];
+}
+
+// Answer a request to STATS_SLAVE_ADDRESS in place. Returns the response length.
+uint16_t processStatsRequest(uint8_t * request, uint16_t length) {
+  uint16_t startAddress = (request[2] << 8) | request[3];
+  uint16_t value = (request[4] << 8) | request[5];
+
+  if (request[1] == MODBUS_FUNCTION_WRITE_SINGLE_REGISTER) {
+    if (length != 8) return modbusExceptionResponse(request, MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE);
+    if (startAddress != STATS_RESET) return modbusExceptionResponse(request, MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS);
+    clearLinkStats();
+    return length; // Echo of the request
+  }
+
+  if (request[1] != MODBUS_FUNCTION_READ_HOLDING_REGISTERS) {
+    return modbusExceptionResponse(request, MODBUS_EXCEPTION_ILLEGAL_FUNCTION);
+  }
+
+  uint16_t quantity = value;
+  if (length != 8 || quantity == 0 || quantity > MODBUS_MAX_READ_QUANTITY) {
+    return modbusExceptionResponse(request, MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE);
+  }
+
+  if (startAddress + quantity > STATS_REGISTER_COUNT) {
+    return modbusExceptionResponse(request, MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS);
+  }
+
+  request[2] = quantity * 2;
+  uint16_t index = 3;
+  for (uint16_t i = 0; i < quantity; i++) {
+    uint16_t registerValue = statsRegisterValue(startAddress + i);
+    request[index++] = registerValue >> 8;
+    request[index++] = registerValue & 0xFF;
+  }
+
+  modbusAppendCRC(request, index);
+  return index + 2;
+}
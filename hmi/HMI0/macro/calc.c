@@ -9,9 +9,15 @@
  * information about how many machines are enabled, how much ammo they hold, and
  * how many double or triple fires are required.
  *
+ * Machines are numbered from 1 to MACHINES. Machine sets are bitmasks of MASK_WORDS words:
+ * bit 0 of the first word is machine 1, bit 0 of the second word machine 17, and so on.
+ * With LEGACY_REGISTERS (the default up to 10 machines) the per-machine words of the
+ * DTool screens are used as well, see shooter.c.
+ *
  * Input Registers:
- *   - LW0-LW9     : Flags indicating if each machine is enabled (1) or disabled (0).
- *   - LW10-LW19   : The decreased ammo values for selected machine(s) (overall).
+ *   - LW0-LW3     : Enabled machines, bitmask (MASK_WORDS words).
+ *     LW0-LW9     : With LEGACY_REGISTERS: one flag per machine (1 = enabled, 0 = disabled).
+ *   - LW10-LW73   : The decreased ammo values for selected machine(s) (overall), one word per machine.
  *   - LW110       : The max fireable ammo that can still be distributed (saved).
  *   - LW111       : The number of double fires (two fires in one cycle) (saved).
  *   - LW112       : The number of triple fires (three fires in one cycle) (saved).
@@ -25,17 +31,38 @@
  *   - LW1000      : Remaining delay; indicates how many cycles remain until another fire can be initiated.
  *
  * Output Registers:
- *   - LW100-LW109 : The amount of ammo assigned to each machine for the upcoming game.
+ *   - LW1200-LW1263: The amount of ammo assigned to each machine for the upcoming game.
+ *     LW100-LW109 : With LEGACY_REGISTERS: the same values.
  *   - LW114       : Clear fired ammo register.
+ *   - LW1001      : The number of steps in the firing schedule.
+ *   - LW1002      : Next step of the schedule (cleared).
+ *   - LW2000-     : The firing schedule for shooter.c, one machine bitmask (MASK_WORDS words) per step.
  *   - LW300       : Error code:
  *                      0 -> No error
  *                      1 -> All configured double/triple fires are not possible with the current ammo distribution
  *                      2 -> Ammo was not evenly distributed among machines
  *                      3 -> Not enough ammo or machines for the requested distribution
+ *                      4 -> More ammo than the schedule holds (SCHEDULE_SIZE); LW110 was reduced to it
  *******************************/
 
 #include "macrotypedef.h"
 #include "math.h"
+#include <stdlib.h>
+#include <time.h>
+
+#ifndef MACHINES
+#define MACHINES 10	// Machines in the game, up to 64 (the same in every macro)
+#endif
+#define MASK_WORDS ((MACHINES + 15) / 16)	// Words of a machine bitmask
+#ifndef LEGACY_REGISTERS
+#define LEGACY_REGISTERS (MACHINES <= 10)	// Keep the per-machine words of the DTool screens (the same in every macro)
+#endif
+#if LEGACY_REGISTERS && MACHINES > 10
+#error "The per-machine words of the DTool screens (LW0-LW9, LW100-LW109) hold 10 machines"
+#endif
+
+#define SCHEDULE_SIZE 1000		// Steps the schedule table holds (LW2000-), also the ammo limit of a game
+#define SCHEDULE_ATTEMPTS 8	// Random selections tried per step before taking the machines with the most ammo
 
 /*
  * Global Variables:
@@ -47,16 +74,21 @@
  * - tripleFire      : The number of triple-fire events to accommodate.
  * - delay           : The delay period between fires (e.g., cycles or ticks).
  * - errorFlag       : Tracks warnings or errors that arise during setup (0 means no error).
+ * - schedule[]      : The machines firing on each step of the game, as bitmasks.
+ * - scheduleState[] : Steps in the schedule and the next step (LW1001-LW1002).
  */
 
-short usableMachines[10] = {0}; // 1 = enabled, 0 = disabled for each of the 10 machines
-short ammo_machine[10] = {0};		// Current ammo "capacity" for each machine (overall)
-short ammo_game[10] = {0};			// Calculated ammo for the next game (what we'll distribute)
+unsigned short enabledMask[MASK_WORDS] = {0}; // LW0-: enabled machines
+short usableMachines[MACHINES] = {0}; // 1 = enabled, 0 = disabled for each machine (from enabledMask, or LW0- with LEGACY_REGISTERS)
+short ammo_machine[MACHINES] = {0};	// Current ammo "capacity" for each machine (overall)
+short ammo_game[MACHINES] = {0};		// Calculated ammo for the next game (what we'll distribute)
 short maxShootableAmmo;					// How much total ammo can be fired across machines
 short doubleFire;								// Number of double fires required
 short tripleFire;								// Number of triple fires required
 short delay = 0;								// Delay in ticks/cycles between fires
 short errorFlag = 0;						// Global error flag (0 indicates no errors, >0 indicates a warning/error)
+unsigned short schedule[SCHEDULE_SIZE * MASK_WORDS]; // Machine bitmask per step
+short scheduleState[2] = {0};		// Steps in the schedule, next step
 const short zero = 0;
 
 /**
@@ -68,196 +100,409 @@ const short zero = 0;
 void reset_selected_machines()
 {
 	short i;
-	for (i = 0; i < 10; i++)
+	for (i = 0; i < MACHINES; i++)
 	{
 		ammo_game[i] = 0;
 	}
 }
 
 /**
- * Function: can_fire_x_times
+ * Function: sift_down
+ * -------------------
+ * Moves index[root] down the max-heap index[0..count-1] (by ammo_machine[]) to its place.
+ */
+void sift_down(short *index, short root, short count)
+{
+	short child, swap;
+	while ((child = root * 2 + 1) < count)
+	{
+		if (child + 1 < count && ammo_machine[index[child + 1]] > ammo_machine[index[child]])
+			child++;
+		if (ammo_machine[index[root]] >= ammo_machine[index[child]])
+			return;
+		swap = index[root];
+		index[root] = index[child];
+		index[child] = swap;
+		root = child;
+	}
+}
+
+/**
+ * Function: sort_by_capacity
  * --------------------------
- * Simulates whether we can actually perform the configured number of double and triple fires
- * using the allocated ammo in ammo_game[]. It does not change the real ammo_game[] array;
- * instead, it copies the data and decrements from the copy.
+ * Heap sort of machine indexes by ammo_machine[], least first; O(n log n) for any
+ * number of machines.
+ *
+ * Parameters:
+ *   - index : The machine indexes to sort.
+ *   - count : How many there are.
+ */
+void sort_by_capacity(short *index, short count)
+{
+	short i, swap;
+	for (i = count / 2 - 1; i >= 0; i--)
+	{
+		sift_down(index, i, count);
+	}
+	for (i = count - 1; i > 0; i--)
+	{
+		swap = index[0];
+		index[0] = index[i];
+		index[i] = swap;
+		sift_down(index, 0, i);
+	}
+}
+
+/**
+ * Function: fires_feasible
+ * ------------------------
+ * Decides exactly whether single, double and triple fires can use up the ammo in ammo[],
+ * with the machines of a double or triple fire all different. O(count).
  *
  * Parameters:
- *   - total_ammo     : The total ammo we’re trying to validate (might be the same as maxShootableAmmo).
- *   - double_fires   : How many double fires we need to check feasibility for.
- *   - triple_fires   : How many triple fires we need to check feasibility for.
+ *   - ammo    : Ammo of each machine.
+ *   - count   : Number of machines.
+ *   - singles, doubles, triples : The fires to make.
  *
  * Returns:
- *   - 1 if the distribution supports the necessary double/triple fires,
+ *   - 1 if the fires are possible,
  *   - 0 otherwise.
  *
- * Algorithm:
- *   1. Copy ammo_game[] into a temporary array (ammo[]).
- *   2. Deduct three bullets per triple fire from the array, ensuring each bullet
- *      comes from a machine that has at least one bullet left.
- *   3. Deduct two bullets per double fire from the array in the same manner.
- *   4. If at any time there isn’t enough ammo to complete a triple or double fire, return 0.
- *   5. If all fires can be allocated correctly, verify that our leftover ammo aligns with
- *      what we expect (remaining_ammo + used bullets == maxShootableAmmo).
+ * Explanation:
+ *   Taking each triple, then each double from the machines with the most ammo left always
+ *   succeeds if anything does. Counting instead of simulating it (Gale-Ryser condition):
+ *   a machine fires at most once per step, so the machine with the most ammo needs at most
+ *   singles + doubles + triples; the two with the most need at most singles + 2 * doubles +
+ *   2 * triples; three or more machines can share any step, so only the totals must match.
  */
-int can_fire_x_times(short total_ammo, short double_fires, short triple_fires)
+int fires_feasible(short *ammo, short count, short singles, short doubles, short triples)
 {
-	short i, count;
-	short remaining_ammo = maxShootableAmmo;
-	short used_double = 0, used_triple = 0;
+	long total = 0;
+	short first = 0, second = 0;	// The two largest ammo values
+	short i;
 
-	// Copy the allocated ammo for each machine into a temporary array for simulation
-	short ammo[10] = {0};
-	for (i = 0; i < 10; i++)
-	{
-		ammo[i] = ammo_game[i];
-	}
+	if (singles < 0 || doubles < 0 || triples < 0)
+		return 0;
 
-	// First, handle triple fires
-	while (used_triple < tripleFire)
+	for (i = 0; i < count; i++)
 	{
-		count = 0;
-		// Attempt to find 3 bullets total, each from possibly different machines
-		for (i = 0; i < 10 && count < 3; i++)
+		total += ammo[i];
+		if (ammo[i] > first)
 		{
-			if (ammo[i] > 0)
-			{
-				ammo[i]--;
-				count++;
-			}
+			second = first;
+			first = ammo[i];
 		}
-
-		// If we don't find 3 bullets total, it means we cannot fulfill a triple fire
-		if (count < 3)
-			return 0;
-
-		used_triple++;
-		remaining_ammo -= 3; // Decrement the total ammo used by 3
-	}
-
-	// Next, handle double fires
-	while (used_double < doubleFire)
-	{
-		count = 0;
-		// Attempt to find 2 bullets total from the machines
-		for (i = 0; i < 10 && count < 2; i++)
+		else if (ammo[i] > second)
 		{
-			if (ammo[i] > 0)
-			{
-				ammo[i]--;
-				count++;
-			}
+			second = ammo[i];
 		}
-
-		// If we don't find 2 bullets total, we cannot fulfill a double fire
-		if (count < 2)
-			return 0;
-
-		used_double++;
-		remaining_ammo -= 2; // Decrement the total ammo used by 2
 	}
 
-	// Finally, check the math to ensure we haven't used more or fewer bullets than expected
-	// (remaining_ammo + total used for double + triple should equal maxShootableAmmo)
-	return (remaining_ammo + used_double * 2 + used_triple * 3) == maxShootableAmmo;
+	return total == singles + doubles * 2L + triples * 3L &&
+		first <= (long)singles + doubles + triples &&
+		first + second <= (long)singles + doubles * 2L + triples * 2L;
 }
 
 /**
  * Function: distribute_ammo
  * -------------------------
- * Distributes the maxShootableAmmo evenly among all enabled machines. If a machine has
- * less capacity than the evenly calculated amount, we adjust accordingly and mark errorFlag
- * to indicate an uneven distribution. We also handle leftover ammo re-distribution if there
- * is any remainder after the initial pass.
+ * Distributes the maxShootableAmmo evenly among all enabled machines, in O(n log n).
+ * Machines with less capacity than their share get all they have, and the rest is shared
+ * evenly among the others (water filling). The one-unit remainder goes to the lowest
+ * numbered machines. As even as possible also means the machines with the most ammo
+ * carry as little as possible, so when any allocation allows the double/triple fires,
+ * this one does.
  *
  * Steps:
- *   1. Count how many machines are enabled and have ammo capacity (ammo_machine[i] > 0).
+ *   1. Collect the machines that are enabled and have ammo capacity (ammo_machine[i] > 0).
  *   2. If no machines are enabled or we have zero maxShootableAmmo, set errorFlag to 3.
- *   3. Calculate ammoPerMachine = maxShootableAmmo / number_of_enabled_machines.
- *   4. The remainder (maxShootableAmmo % totalMachines) is leftover ammo that will be
- *      distributed one unit at a time.
- *   5. If some machines cannot handle the even split, we mark errorFlag = 2.
- *   6. Once the main distribution is done, we distribute leftover ammo to machines
- *      that can still handle more allocations.
- *   7. If we run out of machines that can accept leftover ammo but still have leftover,
- *      we set errorFlag = 3.
+ *   3. Sort them by capacity. Going from the smallest, a machine whose capacity does not
+ *      exceed an even share of the ammo still to place is filled up. If one had less than
+ *      maxShootableAmmo / machines, errorFlag = 2 (not evenly distributed).
+ *   4. If every machine is full and ammo is left, errorFlag = 3 and maxShootableAmmo is
+ *      reduced to what was distributed.
+ *   5. Otherwise the other machines all get the even share of what is left, plus one for
+ *      the remainder.
  */
 void distribute_ammo()
 {
+	short index[MACHINES];
 	short totalMachines = 0;
-	short i, ammoPerMachine, remainingAmmo;
+	short i, k, share, extra;
+	short remainingAmmo = maxShootableAmmo;
 
-	// Count how many machines can receive ammo
-	for (i = 0; i < 10; i++)
+	// Step 1: Machines that can receive ammo
+	for (i = 0; i < MACHINES; i++)
 	{
 		if (usableMachines[i] && ammo_machine[i] > 0)
 		{
-			totalMachines++;
+			index[totalMachines++] = i;
 		}
 	}
 
-	// If there are no machines or if there is no ammo to distribute, set errorFlag = 3
+	// Step 2: If there are no machines or if there is no ammo to distribute, set errorFlag = 3
 	if (totalMachines == 0 || maxShootableAmmo == 0)
 	{
 		errorFlag = 3;
 		return;
 	}
 
-	// Calculate the base distribution and leftover remainder
-	ammoPerMachine = maxShootableAmmo / totalMachines;
-	remainingAmmo = maxShootableAmmo % totalMachines;
-
-	// Primary distribution across enabled machines
-	for (i = 0; i < 10; i++)
+	// Step 3: Fill up the machines too small for an even share
+	sort_by_capacity(index, totalMachines);
+	for (k = 0; k < totalMachines; k++)
 	{
-		if (usableMachines[i] && ammo_machine[i] > 0)
+		share = remainingAmmo / (totalMachines - k);
+		if (ammo_machine[index[k]] > share)
+			break;
+
+		ammo_game[index[k]] = ammo_machine[index[k]];
+		remainingAmmo -= ammo_machine[index[k]];
+		if (ammo_machine[index[k]] < maxShootableAmmo / totalMachines)
 		{
-			// If the machine's overall capacity is >= even allotment, use the even allotment
-			if (ammo_machine[i] >= ammoPerMachine)
-			{
-				ammo_game[i] = ammoPerMachine;
-			}
-			else
-			{
-				// If the machine has less capacity than the calculated even share,
-				// assign its maximum and redistribute the leftover to other machines
-				ammo_game[i] = ammo_machine[i];
-				remainingAmmo += (ammoPerMachine - ammo_machine[i]);
-				// Mark a warning that distribution wasn't perfectly even
-				errorFlag = 2;
-			}
+			// Mark a warning that distribution wasn't perfectly even
+			errorFlag = 2;
 		}
 	}
 
-	// Distribute leftover ammo one unit at a time
-	while (remainingAmmo > 0)
+	// Step 4: Not enough capacity on all machines together
+	if (k == totalMachines)
 	{
-		short unableToDistributeMore = 1;
+		if (remainingAmmo > 0)
+		{
+			errorFlag = 3;
+			maxShootableAmmo -= remainingAmmo;
+		}
+		return;
+	}
 
-		// Try assigning leftover ammo to machines that still have capacity
-		for (i = 0; i < 10 && remainingAmmo > 0; i++)
+	// Step 5: Even share for the rest, the remainder to the lowest numbered machines
+	share = remainingAmmo / (totalMachines - k);
+	extra = remainingAmmo % (totalMachines - k);
+	for (i = 0; i < MACHINES; i++)
+	{
+		if (usableMachines[i] && ammo_machine[i] > share)
 		{
-			if (usableMachines[i] && ammo_machine[i] > ammo_game[i])
+			ammo_game[i] = share;
+			if (extra > 0)
 			{
 				ammo_game[i]++;
-				remainingAmmo--;
-				unableToDistributeMore = 0;
+				extra--;
 			}
 		}
+	}
+}
+
+/**
+ * Function: in_group
+ * ------------------
+ * Returns 1 if machine is one of the first 'count' machines in group[].
+ */
+int in_group(short *group, short count, short machine)
+{
+	short i;
+	for (i = 0; i < count; i++)
+	{
+		if (group[i] == machine)
+			return 1;
+	}
+	return 0;
+}
 
-		// If we couldn't distribute any leftover in this pass, it's an error
-		if (unableToDistributeMore)
+/**
+ * Function: take_group
+ * --------------------
+ * Adds 'change' to the ammo of the 'size' machines in group[].
+ */
+void take_group(short *ammo, short *group, short size, short change)
+{
+	short i;
+	for (i = 0; i < size; i++)
+	{
+		ammo[group[i]] += change;
+	}
+}
+
+/**
+ * Function: random_group
+ * ----------------------
+ * Randomly picks 'size' different machines into group[], each with a probability weighted
+ * by its ammo.
+ *
+ * Returns:
+ *   - 1 if all of them were picked,
+ *   - 0 if fewer than 'size' machines have ammo left.
+ */
+int random_group(short *ammo, short size, short *group)
+{
+	short picked, i;
+	long total, value;
+
+	for (picked = 0; picked < size; picked++)
+	{
+		// The machines picked already are out of the draw
+		total = 0;
+		for (i = 0; i < MACHINES; i++)
 		{
-			errorFlag = 3;
-			//Set the distributed as the maxShootableAmmo
-			short distributed = 0;
-			short i;
-			for (i = 0; i < 10; i++){
-				distributed += ammo_game[i];
-			}
-			maxShootableAmmo = distributed;
+			total += ammo[i];
+		}
+		for (i = 0; i < picked; i++)
+		{
+			total -= ammo[group[i]];
+		}
+		if (total == 0)
+			return 0;
+
+		// Walk through the machines not picked yet until the random value is used up
+		value = rand() % total;
+		for (i = 0; i < MACHINES; i++)
+		{
+			if (in_group(group, picked, i))
+				continue;
+			value -= ammo[i];
+			if (value < 0)
+				break;
+		}
+		group[picked] = i;
+	}
+	return 1;
+}
+
+/**
+ * Function: fullest_group
+ * -----------------------
+ * Picks the 'size' machines with the most ammo left into group[]. A step fired by them
+ * never makes the rest of a feasible schedule infeasible, so this is the fallback of
+ * build_schedule().
+ *
+ * Returns:
+ *   - The number of machines picked (less than 'size' only if too few have ammo).
+ */
+short fullest_group(short *ammo, short size, short *group)
+{
+	short picked, i, best;
+
+	for (picked = 0; picked < size; picked++)
+	{
+		best = -1;
+		for (i = 0; i < MACHINES; i++)
+		{
+			if (!in_group(group, picked, i) && ammo[i] > 0 && (best < 0 || ammo[i] > ammo[best]))
+				best = i;
+		}
+		if (best < 0)
 			break;
+		group[picked] = best;
+	}
+	return picked;
+}
+
+/**
+ * Function: build_schedule
+ * ------------------------
+ * Generates the firing sequence of the whole game into schedule[], so shooter.c only has
+ * to step through it.
+ *
+ * Steps:
+ *   1. Work out the number of single fires from maxShootableAmmo and the double/triple fires.
+ *      If the ammo distribution cannot make all double/triple fires, triples are split into a
+ *      double and a single and doubles into two singles until it can (errorFlag = 1).
+ *   2. Put the steps in random order (Fisher-Yates shuffle of the fire sizes).
+ *   3. For each step in order, randomly pick its machines weighted by their ammo left, like a
+ *      draw during the game would. A pick that would leave the rest of the steps impossible
+ *      is retried, and after SCHEDULE_ATTEMPTS the machines with the most ammo are taken.
+ */
+void build_schedule()
+{
+	short ammo[MACHINES];
+	short left[4];	// Steps not assigned yet, by size (index 1-3)
+	short group[3];	// Machines of the step
+	short singles, doubles, triples, steps;
+	short i, j, size, attempt;
+
+	scheduleState[0] = 0;
+	scheduleState[1] = 0;
+
+	for (i = 0; i < MACHINES; i++)
+	{
+		ammo[i] = ammo_game[i];
+	}
+
+	// Step 1: Fire sizes that fit the distributed ammo
+	doubles = doubleFire;
+	triples = tripleFire;
+	singles = maxShootableAmmo - doubles * 2 - triples * 3;
+	while (singles < 0 || !fires_feasible(ammo, MACHINES, singles, doubles, triples))
+	{
+		if (triples > 0)
+		{
+			triples--;
+			doubles++;
+			singles++;
+		}
+		else if (doubles > 0)
+		{
+			doubles--;
+			singles += 2;
+		}
+		else
+		{
+			return; // No ammo distributed, nothing to schedule
 		}
+		if (errorFlag == 0)
+			errorFlag = 1;
 	}
+
+	// Step 2: Sizes in random order, in the first word of each step for now
+	steps = singles + doubles + triples;
+	for (i = 0; i < steps * MASK_WORDS; i++)
+	{
+		schedule[i] = 0;
+	}
+	for (i = 0; i < steps; i++)
+	{
+		schedule[i * MASK_WORDS] = i < triples ? 3 : i < triples + doubles ? 2 : 1;
+	}
+	for (i = steps - 1; i > 0; i--)
+	{
+		j = rand() % (i + 1);
+		size = schedule[i * MASK_WORDS];
+		schedule[i * MASK_WORDS] = schedule[j * MASK_WORDS];
+		schedule[j * MASK_WORDS] = size;
+	}
+
+	// Step 3: Machines for each step
+	left[1] = singles;
+	left[2] = doubles;
+	left[3] = triples;
+	for (i = 0; i < steps; i++)
+	{
+		size = schedule[i * MASK_WORDS];
+		schedule[i * MASK_WORDS] = 0;
+		left[size]--;
+
+		for (attempt = 0; attempt < SCHEDULE_ATTEMPTS; attempt++)
+		{
+			if (!random_group(ammo, size, group))
+				continue;
+			take_group(ammo, group, size, -1);
+			if (fires_feasible(ammo, MACHINES, left[1], left[2], left[3]))
+				break;
+			take_group(ammo, group, size, 1);
+		}
+
+		if (attempt == SCHEDULE_ATTEMPTS)
+		{
+			size = fullest_group(ammo, size, group);
+			take_group(ammo, group, size, -1);
+		}
+
+		for (j = 0; j < size; j++)
+		{
+			schedule[i * MASK_WORDS + group[j] / 16] |= 1 << (group[j] % 16);
+		}
+	}
+
+	scheduleState[0] = steps;
 }
 
 /**
@@ -268,7 +513,8 @@ void distribute_ammo()
  *   2. Resets the allocated ammo array for a clean slate.
  *   3. Distributes ammo among machines.
  *   4. Validates if the distribution allows for the configured double/triple fires.
- *   5. Writes updated data and any errors or warnings back to the registers.
+ *   5. Generates the firing schedule of the game.
+ *   6. Writes updated data and any errors or warnings back to the registers.
  *
  * Returns:
  *   - 0 to indicate successful completion of the macro.
@@ -276,36 +522,65 @@ void distribute_ammo()
 int MacroEntry()
 {
 	// Step 1: Read in the inputs (machine states, ammo data, config)
-	ReadLocal("LW", 0, 10, (void *)usableMachines, 0);
-	ReadLocal("LW", 10, 10, (void *)ammo_machine, 0);
-	ReadLocal("LW", 100, 10, (void *)ammo_game, 0);
+#if LEGACY_REGISTERS
+	ReadLocal("LW", 0, MACHINES, (void *)usableMachines, 0);
+#else
+	ReadLocal("LW", 0, MASK_WORDS, (void *)enabledMask, 0);
+#endif
+	ReadLocal("LW", 10, MACHINES, (void *)ammo_machine, 0);
 	ReadLocal("LW", 1100, 1, (void *)&maxShootableAmmo, 0);
 	ReadLocal("LW", 1101, 1, (void *)&doubleFire, 0);
 	ReadLocal("LW", 1102, 1, (void *)&tripleFire, 0);
 	ReadLocal("LW", 1103, 1, (void *)&delay, 0);
 
+	short i;
+	for (i = 0; i < MACHINES; i++)
+	{
+#if LEGACY_REGISTERS
+		usableMachines[i] = usableMachines[i] != 0;
+#else
+		usableMachines[i] = (enabledMask[i / 16] >> (i % 16)) & 1;
+#endif
+	}
+
+	// Seed the random number generator once per game.
+	srand(time(NULL));
+
 	// Reset any prior error state and clear the allocated ammo distribution
 	errorFlag = 0;
 	reset_selected_machines();
 
+	// Every step fires at least one machine, so the schedule table limits the ammo of a game
+	if (maxShootableAmmo > SCHEDULE_SIZE)
+	{
+		maxShootableAmmo = SCHEDULE_SIZE;
+		errorFlag = 4;
+	}
+
 	// Step 2: Distribute the ammo among the machines
 	distribute_ammo();
 
 	// Step 3: If no critical error occurred yet, check if the required fires can actually be performed
 	if (errorFlag == 0)
 	{
-		// If can_fire_x_times returns 0, that means the distribution is insufficient for the configured fires
-		errorFlag = !can_fire_x_times(maxShootableAmmo, doubleFire, tripleFire);
+		// If fires_feasible returns 0, that means the distribution is insufficient for the configured fires
+		errorFlag = !fires_feasible(ammo_game, MACHINES, maxShootableAmmo - doubleFire * 2 - tripleFire * 3, doubleFire, tripleFire);
 	}
 
+	// Step 4: The whole game's firing sequence for shooter.c
+	build_schedule();
+
 	if (delay < 4)
 	{
 		delay = 4; // Ensure the delay is at least 2 ticks/cycles
 	}
 
-	// Step 4: Write back the updated states and any error codes
-	WriteLocal("LW", 10, 10, (void *)ammo_machine, 0);
-	WriteLocal("LW", 100, 10, (void *)ammo_game, 0);
+	// Step 5: Write back the updated states and any error codes
+	WriteLocal("LW", 10, MACHINES, (void *)ammo_machine, 0);
+	WriteLocal("LW", 1200, MACHINES, (void *)ammo_game, 0);
+#if LEGACY_REGISTERS
+	WriteLocal("LW", 100, MACHINES, (void *)ammo_game, 0);
+#endif
 	WriteLocal("LW", 110, 1, (void *)&maxShootableAmmo, 0);
 	WriteLocal("LW", 111, 1, (void *)&doubleFire, 0);
 	WriteLocal("LW", 112, 1, (void *)&tripleFire, 0);
@@ -313,6 +588,11 @@ int MacroEntry()
 	WriteLocal("LW", 114, 1, (void *)&zero, 0);
 	WriteLocal("LW", 300, 1, (void *)&errorFlag, 0);
 	WriteLocal("LW", 1000, 1, (void *)&delay, 0);
+	WriteLocal("LW", 1001, 2, (void *)scheduleState, 0);
+	if (scheduleState[0] > 0)
+	{
+		WriteLocal("LW", 2000, scheduleState[0] * MASK_WORDS, (void *)schedule, 0);
+	}
 	// Return 0 indicating the macro ran fully without exceptions
 	return 0;
 }
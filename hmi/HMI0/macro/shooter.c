@@ -1,70 +1,95 @@
 /*******************************
  * Title: Kinco Shooting range machine selection Macro
  * Created: 2025-02-01
- * Version: 1.0
+ * Version: 2.0
  * Author: Nemeth Balint
  *
  * Description:
- * This macro is used to randomly select the next machine(s) to fire. The probability of
- * each machine being selected is determined by the number of ammo it has. The more ammo
- * a machine has, the higher the probability it will be selected.
+ * This macro fires the next step of the game schedule. The schedule is generated once by
+ * calc.c when the game is set up: it holds the machine(s) firing on each step, picked with
+ * a probability weighted by each machine's ammo, and already contains every double and
+ * triple fire. Each cycle therefore only counts down the delay and advances the step index.
+ *
+ * Machines are numbered from 1 to MACHINES. Machine sets are bitmasks of MASK_WORDS words:
+ * bit 0 of the first word is machine 1, bit 0 of the second word machine 17, and so on.
+ * Only the ammo words of the machines that fire are accessed, so the cost of a cycle does
+ * not grow with the number of machines.
+ *
+ * With LEGACY_REGISTERS (the default up to 10 machines) the per-machine words that the
+ * screens of the DTool project are bound to are kept as well: the enabled flags are read
+ * from LW0-LW9 instead of the bitmask, and the game ammo and the selection are also written
+ * to LW100-LW109 and LW200-LW209.
  *
  * Input:
- *  - LW0-LW9: the number of enabled machines (1 means a machine is enabled, 0 means disabled).
- *  - LW10-LW19: the decreased ammo value for the selected machine(s) (overall).
- *  - LW100-LW109: the number of ammo for each machine (specific to the game).
+ *  - LW0-LW3: the enabled machines, bitmask (MASK_WORDS words).
+ *             A machine disabled during the game skips its scheduled shots.
+ *    LW0-LW9 with LEGACY_REGISTERS: one flag per machine (1 = enabled, 0 = disabled).
+ *  - LW10-LW73: the decreased ammo value for the selected machine(s) (overall), one word per machine.
+ *  - LW1200-LW1263: the number of ammo for each machine (specific to the game).
  *  - LW110: the maximum shootable ammo across all machines.
  *  - LW111: the number of double fires allowed.
  *  - LW112: the number of triple fires allowed.
  *  - LW113: the delay between fires.
+ *  - LW1001: the number of steps in the schedule.
+ *  - LW2000-: the schedule, one machine bitmask (MASK_WORDS words) per step.
  *
  *  * Background Registers (IN/OUT):
  *   - LW1000      : Remaining delay; indicates how many cycles remain until another fire can be initiated.
- *   - LW114        : Fired ammo; 
-*
+ *   - LW1002      : Next step of the schedule.
+ *   - LW114       : Fired ammo;
+ *
  * Output:
- *  - LW10-LW19: updated overall ammo values for the selected machine(s).
- *  - LW100-LW109: updated game-specific ammo values for the selected machine(s).
+ *  - LW10-LW73: updated overall ammo values for the selected machine(s).
+ *  - LW1200-LW1263: updated game-specific ammo values for the selected machine(s).
+ *    LW100-LW109 with LEGACY_REGISTERS: the same values.
  *  - LW110: updated maximum shootable ammo after firing.
  *  - LW111: updated double fire count.
  *  - LW112: updated triple fire count.
- *  - LW200-LW209: indicates which machines were selected to fire in this cycle.
+ *  - LW210-LW213: the machines selected to fire in this cycle, bitmask (MASK_WORDS words). Written by
+ *           the HMI as one broadcast (station 0) to registers 0x0100-, so all selected machines fire
+ *           from one radio frame.
+ *    LW200-LW209 with LEGACY_REGISTERS: the same selection, one flag per machine.
  */
 
 #include "macrotypedef.h"
 #include "math.h"
-#include <stdlib.h>
-#include <time.h>
+
+#ifndef MACHINES
+#define MACHINES 10	// Machines in the game, up to 64 (the same in every macro)
+#endif
+#define MASK_WORDS ((MACHINES + 15) / 16)	// Words of a machine bitmask
+#ifndef LEGACY_REGISTERS
+#define LEGACY_REGISTERS (MACHINES <= 10)	// Keep the per-machine words of the DTool screens (the same in every macro)
+#endif
+#if LEGACY_REGISTERS && MACHINES > 10
+#error "The per-machine words of the DTool screens (LW0-LW9, LW100-LW109, LW200-LW209) hold 10 machines"
+#endif
+
+// Indexes into game[] (LW110-LW114)
+#define MAX_SHOOTABLE 0 // The maximum total ammo that can be fired before the game ends.
+#define DOUBLE_FIRE 1		// The number of double (two-in-one) fires left.
+#define TRIPLE_FIRE 2		// The number of triple (three-in-one) fires left.
+#define DELAY 3					// The delay (in cycles or ticks) that must occur between firing actions.
+#define FIRED 4					// Ammo fired in this game.
+
+// Indexes into schedule[] (LW1000-LW1002)
+#define REMAINING_DELAY 0 // How many cycles/ticks remain before another firing action can occur.
+#define STEP_COUNT 1			// Steps in the schedule.
+#define NEXT_STEP 2				// The step fired next.
+
+#define SCHEDULE_ADDRESS 2000 // LW address of the first step
+#define AMMO_MACHINE_ADDRESS 10 // LW address of machine 1's overall ammo
+#define AMMO_GAME_ADDRESS 1200 // LW address of machine 1's game ammo
+#define LEGACY_AMMO_GAME_ADDRESS 100 // LW address of machine 1's game ammo on the screens
+#define LEGACY_SELECTION_ADDRESS 200 // LW address of machine 1's fire flag on the screens
 
 // Global variables representing machine states, ammo counts, and firing rules.
-short usableMachines[10] = {0}; // Stores flags indicating which machines are enabled (1) or not (0).
-short nextFires[10] = {0};			// Tracks which machines are chosen to fire in each cycle (1 = chosen, 0 = not chosen).
-short ammo_machine[10] = {0};		// Tracks the overall ammo available for each machine.
-short ammo_game[10] = {0};			// Tracks the game-specific ammo for each machine.
-short maxShootableAmmo;					// The maximum total ammo that can be fired before the game ends.
-short doubleFire;								// The number of double (two-in-one) fires allowed.
-short tripleFire;								// The number of triple (three-in-one) fires allowed.
-short delay = 0;								// The delay (in cycles or ticks) that must occur between firing actions.
-short remainingDelay = 0;				// How many cycles/ticks remain before another firing action can occur.
-short fired = 0;
+unsigned short enabledMask[MASK_WORDS] = {0};	// The enabled machines.
+unsigned short groupFireMask[MASK_WORDS] = {0};	// The machines chosen to fire in this cycle, for the broadcast group fire.
+short game[5] = {0};						// LW110-LW114, see the indexes above
+short schedule[3] = {0};				// LW1000-LW1002, see the indexes above
 const endWindowID = 12;
 
-/**
- * Function: reset_selected_machines
- * ---------------------------------
- * Sets all entries in nextFires to 0, indicating that no machines have been chosen
- * for firing in this cycle. This is called at the start of each macro cycle to ensure
- * a fresh selection.
- */
-void reset_selected_machines()
-{
-	short i;
-	for (i = 0; i < 10; i++)
-	{
-		nextFires[i] = 0;
-	}
-}
-
 /**
  * Function: delayer
  * -----------------
@@ -84,311 +109,230 @@ void reset_selected_machines()
  */
 bool delayer()
 {
-	if (delay <= 0)
+	if (game[DELAY] <= 0)
 	{
 		// Negative or zero delay is treated as an error or invalid scenario.
 		return true;
 	}
 
-	if (remainingDelay == 0)
+	if (schedule[REMAINING_DELAY] == 0)
 	{
 		// No existing delay, so we reset the remainder delay to the 'delay' value
 		// and allow firing to proceed by returning false.
-		remainingDelay = delay;
+		schedule[REMAINING_DELAY] = game[DELAY];
 		return false;
 	}
 	else
 	{
 		// Delay is ongoing; reduce the remaining delay by one and prohibit firing this cycle.
-		remainingDelay--;
+		schedule[REMAINING_DELAY]--;
 		return true;
 	}
 }
 
 /**
- * Function: checkEndGame
- * ----------------------
- * Evaluates whether the current game has ended by checking if maxShootableAmmo has
- * dropped to 0 or below. If it has, all firing modes are set to zero, and the
- * ammo_game array is cleared.
+ * Function: clear_selection
+ * -------------------------
+ * Clears groupFireMask. Returns 1 if any machine was selected.
  */
-bool checkEndGame()
+int clear_selection()
 {
-	if (maxShootableAmmo <= 0)
+	short word;
+	int selected = 0;
+	for (word = 0; word < MASK_WORDS; word++)
 	{
-		// No more ammo can be fired, so disable double and triple fire modes.
-		doubleFire = 0;
-		tripleFire = 0;
-
-		// Clear the game-specific ammo for all machines.
-		short i;
-		for (i = 0; i < 10; i++)
-		{
-			ammo_game[i] = 0;
-		}
-		return true;
+		if (groupFireMask[word] != 0)
+			selected = 1;
+		groupFireMask[word] = 0;
 	}
-	return false;
+	return selected;
 }
 
 /**
- * Function: select_mode
- * ---------------------
- * Randomly selects whether the next fire should be single, double, or triple. This is determined
- * by comparing a random value with weighted probabilities (based on the remaining number of
- * single, double, or triple fires allowed).
- *
- * Returns:
- *   - 1 for a single fire,
- *   - 2 for a double fire,
- *   - 3 for a triple fire,
- *   - 0 in case no firing mode is available (e.g., zero or negative ammo).
- *
- * Explanation:
- *  - We calculate simpleFire as maxShootableAmmo minus the ammo needed for all potential double and triple fires.
- *  - We create weights based on how many single, double, and triple fires remain feasible.
- *  - We then do a weighted random to decide which mode is chosen.
- *  - If the program cannot find a suitable mode after 100 attempts, it defaults to a single fire mode (returns 1).
+ * Function: write_selection
+ * -------------------------
+ * Writes groupFireMask to LW210-, and with LEGACY_REGISTERS as flags to LW200-LW209.
  */
-short select_mode()
+void write_selection()
 {
-	// Calculate how many single-fires can still occur if we commit to using all double/triple fires.
-	short simpleFire = maxShootableAmmo - doubleFire * 2 - tripleFire * 3;
-
-	// Track the current amount of ammo that can still be fired in total.
-	short remainingAmmo = maxShootableAmmo;
-
-	// These arrays help us quickly handle weighting logic for the random selection.
-	short availableModes[3] = {1, 2, 3};
-	short weights[3] = {simpleFire, doubleFire * 2, tripleFire * 3};
-
-	// If there's not enough ammo to proceed, return 0.
-	if (remainingAmmo <= 0)
-		return 0;
-
-	short unable_to_resolve = 0;
-
-	while (1)
+#if LEGACY_REGISTERS
+	short flags[MACHINES];
+	short machine;
+	for (machine = 0; machine < MACHINES; machine++)
 	{
-		// Weighted random - pick a number within the sum of all weights.
-		short choice = rand() % (weights[0] + weights[1] + weights[2]);
-
-		// If the random "choice" falls in the range for single fires
-		if (choice < weights[0] && remainingAmmo >= 1)
-		{
-			return 1; // Single fire
-		}
-		// If it falls in the range for double fires
-		else if (choice < weights[0] + weights[1] && remainingAmmo >= 2 && doubleFire > 0)
-		{
-			return 2; // Double fire
-		}
-		// Otherwise, it must be in the triple-fire range
-		else if (choice < weights[0] + weights[1] + weights[2] && remainingAmmo >= 3 && tripleFire > 0)
-		{
-			return 3; // Triple fire
-		}
-		else
-		{
-			// If we cannot determine the mode, increment the fail counter.
-			unable_to_resolve++;
-			if (unable_to_resolve > 100)
-			{
-				// If this keeps failing, default to a single fire.
-				return 1;
-			}
-		}
+		flags[machine] = (groupFireMask[0] >> machine) & 1;
 	}
+	WriteLocal("LW", LEGACY_SELECTION_ADDRESS, MACHINES, (void *)flags, 0);
+#endif
+	WriteLocal("LW", 210, MASK_WORDS, (void *)groupFireMask, 0);
 }
 
 /**
- * Function: weighted_random_selection
- * -----------------------------------
- * Chooses one machine to fire based on its weighted probability. Machines with higher game ammo
- * have a higher chance of being selected.
- *
- * Returns:
- *   - The index of the chosen machine (0-9), or
- *   - -1 if no machines have any ammo available for firing.
- *
- * Explanation:
- *  - We first sum the ammo_game values for all machines that are enabled.
- *  - A random value is chosen within 0 and total_weight - 1.
- *  - We then walk through enabled machines summing up their ammo_game counts until
- *    we exceed the random value, indicating that machine was chosen.
+ * Function: read_enabled
+ * ----------------------
+ * Reads the enabled machines into enabledMask, from the flags in LW0-LW9 with
+ * LEGACY_REGISTERS.
  */
-short weighted_random_selection()
+void read_enabled()
 {
-	int total_weight = 0;			 // Sum of all enabled machines' ammo counts
-	int cumulative_weight = 0; // Running tally used to compare against random_value
-	int random_value;
-	short i;
-
-	// Calculate the total weight for all enabled machines.
-	for (i = 0; i < 10; i++)
+#if LEGACY_REGISTERS
+	short flags[MACHINES];
+	short machine;
+	ReadLocal("LW", 0, MACHINES, (void *)flags, 0);
+	enabledMask[0] = 0;
+	for (machine = 0; machine < MACHINES; machine++)
 	{
-		if (usableMachines[i] && ammo_game[i] > 0)
-		{
-			total_weight += ammo_game[i];
-		}
+		if (flags[machine])
+			enabledMask[0] |= 1 << machine;
 	}
+#else
+	ReadLocal("LW", 0, MASK_WORDS, (void *)enabledMask, 0);
+#endif
+}
 
-	// If no machine has ammo, return -1.
-	if (total_weight == 0)
-		return -1;
-
-	// Choose a random value in the inclusive range [0, total_weight-1].
-	random_value = rand() % total_weight;
+/**
+ * Function: add_ammo
+ * ------------------
+ * Adds 'change' to the ammo word at LW 'address' and returns the new value.
+ */
+short add_ammo(short address, short change)
+{
+	short ammo;
+	ReadLocal("LW", address, 1, (void *)&ammo, 0);
+	ammo += change;
+	WriteLocal("LW", address, 1, (void *)&ammo, 0);
+	return ammo;
+}
 
-	for (i = 0; i < 10; i++)
-	{
-		if (usableMachines[i] && ammo_game[i] > 0)
-		{
-			// Accumulate weights until we surpass the random_value.
-			cumulative_weight += ammo_game[i];
-			if (random_value < cumulative_weight)
-			{
-				return i; // This machine is selected.
-			}
-		}
-	}
-	// In a normal scenario, we won't reach here, but return -1 if no selection is made.
-	return -1;
+/**
+ * Function: end_game
+ * ------------------
+ * Called once the schedule is used up or maxShootableAmmo has dropped to 0 or below
+ * (e.g. by force_endgame.c). All firing modes are set to zero, the game-specific ammo is
+ * cleared and the end window is opened.
+ */
+void end_game()
+{
+	short zero[MACHINES] = {0};
+
+	game[MAX_SHOOTABLE] = 0;
+	game[DOUBLE_FIRE] = 0;
+	game[TRIPLE_FIRE] = 0;
+
+	WriteLocal("LW", AMMO_GAME_ADDRESS, MACHINES, (void *)zero, 0);
+#if LEGACY_REGISTERS
+	WriteLocal("LW", LEGACY_AMMO_GAME_ADDRESS, MACHINES, (void *)zero, 0);
+#endif
+	WriteLocal("LW", 110, 5, (void *)game, 0);
+	WriteLocal("LW", 400, 1, (void *)zero, 0);
+	clear_selection();
+	write_selection();
+	WriteLocal("LW", 500, 1, (void *)&endWindowID, 0);
 }
 
 /**
- * Function: process_fire
- * ----------------------
- * Executes the actual firing on one or more machines. The number of machines to fire
- * is indicated by 'count'. This can be 1 (single fire), 2 (double), or 3 (triple).
+ * Function: fire_step
+ * -------------------
+ * Fires the machines of one schedule step.
  *
  * Parameters:
- *   - count: How many machines should fire this cycle (1, 2, or 3).
+ *   - mask: the scheduled machines.
  *
  * Explanation:
- *  - We call weighted_random_selection() 'count' times to pick distinct machines.
- *  - Each selected machine's ammo is decremented (both overall and game-specific).
- *  - The machine is flagged in nextFires and then disabled for subsequent picks
- *    within the same cycle to avoid picking it multiple times.
- *  - Depending on 'count', we decrement the appropriate doubleFire or tripleFire counters.
- *  - If the selection fails, we simply do not pick a machine (indicated by -1).
+ *  - Every scheduled machine uses up one of its game ammo, and the step counts against
+ *    maxShootableAmmo and the double/triple fires, so the rest of the schedule still adds up.
+ *  - Only enabled machines are actually fired and lose overall ammo.
  */
-void process_fire(int count)
+void fire_step(unsigned short *mask)
 {
-	short i, selected;
-	for (i = 0; i < count; i++)
-	{
-		selected = weighted_random_selection();
-		if (selected != -1)
-		{
-			// Reduce ammo for overall and game-specific tracking
-			ammo_machine[selected]--;
-			ammo_game[selected]--;
-
-			// Reduce total available shoots
-			maxShootableAmmo--;
+	short word, bit, machine, ammo;
+	short scheduled = 0;
 
-			// Mark the chosen machine for firing
-			nextFires[selected] = 1;
+	read_enabled();
 
-			// Disable the machine so it won't be chosen again in this cycle
-			usableMachines[selected] = 0;
-
-			fired++;
-		}
-		else
+	clear_selection();
+	for (word = 0; word < MASK_WORDS; word++)
+	{
+		for (bit = 0; mask[word] >> bit; bit++)
 		{
-			// If we fail to pick a machine, we can log or handle an error scenario
-			// but for simplicity, we do nothing.
+			if (!(mask[word] & (1 << bit)))
+				continue;
+
+			machine = word * 16 + bit;
+			scheduled++;
+			ammo = add_ammo(AMMO_GAME_ADDRESS + machine, -1);
+#if LEGACY_REGISTERS
+			WriteLocal("LW", LEGACY_AMMO_GAME_ADDRESS + machine, 1, (void *)&ammo, 0);
+#endif
+			if (enabledMask[word] & (1 << bit))
+			{
+				add_ammo(AMMO_MACHINE_ADDRESS + machine, -1);
+				groupFireMask[word] |= 1 << bit;
+				game[FIRED]++;
+			}
 		}
 	}
 
-	// Adjust the count of double/triple fires allowed if used in this cycle.
-	switch (count)
+	game[MAX_SHOOTABLE] -= scheduled;
+	if (scheduled == 2)
+	{
+		game[DOUBLE_FIRE]--;
+	}
+	else if (scheduled == 3)
 	{
-	case 1:
-		// Single fire, no double or triple counters to decrement
-		break;
-	case 2:
-		// Double fire used
-		doubleFire--;
-		break;
-	case 3:
-		// Triple fire used
-		tripleFire--;
-		break;
+		game[TRIPLE_FIRE]--;
 	}
+
+	WriteLocal("LW", 110, 5, (void *)game, 0);
+	write_selection();
 }
 
 /**
  * Function: MacroEntry
  * --------------------
  * This is the main macro entry point. It performs the following steps:
- *   1. Initializes the random number generator.
- *   2. Reads the necessary inputs (machine states, ammo values, firing rules, etc.).
- *   3. Resets the nextFires state to ensure a fresh cycle.
- *   4. Checks and handles delay logic.
- *   5. If firing is allowed (no delay), determines how many machines will fire and processes it.
- *   6. Checks whether the game has ended or if more firings can proceed.
- *   7. Writes back all updated outputs (changed ammo values, nextFires state, etc.).
+ *   1. Reads the game counters, the delay state and the schedule position.
+ *   2. Clears the displayed selection half way through the delay.
+ *   3. Checks and handles delay logic.
+ *   4. If firing is allowed (no delay), fires the next step, or ends the game when none is left.
+ *   5. Writes back the delay state and the schedule position.
+ *
+ * Ammo registers are only read and written in cycles that fire, and only those of the
+ * machines that fire.
  *
  * Returns:
  *   - 0 to indicate successful execution.
  */
 int MacroEntry()
 {
-	// Seed the random number generator once per macro call with the current time.
-	srand(time(NULL));
+	unsigned short mask[MASK_WORDS];
 
-	// Read in the inputs for configuring the firing logic and ammo tracking.
-	ReadLocal("LW", 0, 10, (void *)usableMachines, 0);
-	ReadLocal("LW", 10, 10, (void *)ammo_machine, 0);
-	ReadLocal("LW", 100, 10, (void *)ammo_game, 0);
-	ReadLocal("LW", 110, 1, (void *)&maxShootableAmmo, 0);
-	ReadLocal("LW", 111, 1, (void *)&doubleFire, 0);
-	ReadLocal("LW", 112, 1, (void *)&tripleFire, 0);
-	ReadLocal("LW", 113, 1, (void *)&delay, 0);
-	ReadLocal("LW", 114, 1, (void *)&fired, 0);
-	ReadLocal("LW", 200, 10, (void *)nextFires, 0);
-	ReadLocal("LW", 1000, 1, (void *)&remainingDelay, 0);
+	ReadLocal("LW", 110, 5, (void *)game, 0);
+	ReadLocal("LW", 210, MASK_WORDS, (void *)groupFireMask, 0);
+	ReadLocal("LW", 1000, 3, (void *)schedule, 0);
 
-	// Ensure no machines are marked as "firing" at the start of this macro cycle.
-	if (remainingDelay < delay / 2) {
-		reset_selected_machines();
+	// The selection of the last fire is shown for the first half of the delay.
+	if (schedule[REMAINING_DELAY] < game[DELAY] / 2 && clear_selection())
+	{
+		write_selection();
 	}
 
 	// If delayer() returns false, no delay is preventing firing, so we can proceed.
 	if (!delayer())
 	{
-		// If we've used up all ammo, end the game by resetting relevant counters, etc.
-		if (checkEndGame()) {
-			short zero = 0;	
-			WriteLocal("LW", 400, 1, (void *)&zero, 0);
-			short i;
-			for (i = 0; i < 10; i++)
-			{
-				nextFires[i] = 0;
-			}
-			WriteLocal("LW", 500, 1, (void *)&endWindowID, 0);
+		if (game[MAX_SHOOTABLE] <= 0 || schedule[NEXT_STEP] >= schedule[STEP_COUNT])
+		{
+			end_game();
 		}
-		else{
-			// Decide how many machines should fire in this cycle (1, 2, or 3).
-			process_fire(select_mode());
+		else
+		{
+			ReadLocal("LW", SCHEDULE_ADDRESS + schedule[NEXT_STEP] * MASK_WORDS, MASK_WORDS, (void *)mask, 0);
+			schedule[NEXT_STEP]++;
+			fire_step(mask);
 		}
 	}
 
-	// Write back the updated states for both the overall ammo and the game-specific ammo.
-	WriteLocal("LW", 10, 10, (void *)ammo_machine, 0);
-	WriteLocal("LW", 100, 10, (void *)ammo_game, 0);
-	WriteLocal("LW", 110, 1, (void *)&maxShootableAmmo, 0);
-	WriteLocal("LW", 111, 1, (void *)&doubleFire, 0);
-	WriteLocal("LW", 112, 1, (void *)&tripleFire, 0);
-	WriteLocal("LW", 114, 1, (void *)&fired, 0);
-
-	// Write which machines were chosen (nextFires array) to LW200-LW209,
-	// and also update the remaining delay.
-	WriteLocal("LW", 200, 10, (void *)nextFires, 0);
-	WriteLocal("LW", 1000, 1, (void *)&remainingDelay, 0);
+	WriteLocal("LW", 1000, 3, (void *)schedule, 0);
 
 	// Return 0 indicating successful execution of the macro.
 	return 0;
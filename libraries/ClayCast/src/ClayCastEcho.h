@@ -0,0 +1,81 @@
+/*
+ * ClayCast echo test protocol
+ *
+ * Used by the controller's test mode and test/test.ino to measure the radio
+ * link: the controller sends echo requests, the test client reflects them
+ * with the type changed to ECHO_REPLY and everything else unchanged.
+ *
+ * Echo payload (inside a standard frame, see ClayCastFrame.h):
+ *
+ * +--------------------+---------+-------------------------------------+
+ * | Field              | Size    | Description                         |
+ * +--------------------+---------+-------------------------------------+
+ * | Magic (0xEC)       | 1 Byte  | Echo frame marker                   |
+ * | Type               | 1 Byte  | ECHO_REQUEST or ECHO_REPLY          |
+ * | Sequence number    | 2 Bytes | Per request, big-endian             |
+ * | Timestamp          | 4 Bytes | Sender micros(), reflected as is    |
+ * | Fill               | X Bytes | (sequence + offset) & 0xFF          |
+ * +--------------------+---------+-------------------------------------+
+ *
+ * The fill pattern lets the sender tell a damaged reply, which slipped past
+ * the additive frame checksum, from a good one. Echo frames fail the Modbus
+ * CRC check, so Modbus clients on the same channel ignore them.
+ *
+ * Plain C++ only (no Arduino.h), so it builds for AVR and natively.
+ */
+
+#ifndef CLAYCAST_ECHO_H
+#define CLAYCAST_ECHO_H
+
+#include <stdint.h>
+#include "ClayCastFrame.h"
+
+#define ECHO_MAGIC 0xEC
+#define ECHO_REQUEST 0x01
+#define ECHO_REPLY 0x02
+#define ECHO_HEADER_SIZE 8 // Magic + type + sequence + timestamp
+
+// Fill byte at a payload offset
+inline uint8_t echoFill(uint16_t sequence, uint16_t offset) {
+  return (sequence + offset) & 0xFF;
+}
+
+// Byte at a payload offset of an echo frame; header holds the first
+// ECHO_HEADER_SIZE bytes (see echoHeader)
+inline uint8_t echoByte(const uint8_t * header, uint16_t sequence, uint16_t offset) {
+  return offset < ECHO_HEADER_SIZE ? header[offset] : echoFill(sequence, offset);
+}
+
+inline void echoHeader(uint8_t * header, uint8_t type, uint16_t sequence, uint32_t timestamp) {
+  header[0] = ECHO_MAGIC;
+  header[1] = type;
+  header[2] = sequence >> 8;
+  header[3] = sequence & 0xFF;
+  header[4] = timestamp >> 24;
+  header[5] = (timestamp >> 16) & 0xFF;
+  header[6] = (timestamp >> 8) & 0xFF;
+  header[7] = timestamp & 0xFF;
+}
+
+inline bool isEchoFrame(const FramePayload & payload, uint8_t type) {
+  return payload.size >= ECHO_HEADER_SIZE && payload.data[0] == ECHO_MAGIC && payload.data[1] == type;
+}
+
+inline uint16_t echoSequence(const uint8_t * data) {
+  return (data[2] << 8) | data[3];
+}
+
+inline uint32_t echoTimestamp(const uint8_t * data) {
+  return ((uint32_t) data[4] << 24) | ((uint32_t) data[5] << 16) | ((uint32_t) data[6] << 8) | data[7];
+}
+
+// True if every fill byte of a received echo frame is as sent
+inline bool echoFillIntact(const FramePayload & payload) {
+  uint16_t sequence = echoSequence(payload.data);
+  for (uint16_t i = ECHO_HEADER_SIZE; i < payload.size; i++) {
+    if (payload.data[i] != echoFill(sequence, i)) return false;
+  }
+  return true;
+}
+
+#endif
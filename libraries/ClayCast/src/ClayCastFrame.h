@@ -0,0 +1,529 @@
+/*
+ * ClayCast radio frame encapsulation
+ *
+ * +--------------------+---------+----------------------+
+ * | Field              | Size    | Description          |
+ * +--------------------+---------+----------------------+
+ * | Start byte (0xAA)  | 1 Byte  | Packet start byte    |
+ * | Data size          | 2 Bytes | Data size            |
+ * | Data               | X Bytes | Modbus RTU package   |
+ * | Checksum           | 2 Bytes | Size + Data checksum |
+ * | End byte (0x55)    | 1 Byte  | Packet end byte      |
+ * +--------------------+---------+----------------------+
+ *
+ * Compact format (Modbus payloads only):
+ *
+ * +--------------------+---------+----------------------+
+ * | Start byte (0xA5)  | 1 Byte  | Compact start byte   |
+ * | Data size          | 1 Byte  | Data size (4-255)    |
+ * | Data               | X Bytes | Modbus RTU package   |
+ * +--------------------+---------+----------------------+
+ *
+ * The compact frame carries no checksum or end byte of its own; it is only
+ * accepted when the Modbus CRC at the end of the data is valid. An 8 byte
+ * request takes 10 bytes on air instead of 14. Receivers accept both formats,
+ * so nodes can be switched over one by one.
+ *
+ * Sequenced format (Modbus payloads only):
+ *
+ * +--------------------+---------+----------------------+
+ * | Start byte (0xA6)  | 1 Byte  | Sequenced start byte |
+ * | Sequence number    | 1 Byte  | Link sequence number |
+ * | Data size          | 1 Byte  | Data size (4-255)    |
+ * | Data               | X Bytes | Modbus RTU package   |
+ * +--------------------+---------+----------------------+
+ *
+ * A compact frame with a link sequence number: the controller numbers every
+ * request and retransmits it under the same number, and a client answers in
+ * kind with the number of the request, so a retransmit is told apart from a
+ * new request and a late answer from the current one.
+ *
+ * FEC format (Modbus payloads only, see ClayCastFec.h):
+ *
+ * +--------------------+---------+----------------------------------+
+ * | Start byte (0xA7)  | 1 Byte  | FEC start byte                   |
+ * | Data size          | 1 Byte  | Data size (4-FEC_MAX_DATA_SIZE)  |
+ * | Sequence number    | 1 Byte  | Link sequence number             |
+ * | Header parity      | 2 Bytes | Corrects one of size, sequence   |
+ * | Data blocks        | X Bytes | FEC_BLOCK_DATA bytes of the      |
+ * |                    |         | Modbus RTU package + 2 parity    |
+ * +--------------------+---------+----------------------------------+
+ *
+ * A sequenced frame that survives one wrong byte in its header and in each
+ * data block (the last one may be shorter): the parity corrects it, and the
+ * Modbus CRC is checked after the correction. It costs 2 bytes per 16 data
+ * bytes plus 2 over the sequenced format.
+ *
+ * Frames are wrapped and unwrapped in place. The payload always lives at
+ * FRAME_HEADER_SIZE inside the caller's buffer, so a node needs a single
+ * FRAME_BUFFER_SIZE buffer and never copies the payload around.
+ *
+ * FrameParser assembles frames byte by byte and hands them on the moment
+ * the last byte arrives, so no idle timeout is needed to find the frame end.
+ *
+ * Plain C++ only (no Arduino.h), so it builds for AVR and natively.
+ */
+
+#ifndef CLAYCAST_FRAME_H
+#define CLAYCAST_FRAME_H
+
+#include <stdint.h>
+#include <string.h>
+#include "ClayCastModbus.h"
+#include "ClayCastFec.h"
+
+#define START_BYTE 0xAA
+#define END_BYTE 0x55
+#define MAX_DATA_SIZE 260
+
+#define COMPACT_START_BYTE 0xA5
+#define COMPACT_MIN_DATA_SIZE 4 // Address + function + CRC
+#define COMPACT_MAX_DATA_SIZE 255
+#define COMPACT_FRAME_OFFSET 1 // Compact frames start one byte into the buffer
+
+#define SEQUENCED_START_BYTE 0xA6
+
+#define FEC_START_BYTE 0xA7
+#define FEC_HEADER_SIZE 5 // Start byte + size + sequence + parity
+#define FEC_BLOCK_DATA 16 // Data bytes per parity block
+#define FEC_MAX_DATA_SIZE 230 // Largest payload whose FEC frame fits FRAME_BUFFER_SIZE
+
+#define FRAME_HEADER_SIZE 3 // Start byte + data size
+#define FRAME_TRAILER_SIZE 3 // Checksum + end byte
+#define FRAME_OVERHEAD (FRAME_HEADER_SIZE + FRAME_TRAILER_SIZE)
+#define FRAME_BUFFER_SIZE (MAX_DATA_SIZE + FRAME_OVERHEAD)
+
+// View of the payload inside a frame buffer (points into the buffer, no copy)
+struct FramePayload {
+  uint8_t * data;
+  uint16_t size;
+};
+
+// Where the payload starts inside a frame buffer
+inline uint8_t * framePayload(uint8_t * frame) {
+  return frame + FRAME_HEADER_SIZE;
+}
+
+// Additive checksum over the size field and the payload
+inline uint16_t frameChecksum(const uint8_t * data, uint16_t dataSize) {
+  uint16_t checksum = (dataSize >> 8) + (dataSize & 0xFF);
+  for (uint16_t i = 0; i < dataSize; i++) checksum += data[i];
+  return checksum;
+}
+
+// Wrap the dataSize bytes already placed at framePayload(frame).
+// Returns the full frame length, or 0 if the payload is too large.
+inline uint16_t wrapModbusRTU(uint8_t * frame, uint16_t dataSize) {
+  if (dataSize > MAX_DATA_SIZE) return 0;
+
+  uint16_t checksum = frameChecksum(framePayload(frame), dataSize);
+
+  frame[0] = START_BYTE;
+  frame[1] = (dataSize >> 8) & 0xFF;
+  frame[2] = dataSize & 0xFF;
+
+  uint16_t index = FRAME_HEADER_SIZE + dataSize;
+  frame[index++] = (checksum >> 8) & 0xFF;
+  frame[index++] = checksum & 0xFF;
+  frame[index++] = END_BYTE;
+
+  return index;
+}
+
+// Wrap the Modbus frame already placed at framePayload(frame) in the compact
+// format. The frame starts at frame + COMPACT_FRAME_OFFSET. Returns its length,
+// or 0 if the payload does not fit.
+inline uint16_t wrapCompactFrame(uint8_t * frame, uint16_t dataSize) {
+  if (dataSize < COMPACT_MIN_DATA_SIZE || dataSize > COMPACT_MAX_DATA_SIZE) return 0;
+
+  frame[COMPACT_FRAME_OFFSET] = COMPACT_START_BYTE;
+  frame[COMPACT_FRAME_OFFSET + 1] = dataSize;
+  return dataSize + FRAME_HEADER_SIZE - COMPACT_FRAME_OFFSET;
+}
+
+// Wrap the Modbus frame already placed at framePayload(frame) in the sequenced
+// format (starts at frame). Returns its length, or 0 if the payload does not fit.
+inline uint16_t wrapSequencedFrame(uint8_t * frame, uint16_t dataSize, uint8_t sequence) {
+  if (dataSize < COMPACT_MIN_DATA_SIZE || dataSize > COMPACT_MAX_DATA_SIZE) return 0;
+
+  frame[0] = SEQUENCED_START_BYTE;
+  frame[1] = sequence;
+  frame[2] = dataSize;
+  return dataSize + FRAME_HEADER_SIZE;
+}
+
+// Length of the FEC frame of a dataSize byte payload
+inline uint16_t fecFrameSize(uint16_t dataSize) {
+  return FEC_HEADER_SIZE + dataSize + FEC_PARITY * ((dataSize + FEC_BLOCK_DATA - 1) / FEC_BLOCK_DATA);
+}
+
+// Wrap the Modbus frame already placed at framePayload(frame) in the FEC format
+// (starts at frame). Returns its length, or 0 if the payload does not fit.
+inline uint16_t wrapFecFrame(uint8_t * frame, uint16_t dataSize, uint8_t sequence) {
+  if (dataSize < COMPACT_MIN_DATA_SIZE || dataSize > FEC_MAX_DATA_SIZE) return 0;
+
+  // Spread the blocks out from the last one, making room for the parity
+  uint8_t blocks = (dataSize + FEC_BLOCK_DATA - 1) / FEC_BLOCK_DATA;
+  for (uint8_t block = blocks; block-- > 0;) {
+    uint16_t offset = block * FEC_BLOCK_DATA;
+    uint8_t size = dataSize - offset < FEC_BLOCK_DATA ? dataSize - offset : FEC_BLOCK_DATA;
+    uint8_t * to = frame + FEC_HEADER_SIZE + block * (FEC_BLOCK_DATA + FEC_PARITY);
+    memmove(to, framePayload(frame) + offset, size);
+    fecEncode(to, size);
+  }
+
+  frame[0] = FEC_START_BYTE;
+  frame[1] = dataSize;
+  frame[2] = sequence;
+  fecEncode(frame + 1, 2);
+  return fecFrameSize(dataSize);
+}
+
+// Check that the data blocks of a received FEC frame can be corrected and that
+// the Modbus CRC holds after the correction, without changing the frame.
+inline bool checkFecBlocks(const uint8_t * frame, uint16_t dataSize) {
+  uint16_t crc = MODBUS_CRC_INIT;
+  uint16_t receivedCRC = 0;
+  for (uint16_t offset = 0; offset < dataSize; offset += FEC_BLOCK_DATA) {
+    uint8_t size = dataSize - offset < FEC_BLOCK_DATA ? dataSize - offset : FEC_BLOCK_DATA;
+    uint8_t block[FEC_BLOCK_DATA + FEC_PARITY];
+    memcpy(block, frame + FEC_HEADER_SIZE + offset / FEC_BLOCK_DATA * (FEC_BLOCK_DATA + FEC_PARITY), size + FEC_PARITY);
+    if (fecDecode(block, size + FEC_PARITY) < 0) return false;
+    for (uint8_t i = 0; i < size; i++) {
+      if (offset + i < dataSize - 2) crc = modbusCRCUpdate(crc, block + i, 1);
+      else receivedCRC = (receivedCRC >> 8) | (block[i] << 8); // Low byte first
+    }
+  }
+  return crc == receivedCRC;
+}
+
+// Correct the data blocks of a received FEC frame and move the payload to
+// framePayload(frame). Returns the bytes corrected, or -1 if a block is beyond
+// repair.
+inline int16_t unwrapFecBlocks(uint8_t * frame, uint16_t dataSize) {
+  int16_t corrected = 0;
+  for (uint16_t offset = 0; offset < dataSize; offset += FEC_BLOCK_DATA) {
+    uint8_t size = dataSize - offset < FEC_BLOCK_DATA ? dataSize - offset : FEC_BLOCK_DATA;
+    uint8_t * from = frame + FEC_HEADER_SIZE + offset / FEC_BLOCK_DATA * (FEC_BLOCK_DATA + FEC_PARITY);
+    int8_t result = fecDecode(from, size + FEC_PARITY);
+    if (result < 0) return -1;
+    corrected += result;
+    memmove(framePayload(frame) + offset, from, size);
+  }
+  return corrected;
+}
+
+// Wrap in the standard or compact format. Returns the frame length, or 0 if it does not fit.
+inline uint16_t wrapFrame(uint8_t * frame, uint16_t dataSize, bool compact) {
+  return compact ? wrapCompactFrame(frame, dataSize) : wrapModbusRTU(frame, dataSize);
+}
+
+// First byte of a frame wrapped in the given format
+inline uint8_t * frameStart(uint8_t * frame, bool compact) {
+  return compact ? frame + COMPACT_FRAME_OFFSET : frame;
+}
+
+// Validate a received frame and point payloadOut at its data.
+inline bool unwrapModbusRTU(uint8_t * frame, uint16_t frameSize, FramePayload * payloadOut) {
+  if (frameSize < FRAME_OVERHEAD || frame[0] != START_BYTE || frame[frameSize - 1] != END_BYTE) return false;
+
+  uint16_t size = (frame[1] << 8) | frame[2];
+  if (size > MAX_DATA_SIZE || frameSize != size + FRAME_OVERHEAD) return false;
+
+  uint16_t checksum = frameChecksum(framePayload(frame), size);
+  uint16_t receivedChecksum = (frame[FRAME_HEADER_SIZE + size] << 8) | frame[FRAME_HEADER_SIZE + size + 1];
+  if (checksum != receivedChecksum) return false;
+
+  payloadOut->data = framePayload(frame);
+  payloadOut->size = size;
+  return true;
+}
+
+// Byte-wise frame parser working on a caller supplied FRAME_BUFFER_SIZE buffer.
+// Accepts all four frame formats. The size field and running checksum are checked
+// as the bytes arrive, and a frame is complete as soon as its last byte is
+// received. On bad data the bytes received after the false start byte are
+// scanned again for the next start byte, so a good frame following a broken
+// one is not lost. When the rescan completes a frame before its end, the bytes
+// behind it may hold the next frame: they stay in the buffer behind the frame
+// and are replayed ahead of the next byte fed (or by expire()). A caller that
+// builds its answer in place over them loses them; a checksum taken when they
+// were kept tells, so they are not replayed then.
+class FrameParser {
+public:
+  explicit FrameParser(uint8_t * frameBuffer) : buffer(frameBuffer), droppedCount(0), correctedCount(0) {
+    reset();
+  }
+
+  // Drop any partially received frame and the bytes kept behind the last one
+  void reset() {
+    state = WAIT_START;
+    start = 0;
+    index = 0;
+    tailStart = 0;
+    tailEnd = 0;
+  }
+
+  // True while a frame is being assembled or kept bytes wait for a replay
+  bool receiving() const {
+    return state != WAIT_START || tailEnd > tailStart;
+  }
+
+  // Feed one received byte. Returns true when a complete and valid frame is
+  // in the buffer; read it with payload() before feeding the next byte.
+  bool feed(uint8_t byteIn) {
+    if (tailEnd > tailStart) {
+      // Replay the kept bytes with this one behind them. They start after a
+      // frame of 6 bytes at least, so the move leaves room for it.
+      uint16_t count = tailEnd - tailStart;
+      memmove(buffer + COMPACT_FRAME_OFFSET, buffer + tailStart, count);
+      buffer[COMPACT_FRAME_OFFSET + count] = byteIn;
+      tailStart = 0;
+      tailEnd = 0;
+      return rescan(COMPACT_FRAME_OFFSET, COMPACT_FRAME_OFFSET + count + 1) == STEP_DONE;
+    }
+
+    uint8_t result = step(byteIn);
+    if (result == STEP_ERROR) result = resync();
+    return result == STEP_DONE;
+  }
+
+  // Fallback for a broken frame whose remaining bytes never arrive (call after
+  // the line was idle for a frame time). Rescans what was received so far and
+  // returns true if a complete frame was found in it. Candidates that are still
+  // incomplete are broken as well, so the scan goes on past them.
+  bool expire() {
+    while (receiving()) {
+      if (tailEnd > tailStart) {
+        uint16_t from = tailStart;
+        uint16_t end = tailEnd;
+        tailStart = 0;
+        tailEnd = 0;
+        if (rescan(from, end) == STEP_DONE) return true;
+      } else if (resync() == STEP_DONE) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Take the buffer over to build an answer in place of the last completed
+  // frame. The bytes kept behind that frame are given up, since the answer
+  // may cover them; without a claim they are replayed by the next feed().
+  void claim() {
+    if (tailEnd > tailStart) droppedCount++; // The kept candidate
+    tailStart = 0;
+    tailEnd = 0;
+  }
+
+  // View of the last completed frame's payload
+  FramePayload payload() const {
+    FramePayload view = {
+      framePayload(buffer),
+      size
+    };
+    return view;
+  }
+
+  // Length of the last completed frame including the wrapper
+  uint16_t frameSize() const {
+    return index - start;
+  }
+
+  // True if the last completed frame used the compact format
+  bool compact() const {
+    return start == COMPACT_FRAME_OFFSET;
+  }
+
+  // True if the last completed frame carries a sequence number (sequenced
+  // or FEC format)
+  bool sequenced() const {
+    return start == 0 && (buffer[0] == SEQUENCED_START_BYTE || buffer[0] == FEC_START_BYTE);
+  }
+
+  // True if the last completed frame used the FEC format
+  bool fec() const {
+    return start == 0 && buffer[0] == FEC_START_BYTE;
+  }
+
+  // Sequence number of the last completed frame (sequenced() frames only)
+  uint8_t sequence() const {
+    return buffer[1];
+  }
+
+  // Bytes corrected in FEC frames, wrapping at 65535. reset() keeps the count.
+  uint16_t corrected() const {
+    return correctedCount;
+  }
+
+  // Start byte candidates given up on (bad size, checksum, end byte or CRC,
+  // incomplete when expired, or kept behind a claimed frame), wrapping at 65535. reset() keeps the count.
+  uint16_t dropped() const {
+    return droppedCount;
+  }
+
+  void clearDropped() {
+    droppedCount = 0;
+  }
+
+private:
+  enum State : uint8_t {
+    WAIT_START,
+    SIZE_HIGH,
+    SIZE_LOW,
+    DATA,
+    CHECKSUM_HIGH,
+    CHECKSUM_LOW,
+    WAIT_END,
+    SEQUENCE,
+    COMPACT_SIZE,
+    COMPACT_DATA,
+    FEC_HEADER,
+    FEC_DATA
+  };
+
+  enum StepResult : uint8_t {
+    STEP_MORE,
+    STEP_DONE,
+    STEP_ERROR
+  };
+
+  uint8_t * buffer;
+  uint8_t state;
+  uint8_t start; // Buffer position of the start byte (0 or COMPACT_FRAME_OFFSET)
+  uint16_t index;
+  uint16_t size;
+  uint16_t checksum;
+  uint16_t tailStart; // Bytes kept behind the last frame: buffer[tailStart, tailEnd)
+  uint16_t tailEnd;
+  uint16_t droppedCount;
+  uint16_t correctedCount;
+
+  static bool isStartByte(uint8_t byteIn) {
+    return byteIn == START_BYTE || byteIn == COMPACT_START_BYTE || byteIn == SEQUENCED_START_BYTE || byteIn == FEC_START_BYTE;
+  }
+
+  // Advance the state machine by one byte. Every byte of a frame in progress
+  // is stored, so a failed frame can be rescanned by resync().
+  uint8_t step(uint8_t byteIn) {
+    if (state == WAIT_START) {
+      if (!isStartByte(byteIn)) return STEP_MORE;
+      start = byteIn == COMPACT_START_BYTE ? COMPACT_FRAME_OFFSET : 0;
+      index = start;
+    }
+    buffer[index++] = byteIn;
+
+    switch (state) {
+    case WAIT_START:
+      state = start == COMPACT_FRAME_OFFSET ? COMPACT_SIZE : byteIn == SEQUENCED_START_BYTE ? SEQUENCE :
+        byteIn == FEC_START_BYTE ? FEC_HEADER : SIZE_HIGH;
+      return STEP_MORE;
+    case SIZE_HIGH:
+      size = byteIn << 8;
+      state = SIZE_LOW;
+      return STEP_MORE;
+    case SIZE_LOW:
+      size |= byteIn;
+      if (size > MAX_DATA_SIZE) return STEP_ERROR;
+      checksum = (size >> 8) + (size & 0xFF);
+      state = size > 0 ? DATA : CHECKSUM_HIGH;
+      return STEP_MORE;
+    case DATA:
+      checksum += byteIn;
+      if (index == FRAME_HEADER_SIZE + size) state = CHECKSUM_HIGH;
+      return STEP_MORE;
+    case CHECKSUM_HIGH:
+      if (byteIn != (checksum >> 8)) return STEP_ERROR;
+      state = CHECKSUM_LOW;
+      return STEP_MORE;
+    case CHECKSUM_LOW:
+      if (byteIn != (checksum & 0xFF)) return STEP_ERROR;
+      state = WAIT_END;
+      return STEP_MORE;
+    case WAIT_END:
+      if (byteIn != END_BYTE) return STEP_ERROR;
+      state = WAIT_START;
+      return STEP_DONE;
+    case SEQUENCE:
+      state = COMPACT_SIZE;
+      return STEP_MORE;
+    case COMPACT_SIZE:
+      size = byteIn;
+      if (size < COMPACT_MIN_DATA_SIZE) return STEP_ERROR;
+      state = COMPACT_DATA;
+      return STEP_MORE;
+    case COMPACT_DATA:
+      if (index < FRAME_HEADER_SIZE + size) return STEP_MORE;
+      if (!modbusCheckCRC(framePayload(buffer), size)) return STEP_ERROR;
+      state = WAIT_START;
+      return STEP_DONE;
+    case FEC_HEADER: {
+      if (index < FEC_HEADER_SIZE) return STEP_MORE;
+      // Corrected in a copy: a failed candidate leaves the bytes as received for resync()
+      uint8_t header[2 + FEC_PARITY];
+      memcpy(header, buffer + 1, sizeof(header));
+      if (fecDecode(header, sizeof(header)) < 0) return STEP_ERROR;
+      size = header[0];
+      if (size < COMPACT_MIN_DATA_SIZE || size > FEC_MAX_DATA_SIZE) return STEP_ERROR;
+      state = FEC_DATA;
+      return STEP_MORE;
+    }
+    default: { // FEC_DATA
+      if (index < fecFrameSize(size)) return STEP_MORE;
+      if (!checkFecBlocks(buffer, size)) return STEP_ERROR;
+      correctedCount += fecDecode(buffer + 1, 2 + FEC_PARITY) + unwrapFecBlocks(buffer, size);
+      buffer[1] = buffer[2]; // Sequence where sequence() finds it
+      buffer[2] = size;
+      state = WAIT_START;
+      return STEP_DONE;
+    }
+    }
+  }
+
+  // Keep buffer[from, end) behind a frame completed by a rescan, from its
+  // first start byte on
+  void keep(uint16_t from, uint16_t end) {
+    while (from < end && !isStartByte(buffer[from])) from++;
+    tailStart = from;
+    tailEnd = end;
+  }
+
+  // Discard the current start byte and replay the received bytes from the next
+  // start byte candidate
+  uint8_t resync() {
+    droppedCount++; // The candidate at start
+    return rescan(start + 1, index);
+  }
+
+  // Replay buffer[from, end) from its first start byte on, giving up every
+  // candidate that fails. A frame completed during the replay is returned at
+  // once and the bytes behind it are kept for the next feed().
+  uint8_t rescan(uint16_t from, uint16_t end) {
+    while (true) {
+      while (from < end && !isStartByte(buffer[from])) from++;
+
+      state = WAIT_START;
+      if (from >= end) {
+        start = 0;
+        index = 0;
+        return STEP_MORE;
+      }
+
+      // Move the candidate to where its format expects the start byte
+      uint8_t candidateStart = buffer[from] == COMPACT_START_BYTE ? COMPACT_FRAME_OFFSET : 0;
+      uint16_t count = end - from;
+      memmove(buffer + candidateStart, buffer + from, count);
+      end = candidateStart + count;
+
+      uint8_t result = STEP_MORE;
+      uint16_t i = candidateStart;
+      while (i < end && result == STEP_MORE) result = step(buffer[i++]);
+      if (result == STEP_DONE) keep(i, end);
+      if (result != STEP_ERROR) return result;
+      droppedCount++;
+      from = start + 1;
+    }
+  }
+};
+
+#endif
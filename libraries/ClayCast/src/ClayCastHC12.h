@@ -0,0 +1,197 @@
+/*
+ * ClayCast HC-12 module configuration
+ *
+ * The module is configured with AT commands while its SET pin is held low.
+ * Every command is answered with "OK" followed by the command's argument
+ * (AT+C050 -> OK+C050, AT+B19200 -> OK+B19200), and the reply is checked
+ * before the change is considered done.
+ *
+ * The serial baud also selects the air rate, so modules only hear each other
+ * when they use the same baud and transmit mode (FU3, approximate air rate):
+ *   1200, 2400      ->   5000 bps
+ *   4800, 9600      ->  15000 bps
+ *   19200, 38400    ->  58000 bps
+ *   57600, 115200   -> 236000 bps
+ * A new baud takes effect when the module leaves command mode.
+ *
+ * Link rate negotiation: every node starts at HC12_DEFAULT_BAUD. The
+ * controller moves the network by broadcasting a write of baud / 100 to
+ * LINK_RATE_REGISTER (see ClayCastModbus.h) and switching its own module.
+ * A client that hears nothing for LINK_SILENCE_TIMEOUT at another rate falls
+ * back to HC12_DEFAULT_BAUD on its own, so a failed change never strands it.
+ */
+
+#ifndef CLAYCAST_HC12_H
+#define CLAYCAST_HC12_H
+
+#include <Arduino.h>
+#include <SoftwareSerial.h>
+#include <stdio.h>
+#include <string.h>
+
+#define HC12_DEFAULT_BAUD 9600 // Rate every node starts and falls back at
+#define HC12_TRANSMIT_MODE 3 // AT+FU3: all bauds, must match on every node
+#define HC12_MAX_SOFTWARE_SERIAL_BAUD 38400 // Highest rate SoftwareSerial receives reliably at 16 MHz
+
+#define HC12_ENTER_COMMAND_TIME 50 // SET low to first command (ms)
+#define HC12_EXIT_COMMAND_TIME 80 // SET high until transparent mode resumes (ms)
+#define HC12_REPLY_TIMEOUT 200 // Wait for the OK reply (ms)
+#define HC12_REPLY_SIZE 16
+
+#define LINK_SILENCE_TIMEOUT 5000 // Client falls back to HC12_DEFAULT_BAUD after this long without a frame (ms)
+
+// Radio ports: the clients can be split over several HC12 channels, each
+// served by its own controller board (its RADIO_PORT) on the shared RS485 bus,
+// so the boards poll their clients in parallel. RADIO_ROUTES gives the port of
+// slave addresses 1, 2, ...; addresses past its end are on port 0. The
+// controller boards and every client must be built with the same tables.
+#define RADIO_PORTS 1 // Controller boards, one HC12 channel each
+#define RADIO_CHANNELS {50, 60, 70, 80} // Channel of each port (1-100), far enough apart not to hear each other
+#define RADIO_ROUTES {0} // Port of slave addresses 1, 2, ..., e.g. {0, 0, 0, 0, 0, 1, 1, 1, 1, 1}
+
+static const uint8_t radioChannels[] = RADIO_CHANNELS;
+static const uint8_t radioRoutes[] = RADIO_ROUTES;
+
+static_assert(RADIO_PORTS >= 1 && sizeof(radioChannels) >= RADIO_PORTS, "RADIO_CHANNELS needs a channel for every radio port");
+
+// Radio port of a slave address; routes to a port that does not exist go to port 0
+inline uint8_t radioPort(uint8_t address) {
+  if (address < 1 || address > sizeof(radioRoutes)) return 0;
+  return radioRoutes[address - 1] < RADIO_PORTS ? radioRoutes[address - 1] : 0;
+}
+
+inline uint8_t radioChannel(uint8_t port) {
+  return radioChannels[port];
+}
+
+static const uint32_t hc12BaudRates[] = {1200, 2400, 4800, 9600, 19200, 38400, 57600, 115200};
+#define HC12_BAUD_RATE_COUNT (sizeof(hc12BaudRates) / sizeof(hc12BaudRates[0]))
+
+// True for the bauds the module supports in HC12_TRANSMIT_MODE that the
+// sketches can also receive with SoftwareSerial
+inline bool hc12UsableBaud(uint32_t baud) {
+  if (baud > HC12_MAX_SOFTWARE_SERIAL_BAUD) return false;
+  for (uint8_t i = 0; i < HC12_BAUD_RATE_COUNT; i++) {
+    if (hc12BaudRates[i] != baud) continue;
+    #if HC12_TRANSMIT_MODE == 2
+    return baud <= 4800;
+    #elif HC12_TRANSMIT_MODE == 4
+    return baud == 1200;
+    #else
+    return true;
+    #endif
+  }
+  return false;
+}
+
+class HC12Link {
+public:
+  HC12Link(SoftwareSerial & serialPort, uint8_t setPin) : port(serialPort), set(setPin), currentBaud(HC12_DEFAULT_BAUD) {
+    reply[0] = '\0';
+  }
+
+  void begin(uint32_t baud) {
+    pinMode(set, OUTPUT);
+    digitalWrite(set, HIGH); // Transparent mode
+    currentBaud = baud;
+    port.begin(baud);
+  }
+
+  uint32_t baud() const {
+    return currentBaud;
+  }
+
+  // Reply to the last command, for debug output
+  const char * lastReply() const {
+    return reply;
+  }
+
+  // Send one AT command and check that the module answered "OK" plus the
+  // command's argument. Radio data arriving meanwhile is discarded.
+  bool command(const char * cmd) {
+    digitalWrite(set, LOW); // Enter AT command mode
+    delay(HC12_ENTER_COMMAND_TIME);
+    while (port.available()) port.read();
+
+    port.print(cmd);
+    bool ok = readReply() && reply[0] == 'O' && reply[1] == 'K' && strcmp(reply + 2, cmd + 2) == 0;
+
+    digitalWrite(set, HIGH); // Back to transparent mode
+    delay(HC12_EXIT_COMMAND_TIME);
+    return ok;
+  }
+
+  bool ping() {
+    return command("AT");
+  }
+
+  bool setChannel(uint8_t channel) {
+    if (channel < 1 || channel > 100) return false; // Out of range
+
+    char cmd[8];
+    sprintf(cmd, "AT+C%03d", channel); // Format: AT+C005, AT+C100, etc.
+    return command(cmd);
+  }
+
+  bool setTransmitMode(uint8_t mode) {
+    char cmd[8];
+    sprintf(cmd, "AT+FU%u", mode);
+    return command(cmd);
+  }
+
+  // Change the module's baud (and with it the air rate) and follow it with
+  // the serial port. The port stays at the old rate if the module refused.
+  bool setBaud(uint32_t baud) {
+    if (!hc12UsableBaud(baud)) return false;
+    if (baud == currentBaud) return true;
+
+    char cmd[12];
+    sprintf(cmd, "AT+B%lu", (unsigned long) baud);
+    if (!command(cmd)) return false;
+
+    currentBaud = baud;
+    port.begin(baud);
+    return true;
+  }
+
+  // Find the rate the module is currently set to (it keeps it across resets)
+  // by pinging at the current and then every other usable rate. Leaves the
+  // port at the found rate and returns it, or returns 0 with the port back at
+  // the previous rate.
+  uint32_t detect() {
+    uint32_t previous = currentBaud;
+    if (ping()) return currentBaud;
+
+    for (uint8_t i = 0; i < HC12_BAUD_RATE_COUNT; i++) {
+      if (hc12BaudRates[i] == previous || !hc12UsableBaud(hc12BaudRates[i])) continue;
+      currentBaud = hc12BaudRates[i];
+      port.begin(currentBaud);
+      if (ping()) return currentBaud;
+    }
+    currentBaud = previous;
+    port.begin(previous);
+    return 0;
+  }
+
+private:
+  SoftwareSerial & port;
+  uint8_t set;
+  uint32_t currentBaud;
+  char reply[HC12_REPLY_SIZE];
+
+  // Read one reply line, without the trailing CR/LF
+  bool readReply() {
+    uint8_t length = 0;
+    uint32_t start = millis();
+    while (millis() - start < HC12_REPLY_TIMEOUT) {
+      if (!port.available()) continue;
+      char c = port.read();
+      if (c == '\n') break;
+      if (c != '\r' && length < HC12_REPLY_SIZE - 1) reply[length++] = c;
+    }
+    reply[length] = '\0';
+    return length > 0;
+  }
+};
+
+#endif
@@ -0,0 +1,274 @@
+/*
+ * ClayCast Modbus RTU helpers
+ *
+ * Frame boundary detection for the wired (RS485) Modbus RTU side:
+ * - the 3.5 character inter-frame gap derived from the baud rate
+ * - the expected length of a request, so a complete frame can be handed on
+ *   as soon as its CRC arrives instead of waiting for the gap
+ *
+ * Modbus CRC-16 behind a single API (modbusCRC / modbusCheckCRC /
+ * modbusAppendCRC). The kernel is chosen at compile time with MODBUS_CRC_IMPL
+ * (cycles per byte on the ATmega328p, tools/bench/crc/results.txt):
+ *   MODBUS_CRC_BITWISE : 8 shift/xor steps per byte, no table (137)
+ *   MODBUS_CRC_NIBBLE  : two lookups per byte in a 32 byte table (59)
+ *   MODBUS_CRC_TABLE   : one lookup per byte in a 512 byte table (30, default)
+ *   MODBUS_CRC_AVR     : avr-libc _crc16_update, hand written asm, AVR only (35)
+ * Tables live in PROGMEM on AVR. The table is the fastest, for 512 bytes of
+ * the 30 KB of flash; _crc16_update is the one to pick when flash runs short.
+ *
+ * Group fire: the master broadcasts (slave address 0, no reply) a write of a
+ * machine bitmask to GROUP_FIRE_REGISTER. Bit n of register
+ * GROUP_FIRE_REGISTER + k selects slave address 16 * k + n + 1, so every
+ * selected client fires from the same radio frame.
+ *
+ * Link rate: a broadcast write of baud / 100 to LINK_RATE_REGISTER moves every
+ * client's HC-12 module to that baud (see ClayCastHC12.h).
+ *
+ * Time sync: the controller broadcasts a write of its micros() to
+ * TIME_SYNC_REGISTER (two registers, high word first) every second or so,
+ * stamped with the moment the frame's last byte leaves it. Clients keep the
+ * offset and drift of their own clock against it.
+ *
+ * Scheduled fire: a broadcast write to FIRE_AT_REGISTER of a controller
+ * micros() (two registers) followed by a machine bitmask laid out like the
+ * group fire registers (FIRE_AT_MASK_REGISTER + k for slave addresses
+ * 16 * k + 1..16). The selected clients fire when their synced clock reaches
+ * that time, from a timer rather than the loop, so they fire together.
+ *
+ * Superframe (report by exception): a broadcast write to SUPERFRAME_REGISTER
+ * of SUPERFRAME_SLOT_TIME, SUPERFRAME_SLOTS, SUPERFRAME_HEARTBEAT and
+ * SUPERFRAME_REPORT_REGISTERS. Slave address n owns the slot starting
+ * n * slot time after the beacon; in it the client sends its registers
+ * 0..report registers - 1 as a 0x03 response nobody asked for, if one of
+ * them has changed since its last report or after heartbeat superframes
+ * without one. Only one client sends at a time, so reports never collide.
+ *
+ * Plain C++ only (no Arduino.h), so it builds for AVR and natively.
+ */
+
+#ifndef CLAYCAST_MODBUS_H
+#define CLAYCAST_MODBUS_H
+
+#include <stdint.h>
+
+#ifdef __AVR__
+#include <avr/pgmspace.h>
+#include <util/crc16.h>
+#define CLAYCAST_PROGMEM PROGMEM
+#define claycastReadWord(address) pgm_read_word(address)
+#else
+#define CLAYCAST_PROGMEM
+#define claycastReadWord(address) (*(address))
+#endif
+
+#define MODBUS_CRC_BITWISE 0
+#define MODBUS_CRC_NIBBLE 1
+#define MODBUS_CRC_TABLE 2
+#define MODBUS_CRC_AVR 3
+
+#ifndef MODBUS_CRC_IMPL
+#define MODBUS_CRC_IMPL MODBUS_CRC_TABLE
+#endif
+
+#if MODBUS_CRC_IMPL == MODBUS_CRC_AVR && !defined(__AVR__)
+#error "MODBUS_CRC_AVR needs avr-libc"
+#endif
+
+#define MODBUS_CHAR_BITS 11 // Start + 8 data + parity/stop + stop
+#define MODBUS_FIXED_GAP_BAUD 19200 // Above this the spec uses fixed timings
+#define MODBUS_FIXED_T35_MICROS 1750
+
+#define MODBUS_BROADCAST_ADDRESS 0
+
+#define GROUP_FIRE_REGISTER 0x0100 // Machines 1-16, next register 17-32, ...
+#define GROUP_FIRE_REGISTER_COUNT 4 // Up to 64 machines
+
+#define LINK_RATE_REGISTER 0x0110 // HC-12 baud / 100, broadcast only
+
+#define TIME_SYNC_REGISTER 0x0112 // Controller micros(), 2 registers, broadcast only
+#define FIRE_AT_REGISTER 0x0120 // Fire time in controller micros(), 2 registers, broadcast only
+#define FIRE_AT_MASK_REGISTER (FIRE_AT_REGISTER + 2) // Machine bitmask, as at GROUP_FIRE_REGISTER
+
+#define SUPERFRAME_REGISTER 0x0114 // Superframe beacon, broadcast only, registers:
+#define SUPERFRAME_SLOT_TIME 0 // Slot length (ms)
+#define SUPERFRAME_SLOTS 1 // Slots: slave addresses 1..SUPERFRAME_SLOTS
+#define SUPERFRAME_HEARTBEAT 2 // Superframes between reports of an unchanged client
+#define SUPERFRAME_REPORT_REGISTERS 3 // Registers reported, from 0
+#define SUPERFRAME_REGISTER_COUNT 4
+
+#define MODBUS_EXCEPTION_ILLEGAL_FUNCTION 0x01
+#define MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS 0x02
+#define MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE 0x03
+#define MODBUS_EXCEPTION_SLAVE_DEVICE_BUSY 0x06
+
+#define MODBUS_MAX_READ_QUANTITY 125 // Registers per 0x03 response
+
+#define MODBUS_FUNCTION_READ_COILS 0x01
+#define MODBUS_FUNCTION_READ_DISCRETE_INPUTS 0x02
+#define MODBUS_FUNCTION_READ_HOLDING_REGISTERS 0x03
+#define MODBUS_FUNCTION_READ_INPUT_REGISTERS 0x04
+#define MODBUS_FUNCTION_WRITE_SINGLE_COIL 0x05
+#define MODBUS_FUNCTION_WRITE_SINGLE_REGISTER 0x06
+#define MODBUS_FUNCTION_WRITE_MULTIPLE_COILS 0x0F
+#define MODBUS_FUNCTION_WRITE_MULTIPLE_REGISTERS 0x10
+#define MODBUS_FUNCTION_READ_WRITE_MULTIPLE_REGISTERS 0x17
+
+// Time of one character on the line in microseconds
+inline uint32_t modbusCharMicros(uint32_t baud) {
+  return (MODBUS_CHAR_BITS * 1000000UL + baud - 1) / baud;
+}
+
+// 3.5 character inter-frame gap (t3.5) in microseconds
+inline uint32_t modbusInterFrameMicros(uint32_t baud) {
+  if (baud > MODBUS_FIXED_GAP_BAUD) return MODBUS_FIXED_T35_MICROS;
+  return (MODBUS_CHAR_BITS * 3500000UL + baud - 1) / baud;
+}
+
+// Expected total length (CRC included) of the request whose first `received`
+// bytes are in `frame`. Returns 0 while the length is not yet known or for
+// function codes that can only be delimited by the inter-frame gap.
+inline uint16_t modbusRequestLength(const uint8_t * frame, uint16_t received) {
+  if (received < 2) return 0;
+
+  switch (frame[1]) {
+  case MODBUS_FUNCTION_READ_COILS:
+  case MODBUS_FUNCTION_READ_DISCRETE_INPUTS:
+  case MODBUS_FUNCTION_READ_HOLDING_REGISTERS:
+  case MODBUS_FUNCTION_READ_INPUT_REGISTERS:
+  case MODBUS_FUNCTION_WRITE_SINGLE_COIL:
+  case MODBUS_FUNCTION_WRITE_SINGLE_REGISTER:
+    return 8; // Address, function, 2x2 data bytes, CRC
+  case MODBUS_FUNCTION_WRITE_MULTIPLE_COILS:
+  case MODBUS_FUNCTION_WRITE_MULTIPLE_REGISTERS:
+    if (received < 7) return 0;
+    return 9 + frame[6]; // Header up to byte count, data, CRC
+  case MODBUS_FUNCTION_READ_WRITE_MULTIPLE_REGISTERS:
+    if (received < 11) return 0;
+    return 13 + frame[10];
+  default:
+    return 0;
+  }
+}
+
+#define MODBUS_CRC_INIT 0xFFFF
+#define MODBUS_CRC_POLY 0xA001 // Reflected 0x8005
+
+// Reference kernel, always available to compare the faster ones against
+inline uint16_t modbusCRCBitwise(uint16_t crc, const uint8_t * data, uint16_t length) {
+  for (uint16_t i = 0; i < length; i++) {
+    crc ^= data[i];
+    for (uint8_t j = 0; j < 8; j++) {
+      if (crc & 1) {
+        crc = (crc >> 1) ^ MODBUS_CRC_POLY;
+      } else {
+        crc >>= 1;
+      }
+    }
+  }
+  return crc;
+}
+
+static const uint16_t modbusCrcNibbleTable[16] CLAYCAST_PROGMEM = {
+  0x0000, 0xCC01, 0xD801, 0x1400, 0xF001, 0x3C00, 0x2800, 0xE401,
+  0xA001, 0x6C00, 0x7800, 0xB401, 0x5000, 0x9C01, 0x8801, 0x4400
+};
+
+inline uint16_t modbusCRCNibble(uint16_t crc, const uint8_t * data, uint16_t length) {
+  for (uint16_t i = 0; i < length; i++) {
+    crc ^= data[i];
+    crc = (crc >> 4) ^ claycastReadWord(&modbusCrcNibbleTable[crc & 0x0F]);
+    crc = (crc >> 4) ^ claycastReadWord(&modbusCrcNibbleTable[crc & 0x0F]);
+  }
+  return crc;
+}
+
+static const uint16_t modbusCrcTable[256] CLAYCAST_PROGMEM = {
+  0x0000, 0xC0C1, 0xC181, 0x0140, 0xC301, 0x03C0, 0x0280, 0xC241,
+  0xC601, 0x06C0, 0x0780, 0xC741, 0x0500, 0xC5C1, 0xC481, 0x0440,
+  0xCC01, 0x0CC0, 0x0D80, 0xCD41, 0x0F00, 0xCFC1, 0xCE81, 0x0E40,
+  0x0A00, 0xCAC1, 0xCB81, 0x0B40, 0xC901, 0x09C0, 0x0880, 0xC841,
+  0xD801, 0x18C0, 0x1980, 0xD941, 0x1B00, 0xDBC1, 0xDA81, 0x1A40,
+  0x1E00, 0xDEC1, 0xDF81, 0x1F40, 0xDD01, 0x1DC0, 0x1C80, 0xDC41,
+  0x1400, 0xD4C1, 0xD581, 0x1540, 0xD701, 0x17C0, 0x1680, 0xD641,
+  0xD201, 0x12C0, 0x1380, 0xD341, 0x1100, 0xD1C1, 0xD081, 0x1040,
+  0xF001, 0x30C0, 0x3180, 0xF141, 0x3300, 0xF3C1, 0xF281, 0x3240,
+  0x3600, 0xF6C1, 0xF781, 0x3740, 0xF501, 0x35C0, 0x3480, 0xF441,
+  0x3C00, 0xFCC1, 0xFD81, 0x3D40, 0xFF01, 0x3FC0, 0x3E80, 0xFE41,
+  0xFA01, 0x3AC0, 0x3B80, 0xFB41, 0x3900, 0xF9C1, 0xF881, 0x3840,
+  0x2800, 0xE8C1, 0xE981, 0x2940, 0xEB01, 0x2BC0, 0x2A80, 0xEA41,
+  0xEE01, 0x2EC0, 0x2F80, 0xEF41, 0x2D00, 0xEDC1, 0xEC81, 0x2C40,
+  0xE401, 0x24C0, 0x2580, 0xE541, 0x2700, 0xE7C1, 0xE681, 0x2640,
+  0x2200, 0xE2C1, 0xE381, 0x2340, 0xE101, 0x21C0, 0x2080, 0xE041,
+  0xA001, 0x60C0, 0x6180, 0xA141, 0x6300, 0xA3C1, 0xA281, 0x6240,
+  0x6600, 0xA6C1, 0xA781, 0x6740, 0xA501, 0x65C0, 0x6480, 0xA441,
+  0x6C00, 0xACC1, 0xAD81, 0x6D40, 0xAF01, 0x6FC0, 0x6E80, 0xAE41,
+  0xAA01, 0x6AC0, 0x6B80, 0xAB41, 0x6900, 0xA9C1, 0xA881, 0x6840,
+  0x7800, 0xB8C1, 0xB981, 0x7940, 0xBB01, 0x7BC0, 0x7A80, 0xBA41,
+  0xBE01, 0x7EC0, 0x7F80, 0xBF41, 0x7D00, 0xBDC1, 0xBC81, 0x7C40,
+  0xB401, 0x74C0, 0x7580, 0xB541, 0x7700, 0xB7C1, 0xB681, 0x7640,
+  0x7200, 0xB2C1, 0xB381, 0x7340, 0xB101, 0x71C0, 0x7080, 0xB041,
+  0x5000, 0x90C1, 0x9181, 0x5140, 0x9301, 0x53C0, 0x5280, 0x9241,
+  0x9601, 0x56C0, 0x5780, 0x9741, 0x5500, 0x95C1, 0x9481, 0x5440,
+  0x9C01, 0x5CC0, 0x5D80, 0x9D41, 0x5F00, 0x9FC1, 0x9E81, 0x5E40,
+  0x5A00, 0x9AC1, 0x9B81, 0x5B40, 0x9901, 0x59C0, 0x5880, 0x9841,
+  0x8801, 0x48C0, 0x4980, 0x8941, 0x4B00, 0x8BC1, 0x8A81, 0x4A40,
+  0x4E00, 0x8EC1, 0x8F81, 0x4F40, 0x8D01, 0x4DC0, 0x4C80, 0x8C41,
+  0x4400, 0x84C1, 0x8581, 0x4540, 0x8701, 0x47C0, 0x4680, 0x8641,
+  0x8201, 0x42C0, 0x4380, 0x8341, 0x4100, 0x81C1, 0x8081, 0x4040
+};
+
+inline uint16_t modbusCRCTable(uint16_t crc, const uint8_t * data, uint16_t length) {
+  for (uint16_t i = 0; i < length; i++) {
+    crc = (crc >> 8) ^ claycastReadWord(&modbusCrcTable[(crc ^ data[i]) & 0xFF]);
+  }
+  return crc;
+}
+
+#ifdef __AVR__
+inline uint16_t modbusCRCAvr(uint16_t crc, const uint8_t * data, uint16_t length) {
+  for (uint16_t i = 0; i < length; i++) crc = _crc16_update(crc, data[i]);
+  return crc;
+}
+#endif
+
+// CRC-16/MODBUS continued over length more bytes
+inline uint16_t modbusCRCUpdate(uint16_t crc, const uint8_t * data, uint16_t length) {
+#if MODBUS_CRC_IMPL == MODBUS_CRC_BITWISE
+  return modbusCRCBitwise(crc, data, length);
+#elif MODBUS_CRC_IMPL == MODBUS_CRC_NIBBLE
+  return modbusCRCNibble(crc, data, length);
+#elif MODBUS_CRC_IMPL == MODBUS_CRC_AVR
+  return modbusCRCAvr(crc, data, length);
+#else
+  return modbusCRCTable(crc, data, length);
+#endif
+}
+
+// CRC-16/MODBUS of length bytes
+inline uint16_t modbusCRC(const uint8_t * data, uint16_t length) {
+  return modbusCRCUpdate(MODBUS_CRC_INIT, data, length);
+}
+
+// True if the last two bytes of a frame hold the CRC (low byte first) of the rest
+inline bool modbusCheckCRC(const uint8_t * frame, uint16_t length) {
+  if (length < 4) return false; // Address + function + CRC at least
+  uint16_t receivedCRC = (frame[length - 1] << 8) | frame[length - 2];
+  return modbusCRC(frame, length - 2) == receivedCRC;
+}
+
+// Append the CRC (low byte first) behind length bytes
+inline void modbusAppendCRC(uint8_t * frame, uint16_t length) {
+  uint16_t crc = modbusCRC(frame, length);
+  frame[length] = crc & 0xFF;
+  frame[length + 1] = crc >> 8;
+}
+
+// Turn a request into an exception response in place. Returns its length.
+inline uint16_t modbusExceptionResponse(uint8_t * frame, uint8_t exceptionCode) {
+  frame[1] |= 0x80; // Add error flag
+  frame[2] = exceptionCode;
+  modbusAppendCRC(frame, 3);
+  return 5;
+}
+
+#endif
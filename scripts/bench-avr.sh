@@ -0,0 +1,85 @@
+#!/bin/bash
+
+# Cycle counts of the client's hot paths on the ATmega328p, run under simavr
+# (tools/bench). Results go to bin/claycast-bench.txt, one "name key=value ..."
+# line per measurement, so two builds can be compared with diff.
+# Needs arduino-cli (as build-all.sh) and simavr; SIMAVR overrides the binary,
+# AVR_NM the avr-nm of the arduino-cli toolchain.
+
+FQBN="arduino:avr:nano:cpu=atmega328"
+PROJECT_DIR="$(dirname "$0")/../client"
+BENCH_DIR="$(dirname "$0")/../tools/bench"
+BIN_DIR="$(dirname "$0")/../bin"
+LIB_DIR="$(dirname "$0")/../libraries"
+SIMAVR="${SIMAVR:-simavr}"
+AVR_NM="${AVR_NM:-$(find "$HOME/.arduino15/packages/arduino/tools/avr-gcc" -name avr-nm -type f 2>/dev/null | head -n 1)}"
+SRAM_BYTES=2048
+OUTPUT_FILE="$BIN_DIR/claycast-bench.txt"
+
+mkdir -p "$BIN_DIR"
+TEMP_DIR=$(mktemp -d)
+
+fail() {
+    echo "$1"
+    rm -rf "$TEMP_DIR"
+    exit 1
+}
+
+# Step 1: Client as shipped, for its static RAM use
+echo "Building client..."
+mkdir "$TEMP_DIR/client"
+cp "$PROJECT_DIR/client.ino" "$TEMP_DIR/client/client.ino"
+CLIENT_LOG=$(arduino-cli compile --fqbn "$FQBN" --libraries "$LIB_DIR" "$TEMP_DIR/client") || fail "Client compilation failed"
+STATIC_BYTES=$(echo "$CLIENT_LOG" | sed -n 's/^Global variables use \([0-9]*\) bytes.*/\1/p')
+
+# Step 2: Benchmark with the client sketch compiled in (see client_under_test.cpp)
+echo "Building benchmark..."
+SKETCH_DIR="$TEMP_DIR/bench"
+mkdir "$SKETCH_DIR"
+cp "$BENCH_DIR"/*.ino "$BENCH_DIR"/*.cpp "$BENCH_DIR"/*.h "$SKETCH_DIR/"
+cp "$PROJECT_DIR/client.ino" "$SKETCH_DIR/client_sketch.h"
+
+# Prototypes for every top-level function definition, as the Arduino builder adds them
+grep -E '^[A-Za-z_][A-Za-z0-9_]*[ *]+[A-Za-z_][A-Za-z0-9_]* *\([^;]*\) *\{ *$' "$SKETCH_DIR/client_sketch.h" |
+    sed -E 's/ *\{ *$/;/' > "$SKETCH_DIR/client_sketch.proto.h"
+
+arduino-cli compile --fqbn "$FQBN" --libraries "$LIB_DIR" --output-dir "$TEMP_DIR/build" "$SKETCH_DIR" ||
+    fail "Benchmark compilation failed"
+
+ELF_FILE=$(find "$TEMP_DIR/build" -name "*.elf" | head -n 1)
+[ -n "$ELF_FILE" ] || fail "Error: No .elf file produced for the benchmark"
+
+# The client's Timer2 interrupts are defined inside namespace client; ISR()
+# declares them extern "C", so they must still be the vectors themselves and
+# not the weak __bad_interrupt defaults
+if [ -n "$AVR_NM" ]; then
+    for vector in __vector_7 __vector_8; do
+        "$AVR_NM" "$ELF_FILE" | grep -q " T $vector\$" || fail "Error: The client's $vector is missing from the benchmark"
+    done
+else
+    echo "avr-nm not found (set AVR_NM), interrupt vectors not checked"
+fi
+
+# Step 3: Run; simavr prints the UART output (with colour codes) and exits
+# when the benchmark sleeps with interrupts off
+echo "Running benchmark under simavr..."
+timeout 600 "$SIMAVR" -m atmega328p -f 16000000 "$ELF_FILE" > "$TEMP_DIR/run.log" 2>&1
+sed -e 's/\x1b\[[0-9;]*m//g' -e 's/\r//g' "$TEMP_DIR/run.log" > "$TEMP_DIR/uart.log"
+if ! grep -qx "done" "$TEMP_DIR/uart.log"; then
+    tail -n 20 "$TEMP_DIR/uart.log"
+    fail "Benchmark did not finish under simavr"
+fi
+
+# Measurement lines only; the client's debug output is interleaved
+grep -E '^[A-Za-z_]+( [a-z_]+=[^ ]+)+$' "$TEMP_DIR/uart.log" > "$OUTPUT_FILE"
+
+# SRAM left for the client as shipped: its static data plus the deepest stack
+# seen in the benchmark (which adds a few bytes of harness frames)
+PEAK_BYTES=$(sed -n 's/^stack peak_bytes=\([0-9]*\).*/\1/p' "$OUTPUT_FILE")
+if [ -n "$STATIC_BYTES" ] && [ -n "$PEAK_BYTES" ]; then
+    echo "sram total_bytes=$SRAM_BYTES static_bytes=$STATIC_BYTES stack_peak_bytes=$PEAK_BYTES free_bytes=$((SRAM_BYTES - STATIC_BYTES - PEAK_BYTES))" >> "$OUTPUT_FILE"
+fi
+
+rm -rf "$TEMP_DIR"
+cat "$OUTPUT_FILE"
+echo "Saved results to $OUTPUT_FILE"
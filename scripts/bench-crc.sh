@@ -0,0 +1,40 @@
+#!/bin/bash
+
+# Cycles per byte of the CRC-16 kernels of ClayCastModbus.h on the ATmega328p,
+# without avr-gcc or simavr: the kernels in tools/bench/crc/crc_kernels.ll are
+# compiled with LLVM's AVR backend and run on a cycle counting interpreter.
+# Results go to bin/claycast-crc.txt, one "name key=value ..." line per kernel.
+# Needs opt, llc and llvm-nm (LLVM 14 or later with the AVR target) and
+# python3; LLVM_BIN overrides the directory of the LLVM tools.
+
+CRC_DIR="$(dirname "$0")/../tools/bench/crc"
+BIN_DIR="$(dirname "$0")/../bin"
+LLVM_BIN="${LLVM_BIN:-$(dirname "$(command -v llc || echo /usr/lib/llvm-14/bin/llc)")}"
+OUTPUT_FILE="$BIN_DIR/claycast-crc.txt"
+
+mkdir -p "$BIN_DIR"
+TEMP_DIR=$(mktemp -d)
+
+fail() {
+    echo "$1"
+    rm -rf "$TEMP_DIR"
+    exit 1
+}
+
+# -Os without unrolling, as avr-gcc -Os leaves the bitwise kernel's inner loop
+echo "Compiling CRC kernels for the ATmega328p..."
+"$LLVM_BIN/opt" -Os -disable-loop-unrolling "$CRC_DIR/crc_kernels.ll" -S -o "$TEMP_DIR/kernels.ll" ||
+    fail "opt failed"
+"$LLVM_BIN/llc" -O2 -march=avr -mcpu=atmega328p "$TEMP_DIR/kernels.ll" -o "$TEMP_DIR/kernels.s" ||
+    fail "llc failed"
+"$LLVM_BIN/llc" -O2 -march=avr -mcpu=atmega328p -filetype=obj "$TEMP_DIR/kernels.ll" -o "$TEMP_DIR/kernels.o" ||
+    fail "llc failed"
+"$LLVM_BIN/llvm-nm" -S "$TEMP_DIR/kernels.o" > "$TEMP_DIR/sizes.txt" || fail "llvm-nm failed"
+
+echo "Running CRC kernels..."
+python3 "$CRC_DIR/avr_cycles.py" "$TEMP_DIR/kernels.s" "$TEMP_DIR/sizes.txt" > "$OUTPUT_FILE" ||
+    fail "CRC kernels failed: $(cat "$OUTPUT_FILE")"
+
+rm -rf "$TEMP_DIR"
+cat "$OUTPUT_FILE"
+echo "Saved results to $OUTPUT_FILE"
@@ -1,14 +1,19 @@
 #!/bin/bash
 
+# Build the client for every machine and a controller for every radio port.
+# Usage: build-all.sh [clients] (default 10, the HMI macros' MACHINES)
+
+CLIENTS="${1:-10}"
 FQBN="arduino:avr:nano:cpu=atmega328"
 PROJECT_DIR="$(dirname "$0")/../client"
 CONTROLLER_DIR="$(dirname "$0")/../controller"
 BIN_DIR="$(dirname "$0")/../bin"
+LIB_DIR="$(dirname "$0")/../libraries"
 
 mkdir -p "$BIN_DIR"
 
-# Step 1: Build client variants with MODBUS_ADDRESS 1–10
-for i in {1..10}; do
+# Step 1: Build client variants with MODBUS_ADDRESS 1–CLIENTS
+for i in $(seq 1 "$CLIENTS"); do
     echo "Building client for MODBUS_ADDRESS=$i..."
 
     TEMP_DIR=$(mktemp -d)
@@ -29,7 +34,7 @@ for i in {1..10}; do
     sed -i "s/#define MODBUS_ADDRESS .*/#define MODBUS_ADDRESS $i \/\/ Slave address/" "$TEMP_INO"
 
     # Compile
-    arduino-cli compile --fqbn "$FQBN" -e "$TEMP_DIR"
+    arduino-cli compile --fqbn "$FQBN" --libraries "$LIB_DIR" -e "$TEMP_DIR"
     if [ $? -ne 0 ]; then
         echo "Compilation failed for MODBUS_ADDRESS=$i"
         rm -rf "$TEMP_DIR"
@@ -50,39 +55,51 @@ for i in {1..10}; do
     rm -rf "$TEMP_DIR"
 done
 
-# Step 2: Build controller (no MODBUS_ADDRESS changes)
-echo "Building controller..."
+# Step 2: Build a controller for every radio port (RADIO_PORTS in the library)
+RADIO_PORTS=$(sed -n 's/^#define RADIO_PORTS \([0-9]*\).*/\1/p' "$LIB_DIR/ClayCast/src/ClayCastHC12.h")
 
-TEMP_DIR=$(mktemp -d)
-cp -r "$CONTROLLER_DIR/"* "$TEMP_DIR/"
+for port in $(seq 0 $((RADIO_PORTS - 1))); do
+    echo "Building controller for RADIO_PORT=$port..."
 
-ORIGINAL_INO=$(find "$TEMP_DIR" -maxdepth 1 -name "*.ino" | head -n 1)
-if [ -z "$ORIGINAL_INO" ]; then
-    echo "Error: No .ino file found in controller project!"
-    rm -rf "$TEMP_DIR"
-    exit 1
-fi
+    TEMP_DIR=$(mktemp -d)
+    cp -r "$CONTROLLER_DIR/"* "$TEMP_DIR/"
 
-TEMP_INO="$TEMP_DIR/$(basename "$TEMP_DIR").ino"
-mv "$ORIGINAL_INO" "$TEMP_INO"
+    ORIGINAL_INO=$(find "$TEMP_DIR" -maxdepth 1 -name "*.ino" | head -n 1)
+    if [ -z "$ORIGINAL_INO" ]; then
+        echo "Error: No .ino file found in controller project!"
+        rm -rf "$TEMP_DIR"
+        exit 1
+    fi
 
-arduino-cli compile --fqbn "$FQBN" -e "$TEMP_DIR"
-if [ $? -ne 0 ]; then
-    echo "Controller compilation failed"
-    rm -rf "$TEMP_DIR"
-    exit 1
-fi
+    TEMP_INO="$TEMP_DIR/$(basename "$TEMP_DIR").ino"
+    mv "$ORIGINAL_INO" "$TEMP_INO"
 
-HEX_FILE=$(find "$TEMP_DIR/build" -name "*.hex" | head -n 1)
-if [ -z "$HEX_FILE" ]; then
-    echo "Error: No .hex file produced for controller"
-    rm -rf "$TEMP_DIR"
-    exit 1
-fi
+    # Replace RADIO_PORT
+    sed -i "s/^#define RADIO_PORT .*/#define RADIO_PORT $port/" "$TEMP_INO"
 
-cp "$HEX_FILE" "$BIN_DIR/claycast-controller.hex"
-echo "Saved controller build to $BIN_DIR/claycast-controller.hex"
+    arduino-cli compile --fqbn "$FQBN" --libraries "$LIB_DIR" -e "$TEMP_DIR"
+    if [ $? -ne 0 ]; then
+        echo "Controller compilation failed for RADIO_PORT=$port"
+        rm -rf "$TEMP_DIR"
+        exit 1
+    fi
 
-rm -rf "$TEMP_DIR"
+    HEX_FILE=$(find "$TEMP_DIR/build" -name "*.hex" | head -n 1)
+    if [ -z "$HEX_FILE" ]; then
+        echo "Error: No .hex file produced for controller"
+        rm -rf "$TEMP_DIR"
+        exit 1
+    fi
+
+    # One port keeps the single controller's file name
+    OUTPUT_FILE="$BIN_DIR/claycast-controller.hex"
+    if [ "$RADIO_PORTS" -gt 1 ]; then
+        OUTPUT_FILE="$BIN_DIR/claycast-controller-$port.hex"
+    fi
+    cp "$HEX_FILE" "$OUTPUT_FILE"
+    echo "Saved controller build to $OUTPUT_FILE"
+
+    rm -rf "$TEMP_DIR"
+done
 
 echo "All builds completed."
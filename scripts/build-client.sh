@@ -15,7 +15,7 @@ echo "Compiling project in directory: $(pwd)"
 
 # Compile the project using arduino-cli and the FQBN specified.
 echo "Starting compilation..."
-arduino-cli compile --fqbn "$FQBN" -e .
+arduino-cli compile --fqbn "$FQBN" --libraries ../libraries -e .
 exit_code=$?
 
 # Handle error or success and keep terminal open.
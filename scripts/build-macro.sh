@@ -0,0 +1,56 @@
+#!/bin/bash
+
+# Build the HMI game macros (hmi/HMI0/macro) as shared objects and the harness
+# that runs them (tools/macro). With a git revision, the macros of that
+# revision are built into bin/macro/<revision> instead, for comparison:
+#   bin/claycast-macro --calc bin/macro/<revision>/calc.so --shooter bin/macro/<revision>/shooter.so
+# The register map depends on the number of machines; MACHINES (default 10,
+# up to 64) sets it for the macros and the harness alike, e.g.
+#   MACHINES=32 build-macro.sh
+# Up to 10 machines the macros also keep the per-machine words the DTool
+# screens use; LEGACY_REGISTERS=0 builds them with the bitmasks only.
+# A revision is only comparable if it has the same register map.
+# Usage: build-macro.sh [git revision]
+
+REVISION="$1"
+CC="${CC:-gcc}"
+CXX="${CXX:-g++}"
+MACHINES="${MACHINES:-10}"
+DEFINES="-DMACHINES=$MACHINES${LEGACY_REGISTERS:+ -DLEGACY_REGISTERS=$LEGACY_REGISTERS}"
+MACRO_DIR="$(dirname "$0")/../hmi/HMI0/macro"
+HARNESS_DIR="$(dirname "$0")/../tools/macro"
+BIN_DIR="$(dirname "$0")/../bin"
+OUTPUT_DIR="$BIN_DIR/macro${REVISION:+/$REVISION}"
+
+# DTool accepts pre-C99 C (implicit int); macrotypedef.h is the harness stand-in
+CFLAGS="-std=gnu89 -O2 -fPIC -shared -w $DEFINES -I$HARNESS_DIR"
+
+mkdir -p "$OUTPUT_DIR"
+TEMP_DIR=$(mktemp -d)
+
+fail() {
+    echo "$1"
+    rm -rf "$TEMP_DIR"
+    exit 1
+}
+
+# Step 1: Macros
+for MACRO in calc shooter; do
+    echo "Building $MACRO macro${REVISION:+ at $REVISION}..."
+    if [ -n "$REVISION" ]; then
+        git -C "$MACRO_DIR" show "$REVISION:./$MACRO.c" > "$TEMP_DIR/$MACRO.c" || fail "No $MACRO.c at $REVISION"
+    else
+        cp "$MACRO_DIR/$MACRO.c" "$TEMP_DIR/$MACRO.c"
+    fi
+    # DTool leaves a NUL byte at the end of the file
+    tr -d '\000' < "$TEMP_DIR/$MACRO.c" > "$TEMP_DIR/$MACRO.src.c"
+    "$CC" $CFLAGS "$TEMP_DIR/$MACRO.src.c" -o "$OUTPUT_DIR/$MACRO.so" || fail "$MACRO compilation failed"
+done
+
+# Step 2: Harness; exports ReadLocal, WriteLocal and time() to the macros
+echo "Building macro harness..."
+"$CXX" -std=gnu++11 -O2 -Wall -rdynamic $DEFINES "$HARNESS_DIR/harness.cpp" -ldl -o "$BIN_DIR/claycast-macro" ||
+    fail "Harness compilation failed"
+
+rm -rf "$TEMP_DIR"
+echo "Saved macros to $OUTPUT_DIR and harness to $BIN_DIR/claycast-macro"
@@ -0,0 +1,96 @@
+#!/bin/bash
+
+# Build the host simulator (tools/sim) from the controller and client sketches.
+# Usage: build-sim.sh [client count, default 10] [NAME=VALUE ...]
+# NAME=VALUE overrides a #define of the controller or client sketch (or both)
+# or of the ClayCast library, e.g. TDMA_ENABLED=1 or RADIO_PORTS=2.
+
+CLIENTS="${1:-10}"
+shift
+CXX="${CXX:-g++}"
+PROJECT_DIR="$(dirname "$0")/../client"
+CONTROLLER_DIR="$(dirname "$0")/../controller"
+SIM_DIR="$(dirname "$0")/../tools/sim"
+BIN_DIR="$(dirname "$0")/../bin"
+LIB_DIR="$(dirname "$0")/../libraries"
+
+BAUD_RATE=$(sed -n 's/^#define BAUD_RATE \([0-9]*\).*/\1/p' "$CONTROLLER_DIR/controller.ino")
+
+DEFINES=("$@")
+for define in "${DEFINES[@]}"; do
+    if ! grep -q "^#define ${define%%=*} " "$CONTROLLER_DIR/controller.ino" "$PROJECT_DIR/client.ino" "$LIB_DIR"/ClayCast/src/*.h; then
+        echo "Unknown define: ${define%%=*}"
+        exit 1
+    fi
+done
+
+mkdir -p "$BIN_DIR"
+TEMP_DIR=$(mktemp -d)
+CXXFLAGS="-std=gnu++11 -O2 -Wall -Wextra -I$SIM_DIR -I$TEMP_DIR/ClayCast"
+
+# Prototypes for every top-level function definition, as the Arduino builder adds them
+prototypes() {
+    grep -E '^[A-Za-z_][A-Za-z0-9_]*[ *]+[A-Za-z_][A-Za-z0-9_]* *\([^;]*\) *\{ *$' "$1" | sed -E 's/ *\{ *$/;/' > "$2"
+}
+
+# Apply the NAME=VALUE overrides that the file defines
+override() {
+    for define in "${DEFINES[@]}"; do
+        sed -i "s/^#define ${define%%=*} .*/#define ${define%%=*} ${define#*=}/" "$1"
+    done
+}
+
+compile() {
+    "$CXX" $CXXFLAGS "$@"
+    if [ $? -ne 0 ]; then
+        echo "Simulator compilation failed"
+        rm -rf "$TEMP_DIR"
+        exit 1
+    fi
+}
+
+# Step 1: Library with the overrides, shared by every node and the simulator
+cp -r "$LIB_DIR/ClayCast/src" "$TEMP_DIR/ClayCast"
+for header in "$TEMP_DIR"/ClayCast/*.h; do
+    override "$header"
+done
+RADIO_PORTS=$(sed -n 's/^#define RADIO_PORTS \([0-9]*\).*/\1/p' "$TEMP_DIR/ClayCast/ClayCastHC12.h")
+
+# Step 2: Controller nodes with RADIO_PORT 0–RADIO_PORTS-1
+for port in $(seq 0 $((RADIO_PORTS - 1))); do
+    echo "Building simulated controller for RADIO_PORT=$port..."
+
+    CONTROLLER_INO="$TEMP_DIR/controller$port.ino"
+    cp "$CONTROLLER_DIR/controller.ino" "$CONTROLLER_INO"
+    override "$CONTROLLER_INO"
+    sed -i "s/^#define RADIO_PORT .*/#define RADIO_PORT $port/" "$CONTROLLER_INO"
+    prototypes "$CONTROLLER_INO" "$TEMP_DIR/controller$port.proto.h"
+
+    compile -DSIM_NAMESPACE=controller_node_$port \
+        -DSIM_SKETCH="\"$CONTROLLER_INO\"" -DSIM_PROTOTYPES="\"$TEMP_DIR/controller$port.proto.h\"" \
+        -c "$SIM_DIR/controller_node.cpp" -o "$TEMP_DIR/controller$port.o"
+done
+
+# Step 3: Client nodes with MODBUS_ADDRESS 1–CLIENTS
+for i in $(seq 1 "$CLIENTS"); do
+    echo "Building simulated client for MODBUS_ADDRESS=$i..."
+
+    CLIENT_INO="$TEMP_DIR/client$i.ino"
+    cp "$PROJECT_DIR/client.ino" "$CLIENT_INO"
+    sed -i "s/#define MODBUS_ADDRESS .*/#define MODBUS_ADDRESS $i \/\/ Slave address/" "$CLIENT_INO"
+    override "$CLIENT_INO"
+    prototypes "$CLIENT_INO" "$TEMP_DIR/client$i.proto.h"
+
+    compile -DSIM_NAMESPACE=client_node_$i \
+        -DSIM_SKETCH="\"$CLIENT_INO\"" -DSIM_PROTOTYPES="\"$TEMP_DIR/client$i.proto.h\"" \
+        -c "$SIM_DIR/client_node.cpp" -o "$TEMP_DIR/client$i.o"
+done
+
+# Step 4: Simulator and link
+echo "Linking simulator..."
+compile -DSIM_BAUD_RATE="$BAUD_RATE" \
+    "$SIM_DIR/kernel.cpp" "$SIM_DIR/hc12.cpp" "$SIM_DIR/main.cpp" "$TEMP_DIR"/*.o \
+    -o "$BIN_DIR/claycast-sim"
+
+rm -rf "$TEMP_DIR"
+echo "Saved simulator to $BIN_DIR/claycast-sim"
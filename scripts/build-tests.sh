@@ -0,0 +1,43 @@
+#!/bin/bash
+
+# Build the native tests (tests/) and run them.
+# Usage: build-tests.sh [test name filter ...]
+# The client and controller sketches are compiled in against the simulator's
+# Arduino stand-in (tools/sim), as client_sketch.h and controller_sketch.h with
+# their prototypes in client_sketch.proto.h and controller_sketch.proto.h.
+
+CXX="${CXX:-g++}"
+TESTS_DIR="$(dirname "$0")/../tests"
+PROJECT_DIR="$(dirname "$0")/../client"
+CONTROLLER_DIR="$(dirname "$0")/../controller"
+SIM_DIR="$(dirname "$0")/../tools/sim"
+BIN_DIR="$(dirname "$0")/../bin"
+LIB_DIR="$(dirname "$0")/../libraries"
+
+mkdir -p "$BIN_DIR"
+TEMP_DIR=$(mktemp -d)
+CXXFLAGS="-std=gnu++11 -O2 -Wall -Wextra -I$LIB_DIR/ClayCast/src -I$SIM_DIR -I$TEMP_DIR"
+
+compile() {
+    "$CXX" $CXXFLAGS "$@"
+    if [ $? -ne 0 ]; then
+        echo "Test compilation failed"
+        rm -rf "$TEMP_DIR"
+        exit 1
+    fi
+}
+
+cp "$PROJECT_DIR/client.ino" "$TEMP_DIR/client_sketch.h"
+cp "$CONTROLLER_DIR/controller.ino" "$TEMP_DIR/controller_sketch.h"
+
+# Prototypes for every top-level function definition, as the Arduino builder adds them
+for sketch in client controller; do
+    grep -E '^[A-Za-z_][A-Za-z0-9_]*[ *]+[A-Za-z_][A-Za-z0-9_]* *\([^;]*\) *\{ *$' "$TEMP_DIR/${sketch}_sketch.h" |
+        sed -E 's/ *\{ *$/;/' > "$TEMP_DIR/${sketch}_sketch.proto.h"
+done
+
+echo "Building tests..."
+compile "$TESTS_DIR"/*.cpp "$SIM_DIR/kernel.cpp" "$SIM_DIR/hc12.cpp" -o "$BIN_DIR/claycast-tests"
+
+rm -rf "$TEMP_DIR"
+"$BIN_DIR/claycast-tests" "$@"
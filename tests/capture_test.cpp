@@ -0,0 +1,120 @@
+/*
+ * SoftwareSerial reception of the client sketch while its Timer2 contact
+ * capture runs, against the simulator's models (tools/sim): a Timer2
+ * interrupt running when a start bit arrives holds off the receive interrupt,
+ * and one held off too long misreads the byte. Another node sends a stream
+ * over a pair of HC-12 modules. The simulator runs once per process, so each
+ * run is a child process.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <Arduino.h>
+#include <SoftwareSerial.h>
+#include <ClayCastFrame.h>
+#include <ClayCastModbus.h>
+#include <ClayCastHC12.h>
+#include "sim.h"
+#include "test.h"
+
+// A copy of its own, as the simulator builds one per client node
+namespace capture_client {
+#include "client_sketch.proto.h"
+#include "client_sketch.h"
+}
+
+namespace {
+
+using namespace sim;
+
+const uint16_t STREAM_SIZE = 2000;
+const Time RUN_LIMIT = 5 * SECOND; // The stream at 19200 baud with room to spare
+
+SoftwareSerial port(2, 3);
+uint32_t streamBaud = 0;
+uint16_t received = 0;
+uint16_t wrong = 0;
+
+void senderSetup() {
+  port.begin(streamBaud);
+  for (uint16_t i = 0; i < STREAM_SIZE; i++) port.write((uint8_t) i);
+}
+
+void receiverSetup() {
+  port.begin(streamBaud);
+  capture_client::startContactCapture();
+}
+
+void receiverLoop() {
+  while (port.available()) {
+    if (port.read() != (uint8_t) received) wrong++;
+    received++;
+  }
+}
+
+void idleLoop() {
+}
+
+const SketchEntry senderSketch = {
+  "sender", 0, 0, senderSetup, idleLoop, nullptr, nullptr, nullptr, NO_PIN, NO_PIN, NO_PIN
+};
+
+const SketchEntry receiverSketch = {
+  "client", 1, 0, receiverSetup, receiverLoop, nullptr, capture_client::TIMER2_COMPA_vect, capture_client::TIMER2_COMPB_vect,
+  NO_PIN, NO_PIN, NO_PIN
+};
+
+// Stream bytes to the client at a baud, IN1 bouncing every millisecond or at
+// rest. Returns whether every byte arrived intact.
+bool simulate(uint32_t baud, bool bouncing) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) return false;
+
+  if (pid == 0) {
+    unsigned before = test::failedCheckCount();
+    streamBaud = baud;
+    Air air((RadioConfig()));
+    Node & sender = addSketchNode(senderSketch);
+    Node & receiver = addSketchNode(receiverSketch);
+    Hc12Module senderModule(sender, air);
+    Hc12Module receiverModule(receiver, air);
+    senderModule.baud = baud;
+    receiverModule.baud = baud;
+    sender.module = &senderModule;
+    receiver.module = &receiverModule;
+
+    addScriptNode([&receiver, bouncing]() {
+      while (received < STREAM_SIZE && now() < RUN_LIMIT) {
+        sleep(MILLISECOND);
+        if (bouncing) receiver.pinLevel[A0] = !receiver.pinLevel[A0];
+      }
+    });
+    run(~(Time) 0);
+
+    const SoftwareUart & uart = receiver.softUart;
+    printf("capture baud=%u bouncing=%d received=%u wrong=%u held_off=%u late=%u\n", (unsigned) baud, bouncing,
+      received, wrong, (unsigned) uart.rxHeldOff, (unsigned) uart.rxLate);
+    CHECK_EQUAL(received, STREAM_SIZE);
+    CHECK_EQUAL(wrong, 0);
+    CHECK_EQUAL(uart.rxLate, 0);
+    fflush(stdout);
+    _exit(test::failedCheckCount() == before ? 0 : 1);
+  }
+
+  int status = 0;
+  waitpid(pid, &status, 0);
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+} // namespace
+
+TEST(capture_rx_at_link_rates) {
+  static const uint32_t rates[] = {HC12_DEFAULT_BAUD, 19200, HC12_MAX_SOFTWARE_SERIAL_BAUD};
+  for (uint32_t rate : rates) {
+    CHECK(simulate(rate, false));
+    CHECK(simulate(rate, true));
+  }
+}
@@ -0,0 +1,136 @@
+/*
+ * Modbus requests through the client sketch's handler, request bytes in,
+ * response bytes out. scripts/build-tests.sh copies client.ino as
+ * client_sketch.h, with its prototypes in client_sketch.proto.h, and builds
+ * it against the simulator's Arduino stand-in (tools/sim), like
+ * tools/bench/client_under_test.cpp does for AVR.
+ */
+
+#include <stdint.h>
+#include <vector>
+#include <Arduino.h>
+#include <SoftwareSerial.h>
+#include <ClayCastFrame.h>
+#include <ClayCastModbus.h>
+#include "test.h"
+
+namespace client {
+#include "client_sketch.proto.h"
+#include "client_sketch.h"
+}
+
+namespace {
+
+using client::REGISTER_COUNT; // In the sketch's READABLE_REGISTER_COUNT
+
+typedef std::vector<uint8_t> Bytes;
+
+Bytes withCrc(Bytes frame) {
+  frame.resize(frame.size() + 2);
+  modbusAppendCRC(frame.data(), frame.size() - 2);
+  return frame;
+}
+
+// Run a request (CRC appended here) through processModbusRequest() in one
+// buffer, as the sketch does, and return the response
+Bytes exchange(const Bytes & request) {
+  Bytes frame = withCrc(request);
+  uint8_t buffer[MAX_DATA_SIZE];
+  memcpy(buffer, frame.data(), frame.size());
+  int size = client::processModbusRequest(buffer, frame.size(), buffer);
+  return Bytes(buffer, buffer + size);
+}
+
+Bytes exception(uint8_t function, uint8_t code) {
+  return withCrc({MODBUS_ADDRESS, (uint8_t)(function | 0x80), code});
+}
+
+void resetRegisters() {
+  memset(client::holdingRegisters, 0, sizeof(client::holdingRegisters));
+  client::holdingRegisters[client::DEVICE_ID] = MODBUS_ADDRESS;
+  client::holdingRegisters[client::CONTACT1] = 1;
+  client::holdingRegisters[client::CONTACT2_DELAY] = 0x1234;
+}
+
+const uint8_t READ = MODBUS_FUNCTION_READ_HOLDING_REGISTERS;
+const uint8_t WRITE = MODBUS_FUNCTION_WRITE_SINGLE_REGISTER;
+const uint8_t WRITE_MULTIPLE = MODBUS_FUNCTION_WRITE_MULTIPLE_REGISTERS;
+const uint8_t READ_WRITE = MODBUS_FUNCTION_READ_WRITE_MULTIPLE_REGISTERS;
+
+TEST(client_read_holding_registers) {
+  resetRegisters();
+  CHECK(exchange({MODBUS_ADDRESS, READ, 0, 0, 0, 3}) == withCrc({MODBUS_ADDRESS, READ, 6, 0, MODBUS_ADDRESS, 0, 0, 0, 1}));
+  CHECK(exchange({MODBUS_ADDRESS, READ, 0, client::CONTACT2_DELAY, 0, 1}) == withCrc({MODBUS_ADDRESS, READ, 2, 0x12, 0x34}));
+
+  CHECK(exchange({MODBUS_ADDRESS, READ, 0, 0, 0, 0}) == exception(READ, MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE));
+  CHECK(exchange({MODBUS_ADDRESS, READ, 0, 0, 0}) == exception(READ, MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE));
+  uint16_t end = READABLE_REGISTER_COUNT;
+  CHECK(exchange({MODBUS_ADDRESS, READ, (uint8_t)(end >> 8), (uint8_t)end, 0, 1}) == exception(READ, MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS));
+  CHECK(exchange({MODBUS_ADDRESS, READ, 0, 1, (uint8_t)(end >> 8), (uint8_t)end}) == exception(READ, MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS));
+}
+
+TEST(client_write_single_register) {
+  resetRegisters();
+  CHECK(exchange({MODBUS_ADDRESS, WRITE, 0, client::FIRE, 0, 1}) == withCrc({MODBUS_ADDRESS, WRITE, 0, client::FIRE, 0, 1}));
+  CHECK_EQUAL(client::holdingRegisters[client::FIRE], 1);
+
+  CHECK(exchange({MODBUS_ADDRESS, WRITE, 0, client::DEVICE_ID, 0, 9}) == exception(WRITE, MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE));
+  CHECK(exchange({MODBUS_ADDRESS, WRITE, 0, client::REGISTER_COUNT, 0, 1}) == exception(WRITE, MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS));
+  CHECK_EQUAL(client::holdingRegisters[client::DEVICE_ID], MODBUS_ADDRESS);
+}
+
+TEST(client_write_multiple_registers) {
+  resetRegisters();
+  CHECK(exchange({MODBUS_ADDRESS, WRITE_MULTIPLE, 0, client::FIRE, 0, 1, 2, 0, 1}) ==
+    withCrc({MODBUS_ADDRESS, WRITE_MULTIPLE, 0, client::FIRE, 0, 1}));
+  CHECK_EQUAL(client::holdingRegisters[client::FIRE], 1);
+
+  // FIRE and CONTACT1: the read-only register refuses the whole write
+  CHECK(exchange({MODBUS_ADDRESS, WRITE_MULTIPLE, 0, client::FIRE, 0, 2, 4, 0, 2, 0, 3}) ==
+    exception(WRITE_MULTIPLE, MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE));
+  CHECK_EQUAL(client::holdingRegisters[client::FIRE], 1);
+  CHECK_EQUAL(client::holdingRegisters[client::CONTACT1], 1);
+
+  CHECK(exchange({MODBUS_ADDRESS, WRITE_MULTIPLE, 0, client::FIRE, 0, 0, 0}) == exception(WRITE_MULTIPLE, MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE));
+  CHECK(exchange({MODBUS_ADDRESS, WRITE_MULTIPLE, 0, client::FIRE, 0, 1, 4, 0, 1}) == exception(WRITE_MULTIPLE, MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE));
+  CHECK(exchange({MODBUS_ADDRESS, WRITE_MULTIPLE, 0, client::FIRE, 0, 1, 2, 0}) == exception(WRITE_MULTIPLE, MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE));
+  CHECK(exchange({MODBUS_ADDRESS, WRITE_MULTIPLE, 0, client::EVENT_CURSOR, 0, 2, 4, 0, 1, 0, 1}) ==
+    exception(WRITE_MULTIPLE, MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS));
+}
+
+// FIRE set and the contact registers read back in one transaction; the write
+// comes first, so a read of FIRE sees the new value
+TEST(client_read_write_multiple_registers) {
+  resetRegisters();
+  Bytes response = exchange({MODBUS_ADDRESS, READ_WRITE, 0, client::FIRE, 0, 7, 0, client::FIRE, 0, 1, 2, 0, 1});
+  CHECK(response == withCrc({MODBUS_ADDRESS, READ_WRITE, 14, 0, 1, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0x12, 0x34}));
+  CHECK_EQUAL(client::holdingRegisters[client::FIRE], 1);
+
+  CHECK(exchange({MODBUS_ADDRESS, READ_WRITE, 0, 0, 0, 0, 0, client::FIRE, 0, 1, 2, 0, 1}) ==
+    exception(READ_WRITE, MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE));
+  CHECK(exchange({MODBUS_ADDRESS, READ_WRITE, 0, 0, 0, 1, 0, client::FIRE, 0, 1, 3, 0, 1}) ==
+    exception(READ_WRITE, MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE));
+  CHECK(exchange({MODBUS_ADDRESS, READ_WRITE, 0, 0, 0, 1, 0, client::CONTACT1, 0, 1, 2, 0, 1}) ==
+    exception(READ_WRITE, MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE));
+  CHECK(exchange({MODBUS_ADDRESS, READ_WRITE, 0, 0, 0, 1, 0, client::REGISTER_COUNT, 0, 1, 2, 0, 1}) ==
+    exception(READ_WRITE, MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS));
+  uint16_t end = READABLE_REGISTER_COUNT;
+  CHECK(exchange({MODBUS_ADDRESS, READ_WRITE, (uint8_t)(end >> 8), (uint8_t)end, 0, 1, 0, client::FIRE, 0, 1, 2, 0, 1}) ==
+    exception(READ_WRITE, MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS));
+}
+
+TEST(client_ignored_requests) {
+  resetRegisters();
+  CHECK(exchange({MODBUS_ADDRESS + 1, READ, 0, 0, 0, 1}).empty());
+  CHECK(exchange({MODBUS_BROADCAST_ADDRESS, WRITE, 0, client::FIRE, 0, 1}).empty());
+  CHECK_EQUAL(client::holdingRegisters[client::FIRE], 0);
+
+  Bytes request = withCrc({MODBUS_ADDRESS, READ, 0, 0, 0, 1});
+  request[3] ^= 0x01;
+  CHECK_EQUAL(client::processModbusRequest(request.data(), request.size(), request.data()), 0);
+
+  CHECK(exchange({MODBUS_ADDRESS, MODBUS_FUNCTION_READ_INPUT_REGISTERS, 0, 0, 0, 1}) ==
+    exception(MODBUS_FUNCTION_READ_INPUT_REGISTERS, MODBUS_EXCEPTION_ILLEGAL_FUNCTION));
+}
+
+} // namespace
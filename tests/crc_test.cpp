@@ -0,0 +1,64 @@
+/*
+ * CRC-16/MODBUS kernels (ClayCastModbus.h) against the bitwise reference.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <ClayCastModbus.h>
+#include "test.h"
+
+namespace {
+
+// Table entry of value after steps shift/xor steps of the reference loop
+uint16_t referenceEntry(uint16_t value, uint8_t steps) {
+  for (uint8_t j = 0; j < steps; j++) value = value & 1 ? (value >> 1) ^ MODBUS_CRC_POLY : value >> 1;
+  return value;
+}
+
+TEST(crc_check_value) {
+  const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+  CHECK_EQUAL(modbusCRCBitwise(MODBUS_CRC_INIT, check, sizeof(check)), 0x4B37);
+  CHECK_EQUAL(modbusCRCNibble(MODBUS_CRC_INIT, check, sizeof(check)), 0x4B37);
+  CHECK_EQUAL(modbusCRCTable(MODBUS_CRC_INIT, check, sizeof(check)), 0x4B37);
+  CHECK_EQUAL(modbusCRC(check, sizeof(check)), 0x4B37);
+}
+
+TEST(crc_tables) {
+  for (uint16_t i = 0; i < 256; i++) CHECK_EQUAL(modbusCrcTable[i], referenceEntry(i, 8));
+  for (uint16_t i = 0; i < 16; i++) CHECK_EQUAL(modbusCrcNibbleTable[i], referenceEntry(i, 4));
+}
+
+// Every kernel gives the reference CRC for random data of every length up to
+// a full frame, from any starting value, and in pieces
+TEST(crc_kernels_equal_bitwise) {
+  srand(5);
+  uint8_t data[MODBUS_MAX_READ_QUANTITY * 2 + 10];
+  for (int run = 0; run < 50; run++) {
+    for (uint16_t i = 0; i < sizeof(data); i++) data[i] = rand();
+    uint16_t start = run == 0 ? MODBUS_CRC_INIT : rand();
+    for (uint16_t length = 0; length <= sizeof(data); length++) {
+      uint16_t expected = modbusCRCBitwise(start, data, length);
+      CHECK_EQUAL(modbusCRCNibble(start, data, length), expected);
+      CHECK_EQUAL(modbusCRCTable(start, data, length), expected);
+      uint16_t split = length / 3;
+      CHECK_EQUAL(modbusCRCUpdate(modbusCRCUpdate(start, data, split), data + split, length - split), expected);
+    }
+  }
+}
+
+TEST(crc_append_and_check) {
+  uint8_t frame[] = {0x01, MODBUS_FUNCTION_READ_HOLDING_REGISTERS, 0x00, 0x00, 0x00, 0x0A, 0, 0};
+  modbusAppendCRC(frame, 6);
+  CHECK_EQUAL(frame[6], 0xC5); // 01 03 00 00 00 0A C5 CD
+  CHECK_EQUAL(frame[7], 0xCD);
+  CHECK(modbusCheckCRC(frame, sizeof(frame)));
+
+  for (uint16_t i = 0; i < sizeof(frame) * 8; i++) {
+    frame[i / 8] ^= 1 << (i % 8);
+    CHECK(!modbusCheckCRC(frame, sizeof(frame)));
+    frame[i / 8] ^= 1 << (i % 8);
+  }
+  CHECK(!modbusCheckCRC(frame, 3)); // Shorter than address + function + CRC
+}
+
+} // namespace
@@ -0,0 +1,120 @@
+/*
+ * In-place frame wrapping and unwrapping (ClayCastFrame.h).
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <ClayCastFrame.h>
+#include "test.h"
+
+namespace {
+
+// Fill size payload bytes at framePayload(frame) with a pattern from seed
+void fillPayload(uint8_t * frame, uint16_t size, uint8_t seed) {
+  for (uint16_t i = 0; i < size; i++) framePayload(frame)[i] = seed + i * 7;
+}
+
+bool payloadIntact(const uint8_t * data, uint16_t size, uint8_t seed) {
+  for (uint16_t i = 0; i < size; i++) {
+    if (data[i] != (uint8_t)(seed + i * 7)) return false;
+  }
+  return true;
+}
+
+TEST(frame_wrap_layout) {
+  uint8_t frame[FRAME_BUFFER_SIZE];
+  fillPayload(frame, 8, 1);
+  uint16_t checksum = frameChecksum(framePayload(frame), 8);
+
+  CHECK_EQUAL(wrapModbusRTU(frame, 8), 8 + FRAME_OVERHEAD);
+  CHECK_EQUAL(frame[0], START_BYTE);
+  CHECK_EQUAL(frame[1], 0);
+  CHECK_EQUAL(frame[2], 8);
+  CHECK(payloadIntact(framePayload(frame), 8, 1));
+  CHECK_EQUAL(frame[FRAME_HEADER_SIZE + 8], checksum >> 8);
+  CHECK_EQUAL(frame[FRAME_HEADER_SIZE + 9], checksum & 0xFF);
+  CHECK_EQUAL(frame[FRAME_HEADER_SIZE + 10], END_BYTE);
+}
+
+// Unwrapping hands out a view into the buffer, the payload is never copied
+TEST(frame_unwrap_in_place) {
+  uint8_t frame[FRAME_BUFFER_SIZE];
+  for (uint16_t size = 0; size <= MAX_DATA_SIZE; size++) {
+    fillPayload(frame, size, size);
+    uint16_t length = wrapModbusRTU(frame, size);
+    CHECK_EQUAL(length, size + FRAME_OVERHEAD);
+
+    FramePayload payload = {0, 0};
+    CHECK(unwrapModbusRTU(frame, length, &payload));
+    CHECK(payload.data == framePayload(frame));
+    CHECK_EQUAL(payload.size, size);
+    CHECK(payloadIntact(payload.data, payload.size, size));
+  }
+}
+
+TEST(frame_wrap_too_large) {
+  uint8_t frame[FRAME_BUFFER_SIZE + 1];
+  CHECK_EQUAL(wrapModbusRTU(frame, MAX_DATA_SIZE + 1), 0);
+  CHECK_EQUAL(wrapCompactFrame(frame, COMPACT_MAX_DATA_SIZE + 1), 0);
+  CHECK_EQUAL(wrapCompactFrame(frame, COMPACT_MIN_DATA_SIZE - 1), 0);
+  CHECK_EQUAL(wrapSequencedFrame(frame, COMPACT_MAX_DATA_SIZE + 1, 0), 0);
+  CHECK_EQUAL(wrapFecFrame(frame, FEC_MAX_DATA_SIZE + 1, 0), 0);
+  CHECK(fecFrameSize(FEC_MAX_DATA_SIZE) <= FRAME_BUFFER_SIZE);
+}
+
+TEST(frame_unwrap_rejects) {
+  uint8_t frame[FRAME_BUFFER_SIZE];
+  fillPayload(frame, 10, 3);
+  uint16_t length = wrapModbusRTU(frame, 10);
+  FramePayload payload = {0, 0};
+
+  CHECK(!unwrapModbusRTU(frame, length - 1, &payload)); // Cut short
+  CHECK(!unwrapModbusRTU(frame, FRAME_OVERHEAD - 1, &payload));
+  for (uint16_t i = 0; i < length; i++) {
+    frame[i] ^= 0x01;
+    CHECK(!unwrapModbusRTU(frame, length, &payload));
+    frame[i] ^= 0x01;
+  }
+  CHECK(payload.data == 0);
+  CHECK(unwrapModbusRTU(frame, length, &payload));
+}
+
+// The compact and sequenced formats put their header in front of the payload
+// where it already is
+TEST(frame_compact_and_sequenced_layout) {
+  uint8_t frame[FRAME_BUFFER_SIZE];
+  fillPayload(frame, 8, 5);
+  CHECK_EQUAL(wrapFrame(frame, 8, true), 10);
+  uint8_t * first = frameStart(frame, true);
+  CHECK(first == frame + COMPACT_FRAME_OFFSET);
+  CHECK_EQUAL(first[0], COMPACT_START_BYTE);
+  CHECK_EQUAL(first[1], 8);
+  CHECK(payloadIntact(framePayload(frame), 8, 5));
+
+  CHECK_EQUAL(wrapSequencedFrame(frame, 8, 200), 11);
+  CHECK_EQUAL(frame[0], SEQUENCED_START_BYTE);
+  CHECK_EQUAL(frame[1], 200);
+  CHECK_EQUAL(frame[2], 8);
+  CHECK(payloadIntact(framePayload(frame), 8, 5));
+
+  CHECK(frameStart(frame, false) == frame);
+  CHECK_EQUAL(wrapFrame(frame, 8, false), 8 + FRAME_OVERHEAD);
+}
+
+// The FEC format spreads the payload over its blocks in place and back
+TEST(frame_fec_round_trip) {
+  uint8_t frame[FRAME_BUFFER_SIZE];
+  for (uint16_t size = COMPACT_MIN_DATA_SIZE; size <= FEC_MAX_DATA_SIZE; size++) {
+    fillPayload(frame, size, size);
+    uint16_t length = wrapFecFrame(frame, size, 9);
+    CHECK_EQUAL(length, fecFrameSize(size));
+    CHECK_EQUAL(frame[0], FEC_START_BYTE);
+
+    frame[FEC_HEADER_SIZE + size / 2] ^= 0x5A; // One wrong byte in one block
+    CHECK(fecDecode(frame + 1, 2 + FEC_PARITY) == 0);
+    CHECK_EQUAL(unwrapFecBlocks(frame, size), 1);
+    CHECK(payloadIntact(framePayload(frame), size, size));
+  }
+}
+
+} // namespace
@@ -0,0 +1,152 @@
+/*
+ * HC12Link against the simulator's HC-12 stand-in (tools/sim/hc12.cpp), which
+ * answers AT, AT+Bxxxx, AT+Cxxx and AT+FUx like the module and garbles bytes
+ * sent at the wrong baud. The link runs in the setup() of a simulated node;
+ * the simulator runs once per process, so each run is a child process.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <functional>
+#include <Arduino.h>
+#include <SoftwareSerial.h>
+#include <ClayCastHC12.h>
+#include "sim.h"
+#include "test.h"
+
+namespace {
+
+using namespace sim;
+
+const uint8_t SET_PIN = 4;
+const Time RUN_LIMIT = 10 * SECOND; // Longer than any detect()
+
+typedef std::function<void(HC12Link & link, Hc12Module & module)> LinkBody;
+
+SoftwareSerial port(2, 3);
+HC12Link link(port, SET_PIN);
+Hc12Module * module = nullptr;
+LinkBody body;
+
+void linkSetup() {
+  link.begin(HC12_DEFAULT_BAUD);
+  body(link, *module);
+}
+
+void linkLoop() {
+}
+
+const SketchEntry linkSketch = {
+  "link", 1, 0, linkSetup, linkLoop, nullptr, nullptr, nullptr, SET_PIN, NO_PIN, NO_PIN
+};
+
+// Run a body against a module left at a baud, wired to the node's
+// SoftwareSerial and SET pin or not at all. Returns whether the body
+// finished and its checks passed.
+bool simulate(uint32_t moduleBaud, bool wired, LinkBody linkBody) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) return false;
+
+  if (pid == 0) {
+    unsigned before = test::failedCheckCount();
+    Air air((RadioConfig()));
+    Node & node = addSketchNode(linkSketch);
+    Hc12Module hc12(node, air);
+    hc12.baud = moduleBaud;
+    if (wired) node.module = &hc12;
+    module = &hc12;
+    body = linkBody;
+
+    addScriptNode([&node]() {
+      while (!node.setupDone && now() < RUN_LIMIT) sleep(MILLISECOND);
+      CHECK(node.setupDone);
+    });
+    run(~(Time) 0);
+    fflush(stdout);
+    _exit(test::failedCheckCount() == before ? 0 : 1);
+  }
+
+  int status = 0;
+  waitpid(pid, &status, 0);
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+} // namespace
+
+TEST(hc12_commands_checked_against_reply) {
+  CHECK(simulate(9600, true, [](HC12Link & link, Hc12Module & module) {
+    CHECK(link.ping());
+    CHECK_EQUAL(strcmp(link.lastReply(), "OK"), 0);
+
+    CHECK(link.setChannel(5));
+    CHECK_EQUAL(strcmp(link.lastReply(), "OK+C005"), 0);
+    CHECK_EQUAL(module.channel, 5);
+
+    CHECK(link.setTransmitMode(3));
+    CHECK_EQUAL(strcmp(link.lastReply(), "OK+FU3"), 0);
+    CHECK_EQUAL(module.mode, 3);
+
+    // Refused by the module, and out of range without a command
+    CHECK(!link.setTransmitMode(5));
+    CHECK_EQUAL(strcmp(link.lastReply(), "ERROR"), 0);
+    CHECK(!link.setChannel(0));
+    CHECK(!link.setChannel(101));
+    CHECK_EQUAL(module.channel, 5);
+    CHECK(!module.commandMode);
+  }));
+}
+
+TEST(hc12_set_baud_moves_port_with_module) {
+  CHECK(simulate(9600, true, [](HC12Link & link, Hc12Module & module) {
+    CHECK(link.setBaud(19200));
+    CHECK_EQUAL(strcmp(link.lastReply(), "OK+B19200"), 0);
+    CHECK_EQUAL(link.baud(), 19200);
+    CHECK_EQUAL(module.baud, 19200);
+    CHECK(link.ping()); // Both at the new rate
+
+    // Above what SoftwareSerial receives: refused without a command
+    CHECK(!link.setBaud(57600));
+    CHECK_EQUAL(link.baud(), 19200);
+    CHECK_EQUAL(module.baud, 19200);
+
+    CHECK(link.setBaud(HC12_DEFAULT_BAUD));
+    CHECK_EQUAL(module.baud, HC12_DEFAULT_BAUD);
+    CHECK(link.ping());
+  }));
+}
+
+TEST(hc12_set_baud_keeps_port_without_ok) {
+  // Module at another rate: it garbles the command, the link keeps its rate
+  CHECK(simulate(38400, true, [](HC12Link & link, Hc12Module & module) {
+    CHECK(!link.setBaud(19200));
+    CHECK_EQUAL(link.baud(), HC12_DEFAULT_BAUD);
+    CHECK_EQUAL(module.baud, 38400);
+  }));
+}
+
+TEST(hc12_detect_finds_module_rate) {
+  static const uint32_t rates[] = {1200, 4800, 9600, 19200, 38400};
+  for (uint32_t rate : rates) {
+    CHECK(simulate(rate, true, [rate](HC12Link & link, Hc12Module & module) {
+      CHECK_EQUAL(link.detect(), rate);
+      CHECK_EQUAL(link.baud(), rate);
+      CHECK(link.ping());
+
+      // The configuration every node does after detect()
+      CHECK(link.setBaud(HC12_DEFAULT_BAUD));
+      CHECK_EQUAL(module.baud, HC12_DEFAULT_BAUD);
+    }));
+  }
+}
+
+TEST(hc12_detect_without_module) {
+  CHECK(simulate(9600, false, [](HC12Link & link, Hc12Module &) {
+    CHECK_EQUAL(link.detect(), 0);
+    CHECK_EQUAL(link.baud(), HC12_DEFAULT_BAUD);
+    CHECK(!link.setChannel(1));
+  }));
+}
@@ -0,0 +1,71 @@
+/*
+ * claycast-tests: runs every registered test, or those whose name contains
+ * one of the arguments. Prints one line per failed check and a summary, and
+ * exits non-zero if any check failed.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "test.h"
+
+namespace test {
+
+namespace {
+
+struct Test {
+  const char * name;
+  TestFunction function;
+};
+
+std::vector<Test> & tests() {
+  static std::vector<Test> registered; // Filled by static initializers in any order
+  return registered;
+}
+
+unsigned failedChecks = 0;
+
+} // namespace
+
+Registration::Registration(const char * name, TestFunction function) {
+  Test entry = {name, function};
+  tests().push_back(entry);
+}
+
+void check(bool ok, const char * expression, const char * file, int line) {
+  if (ok) return;
+  failedChecks++;
+  printf("%s:%d: CHECK(%s) failed\n", file, line, expression);
+}
+
+void checkEqual(long long actual, long long expected, const char * expression, const char * file, int line) {
+  if (actual == expected) return;
+  failedChecks++;
+  printf("%s:%d: CHECK_EQUAL(%s) failed: %lld != %lld\n", file, line, expression, actual, expected);
+}
+
+unsigned failedCheckCount() {
+  return failedChecks;
+}
+
+} // namespace test
+
+int main(int argc, char ** argv) {
+  unsigned passed = 0;
+  unsigned failed = 0;
+  for (const test::Test & entry : test::tests()) {
+    bool selected = argc < 2;
+    for (int i = 1; i < argc; i++) {
+      if (strstr(entry.name, argv[i])) selected = true;
+    }
+    if (!selected) continue;
+
+    unsigned before = test::failedChecks;
+    entry.function();
+    bool ok = test::failedChecks == before;
+    printf("%s %s\n", ok ? "ok  " : "FAIL", entry.name);
+    ok ? passed++ : failed++;
+  }
+  printf("tests passed=%u failed=%u\n", passed, failed);
+  return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,266 @@
+/*
+ * FrameParser on split, merged and corrupted byte streams.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <ClayCastFrame.h>
+#include "test.h"
+
+namespace {
+
+typedef std::vector<uint8_t> Bytes;
+
+enum Format { STANDARD, COMPACT, SEQUENCED, FEC, FORMATS };
+
+// Modbus request to address with size - 3 data bytes derived from seed, plus CRC
+Bytes modbusFrame(uint8_t address, uint8_t size, uint8_t seed) {
+  Bytes data(size);
+  data[0] = address;
+  data[1] = MODBUS_FUNCTION_WRITE_MULTIPLE_REGISTERS;
+  for (uint8_t i = 2; i < size - 2; i++) data[i] = seed + i * 37;
+  modbusAppendCRC(data.data(), size - 2);
+  return data;
+}
+
+// The bytes on air of payload wrapped in format
+Bytes wrap(const Bytes & payload, Format format, uint8_t sequence = 0) {
+  uint8_t frame[FRAME_BUFFER_SIZE];
+  memcpy(framePayload(frame), payload.data(), payload.size());
+  uint16_t length = 0;
+  uint8_t * first = frame;
+  switch (format) {
+  case STANDARD: length = wrapModbusRTU(frame, payload.size()); break;
+  case COMPACT: length = wrapCompactFrame(frame, payload.size()); first = frameStart(frame, true); break;
+  case SEQUENCED: length = wrapSequencedFrame(frame, payload.size(), sequence); break;
+  default: length = wrapFecFrame(frame, payload.size(), sequence); break;
+  }
+  return Bytes(first, first + length);
+}
+
+void append(Bytes & stream, const Bytes & bytes) {
+  stream.insert(stream.end(), bytes.begin(), bytes.end());
+}
+
+// Feeds a stream and collects the payloads of the frames it yields,
+// expiring the parser at the end like a receiver after a frame time of silence
+struct Receiver {
+  uint8_t buffer[FRAME_BUFFER_SIZE];
+  FrameParser parser;
+  std::vector<Bytes> frames;
+
+  Receiver() : parser(buffer + 0) {}
+
+  void take() {
+    FramePayload payload = parser.payload();
+    frames.push_back(Bytes(payload.data, payload.data + payload.size));
+  }
+
+  void feed(const Bytes & stream) {
+    for (uint8_t byteIn : stream) {
+      if (parser.feed(byteIn)) take();
+    }
+  }
+
+  void idle() {
+    while (parser.expire()) take();
+  }
+};
+
+TEST(parser_every_format) {
+  Bytes payload = modbusFrame(3, 13, 1);
+  for (int format = 0; format < FORMATS; format++) {
+    Receiver receiver;
+    receiver.feed(wrap(payload, (Format)format, 42));
+    CHECK_EQUAL(receiver.frames.size(), 1);
+    CHECK(receiver.frames.size() == 1 && receiver.frames[0] == payload);
+    CHECK(!receiver.parser.receiving());
+    CHECK_EQUAL(receiver.parser.compact(), format == COMPACT);
+    CHECK_EQUAL(receiver.parser.sequenced(), format == SEQUENCED || format == FEC);
+    CHECK_EQUAL(receiver.parser.fec(), format == FEC);
+    if (format == SEQUENCED || format == FEC) CHECK_EQUAL(receiver.parser.sequence(), 42);
+    CHECK_EQUAL(receiver.parser.dropped(), 0);
+  }
+}
+
+// A frame arriving in pieces completes with its last byte, not before
+TEST(parser_split_frame) {
+  Bytes payload = modbusFrame(7, 30, 2);
+  for (int format = 0; format < FORMATS; format++) {
+    Bytes frame = wrap(payload, (Format)format, 1);
+    for (size_t split = 1; split < frame.size(); split++) {
+      Receiver receiver;
+      receiver.feed(Bytes(frame.begin(), frame.begin() + split));
+      CHECK(receiver.frames.empty());
+      CHECK(receiver.parser.receiving());
+      receiver.feed(Bytes(frame.begin() + split, frame.end()));
+      CHECK(receiver.frames.size() == 1 && receiver.frames[0] == payload);
+    }
+  }
+}
+
+// Back to back frames of every format, with and without noise between them
+TEST(parser_merged_frames) {
+  Bytes stream;
+  std::vector<Bytes> sent;
+  for (int i = 0; i < 12; i++) {
+    sent.push_back(modbusFrame(i + 1, 8 + i, i));
+    append(stream, wrap(sent.back(), (Format)(i % FORMATS), i));
+    if (i % 3 == 2) append(stream, Bytes(i, 0x00));
+  }
+
+  Receiver receiver;
+  receiver.feed(stream);
+  CHECK(receiver.frames == sent);
+  CHECK_EQUAL(receiver.parser.dropped(), 0);
+}
+
+// A false start byte whose size swallows the frames behind it. The rescan
+// finds the first frame before the end of the received bytes, and the ones
+// behind it must still come out.
+TEST(parser_frames_behind_false_start) {
+  Bytes stream = {COMPACT_START_BYTE, 40};
+  std::vector<Bytes> sent;
+  for (int i = 0; i < 4; i++) {
+    sent.push_back(modbusFrame(i + 1, 8, i));
+    append(stream, wrap(sent.back(), COMPACT));
+  }
+
+  Receiver receiver;
+  receiver.feed(stream);
+  receiver.idle();
+  CHECK_EQUAL(receiver.frames.size(), 4);
+  CHECK(receiver.frames == sent);
+  CHECK(!receiver.parser.receiving());
+  CHECK_EQUAL(receiver.parser.dropped(), 1);
+}
+
+// The bytes kept behind a rescanned frame are replayed by expire() as well
+TEST(parser_frames_behind_false_start_expire) {
+  Bytes stream = {START_BYTE, 0, 60};
+  std::vector<Bytes> sent;
+  for (int i = 0; i < 2; i++) {
+    sent.push_back(modbusFrame(i + 1, 10, i));
+    append(stream, wrap(sent.back(), SEQUENCED, i));
+  }
+
+  Receiver receiver;
+  receiver.feed(stream);
+  CHECK(receiver.frames.empty());
+  receiver.idle();
+  CHECK(receiver.frames == sent);
+  CHECK(!receiver.parser.receiving());
+}
+
+// A claim for an answer built in place over the kept bytes makes the parser
+// drop them instead of replaying the answer
+TEST(parser_tail_claimed) {
+  // The false candidate ends 8 bytes into the second frame
+  Bytes stream = {COMPACT_START_BYTE, 18};
+  Bytes first = modbusFrame(1, 8, 1);
+  Bytes second = wrap(modbusFrame(2, 8, 2), COMPACT);
+  append(stream, wrap(first, COMPACT));
+  append(stream, Bytes(second.begin(), second.begin() + 8));
+
+  Receiver receiver;
+  receiver.feed(stream);
+  CHECK(receiver.frames.size() == 1 && receiver.frames[0] == first);
+  CHECK(receiver.parser.receiving());
+
+  uint16_t dropped = receiver.parser.dropped();
+  receiver.parser.claim();
+  CHECK(!receiver.parser.receiving());
+  CHECK_EQUAL(receiver.parser.dropped(), dropped + 1);
+  Bytes answer = wrap(modbusFrame(1, 25, 3), COMPACT);
+  memcpy(receiver.buffer + COMPACT_FRAME_OFFSET, answer.data(), answer.size());
+  receiver.idle();
+  CHECK_EQUAL(receiver.frames.size(), 1);
+  CHECK(!receiver.parser.receiving());
+
+  Bytes third = modbusFrame(3, 8, 4);
+  receiver.feed(wrap(third, COMPACT));
+  CHECK(receiver.frames.size() == 2 && receiver.frames[1] == third);
+}
+
+TEST(parser_corrupted_frame) {
+  Bytes first = modbusFrame(1, 12, 3);
+  Bytes second = modbusFrame(2, 12, 4);
+  for (int format = 0; format < FORMATS; format++) {
+    Bytes frame = wrap(first, (Format)format, 5);
+    for (size_t i = 1; i < frame.size(); i++) {
+      if (format == SEQUENCED && i == 1) continue; // The sequence number is not checked
+      Bytes stream = frame;
+      stream[i] ^= 0x10;
+      append(stream, wrap(second, (Format)format, 6));
+
+      Receiver receiver;
+      receiver.feed(stream);
+      receiver.idle();
+      // FEC repairs one byte per block; any other format loses the first frame
+      if (format == FEC) {
+        CHECK(receiver.frames.size() == 2 && receiver.frames[0] == first);
+        CHECK_EQUAL(receiver.parser.corrected(), 1);
+      } else {
+        CHECK(!receiver.frames.empty() && receiver.frames.back() == second);
+        CHECK_EQUAL(receiver.frames.size(), 1);
+      }
+    }
+  }
+}
+
+// A frame cut short is given up by expire(), and one sent after it is found
+TEST(parser_truncated_frame) {
+  Bytes first = modbusFrame(1, 20, 7);
+  Bytes second = modbusFrame(2, 9, 8);
+  for (int format = 0; format < FORMATS; format++) {
+    Bytes frame = wrap(first, (Format)format, 1);
+    Receiver receiver;
+    receiver.feed(Bytes(frame.begin(), frame.end() - 3));
+    receiver.idle();
+    CHECK(receiver.frames.empty());
+    CHECK(!receiver.parser.receiving());
+    CHECK(receiver.parser.dropped() > 0);
+    receiver.feed(wrap(second, (Format)format, 2));
+    CHECK(receiver.frames.size() == 1 && receiver.frames[0] == second);
+  }
+}
+
+// Random noise, including start bytes, between frames of random formats.
+// Every frame comes out unless the noise forms a valid frame with it, and
+// then only frames that were sent come out, in order.
+TEST(parser_noisy_streams) {
+  srand(1);
+  unsigned sentCount = 0;
+  unsigned receivedCount = 0;
+  for (int run = 0; run < 2000; run++) {
+    Bytes stream;
+    std::vector<Bytes> sent;
+    for (int i = 0; i < 8; i++) {
+      int noise = rand() % 12;
+      for (int j = 0; j < noise; j++) {
+        stream.push_back(rand() % 4 == 0 ? (rand() % 2 ? START_BYTE : 0xA5 + rand() % 3) : rand() % 256);
+      }
+      sent.push_back(modbusFrame(1 + rand() % 247, 4 + rand() % 40, rand()));
+      append(stream, wrap(sent.back(), (Format)(rand() % FORMATS), rand()));
+    }
+
+    Receiver receiver;
+    receiver.feed(stream);
+    receiver.idle();
+    size_t next = 0;
+    for (const Bytes & frame : receiver.frames) {
+      while (next < sent.size() && sent[next] != frame) next++;
+      if (next < sent.size()) {
+        receivedCount++;
+        next++;
+      }
+    }
+    sentCount += sent.size();
+  }
+  printf("parser_noisy_streams sent=%u received=%u\n", sentCount, receivedCount);
+  CHECK(receivedCount >= sentCount * 999 / 1000);
+}
+
+} // namespace
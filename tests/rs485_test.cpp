@@ -0,0 +1,132 @@
+/*
+ * RS485 bus release of the controller sketch: DE driven by rs485Write() and
+ * dropped from its USART TX complete interrupt, against the simulator's USART
+ * model (tools/sim). scripts/build-tests.sh copies controller.ino as
+ * controller_sketch.h, with its prototypes in controller_sketch.proto.h. The
+ * simulator runs once per process, so each run is a child process.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <functional>
+#include <vector>
+#include <Arduino.h>
+#include <SoftwareSerial.h>
+#include <ClayCastFrame.h>
+#include <ClayCastModbus.h>
+#include <ClayCastHC12.h>
+#include <ClayCastEcho.h>
+#include "sim.h"
+#include "test.h"
+
+namespace controller {
+#include "controller_sketch.proto.h"
+#include "controller_sketch.h"
+}
+
+namespace {
+
+using namespace sim;
+
+const uint16_t ANSWER_SIZE = 37; // An event log window, more than the ring holds at once
+const Time RUN_LIMIT = 200 * MILLISECOND;
+
+struct Release {
+  std::vector<Time> deLow; // Times DE went low
+  Time lastByteEnd; // End of the last stop bit on the line
+  uint32_t bytes;
+  uint32_t vectors; // TX complete interrupts taken
+  uint32_t vectorsWithUdrie; // ... of them with UDRIE0 still set
+};
+
+Node * node = nullptr;
+bool staleTxc = false; // Raise TXC while bytes are still queued
+Release release;
+
+// ISR(USART_TX_vect) as the simulator enters it, counted
+void txComplete() {
+  release.vectors++;
+  if (UCSR0B & _BV(UDRIE0)) release.vectorsWithUdrie++;
+  controller::USART_TX_vect();
+}
+
+void rs485Setup() {
+  Serial.begin(BAUD_RATE);
+  pinMode(RS485_DE, OUTPUT);
+  digitalWrite(RS485_DE, LOW);
+
+  uint8_t answer[ANSWER_SIZE];
+  for (uint16_t i = 0; i < ANSWER_SIZE; i++) answer[i] = i;
+  controller::rs485Write(answer, ANSWER_SIZE);
+
+  // The flag a late UDRE interrupt leaves behind (the line went idle while
+  // SoftwareSerial held interrupts off), taken with the rest still queued
+  if (staleTxc) node->uart.txc = true;
+}
+
+void rs485Loop() {
+}
+
+const SketchEntry rs485Sketch = {
+  "controller", 0, 0, rs485Setup, rs485Loop, txComplete, nullptr, nullptr, NO_PIN, RS485_DE, NO_PIN
+};
+
+// Send one answer and check how the bus was released: DE low once, after the
+// last stop bit and within a character time of it. Returns whether the run
+// finished and its checks passed.
+bool simulate(bool stale, const std::function<void(const Release &)> & checkVectors) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) return false;
+
+  if (pid == 0) {
+    unsigned before = test::failedCheckCount();
+    staleTxc = stale;
+    node = &addSketchNode(rs485Sketch);
+    node->pinObserver = [](uint8_t pin, uint8_t level, Time when) {
+      if (pin == RS485_DE && level == LOW) release.deLow.push_back(when);
+    };
+    node->uart.sink = [](uint8_t, Time, Time end) {
+      release.bytes++;
+      release.lastByteEnd = end;
+    };
+
+    addScriptNode([]() {
+      sleep(RUN_LIMIT);
+    });
+    run(~(Time) 0);
+
+    CHECK_EQUAL(release.bytes, ANSWER_SIZE);
+    CHECK_EQUAL(release.deLow.size(), 1);
+    if (release.deLow.size() == 1) {
+      CHECK(release.deLow[0] >= release.lastByteEnd);
+      CHECK(release.deLow[0] - release.lastByteEnd <= charTime(BAUD_RATE));
+    }
+    checkVectors(release);
+    fflush(stdout);
+    _exit(test::failedCheckCount() == before ? 0 : 1);
+  }
+
+  int status = 0;
+  waitpid(pid, &status, 0);
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+} // namespace
+
+TEST(rs485_de_released_after_last_stop_bit) {
+  CHECK(simulate(false, [](const Release & result) {
+    CHECK_EQUAL(result.vectors, 1);
+    CHECK_EQUAL(result.vectorsWithUdrie, 0);
+  }));
+}
+
+// The vector taken mid-answer leaves DE high; the one after the last byte drops it
+TEST(rs485_de_kept_while_udrie_set) {
+  CHECK(simulate(true, [](const Release & result) {
+    CHECK_EQUAL(result.vectorsWithUdrie, 1);
+    CHECK_EQUAL(result.vectors, 2);
+  }));
+}
@@ -0,0 +1,34 @@
+/*
+ * Minimal test harness for the native tests (scripts/build-tests.sh).
+ *
+ * TEST(name) { ... } defines and registers a test; CHECK() and CHECK_EQUAL()
+ * report a failed check with its file and line and let the test go on.
+ */
+
+#ifndef CLAYCAST_TEST_H
+#define CLAYCAST_TEST_H
+
+namespace test {
+
+typedef void (*TestFunction)();
+
+struct Registration {
+  Registration(const char * name, TestFunction function);
+};
+
+void check(bool ok, const char * expression, const char * file, int line);
+void checkEqual(long long actual, long long expected, const char * expression, const char * file, int line);
+unsigned failedCheckCount(); // Failed checks so far, for tests that check in a child process
+
+} // namespace test
+
+#define TEST(name) \
+  static void name(); \
+  static test::Registration name##_registration(#name, name); \
+  static void name()
+
+#define CHECK(condition) test::check((condition), #condition, __FILE__, __LINE__)
+#define CHECK_EQUAL(actual, expected) \
+  test::checkEqual((long long)(actual), (long long)(expected), #actual " == " #expected, __FILE__, __LINE__)
+
+#endif
@@ -0,0 +1,21 @@
+/*
+ * ClayCast AVR benchmark
+ *
+ * Runs the client's hot paths on the ATmega328p at 16 MHz and prints one line
+ * per measurement on Serial, "name key=value ...", with times in CPU cycles.
+ * Built and run under simavr by scripts/bench-avr.sh; the cases are in
+ * benchmark.cpp. Stops the CPU when done, which ends the simulation.
+ */
+
+#include <SoftwareSerial.h>
+#include <ClayCastFrame.h>
+#include <ClayCastModbus.h>
+#include <ClayCastHC12.h>
+#include "benchmark.h"
+
+void setup() {
+  runBenchmarks();
+}
+
+void loop() {
+}
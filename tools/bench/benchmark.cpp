@@ -0,0 +1,377 @@
+/*
+ * Benchmark cases and the cycle counter.
+ *
+ * - Timer1 runs at the CPU clock; its overflow interrupt extends it to 32 bits
+ * - every case is a noinline step called through a pointer, timed from outside;
+ *   the cost of timing an empty step is subtracted
+ * - each case runs several times from the same input, after an untimed
+ *   prepare step; the fastest and slowest run are reported. The millis()
+ *   interrupt lands in some runs, so the maximum includes it.
+ * - the free SRAM is painted before main() and scanned at the end for the
+ *   deepest byte the stack reached
+ */
+
+#include <Arduino.h>
+#include <avr/sleep.h>
+#include <string.h>
+#include <SoftwareSerial.h>
+#include <ClayCastFrame.h>
+#include <ClayCastModbus.h>
+#include <ClayCastHC12.h>
+#include "benchmark.h"
+#include "client_under_test.h"
+
+#define BENCH_REPEATS 16 // Runs per function case
+#define LOOP_IDLE_PASSES 1000 // loop() passes without radio traffic
+#define LOOP_REQUEST_PASSES 4 // loop() passes that answer a request
+#define CRC_BENCH_BYTES 64 // Input length for the CRC kernels
+#define STACK_PAINT 0xC5
+
+extern uint8_t _end; // End of .data and .bss (no heap is used)
+extern uint8_t __stack; // RAMEND
+
+// Fill the free SRAM before the stack is set up. Runs ahead of the C runtime
+// (the zero register is not cleared yet), so it is written in assembly.
+void paintStack() __attribute__((naked, used, section(".init1")));
+void paintStack() {
+  asm volatile(
+    "  ldi r30, lo8(_end)\n"
+    "  ldi r31, hi8(_end)\n"
+    "  ldi r24, %0\n"
+    "  ldi r25, hi8(__stack)\n"
+    "  rjmp 2f\n"
+    "1: st Z+, r24\n"
+    "2: cpi r30, lo8(__stack)\n"
+    "  cpc r31, r25\n"
+    "  brlo 1b\n"
+    "  breq 1b\n"
+    :: "M" (STACK_PAINT));
+}
+
+namespace {
+
+struct BenchResult {
+  uint32_t min;
+  uint32_t max;
+};
+
+typedef void (*BenchStep)();
+
+volatile uint16_t timerOverflows = 0;
+uint32_t overhead = 0; // Cycles measured for an empty step
+
+// Inputs and outputs of the steps. Results go to volatiles so the work is kept.
+uint8_t frame[FRAME_BUFFER_SIZE]; // Wrap, unwrap and processModbusRequest work in place here
+uint8_t wire[FRAME_BUFFER_SIZE]; // A wrapped request as it arrives over the air
+uint8_t parserBuffer[FRAME_BUFFER_SIZE];
+FrameParser parser(parserBuffer);
+uint8_t crcInput[CRC_BENCH_BYTES];
+
+uint8_t request[16]; // Modbus request for the current case, with CRC
+uint8_t requestLength = 0;
+uint16_t wireLength = 0;
+uint16_t dataSize = 0;
+
+volatile uint16_t resultValue;
+volatile bool resultFlag;
+
+// Timer1 at the CPU clock, replacing the core's PWM setup (nothing here uses analogWrite)
+void startCycleCounter() {
+  TCCR1A = 0;
+  TCCR1B = _BV(CS10);
+  TCNT1 = 0;
+  TIFR1 = _BV(TOV1);
+  TIMSK1 = _BV(TOIE1);
+}
+
+// CPU cycles since startCycleCounter(). Interrupts may be off for less than
+// one timer period (4 ms) at a time, e.g. while SoftwareSerial sends a byte.
+uint32_t cycles() {
+  uint8_t sreg = SREG;
+  cli();
+  uint16_t low = TCNT1;
+  uint16_t high = timerOverflows;
+  if ((TIFR1 & _BV(TOV1)) && low < 0x8000) high++; // Wrapped, interrupt still pending
+  SREG = sreg;
+  return ((uint32_t) high << 16) | low;
+}
+
+void emptyStep() __attribute__((noinline));
+void emptyStep() {
+}
+
+// Time step repeats times, each after an untimed prepare (may be null)
+BenchResult measure(BenchStep prepare, BenchStep step, uint16_t repeats) {
+  BenchResult result = {0xFFFFFFFF, 0};
+  for (uint16_t i = 0; i < repeats; i++) {
+    Serial.flush(); // Keep the UART interrupt of earlier output out of the run
+    if (prepare) prepare();
+
+    uint32_t start = cycles();
+    step();
+    uint32_t elapsed = cycles() - start;
+
+    elapsed = elapsed > overhead ? elapsed - overhead : 0;
+    if (elapsed < result.min) result.min = elapsed;
+    if (elapsed > result.max) result.max = elapsed;
+  }
+  return result;
+}
+
+void report(const __FlashStringHelper * name, uint16_t bytes, BenchResult result) {
+  Serial.print(name);
+  Serial.print(F(" bytes="));
+  Serial.print(bytes);
+  Serial.print(F(" cycles_min="));
+  Serial.print(result.min);
+  Serial.print(F(" cycles_max="));
+  Serial.print(result.max);
+  Serial.print(F(" us_max="));
+  Serial.println(result.max / clockCyclesPerMicrosecond());
+}
+
+void reportCRC(const __FlashStringHelper * name, BenchResult result) {
+  Serial.print(name);
+  Serial.print(F(" bytes="));
+  Serial.print(CRC_BENCH_BYTES);
+  Serial.print(F(" cycles_min="));
+  Serial.print(result.min);
+  Serial.print(F(" cycles_per_byte="));
+  Serial.println((float) result.min / CRC_BENCH_BYTES, 1);
+}
+
+// 8 byte request: address, function, two 16 bit fields, CRC
+void setRequest(uint8_t address, uint8_t function, uint16_t first, uint16_t second) {
+  request[0] = address;
+  request[1] = function;
+  request[2] = first >> 8;
+  request[3] = first & 0xFF;
+  request[4] = second >> 8;
+  request[5] = second & 0xFF;
+  modbusAppendCRC(request, 6);
+  requestLength = 8;
+}
+
+// Write of value to one register with 0x10
+void setWriteMultipleRequest(uint16_t address, uint16_t value) {
+  const uint8_t body[] = {
+    client::sketchAddress, MODBUS_FUNCTION_WRITE_MULTIPLE_REGISTERS,
+    (uint8_t)(address >> 8), (uint8_t)(address & 0xFF), 0x00, 0x01, 0x02,
+    (uint8_t)(value >> 8), (uint8_t)(value & 0xFF)
+  };
+  memcpy(request, body, sizeof(body));
+  modbusAppendCRC(request, sizeof(body));
+  requestLength = sizeof(body) + 2;
+}
+
+// 0x17: read 4 registers from 0, write value to one register
+void setReadWriteRequest(uint16_t address, uint16_t value) {
+  const uint8_t body[] = {
+    client::sketchAddress, MODBUS_FUNCTION_READ_WRITE_MULTIPLE_REGISTERS,
+    0x00, 0x00, 0x00, 0x04,
+    (uint8_t)(address >> 8), (uint8_t)(address & 0xFF), 0x00, 0x01, 0x02,
+    (uint8_t)(value >> 8), (uint8_t)(value & 0xFF)
+  };
+  memcpy(request, body, sizeof(body));
+  modbusAppendCRC(request, sizeof(body));
+  requestLength = sizeof(body) + 2;
+}
+
+// Wrap the current request as the controller sends it
+void wrapRequest() {
+  memcpy(framePayload(wire), request, requestLength);
+  wireLength = wrapModbusRTU(wire, requestLength);
+}
+
+// Steps and their prepare functions
+
+void crcBitwise() __attribute__((noinline));
+void crcBitwise() {
+  resultValue = modbusCRCBitwise(0xFFFF, crcInput, CRC_BENCH_BYTES);
+}
+
+void crcNibble() __attribute__((noinline));
+void crcNibble() {
+  resultValue = modbusCRCNibble(0xFFFF, crcInput, CRC_BENCH_BYTES);
+}
+
+void crcTable() __attribute__((noinline));
+void crcTable() {
+  resultValue = modbusCRCTable(0xFFFF, crcInput, CRC_BENCH_BYTES);
+}
+
+void crcAvr() __attribute__((noinline));
+void crcAvr() {
+  resultValue = modbusCRCAvr(0xFFFF, crcInput, CRC_BENCH_BYTES);
+}
+
+void copyRequestPayload() {
+  memcpy(framePayload(frame), request, requestLength);
+  dataSize = requestLength;
+}
+
+void copyWire() {
+  memcpy(frame, wire, wireLength);
+}
+
+void wrapLegacy() __attribute__((noinline));
+void wrapLegacy() {
+  resultValue = wrapModbusRTU(frame, dataSize);
+}
+
+void wrapCompact() __attribute__((noinline));
+void wrapCompact() {
+  resultValue = wrapCompactFrame(frame, dataSize);
+}
+
+void unwrapLegacy() __attribute__((noinline));
+void unwrapLegacy() {
+  FramePayload payload;
+  resultFlag = unwrapModbusRTU(frame, wireLength, &payload);
+}
+
+void resetParser() {
+  parser.reset();
+}
+
+void feedFrame() __attribute__((noinline));
+void feedFrame() {
+  bool done = false;
+  for (uint16_t i = 0; i < wireLength; i++) done = parser.feed(wire[i]);
+  resultFlag = done;
+}
+
+void processRequest() __attribute__((noinline));
+void processRequest() {
+  uint8_t * data = framePayload(frame);
+  resultValue = client::processModbusRequest(data, requestLength, data);
+}
+
+void clientLoop() __attribute__((noinline));
+void clientLoop() {
+  client::loop();
+}
+
+// Leave the current request in the client's parser behind an unfinished
+// compact frame, with the line idle for longer than the frame time. The next
+// loop() takes the broken frame path: it rescans the buffer, finds the
+// request, answers it over SoftwareSerial and prints the debug lines. This is
+// the slowest way a request can reach processModbusRequest.
+void queueRequest() {
+  client::hc12Parser.reset();
+  client::hc12Parser.feed(COMPACT_START_BYTE);
+  client::hc12Parser.feed(COMPACT_MAX_DATA_SIZE);
+  for (uint16_t i = 0; i < wireLength; i++) client::hc12Parser.feed(wire[i]);
+  client::hc12_lastByteTime = millis() - 1000;
+  client::lastFrameTime = millis();
+}
+
+void benchCRC() {
+  for (uint8_t i = 0; i < CRC_BENCH_BYTES; i++) crcInput[i] = i * 37 + 11;
+
+  reportCRC(F("crc_bitwise"), measure(nullptr, crcBitwise, BENCH_REPEATS));
+  reportCRC(F("crc_nibble"), measure(nullptr, crcNibble, BENCH_REPEATS));
+  reportCRC(F("crc_table"), measure(nullptr, crcTable, BENCH_REPEATS));
+  reportCRC(F("crc_avr"), measure(nullptr, crcAvr, BENCH_REPEATS));
+}
+
+// Framing of the largest answer in use: 4 registers read (13 bytes)
+void benchFraming() {
+  setRequest(client::sketchAddress, MODBUS_FUNCTION_READ_HOLDING_REGISTERS, 0, 4);
+  copyRequestPayload();
+  dataSize = client::processModbusRequest(framePayload(frame), requestLength, framePayload(frame));
+  memcpy(request, framePayload(frame), dataSize);
+  requestLength = dataSize;
+
+  report(F("wrapModbusRTU"), dataSize, measure(copyRequestPayload, wrapLegacy, BENCH_REPEATS));
+  report(F("wrapCompactFrame"), dataSize, measure(copyRequestPayload, wrapCompact, BENCH_REPEATS));
+
+  wrapRequest();
+  report(F("unwrapModbusRTU"), wireLength, measure(copyWire, unwrapLegacy, BENCH_REPEATS));
+  report(F("FrameParser_feed"), wireLength, measure(resetParser, feedFrame, BENCH_REPEATS));
+}
+
+// processModbusRequest for every request the controller sends. FIRE is
+// written as 0, so the later loop() passes do not fire.
+void benchRequests() {
+  uint16_t ownBit = 1u << ((client::sketchAddress - 1) % 16);
+
+  setRequest(client::sketchAddress, MODBUS_FUNCTION_READ_HOLDING_REGISTERS, 0, 4);
+  report(F("process_read"), requestLength, measure(copyRequestPayload, processRequest, BENCH_REPEATS));
+
+  setRequest(client::sketchAddress, MODBUS_FUNCTION_WRITE_SINGLE_REGISTER, 1, 0);
+  report(F("process_write_single"), requestLength, measure(copyRequestPayload, processRequest, BENCH_REPEATS));
+
+  setWriteMultipleRequest(1, 0);
+  report(F("process_write_multiple"), requestLength, measure(copyRequestPayload, processRequest, BENCH_REPEATS));
+
+  setReadWriteRequest(1, 0);
+  report(F("process_read_write"), requestLength, measure(copyRequestPayload, processRequest, BENCH_REPEATS));
+
+  // Group fire of the other machines
+  setRequest(MODBUS_BROADCAST_ADDRESS, MODBUS_FUNCTION_WRITE_SINGLE_REGISTER, GROUP_FIRE_REGISTER, ~ownBit);
+  report(F("process_group_fire"), requestLength, measure(copyRequestPayload, processRequest, BENCH_REPEATS));
+
+  setRequest(client::sketchAddress + 1, MODBUS_FUNCTION_READ_HOLDING_REGISTERS, 0, 4);
+  report(F("process_other_slave"), requestLength, measure(copyRequestPayload, processRequest, BENCH_REPEATS));
+}
+
+void benchLoop() {
+  report(F("loop_idle"), 0, measure(nullptr, clientLoop, LOOP_IDLE_PASSES));
+
+  setRequest(client::sketchAddress, MODBUS_FUNCTION_READ_HOLDING_REGISTERS, 0, 4);
+  wrapRequest();
+  report(F("loop_request"), wireLength, measure(queueRequest, clientLoop, LOOP_REQUEST_PASSES));
+}
+
+// Deepest stack use of the whole run. A pushed byte equal to STACK_PAINT at
+// the very bottom would hide a byte or two, which is within the noise here.
+void reportStack() {
+  const uint8_t * lowest = &_end;
+  while (lowest <= &__stack && *lowest == STACK_PAINT) lowest++;
+
+  Serial.print(F("stack peak_bytes="));
+  Serial.print((uint16_t)(&__stack - lowest + 1));
+  Serial.print(F(" bench_static_bytes="));
+  Serial.print((uint16_t)(&_end - (uint8_t *) RAMSTART));
+  Serial.print(F(" bench_free_bytes="));
+  Serial.println((uint16_t)(lowest - &_end));
+}
+
+} // namespace
+
+ISR(TIMER1_OVF_vect) {
+  timerOverflows++;
+}
+
+void runBenchmarks() {
+  // The client's setup() without the HC-12 configuration, which needs a module
+  Serial.begin(client::sketchBaudRate);
+  client::hc12Link.begin(HC12_DEFAULT_BAUD);
+  client::lastFrameTime = millis();
+
+  startCycleCounter();
+  overhead = measure(nullptr, emptyStep, BENCH_REPEATS).min;
+
+  Serial.print(F("bench f_cpu="));
+  Serial.print(F_CPU);
+  Serial.print(F(" crc_impl="));
+  Serial.print(MODBUS_CRC_IMPL);
+  Serial.print(F(" overhead_cycles="));
+  Serial.println(overhead);
+
+  benchCRC();
+  benchFraming();
+  benchRequests();
+  benchLoop();
+  reportStack();
+
+  Serial.println(F("done"));
+  Serial.flush();
+
+  // Sleeping with interrupts off ends the simulation
+  set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+  sleep_enable();
+  cli();
+  sleep_cpu();
+}
@@ -0,0 +1,7 @@
+#ifndef CLAYCAST_BENCHMARK_H
+#define CLAYCAST_BENCHMARK_H
+
+// Run every case, print the results and stop the CPU
+void runBenchmarks();
+
+#endif
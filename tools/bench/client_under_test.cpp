@@ -0,0 +1,20 @@
+/*
+ * Client sketch as part of the benchmark build. scripts/bench-avr.sh copies
+ * client.ino next to this file as client_sketch.h, with its prototypes in
+ * client_sketch.proto.h, as the Arduino builder would generate them.
+ */
+
+#include <Arduino.h>
+#include <SoftwareSerial.h>
+#include <ClayCastFrame.h>
+#include <ClayCastModbus.h>
+#include <ClayCastHC12.h>
+#include "client_under_test.h"
+
+namespace client {
+#include "client_sketch.proto.h"
+#include "client_sketch.h"
+
+const uint32_t sketchBaudRate = BAUD_RATE;
+const uint8_t sketchAddress = MODBUS_ADDRESS;
+}
@@ -0,0 +1,29 @@
+/*
+ * The parts of the client sketch the benchmark calls. The sketch itself is
+ * compiled in namespace client by client_under_test.cpp.
+ */
+
+#ifndef CLAYCAST_CLIENT_UNDER_TEST_H
+#define CLAYCAST_CLIENT_UNDER_TEST_H
+
+#include <SoftwareSerial.h>
+#include <ClayCastFrame.h>
+#include <ClayCastHC12.h>
+
+namespace client {
+
+extern SoftwareSerial hc12;
+extern HC12Link hc12Link;
+extern FrameParser hc12Parser;
+extern uint32_t hc12_lastByteTime;
+extern uint32_t lastFrameTime;
+
+extern const uint32_t sketchBaudRate; // BAUD_RATE
+extern const uint8_t sketchAddress; // MODBUS_ADDRESS
+
+int processModbusRequest(uint8_t * request, int requestLength, uint8_t * response);
+void loop();
+
+} // namespace client
+
+#endif
@@ -0,0 +1,193 @@
+#!/usr/bin/env python3
+"""
+Runs the CRC kernels of crc_kernels.ll, as llc compiled them for the
+ATmega328p, on a small AVR interpreter that counts cycles (timings of the AVR
+instruction set manual for a 16 bit program counter). It knows the
+instructions llc emits for these kernels and stops on any other.
+
+Usage: avr_cycles.py kernels.s sizes.txt
+  kernels.s  llc assembly output
+  sizes.txt  llvm-nm -S of the object, for the code and table sizes
+
+Prints one "name key=value ..." line per kernel, like the AVR benchmark.
+Every kernel is checked against the bitwise CRC first.
+"""
+
+import random
+import re
+import sys
+
+CYCLES = {'ld': 2, 'lpm': 3, 'adiw': 2, 'rjmp': 2, 'push': 2, 'pop': 2, 'ret': 4}
+TABLES = {'nibble': 0x0100, 'table': 0x0200}  # Flash addresses of the tables
+DATA_ADDRESS = 0x0200  # SRAM address of the bytes
+SIZES = (8, 64, 256)  # Bytes per run; a Modbus frame is at most 256
+KERNELS = ('crc_bitwise', 'crc_nibble', 'crc_table', 'crc_avr')
+
+
+def parse(path):
+    """Instructions of each function, labels and table contents."""
+    functions, labels, flash = {}, {}, {}
+    code, table, address = None, None, 0
+    for line in open(path):
+        line = line.split(';')[0].rstrip()
+        if not line.strip():
+            continue
+        label = re.match(r'^([\w.]+):', line)
+        if label:
+            name = label.group(1)
+            if name in TABLES:
+                code, table, address = None, name, TABLES[name]
+            else:
+                if not name.startswith('.'):
+                    code, table = functions.setdefault(name, []), None
+                if code is not None:
+                    labels[name] = (code, len(code))
+            continue
+        fields = line.split(None, 1)
+        operands = [field.strip() for field in fields[1].split(',')] if len(fields) > 1 else []
+        if fields[0] == '.short' and table:
+            value = int(operands[0]) & 0xFFFF
+            flash[address], flash[address + 1] = value & 0xFF, value >> 8
+            address += 2
+        elif not fields[0].startswith('.') and code is not None:
+            code.append((fields[0], operands))
+    return functions, labels, flash
+
+
+def immediate(operand):
+    """An immediate; -lo8(table) and -hi8(table) as the assembler resolves them."""
+    symbol = re.match(r'-(lo8|hi8)\((\w+)\)', operand)
+    if symbol:
+        value = -TABLES[symbol.group(2)] & 0xFFFF
+        return value & 0xFF if symbol.group(1) == 'lo8' else value >> 8
+    return int(operand, 0) & 0xFF
+
+
+def run(functions, labels, flash, name, crc, data):
+    """Calls a kernel like avr-gcc would (crc, data, length); returns (crc, cycles)."""
+    code = functions[name]
+    r = [0] * 32
+    memory = {DATA_ADDRESS + i: byte for i, byte in enumerate(data)}
+    r[24], r[25] = crc & 0xFF, crc >> 8
+    r[22], r[23] = DATA_ADDRESS & 0xFF, DATA_ADDRESS >> 8
+    r[20], r[21] = len(data) & 0xFF, len(data) >> 8
+    stack = []
+    carry = zero = False
+    pc = cycles = 0
+
+    def reg(operand):
+        return int(operand[1:])
+
+    def word(d):
+        return r[d] | r[d + 1] << 8
+
+    def set_word(d, value):
+        r[d], r[d + 1] = value & 0xFF, value >> 8
+
+    while True:
+        op, operands = code[pc]
+        pc += 1
+        cycles += CYCLES.get(op, 1)
+        d = reg(operands[0]) if operands and operands[0].startswith('r') else None
+        if op == 'ret':
+            return word(24), cycles
+        elif op == 'push':
+            stack.append(r[d])
+        elif op == 'pop':
+            r[d] = stack.pop()
+        elif op == 'ldi':
+            r[d] = immediate(operands[1])
+        elif op == 'mov':
+            r[d] = r[reg(operands[1])]
+        elif op == 'movw':
+            set_word(d, word(reg(operands[1])))
+        elif op == 'clr':
+            r[d], zero = 0, True
+        elif op == 'swap':
+            r[d] = (r[d] << 4 | r[d] >> 4) & 0xFF
+        elif op in ('eor', 'and', 'or', 'andi'):
+            value = immediate(operands[1]) if op == 'andi' else r[reg(operands[1])]
+            r[d] = {'eor': r[d] ^ value, 'or': r[d] | value}.get(op, r[d] & value)
+            zero = r[d] == 0
+        elif op in ('inc', 'dec'):
+            r[d] = (r[d] + (1 if op == 'inc' else -1)) & 0xFF
+            zero = r[d] == 0
+        elif op in ('add', 'adc'):
+            value = r[d] + r[reg(operands[1])] + (carry if op == 'adc' else 0)
+            r[d], carry = value & 0xFF, value > 0xFF
+            zero = r[d] == 0
+        elif op in ('sub', 'sbc', 'subi', 'sbci', 'cp', 'cpc', 'cpi'):
+            value = immediate(operands[1]) if op in ('subi', 'sbci', 'cpi') else r[reg(operands[1])]
+            chained = op in ('sbc', 'sbci', 'cpc')  # Carry in, and Z only stays set
+            value = r[d] - value - (carry if chained else 0)
+            carry = value < 0
+            zero = (value & 0xFF) == 0 and (zero or not chained)
+            if not op.startswith('cp'):
+                r[d] = value & 0xFF
+        elif op == 'adiw':
+            value = word(d) + int(operands[1])
+            carry, zero = value > 0xFFFF, (value & 0xFFFF) == 0
+            set_word(d, value & 0xFFFF)
+        elif op in ('lsr', 'ror'):
+            bit7 = carry if op == 'ror' else 0
+            carry, r[d] = r[d] & 1, r[d] >> 1 | bit7 << 7
+            zero = r[d] == 0
+        elif op in ('lsl', 'rol'):
+            bit0 = carry if op == 'rol' else 0
+            carry, r[d] = r[d] >> 7, (r[d] << 1 | bit0) & 0xFF
+            zero = r[d] == 0
+        elif op == 'ld':
+            r[d] = memory[word({'X': 26, 'Y': 28, 'Z': 30}[operands[1][0]])]
+        elif op == 'lpm':
+            r[d] = flash[word(30)]
+            if operands[1] == 'Z+':
+                set_word(30, word(30) + 1)
+        elif op in ('rjmp', 'breq', 'brne', 'brcs', 'brlo', 'brcc', 'brsh'):
+            taken = {'rjmp': True, 'breq': zero, 'brne': not zero, 'brcs': carry, 'brlo': carry,
+                     'brcc': not carry, 'brsh': not carry}[op]
+            if taken:
+                cycles += 0 if op == 'rjmp' else 1
+                target, pc = labels[operands[0]]
+                assert target is code
+        else:
+            sys.exit('avr_cycles.py: %s uses %s, which is not modelled' % (name, op))
+
+
+def reference(crc, data):
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0xA001 if crc & 1 else crc >> 1
+    return crc
+
+
+def main():
+    functions, labels, flash = parse(sys.argv[1])
+    sizes = {}
+    for line in open(sys.argv[2]):
+        fields = line.split()
+        if len(fields) == 4:
+            sizes[fields[3]] = int(fields[1], 16)
+    table_bytes = {'crc_nibble': sizes['nibble'], 'crc_table': sizes['table']}
+
+    rng = random.Random(1)
+    for name in KERNELS:
+        for _ in range(200):
+            data = [rng.randrange(256) for _ in range(rng.randrange(1, 40))]
+            crc = rng.randrange(0x10000)
+            if run(functions, labels, flash, name, crc, data)[0] != reference(crc, data):
+                sys.exit('avr_cycles.py: %s gives a wrong CRC' % name)
+
+        # Cost per byte: the slope from an empty call, over random data (the
+        # bitwise kernel's branches depend on it)
+        empty = run(functions, labels, flash, name, 0xFFFF, [])[1]
+        per_byte = []
+        for size in SIZES:
+            data = [rng.randrange(256) for _ in range(size)]
+            per_byte.append((run(functions, labels, flash, name, 0xFFFF, data)[1] - empty) / size)
+        print('%s cycles_per_byte=%.1f cycles_per_byte_max=%.1f call_cycles=%d code_bytes=%d table_bytes=%d' % (
+            name, per_byte[-1], max(per_byte), empty, sizes[name], table_bytes.get(name, 0)))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,126 @@
+; CRC-16/MODBUS kernels of ClayCastModbus.h, written out by hand in LLVM IR
+; for scripts/bench-crc.sh, which measures them where avr-gcc and simavr are
+; missing: llc compiles IR for the ATmega328p. Keep each function in step with
+; its C++ original; the script checks their results against the bitwise CRC.
+; Tables are in address space 1 (program memory, read with lpm), like the
+; PROGMEM tables.
+
+target datalayout = "e-P1-p:16:8-i8:8-i16:8-i32:8-i64:8-f32:8-f64:8-n8-a:8"
+target triple = "avr"
+
+; modbusCrcNibbleTable
+@nibble = internal addrspace(1) constant [16 x i16] [i16 0, i16 -13311, i16 -10239, i16 5120, i16 -4095, i16 15360, i16 10240, i16 -7167, i16 -24575, i16 27648, i16 30720, i16 -19455, i16 20480, i16 -25599, i16 -30719, i16 17408], align 1
+; modbusCrcTable
+@table = internal addrspace(1) constant [256 x i16] [i16 0, i16 -16191, i16 -15999, i16 320, i16 -15615, i16 960, i16 640, i16 -15807, i16 -14847, i16 1728, i16 1920, i16 -14527, i16 1280, i16 -14911, i16 -15231, i16 1088, i16 -13311, i16 3264, i16 3456, i16 -12991, i16 3840, i16 -12351, i16 -12671, i16 3648, i16 2560, i16 -13631, i16 -13439, i16 2880, i16 -14079, i16 2496, i16 2176, i16 -14271, i16 -10239, i16 6336, i16 6528, i16 -9919, i16 6912, i16 -9279, i16 -9599, i16 6720, i16 7680, i16 -8511, i16 -8319, i16 8000, i16 -8959, i16 7616, i16 7296, i16 -9151, i16 5120, i16 -11071, i16 -10879, i16 5440, i16 -10495, i16 6080, i16 5760, i16 -10687, i16 -11775, i16 4800, i16 4992, i16 -11455, i16 4352, i16 -11839, i16 -12159, i16 4160, i16 -4095, i16 12480, i16 12672, i16 -3775, i16 13056, i16 -3135, i16 -3455, i16 12864, i16 13824, i16 -2367, i16 -2175, i16 14144, i16 -2815, i16 13760, i16 13440, i16 -3007, i16 15360, i16 -831, i16 -639, i16 15680, i16 -255, i16 16320, i16 16000, i16 -447, i16 -1535, i16 15040, i16 15232, i16 -1215, i16 14592, i16 -1599, i16 -1919, i16 14400, i16 10240, i16 -5951, i16 -5759, i16 10560, i16 -5375, i16 11200, i16 10880, i16 -5567, i16 -4607, i16 11968, i16 12160, i16 -4287, i16 11520, i16 -4671, i16 -4991, i16 11328, i16 -7167, i16 9408, i16 9600, i16 -6847, i16 9984, i16 -6207, i16 -6527, i16 9792, i16 8704, i16 -7487, i16 -7295, i16 9024, i16 -7935, i16 8640, i16 8320, i16 -8127, i16 -24575, i16 24768, i16 24960, i16 -24255, i16 25344, i16 -23615, i16 -23935, i16 25152, i16 26112, i16 -22847, i16 -22655, i16 26432, i16 -23295, i16 26048, i16 25728, i16 -23487, i16 27648, i16 -21311, i16 -21119, i16 27968, i16 -20735, i16 28608, i16 28288, i16 -20927, i16 -22015, i16 27328, i16 27520, i16 -21695, i16 26880, i16 -22079, i16 -22399, i16 26688, i16 30720, i16 -18239, i16 -18047, i16 31040, i16 -17663, i16 31680, i16 31360, i16 -17855, i16 -16895, i16 32448, i16 32640, i16 -16575, i16 32000, i16 -16959, i16 -17279, i16 31808, i16 -19455, i16 29888, i16 30080, i16 -19135, i16 30464, i16 -18495, i16 -18815, i16 30272, i16 29184, i16 -19775, i16 -19583, i16 29504, i16 -20223, i16 29120, i16 28800, i16 -20415, i16 20480, i16 -28479, i16 -28287, i16 20800, i16 -27903, i16 21440, i16 21120, i16 -28095, i16 -27135, i16 22208, i16 22400, i16 -26815, i16 21760, i16 -27199, i16 -27519, i16 21568, i16 -25599, i16 23744, i16 23936, i16 -25279, i16 24320, i16 -24639, i16 -24959, i16 24128, i16 23040, i16 -25919, i16 -25727, i16 23360, i16 -26367, i16 22976, i16 22656, i16 -26559, i16 -30719, i16 18624, i16 18816, i16 -30399, i16 19200, i16 -29759, i16 -30079, i16 19008, i16 19968, i16 -28991, i16 -28799, i16 20288, i16 -29439, i16 19904, i16 19584, i16 -29631, i16 17408, i16 -31551, i16 -31359, i16 17728, i16 -30975, i16 18368, i16 18048, i16 -31167, i16 -32255, i16 17088, i16 17280, i16 -31935, i16 16640, i16 -32319, i16 -32639, i16 16448], align 1
+
+; modbusCRCBitwise
+define i16 @crc_bitwise(i16 %crc, i8* nocapture readonly %data, i16 %len) {
+entry:
+  %z = icmp eq i16 %len, 0
+  br i1 %z, label %exit, label %outer
+outer:
+  %i = phi i16 [0, %entry], [%i1, %outer_end]
+  %c0 = phi i16 [%crc, %entry], [%cn, %outer_end]
+  %p = getelementptr i8, i8* %data, i16 %i
+  %b = load i8, i8* %p
+  %bx = zext i8 %b to i16
+  %cx = xor i16 %c0, %bx
+  br label %inner
+inner:
+  %j = phi i8 [0, %outer], [%j1, %next]
+  %c = phi i16 [%cx, %outer], [%cn, %next]
+  %bit = and i16 %c, 1
+  %odd = icmp ne i16 %bit, 0
+  %sh = lshr i16 %c, 1
+  br i1 %odd, label %poly, label %next
+poly:
+  %x = xor i16 %sh, -24575
+  br label %next
+next:
+  %cn = phi i16 [%x, %poly], [%sh, %inner]
+  %j1 = add i8 %j, 1
+  %jd = icmp eq i8 %j1, 8
+  br i1 %jd, label %outer_end, label %inner
+outer_end:
+  %i1 = add i16 %i, 1
+  %d = icmp eq i16 %i1, %len
+  br i1 %d, label %exit, label %outer
+exit:
+  %r = phi i16 [%crc, %entry], [%cn, %outer_end]
+  ret i16 %r
+}
+
+; modbusCRCNibble
+define i16 @crc_nibble(i16 %crc, i8* nocapture readonly %data, i16 %len) {
+entry:
+  %z = icmp eq i16 %len, 0
+  br i1 %z, label %exit, label %loop
+loop:
+  %i = phi i16 [0, %entry], [%i1, %loop]
+  %c0 = phi i16 [%crc, %entry], [%c2, %loop]
+  %p = getelementptr i8, i8* %data, i16 %i
+  %b = load i8, i8* %p
+  %bx = zext i8 %b to i16
+  %cx = xor i16 %c0, %bx
+  %n1 = and i16 %cx, 15
+  %t1p = getelementptr [16 x i16], [16 x i16] addrspace(1)* @nibble, i16 0, i16 %n1
+  %t1 = load i16, i16 addrspace(1)* %t1p
+  %s1 = lshr i16 %cx, 4
+  %c1 = xor i16 %s1, %t1
+  %n2 = and i16 %c1, 15
+  %t2p = getelementptr [16 x i16], [16 x i16] addrspace(1)* @nibble, i16 0, i16 %n2
+  %t2 = load i16, i16 addrspace(1)* %t2p
+  %s2 = lshr i16 %c1, 4
+  %c2 = xor i16 %s2, %t2
+  %i1 = add i16 %i, 1
+  %d = icmp eq i16 %i1, %len
+  br i1 %d, label %exit, label %loop
+exit:
+  %r = phi i16 [%crc, %entry], [%c2, %loop]
+  ret i16 %r
+}
+
+; modbusCRCTable
+define i16 @crc_table(i16 %crc, i8* nocapture readonly %data, i16 %len) {
+entry:
+  %z = icmp eq i16 %len, 0
+  br i1 %z, label %exit, label %loop
+loop:
+  %i = phi i16 [0, %entry], [%i1, %loop]
+  %c0 = phi i16 [%crc, %entry], [%cn, %loop]
+  %p = getelementptr i8, i8* %data, i16 %i
+  %b = load i8, i8* %p
+  %bx = zext i8 %b to i16
+  %cx = xor i16 %c0, %bx
+  %idx = and i16 %cx, 255
+  %tp = getelementptr [256 x i16], [256 x i16] addrspace(1)* @table, i16 0, i16 %idx
+  %t = load i16, i16 addrspace(1)* %tp
+  %s = lshr i16 %c0, 8
+  %cn = xor i16 %s, %t
+  %i1 = add i16 %i, 1
+  %d = icmp eq i16 %i1, %len
+  br i1 %d, label %exit, label %loop
+exit:
+  %r = phi i16 [%crc, %entry], [%cn, %loop]
+  ret i16 %r
+}
+
+; modbusCRCAvr: the inline asm of _crc16_update() in avr-libc util/crc16.h
+define i16 @crc_avr(i16 %crc, i8* nocapture readonly %data, i16 %len) {
+entry:
+  %z = icmp eq i16 %len, 0
+  br i1 %z, label %exit, label %loop
+loop:
+  %i = phi i16 [0, %entry], [%i1, %loop]
+  %c0 = phi i16 [%crc, %entry], [%cn, %loop]
+  %p = getelementptr i8, i8* %data, i16 %i
+  %b = load i8, i8* %p
+  %res = call { i16, i8 } asm "eor ${0:A},$2\0A\09mov $1,${0:A}\0A\09swap $1\0A\09eor $1,${0:A}\0A\09mov r0,$1\0A\09lsr $1\0A\09lsr $1\0A\09eor $1,r0\0A\09mov r0,$1\0A\09lsr $1\0A\09eor $1,r0\0A\09andi $1,0x07\0A\09mov r0,${0:A}\0A\09mov ${0:A},${0:B}\0A\09lsr $1\0A\09ror r0\0A\09ror $1\0A\09mov ${0:B},r0\0A\09eor ${0:A},$1\0A\09lsr r0\0A\09ror $1\0A\09eor ${0:B},r0\0A\09eor ${0:A},$1", "=r,=&d,r,0,~{r0}"(i8 %b, i16 %c0)
+  %cn = extractvalue { i16, i8 } %res, 0
+  %i1 = add i16 %i, 1
+  %d = icmp eq i16 %i1, %len
+  br i1 %d, label %exit, label %loop
+exit:
+  %r = phi i16 [%crc, %entry], [%cn, %loop]
+  ret i16 %r
+}
@@ -0,0 +1,571 @@
+/*
+ * claycast-macro: runs the HMI game macros (hmi/HMI0/macro) outside DTool.
+ *
+ * calc.c and shooter.c are built as shared objects against the stand-in
+ * macrotypedef.h (scripts/build-macro.sh), so each keeps its own globals like
+ * on the HMI. The local words (LW) are one array here, and ReadLocal,
+ * WriteLocal and time() are answered by this program: the macros' clock is the
+ * simulated tick time, so a run is repeatable for a seed.
+ *
+ * Every game is set up by calc.c and then played by calling shooter.c once per
+ * tick until it opens the end window. Results are printed one line per
+ * measurement as "name key=value ...".
+ *
+ * With --check, calc.c's ammo allocation and double/triple feasibility solver
+ * are compared against brute force on random setups instead.
+ */
+
+#include <dlfcn.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+// Machines in the game; must match the macros (scripts/build-macro.sh passes
+// the same -DMACHINES to both)
+#ifndef MACHINES
+#define MACHINES 10
+#endif
+#define MASK_WORDS ((MACHINES + 15) / 16)
+#ifndef LEGACY_REGISTERS
+#define LEGACY_REGISTERS (MACHINES <= 10) // Per-machine words of the DTool screens, as in the macros
+#endif
+
+namespace {
+
+const int LW_SIZE = 65536;
+const int QUARTERS = 4; // Game sections for the spread of each machine's shots
+
+// Local words used by the harness (see the macro headers)
+const int LW_ENABLED = 0; // Bitmask, MASK_WORDS words, or one flag per machine with LEGACY_REGISTERS
+const int LW_AMMO_MACHINE = 10;
+const int LW_AMMO_GAME = 1200;
+const int LW_MAX_SHOOTABLE = 110;
+const int LW_DOUBLE_FIRE = 111;
+const int LW_TRIPLE_FIRE = 112;
+const int LW_FIRED = 114;
+const int LW_SELECTION = 210; // Bitmask, MASK_WORDS words
+const int LW_ERROR = 300;
+const int LW_WINDOW = 500;
+const int LW_SETUP = 1100; // Max throws, doubles, triples, delay
+const int LW_LEGACY_AMMO_GAME = 100; // LEGACY_REGISTERS: copy of the game ammo
+const int LW_LEGACY_SELECTION = 200; // LEGACY_REGISTERS: the selection, one flag per machine
+const uint16_t END_WINDOW = 12;
+const int SCHEDULE_STEPS = 1000; // SCHEDULE_SIZE of calc.c, the throws of a game at most
+const int ERROR_SCHEDULE_FULL = 4;
+
+typedef int (*MacroEntry)();
+typedef int (*FiresFeasible)(short * ammo, short count, short singles, short doubles, short triples);
+
+struct Options {
+  std::string calc = "bin/macro/calc.so";
+  std::string shooter = "bin/macro/shooter.so";
+  int games = 200;
+  int machines = MACHINES; // Enabled, from machine 1 on
+  int ammo = 100; // Overall ammo of each machine
+  int throws = 50;
+  int doubles = 5;
+  int triples = 3;
+  int delay = 4;
+  int tickMs = 100;
+  unsigned seed = 1;
+  int checks = 0; // Random solver checks instead of games
+};
+
+struct Stats {
+  std::vector<double> values;
+
+  void add(double value) {
+    values.push_back(value);
+  }
+
+  double max() const {
+    return values.empty() ? 0 : *std::max_element(values.begin(), values.end());
+  }
+
+  double average() const {
+    double sum = 0;
+    for (double value : values) sum += value;
+    return values.empty() ? 0 : sum / values.size();
+  }
+};
+
+// Cost of one macro call
+struct CallStats {
+  Stats ns;
+  Stats calls; // ReadLocal + WriteLocal
+  Stats words;
+};
+
+uint16_t lw[LW_SIZE];
+unsigned clockSeed = 1;
+long long clockMs = 0; // Simulated time of the current tick
+long long accessCalls = 0;
+long long accessWords = 0;
+
+bool validRange(const char * type, int address, int count) {
+  if (strcmp(type, "LW") != 0 || address < 0 || count < 0 || address + count > LW_SIZE) {
+    fprintf(stderr, "Invalid local access %s%d, %d words\n", type, address, count);
+    exit(1);
+  }
+  accessCalls++;
+  accessWords += count;
+  return true;
+}
+
+long long nanos() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+// Machine bitmasks: bit 0 of the first word is machine 1, of the second word machine 17
+void setMachine(int address, int machine) {
+  lw[address + machine / 16] |= 1 << (machine % 16);
+}
+
+uint64_t readMask(int address) {
+  uint64_t mask = 0;
+  for (int word = 0; word < MASK_WORDS; word++) mask |= (uint64_t) lw[address + word] << (16 * word);
+  return mask;
+}
+
+void enableMachine(int machine) {
+  if (LEGACY_REGISTERS) lw[LW_ENABLED + machine] = 1;
+  else setMachine(LW_ENABLED, machine);
+}
+
+// LEGACY_REGISTERS: do the per-machine words match the game ammo and the selection?
+bool legacyInSync() {
+  if (!LEGACY_REGISTERS) return true;
+  uint64_t selection = readMask(LW_SELECTION);
+  for (int i = 0; i < MACHINES; i++) {
+    if (lw[LW_LEGACY_AMMO_GAME + i] != lw[LW_AMMO_GAME + i]) return false;
+    if (lw[LW_LEGACY_SELECTION + i] != ((selection >> i) & 1)) return false;
+  }
+  return true;
+}
+
+void * loadMacro(const std::string & path) {
+  void * library = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (!library) {
+    fprintf(stderr, "%s\n", dlerror());
+    exit(1);
+  }
+  return library;
+}
+
+void * macroSymbol(void * library, const std::string & path, const char * name) {
+  void * symbol = dlsym(library, name);
+  if (!symbol) {
+    fprintf(stderr, "%s: no %s\n", path.c_str(), name);
+    exit(1);
+  }
+  return symbol;
+}
+
+// Run a macro, adding its time and local word accesses to stats
+void call(MacroEntry macro, CallStats & stats) {
+  accessCalls = 0;
+  accessWords = 0;
+  long long start = nanos();
+  macro();
+  stats.ns.add(nanos() - start);
+  stats.calls.add(accessCalls);
+  stats.words.add(accessWords);
+}
+
+void printCalls(const char * name, const CallStats & stats) {
+  printf("%s calls=%zu ns_avg=%.0f ns_max=%.0f local_calls_avg=%.1f local_words_avg=%.1f\n", name,
+    stats.ns.values.size(), stats.ns.average(), stats.ns.max(), stats.calls.average(), stats.words.average());
+}
+
+// Brute force: can the double and triple fires each take different machines,
+// with the rest of the ammo fired as singles? Machines are interchangeable, so
+// states are memoised on the ammo sorted.
+bool bruteFires(std::vector<int> ammo, int doubles, int triples, std::map<std::vector<int>, bool> & memo) {
+  if (doubles == 0 && triples == 0) return true;
+  std::sort(ammo.begin(), ammo.end(), std::greater<int>());
+  std::vector<int> key = ammo;
+  key.push_back(doubles);
+  key.push_back(triples);
+  auto known = memo.find(key);
+  if (known != memo.end()) return known->second;
+
+  bool found = false;
+  size_t n = ammo.size();
+  for (size_t a = 0; a < n && !found; a++) {
+    for (size_t b = a + 1; b < n && !found; b++) {
+      if (!ammo[a] || !ammo[b]) continue;
+      ammo[a]--;
+      ammo[b]--;
+      if (triples == 0) {
+        found = bruteFires(ammo, doubles - 1, 0, memo);
+      } else {
+        for (size_t c = b + 1; c < n && !found; c++) {
+          if (!ammo[c]) continue;
+          ammo[c]--;
+          found = bruteFires(ammo, doubles, triples - 1, memo);
+          ammo[c]++;
+        }
+      }
+      ammo[a]++;
+      ammo[b]++;
+    }
+  }
+  memo[key] = found;
+  return found;
+}
+
+// Does any allocation of total ammo within the capacities allow the fires?
+bool bruteAllocation(const std::vector<int> & capacity, std::vector<int> & ammo, size_t machine, int left,
+  int doubles, int triples, std::map<std::vector<int>, bool> & memo) {
+  if (machine == capacity.size()) {
+    int total = 0;
+    for (int value : ammo) total += value;
+    return left == 0 && total >= doubles * 2 + triples * 3 && bruteFires(ammo, doubles, triples, memo);
+  }
+  for (int value = 0; value <= std::min(capacity[machine], left); value++) {
+    ammo[machine] = value;
+    if (bruteAllocation(capacity, ammo, machine + 1, left - value, doubles, triples, memo)) return true;
+  }
+  return false;
+}
+
+// The earlier distribute_ammo(): even split, then the leftover in one-unit passes
+int referenceDistribution(const bool * enabled, const int * capacity, int & maxAmmo, int * allocation) {
+  int machines = 0, error = 0;
+  for (int i = 0; i < MACHINES; i++) {
+    allocation[i] = 0;
+    if (enabled[i] && capacity[i] > 0) machines++;
+  }
+  if (machines == 0 || maxAmmo == 0) return 3;
+
+  int perMachine = maxAmmo / machines;
+  int remaining = maxAmmo % machines;
+  for (int i = 0; i < MACHINES; i++) {
+    if (!enabled[i] || capacity[i] <= 0) continue;
+    if (capacity[i] >= perMachine) {
+      allocation[i] = perMachine;
+    } else {
+      allocation[i] = capacity[i];
+      remaining += perMachine - capacity[i];
+      error = 2;
+    }
+  }
+  while (remaining > 0) {
+    bool placed = false;
+    for (int i = 0; i < MACHINES && remaining > 0; i++) {
+      if (enabled[i] && capacity[i] > allocation[i]) {
+        allocation[i]++;
+        remaining--;
+        placed = true;
+      }
+    }
+    if (!placed) {
+      maxAmmo -= remaining;
+      return 3;
+    }
+  }
+  return error;
+}
+
+// Compare calc.c against brute force on random setups; true if all agree
+bool runChecks(void * library, const std::string & path, MacroEntry calc, int checks) {
+  FiresFeasible feasible = (FiresFeasible) macroSymbol(library, path, "fires_feasible");
+  std::map<std::vector<int>, bool> memo;
+  int feasibleMismatches = 0, allocationMismatches = 0, errorMismatches = 0, solvable = 0;
+
+  // fires_feasible(), for up to 16 machines; sometimes with the wrong number of singles
+  for (int check = 0; check < checks; check++) {
+    int machines = 1 + rand() % 16;
+    short ammo[16];
+    std::vector<int> values(machines);
+    int total = 0;
+    for (int i = 0; i < machines; i++) {
+      ammo[i] = values[i] = rand() % 6;
+      total += ammo[i];
+    }
+    int doubles = rand() % 4, triples = rand() % 4;
+    int singles = total - doubles * 2 - triples * 3;
+    if (rand() % 4 == 0) singles += rand() % 2 ? 1 : -1;
+
+    bool expected = singles >= 0 && singles == total - doubles * 2 - triples * 3 &&
+      bruteFires(values, doubles, triples, memo);
+    if (expected) solvable++;
+    if ((feasible(ammo, machines, singles, doubles, triples) != 0) != expected) {
+      if (feasibleMismatches++ < 5) {
+        printf("mismatch fires_feasible machines=%d singles=%d doubles=%d triples=%d expected=%d ammo=", machines,
+          singles, doubles, triples, expected);
+        for (int i = 0; i < machines; i++) printf("%d%s", ammo[i], i + 1 < machines ? "," : "\n");
+      }
+    }
+  }
+
+  // MacroEntry: allocation as the earlier distribution, and error 1 exactly
+  // when no allocation at all allows the fires (up to 5 machines, for brute force)
+  for (int check = 0; check < checks; check++) {
+    memset(lw, 0, sizeof(lw));
+    bool enabled[MACHINES] = {false};
+    int capacity[MACHINES] = {0};
+    int capacityTotal = 0;
+    for (int placed = 0, count = 1 + rand() % 5; placed < count; placed++) {
+      int machine = rand() % MACHINES;
+      enabled[machine] = true;
+      capacity[machine] = rand() % 6;
+    }
+    for (int i = 0; i < MACHINES; i++) {
+      if (enabled[i]) enableMachine(i);
+      lw[LW_AMMO_MACHINE + i] = capacity[i];
+      if (enabled[i]) capacityTotal += capacity[i];
+    }
+    int maxAmmo = 1 + rand() % (capacityTotal + 3);
+    int doubles = rand() % 4, triples = rand() % 3;
+    lw[LW_SETUP] = maxAmmo;
+    lw[LW_SETUP + 1] = doubles;
+    lw[LW_SETUP + 2] = triples;
+    lw[LW_SETUP + 3] = 4;
+    calc();
+
+    int allocation[MACHINES];
+    int referenceMax = maxAmmo;
+    int referenceError = referenceDistribution(enabled, capacity, referenceMax, allocation);
+    bool same = lw[LW_MAX_SHOOTABLE] == referenceMax;
+    for (int i = 0; i < MACHINES; i++) same = same && lw[LW_AMMO_GAME + i] == allocation[i];
+    if (!same && allocationMismatches++ < 5) {
+      printf("mismatch allocation max=%d expected_max=%d got_max=%d\n", maxAmmo, referenceMax, lw[LW_MAX_SHOOTABLE]);
+    }
+
+    // Error 2 and 3 come from the distribution, which skips the fire check
+    int expectedError = referenceError;
+    if (expectedError == 0) {
+      std::vector<int> capacities, ammo;
+      for (int i = 0; i < MACHINES; i++) {
+        if (enabled[i]) capacities.push_back(capacity[i]);
+      }
+      ammo.resize(capacities.size());
+      expectedError = bruteAllocation(capacities, ammo, 0, maxAmmo, doubles, triples, memo) ? 0 : 1;
+    }
+    if (lw[LW_ERROR] != expectedError && errorMismatches++ < 5) {
+      printf("mismatch error max=%d doubles=%d triples=%d expected=%d got=%d\n", maxAmmo, doubles, triples,
+        expectedError, lw[LW_ERROR]);
+    }
+  }
+
+  // More throws than the schedule holds: capped, with an error of its own
+  memset(lw, 0, sizeof(lw));
+  for (int i = 0; i < MACHINES; i++) {
+    enableMachine(i);
+    lw[LW_AMMO_MACHINE + i] = SCHEDULE_STEPS;
+  }
+  lw[LW_SETUP] = SCHEDULE_STEPS + 1;
+  lw[LW_SETUP + 3] = 4;
+  calc();
+  bool capped = lw[LW_MAX_SHOOTABLE] == SCHEDULE_STEPS && lw[LW_ERROR] == ERROR_SCHEDULE_FULL;
+  if (!capped) errorMismatches++;
+
+  printf("check fires_feasible=%d solvable=%d mismatches=%d\n", checks, solvable, feasibleMismatches);
+  printf("check allocation=%d mismatches=%d error_mismatches=%d schedule_cap=%s\n", checks, allocationMismatches,
+    errorMismatches, capped ? "ok" : "wrong");
+  return feasibleMismatches == 0 && allocationMismatches == 0 && errorMismatches == 0;
+}
+
+void usage(const char * program) {
+  printf("Usage: %s [options]\n", program);
+  printf("  --calc PATH       Setup macro (default bin/macro/calc.so)\n");
+  printf("  --shooter PATH    Per-tick macro (default bin/macro/shooter.so)\n");
+  printf("  --games N         Games to play (default 200)\n");
+  printf("  --machines N      Enabled machines, 1-%d (default %d)\n", MACHINES, MACHINES);
+  printf("  --ammo N          Overall ammo of each machine (default 100)\n");
+  printf("  --throws N        Max throws of a game (default 50)\n");
+  printf("  --doubles N       Double fires (default 5)\n");
+  printf("  --triples N       Triple fires (default 3)\n");
+  printf("  --delay N         Ticks between fires (default 4)\n");
+  printf("  --tick-ms N       Macro period, for the macros' time() (default 100)\n");
+  printf("  --seed N          Start of the macros' time() (default 1)\n");
+  printf("  --check N         Compare calc.c's solver against brute force on N random setups\n");
+}
+
+} // namespace
+
+extern "C" int ReadLocal(const char * type, int address, int count, void * buffer, int) {
+  validRange(type, address, count);
+  memcpy(buffer, lw + address, count * sizeof(uint16_t));
+  return 0;
+}
+
+extern "C" int WriteLocal(const char * type, int address, int count, void * buffer, int) {
+  validRange(type, address, count);
+  memcpy(lw + address, buffer, count * sizeof(uint16_t));
+  return 0;
+}
+
+// The macros seed rand() from time(NULL); answer from the simulated clock
+extern "C" time_t time(time_t * result) {
+  time_t now = clockSeed + clockMs / 1000;
+  if (result) *result = now;
+  return now;
+}
+
+int main(int argc, char ** argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    const char * option = argv[i];
+    const char * value = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (!strcmp(option, "--help")) {
+      usage(argv[0]);
+      return 0;
+    }
+    if (!value) {
+      usage(argv[0]);
+      return 1;
+    }
+    i++;
+    if (!strcmp(option, "--calc")) options.calc = value;
+    else if (!strcmp(option, "--shooter")) options.shooter = value;
+    else if (!strcmp(option, "--games")) options.games = atoi(value);
+    else if (!strcmp(option, "--machines")) options.machines = atoi(value);
+    else if (!strcmp(option, "--ammo")) options.ammo = atoi(value);
+    else if (!strcmp(option, "--throws")) options.throws = atoi(value);
+    else if (!strcmp(option, "--doubles")) options.doubles = atoi(value);
+    else if (!strcmp(option, "--triples")) options.triples = atoi(value);
+    else if (!strcmp(option, "--delay")) options.delay = atoi(value);
+    else if (!strcmp(option, "--tick-ms")) options.tickMs = atoi(value);
+    else if (!strcmp(option, "--seed")) options.seed = atoi(value);
+    else if (!strcmp(option, "--check")) options.checks = atoi(value);
+    else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  options.machines = std::max(1, std::min(options.machines, MACHINES));
+  options.games = std::max(options.games, 1);
+  options.tickMs = std::max(options.tickMs, 1);
+
+  void * calcLibrary = loadMacro(options.calc);
+  MacroEntry calc = (MacroEntry) macroSymbol(calcLibrary, options.calc, "MacroEntry");
+  clockSeed = options.seed;
+
+  if (options.checks > 0) {
+    srand(options.seed);
+    printf("config checks=%d seed=%u\n", options.checks, options.seed);
+    return runChecks(calcLibrary, options.calc, calc, options.checks) ? 0 : 1;
+  }
+  MacroEntry shooter = (MacroEntry) macroSymbol(loadMacro(options.shooter), options.shooter, "MacroEntry");
+
+  printf("config games=%d machines=%d/%d ammo=%d throws=%d doubles=%d triples=%d delay=%d tick_ms=%d seed=%u\n",
+    options.games, options.machines, MACHINES, options.ammo, options.throws, options.doubles, options.triples,
+    options.delay, options.tickMs, options.seed);
+
+  CallStats setupCalls, idleCalls, fireCalls;
+  Stats steps, ticks, leftover, shareError, spread, repeats;
+  int errors = 0, completed = 0, doublesMissing = 0, triplesMissing = 0, legacyCalls = 0;
+
+  for (int gameIndex = 0; gameIndex < options.games; gameIndex++) {
+    memset(lw, 0, sizeof(lw));
+    for (int i = 0; i < options.machines; i++) {
+      enableMachine(i);
+      lw[LW_AMMO_MACHINE + i] = options.ammo;
+    }
+    lw[LW_SETUP] = options.throws;
+    lw[LW_SETUP + 1] = options.doubles;
+    lw[LW_SETUP + 2] = options.triples;
+    lw[LW_SETUP + 3] = options.delay;
+
+    call(calc, setupCalls);
+    if (lw[LW_ERROR] != 0) errors++;
+    if (!legacyInSync()) legacyCalls++;
+
+    int allocated[MACHINES];
+    int allocatedTotal = 0;
+    for (int i = 0; i < MACHINES; i++) {
+      allocated[i] = lw[LW_AMMO_GAME + i];
+      allocatedTotal += allocated[i];
+    }
+    int doublesPlanned = lw[LW_DOUBLE_FIRE];
+    int triplesPlanned = lw[LW_TRIPLE_FIRE];
+
+    // Play; every increase of the fired counter is one step with the selection mask in LW210
+    std::vector<uint64_t> fired;
+    int tickLimit = (allocatedTotal + 1) * (options.delay + 2) + 100;
+    int tick = 0;
+    uint16_t firedCount = lw[LW_FIRED];
+    for (; tick < tickLimit && lw[LW_WINDOW] != END_WINDOW; tick++) {
+      clockMs += options.tickMs;
+      CallStats tickCalls;
+      call(shooter, tickCalls);
+
+      bool step = lw[LW_FIRED] != firedCount;
+      CallStats & target = step ? fireCalls : idleCalls;
+      target.ns.add(tickCalls.ns.values[0]);
+      target.calls.add(tickCalls.calls.values[0]);
+      target.words.add(tickCalls.words.values[0]);
+      if (step) fired.push_back(readMask(LW_SELECTION));
+      if (!legacyInSync()) legacyCalls++;
+      firedCount = lw[LW_FIRED];
+    }
+    ticks.add(tick);
+    steps.add(fired.size());
+
+    // Shots per machine, per game quarter, and steps by size
+    int shots[MACHINES] = {0};
+    int sections[MACHINES][QUARTERS] = {{0}};
+    int sizes[MACHINES + 1] = {0};
+    int shotTotal = 0, repeated = 0;
+    for (size_t s = 0; s < fired.size(); s++) {
+      int size = 0;
+      for (int i = 0; i < MACHINES; i++) {
+        if (!(fired[s] & (1ULL << i))) continue;
+        shots[i]++;
+        sections[i][s * QUARTERS / fired.size()]++;
+        size++;
+      }
+      sizes[size]++;
+      shotTotal += size;
+      if (s > 0 && (fired[s] & fired[s - 1])) repeated++;
+    }
+
+    if (lw[LW_WINDOW] == END_WINDOW && shotTotal == allocatedTotal) completed++;
+    leftover.add(allocatedTotal - shotTotal);
+    doublesMissing += std::max(0, doublesPlanned - sizes[2]);
+    triplesMissing += std::max(0, triplesPlanned - sizes[3]);
+    if (fired.size() > 1) repeats.add((double) repeated / (fired.size() - 1));
+
+    // Fired share against allocated share, and how evenly each machine's shots
+    // spread over the game (chi-square per degree of freedom, about 1 if random)
+    double error = 0, chi2 = 0;
+    int dof = 0;
+    for (int i = 0; i < MACHINES; i++) {
+      if (allocatedTotal > 0 && shotTotal > 0) {
+        error += fabs((double) shots[i] / shotTotal - (double) allocated[i] / allocatedTotal);
+      }
+      if (shots[i] < QUARTERS) continue;
+      double expected = (double) shots[i] / QUARTERS;
+      for (int q = 0; q < QUARTERS; q++) {
+        chi2 += (sections[i][q] - expected) * (sections[i][q] - expected) / expected;
+      }
+      dof += QUARTERS - 1;
+    }
+    shareError.add(error / 2);
+    if (dof > 0) spread.add(chi2 / dof);
+  }
+
+  printCalls("setup", setupCalls);
+  printCalls("tick_idle", idleCalls);
+  printCalls("tick_fire", fireCalls);
+  printf("game games=%d completed=%d setup_errors=%d steps_avg=%.1f ticks_avg=%.1f leftover_avg=%.2f "
+    "doubles_missing=%d triples_missing=%d\n",
+    options.games, completed, errors, steps.average(), ticks.average(), leftover.average(), doublesMissing,
+    triplesMissing);
+  if (LEGACY_REGISTERS) printf("legacy calls_out_of_sync=%d\n", legacyCalls);
+  printf("distribution share_error=%.4f spread_chi2=%.3f repeat_rate=%.4f\n", shareError.average(),
+    spread.average(), repeats.average());
+  return 0;
+}
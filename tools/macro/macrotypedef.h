@@ -0,0 +1,18 @@
+/*
+ * Stand-in for the Kinco DTool macrotypedef.h, for building the HMI macros
+ * natively (scripts/build-macro.sh). Only what the macros use is declared;
+ * the functions are implemented by tools/macro/harness.cpp.
+ */
+
+#ifndef MACROTYPEDEF_H
+#define MACROTYPEDEF_H
+
+#include <stdbool.h>
+
+// Copy count local words from address on into buffer (type "LW" only)
+int ReadLocal(const char * type, int address, int count, void * buffer, int flag);
+
+// Copy count words from buffer into the local words from address on
+int WriteLocal(const char * type, int address, int count, void * buffer, int flag);
+
+#endif
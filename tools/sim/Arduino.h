@@ -0,0 +1,199 @@
+/*
+ * Host stand-in for the parts of the Arduino core the ClayCast sketches use.
+ * Every call acts on the node the simulator is currently running and costs
+ * simulated CPU time (see sim.h).
+ */
+
+#ifndef CLAYCAST_SIM_ARDUINO_H
+#define CLAYCAST_SIM_ARDUINO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t byte;
+
+// Flash strings are plain strings on the host
+class __FlashStringHelper;
+#define F(text) (reinterpret_cast<const __FlashStringHelper *>(text))
+
+#define HIGH 1
+#define LOW 0
+
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+#define DEC 10
+#define HEX 16
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+#define A6 20
+#define A7 21
+
+#define SIM_PIN_COUNT 22
+
+// USART0 control register, as far as the controller's RS485 driver uses it
+#define UDRIE0 5
+#define TXCIE0 6
+#define _BV(bit) (1 << (bit))
+#define UCSR0B (*simUcsr0b())
+#define ISR(vector) void vector()
+
+uint8_t * simUcsr0b();
+
+// Timer2, as far as the client uses it: CTC mode with the /64 prescaler and
+// the compare A and B interrupts. Each node has its own, counting on its local
+// clock (see sim.h); writing a 1 to a TIFR2 flag clears it, as on the AVR.
+#define WGM21 1
+#define CS22 2
+#define OCIE2A 1
+#define OCIE2B 2
+#define OCF2A 1
+#define OCF2B 2
+#define TCCR2A (simTimer2()->tccr2a)
+#define TCCR2B (simTimer2()->tccr2b)
+#define OCR2A (simTimer2()->ocr2a)
+#define OCR2B (simTimer2()->ocr2b)
+#define TIMSK2 (simTimer2()->timsk2)
+#define TIFR2 (simTimer2()->tifr2)
+#define TCNT2 (simTimer2Count())
+
+struct SimTimer2 {
+  uint8_t tccr2a;
+  uint8_t tccr2b;
+  uint8_t ocr2a;
+  uint8_t ocr2b;
+  uint8_t timsk2;
+  uint8_t tifr2;
+};
+
+SimTimer2 * simTimer2();
+uint8_t simTimer2Count();
+
+// Input register of port C, A0-A5 in bits 0-5, read in zero time like the
+// sketch code around it
+#define PINC (simPortC())
+
+uint8_t simPortC();
+
+// Global interrupt flag of the running node
+void simInterrupts(bool enabled);
+
+inline void noInterrupts() {
+  simInterrupts(false);
+}
+
+inline void interrupts() {
+  simInterrupts(true);
+}
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+class Print {
+public:
+  virtual ~Print() {}
+
+  virtual size_t write(uint8_t value) = 0;
+
+  virtual size_t write(const uint8_t * data, size_t size) {
+    size_t written = 0;
+    while (size--) written += write(*data++);
+    return written;
+  }
+
+  size_t write(const char * text) {
+    return write((const uint8_t *) text, strlen(text));
+  }
+
+  size_t print(const char * text) {
+    return write(text);
+  }
+
+  size_t print(const __FlashStringHelper * text) {
+    return write(reinterpret_cast<const char *>(text));
+  }
+
+  size_t print(char value) {
+    return write((uint8_t) value);
+  }
+
+  size_t print(unsigned char value, int base = DEC) {
+    return printNumber(value, base);
+  }
+
+  size_t print(int value, int base = DEC) {
+    return print((long) value, base);
+  }
+
+  size_t print(unsigned int value, int base = DEC) {
+    return printNumber(value, base);
+  }
+
+  size_t print(long value, int base = DEC) {
+    if (value < 0 && base == DEC) return print('-') + printNumber(-(unsigned long) value, base);
+    return printNumber((unsigned long) value, base);
+  }
+
+  size_t print(unsigned long value, int base = DEC) {
+    return printNumber(value, base);
+  }
+
+  size_t println() {
+    return write("\r\n");
+  }
+
+  template <typename T>
+  size_t println(T value) {
+    return print(value) + println();
+  }
+
+  template <typename T>
+  size_t println(T value, int base) {
+    return print(value, base) + println();
+  }
+
+private:
+  size_t printNumber(unsigned long value, int base) {
+    char text[8 * sizeof(long) + 1];
+    char * digit = text + sizeof(text) - 1;
+    *digit = '\0';
+    do {
+      unsigned long rest = value % base;
+      *--digit = rest < 10 ? '0' + rest : 'A' + rest - 10;
+      value /= base;
+    } while (value);
+    return write(digit);
+  }
+};
+
+// Hardware USART0 of the running node
+class HardwareSerial : public Print {
+public:
+  void begin(unsigned long baud);
+  int available();
+  int read();
+  void flush();
+  size_t write(uint8_t value);
+  using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+#endif
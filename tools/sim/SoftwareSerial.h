@@ -0,0 +1,30 @@
+/*
+ * Host stand-in for SoftwareSerial. Each node has one software port, wired to
+ * its HC-12 module. Writes block for the whole character, like the bit-banged
+ * original, and bytes arriving meanwhile are corrupted.
+ */
+
+#ifndef CLAYCAST_SIM_SOFTWARE_SERIAL_H
+#define CLAYCAST_SIM_SOFTWARE_SERIAL_H
+
+#include "Arduino.h"
+
+class SoftwareSerial : public Print {
+public:
+  SoftwareSerial(uint8_t receivePin, uint8_t transmitPin) {
+    (void) receivePin;
+    (void) transmitPin;
+  }
+
+  void begin(long baud);
+  int available();
+  int read();
+  void flush() {}
+  bool listen() {
+    return true;
+  }
+  size_t write(uint8_t value);
+  using Print::write;
+};
+
+#endif
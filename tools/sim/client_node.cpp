@@ -0,0 +1,32 @@
+/*
+ * Client sketch as a simulator node, one build per slave address. Built by
+ * scripts/build-sim.sh with SIM_SKETCH (path of the sketch copy with its
+ * MODBUS_ADDRESS set), SIM_PROTOTYPES and SIM_NAMESPACE.
+ */
+
+#include "sim.h"
+#include "SoftwareSerial.h"
+#include <ClayCastFrame.h>
+#include <ClayCastModbus.h>
+#include <ClayCastHC12.h>
+
+namespace SIM_NAMESPACE {
+#include SIM_PROTOTYPES
+#include SIM_SKETCH
+}
+
+static const sim::SketchEntry clientSketch = {
+  "client",
+  MODBUS_ADDRESS,
+  radioPort(MODBUS_ADDRESS),
+  SIM_NAMESPACE::setup,
+  SIM_NAMESPACE::loop,
+  nullptr,
+  SIM_NAMESPACE::TIMER2_COMPA_vect,
+  SIM_NAMESPACE::TIMER2_COMPB_vect,
+  SIM_NAMESPACE::hc12SetPin,
+  sim::NO_PIN,
+  DO1
+};
+
+static sim::SketchRegistrar registrar(clientSketch);
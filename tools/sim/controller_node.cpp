@@ -0,0 +1,33 @@
+/*
+ * Controller sketch as a simulator node, one build per radio port. Built by
+ * scripts/build-sim.sh with SIM_SKETCH (path of the sketch copy with its
+ * RADIO_PORT set), SIM_PROTOTYPES (its function prototypes, which the Arduino
+ * builder would otherwise generate) and SIM_NAMESPACE.
+ */
+
+#include "sim.h"
+#include "SoftwareSerial.h"
+#include <ClayCastFrame.h>
+#include <ClayCastModbus.h>
+#include <ClayCastHC12.h>
+
+namespace SIM_NAMESPACE {
+#include SIM_PROTOTYPES
+#include SIM_SKETCH
+}
+
+static const sim::SketchEntry controllerSketch = {
+  "controller",
+  0,
+  RADIO_PORT,
+  SIM_NAMESPACE::setup,
+  SIM_NAMESPACE::loop,
+  SIM_NAMESPACE::USART_TX_vect,
+  nullptr,
+  nullptr,
+  SIM_NAMESPACE::hc12SetPin,
+  RS485_DE,
+  sim::NO_PIN
+};
+
+static sim::SketchRegistrar registrar(controllerSketch);
@@ -0,0 +1,211 @@
+/*
+ * HC-12 module and air model.
+ *
+ * - Command mode (SET low): bytes are collected until the line is idle, then
+ *   AT, AT+Bxxxx, AT+Cxxx and AT+FUx are answered like the real module. A new
+ *   baud takes effect when SET goes high again.
+ * - Transparent mode: each byte goes on air once it has been received from
+ *   the node and reaches every other module on the same channel, mode and air
+ *   rate after RadioConfig::latency, then leaves that module's serial output
+ *   at its baud.
+ * - A burst (bytes less than three characters apart) is lost per receiver
+ *   with RadioConfig::loss and delayed by a random jitter, part common to all
+ *   receivers and part per receiver; delivered bits flip with bitErrorRate;
+ *   bytes of two modules that overlap on air are corrupted at every receiver.
+ * - Each character on a node's serial input holds off its other interrupts
+ *   for the character time, as SoftwareSerial receives it with them off.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include "sim.h"
+
+namespace sim {
+
+namespace {
+
+const Time COMMAND_IDLE = 2 * MILLISECOND; // Line idle time that ends an AT command
+const uint8_t COMMAND_IDLE_CHARS = 2; // At least this many character times, for the slow rates
+const Time COMMAND_REPLY_DELAY = 5 * MILLISECOND;
+const uint8_t BURST_GAP_CHARS = 3;
+const Time RECENT_WINDOW = 5 * MILLISECOND;
+
+bool validBaud(uint32_t baud) {
+  static const uint32_t rates[] = {1200, 2400, 4800, 9600, 19200, 38400, 57600, 115200};
+  for (uint32_t rate : rates) {
+    if (rate == baud) return true;
+  }
+  return false;
+}
+
+} // namespace
+
+uint32_t airRate(uint32_t baud) {
+  if (baud <= 2400) return 5000;
+  if (baud <= 9600) return 15000;
+  if (baud <= 38400) return 58000;
+  return 236000;
+}
+
+Hc12Module::Hc12Module(Node & owner, Air & radio) : node(owner), air(radio) {
+  air.attach(*this);
+}
+
+void Hc12Module::setPin(uint8_t level) {
+  if (level == LOW) {
+    commandMode = true;
+    command.clear();
+    return;
+  }
+
+  commandMode = false;
+  if (pendingBaud) {
+    baud = pendingBaud;
+    pendingBaud = 0;
+  }
+}
+
+void Hc12Module::fromNode(uint8_t value, uint32_t nodeBaud, Time end) {
+  if (nodeBaud != baud) value ^= 0xA5; // Framed at the wrong rate
+
+  if (!commandMode) {
+    air.transmit(*this, value, end);
+    return;
+  }
+
+  command.push_back(value);
+  uint32_t generation = ++commandGeneration;
+  Time idle = std::max(COMMAND_IDLE, COMMAND_IDLE_CHARS * charTime(nodeBaud));
+  schedule(end + idle, [this, generation]() {
+    if (generation == commandGeneration && commandMode) runCommand();
+  });
+}
+
+void Hc12Module::runCommand() {
+  std::string text(command.begin(), command.end());
+  command.clear();
+
+  char reply[24] = "ERROR";
+  if (text == "AT") {
+    strcpy(reply, "OK");
+  } else if (text.compare(0, 4, "AT+B") == 0 && validBaud(strtoul(text.c_str() + 4, nullptr, 10))) {
+    pendingBaud = strtoul(text.c_str() + 4, nullptr, 10);
+    snprintf(reply, sizeof(reply), "OK+B%lu", (unsigned long) pendingBaud);
+  } else if (text.compare(0, 4, "AT+C") == 0 && text.size() == 7) {
+    int requested = atoi(text.c_str() + 4);
+    if (requested >= 1 && requested <= 127) {
+      channel = requested;
+      snprintf(reply, sizeof(reply), "OK+C%03d", requested);
+    }
+  } else if (text.compare(0, 5, "AT+FU") == 0 && text.size() == 6 && text[5] >= '1' && text[5] <= '4') {
+    mode = text[5] - '0';
+    snprintf(reply, sizeof(reply), "OK+FU%d", mode);
+  }
+
+  Time when = now() + COMMAND_REPLY_DELAY;
+  for (const char * c = reply; *c; c++) output(*c, when);
+  output('\r', when);
+  output('\n', when);
+}
+
+void Hc12Module::fromAir(uint8_t value, Time arrival) {
+  if (commandMode) return; // Radio is off while configuring
+  output(value, arrival);
+}
+
+// Serial output to the node, one character after another at the module's baud
+void Hc12Module::output(uint8_t value, Time earliest) {
+  Time start = earliest > outputFree ? earliest : outputFree;
+  Time end = start + charTime(baud);
+  outputFree = end;
+
+  std::deque<std::pair<Time, Time>> & busy = node.softUart.rxBusy;
+  while (!busy.empty() && busy.front().second < now()) busy.pop_front();
+  if (node.softUart.baud) busy.emplace_back(start, end - charTime(baud) / 40); // recv() returns a quarter bit early
+
+  Node * target = &node;
+  uint32_t rate = baud;
+  schedule(end, [target, value, rate, start]() {
+    deliverSoftSerial(*target, value, rate, start);
+  });
+}
+
+Air::Air(const RadioConfig & radioConfig) : config(radioConfig), random(radioConfig.seed) {
+}
+
+void Air::attach(Hc12Module & module) {
+  modules.push_back(&module);
+  for (Hc12Module * other : modules) {
+    other->burstLost.resize(modules.size());
+    other->burstDelay.resize(modules.size());
+    other->lastArrival.resize(modules.size());
+  }
+}
+
+bool Air::hears(const Hc12Module & receiver, const Hc12Module & sender) const {
+  return &receiver != &sender && receiver.channel == sender.channel && receiver.mode == sender.mode &&
+    airRate(receiver.baud) == airRate(sender.baud);
+}
+
+uint8_t Air::corrupt(uint8_t value, double bitErrorRate) {
+  if (bitErrorRate <= 0) return value;
+  std::uniform_real_distribution<double> chance(0, 1);
+  for (uint8_t bit = 0; bit < 8; bit++) {
+    if (chance(random) < bitErrorRate) value ^= 1 << bit;
+  }
+  return value;
+}
+
+void Air::transmit(Hc12Module & from, uint8_t value, Time start) {
+  counters.bytesSent++;
+  Time airTime = 10 * SECOND / airRate(from.baud);
+  Time latency = config.latency > airTime ? config.latency : airTime;
+
+  // A new burst is lost or heard as a whole by each receiver
+  if (start - from.lastAirByte > BURST_GAP_CHARS * charTime(from.baud)) {
+    std::uniform_real_distribution<double> chance(0, 1);
+    Time jitter = (Time) (chance(random) * config.jitter);
+    for (size_t i = 0; i < modules.size(); i++) {
+      from.burstLost[i] = chance(random) < config.loss;
+      from.burstDelay[i] = jitter + (Time) (chance(random) * config.receiverJitter);
+    }
+  }
+  from.lastAirByte = start;
+
+  // Overlapping bytes of two transmitters corrupt each other
+  std::shared_ptr<AirByte> sent(new AirByte {&from, start, start + airTime, false});
+  while (!recent.empty() && recent.front()->end + RECENT_WINDOW < start) recent.pop_front();
+  for (auto & other : recent) {
+    if (other->from == &from || other->from->channel != from.channel) continue;
+    if (other->start < sent->end && sent->start < other->end) {
+      if (!other->collided && !sent->collided) counters.collisions++;
+      other->collided = true;
+      sent->collided = true;
+    }
+  }
+  recent.push_back(sent);
+
+  for (size_t i = 0; i < modules.size(); i++) {
+    Hc12Module * receiver = modules[i];
+    if (!hears(*receiver, from)) continue;
+    if (from.burstLost[i]) {
+      counters.bytesLost++;
+      continue;
+    }
+
+    Time arrival = std::max(start + latency + from.burstDelay[i], from.lastArrival[i]);
+    from.lastArrival[i] = arrival;
+    schedule(arrival, [this, receiver, value, sent, arrival]() {
+      uint8_t received = corrupt(value, config.bitErrorRate);
+      if (sent->collided) received ^= 1 << (random() % 8);
+      if (received != value) counters.bytesCorrupted++;
+      counters.bytesDelivered++;
+      receiver->fromAir(received, arrival);
+    });
+  }
+}
+
+} // namespace sim
@@ -0,0 +1,544 @@
+/*
+ * Scheduler, coroutines and the Arduino stand-in behind Arduino.h and
+ * SoftwareSerial.h. CPU costs are rough ATmega328p figures at 16 MHz; the
+ * sketch code between Arduino calls runs in zero simulated time.
+ */
+
+#include <stdlib.h>
+#include <algorithm>
+#include <queue>
+#include "sim.h"
+#include "SoftwareSerial.h"
+
+namespace sim {
+
+namespace {
+
+const Time CALL_COST = 1 * MICROSECOND; // millis(), available(), read()
+const Time PIN_COST = 4 * MICROSECOND; // digitalWrite(), digitalRead()
+const Time WRITE_COST = 2 * MICROSECOND; // Serial.write() of one byte
+const Time LOOP_COST = 2 * MICROSECOND; // main() around each loop()
+const Time ISR_COST = 2 * MICROSECOND; // Interrupt entry and exit
+const Time TIMER2_TICK = 4 * MICROSECOND; // 16 MHz / 64 (CS22), on the local clock
+const Time TIMER_BUSY_KEPT = 10 * MILLISECOND; // Longer than a character at 1200 baud
+const size_t SOFT_SERIAL_RX_BUFFER = 64;
+const size_t SERIAL_RX_BUFFER = 64;
+const size_t SERIAL_TX_BUFFER = 64;
+const size_t STACK_SIZE = 256 * 1024;
+const Time NEVER = ~(Time) 0;
+
+struct Event {
+  Time when;
+  uint64_t sequence;
+  std::function<void()> action;
+};
+
+struct EventOrder {
+  bool operator()(const Event & a, const Event & b) const {
+    return a.when != b.when ? a.when > b.when : a.sequence > b.sequence;
+  }
+};
+
+std::priority_queue<Event, std::vector<Event>, EventOrder> events;
+uint64_t eventSequence = 0;
+std::vector<std::unique_ptr<Node>> nodes;
+ucontext_t schedulerContext;
+Node * running = nullptr;
+Time horizon = 0;
+Time eventTime = 0;
+bool scriptFinished = false;
+
+void nodeMain() {
+  Node * node = running;
+  node->body();
+  node->finished = true;
+  if (!node->sketch) scriptFinished = true;
+  while (true) swapcontext(&node->context, &schedulerContext);
+}
+
+Node & addNode(std::function<void()> body) {
+  nodes.emplace_back(new Node());
+  Node & node = *nodes.back();
+  node.body = body;
+  node.stack.resize(STACK_SIZE);
+  getcontext(&node.context);
+  node.context.uc_stack.ss_sp = node.stack.data();
+  node.context.uc_stack.ss_size = node.stack.size();
+  node.context.uc_link = &schedulerContext;
+  makecontext(&node.context, nodeMain, 0);
+  return node;
+}
+
+void handOver() {
+  Node * node = running;
+  swapcontext(&node->context, &schedulerContext);
+}
+
+// Run the TX complete interrupt of the running node if it is due
+void serviceInterrupts(Node & node) {
+  if (node.inIsr || !node.interruptsEnabled || !node.sketch || !node.sketch->txCompleteIsr) return;
+  if (!node.uart.txc || !(node.ucsr0b & _BV(TXCIE0))) return;
+
+  node.uart.txc = false; // Cleared by executing the vector
+  node.inIsr = true;
+  node.sketch->txCompleteIsr();
+  node.inIsr = false;
+}
+
+Time localTime(const Node & node, Time when) {
+  return node.clockPhase + (Time) (when * node.clockRate);
+}
+
+// First simulation time at which a node's local clock reads local
+Time simulationTime(const Node & node, Time local) {
+  if (local <= node.clockPhase) return 0;
+  Time when = (Time) ((local - node.clockPhase) / node.clockRate);
+  while (localTime(node, when) < local) when++;
+  return when;
+}
+
+// Local time of the first Timer2 compare match after a local time. In CTC
+// mode the counter runs 0..OCR2A, and a compare flag is set on the tick after
+// the counter has reached the compare value.
+Time timer2Match(const SimTimer2 & timer, Time after, uint8_t compare) {
+  Time period = (timer.ocr2a + 1) * TIMER2_TICK;
+  Time offset = (compare + 1) * TIMER2_TICK;
+  if (after < offset) return offset;
+  return ((after - offset) / period + 1) * period + offset;
+}
+
+bool timer2Enabled(const Node & node, bool compareB) {
+  const SimTimer2 & timer = node.timer2;
+  if (!(timer.timsk2 & _BV(compareB ? OCIE2B : OCIE2A))) return false;
+  if (compareB && timer.ocr2b > timer.ocr2a) return false; // Never reached
+  return compareB ? node.sketch->timer2CompareBIsr : node.sketch->timer2CompareAIsr;
+}
+
+// Local time at which a compare flag is set next (or was set and is pending)
+Time timer2Flag(const Node & node, bool compareB) {
+  const SimTimer2 & timer = node.timer2;
+  return compareB ? timer2Match(timer, node.timer2MatchB, timer.ocr2b) : timer2Match(timer, node.timer2MatchA, timer.ocr2a);
+}
+
+// Simulation time of the next Timer2 interrupt of a node, or NEVER. Also
+// applies flag clears written to TIFR2.
+Time timer2Due(Node & node) {
+  SimTimer2 & timer = node.timer2;
+  Time local = localTime(node, node.clock);
+  if (!(timer.tccr2b & 0x07)) { // Stopped
+    node.timer2MatchA = local;
+    node.timer2MatchB = local;
+    return NEVER;
+  }
+  if (timer.tifr2 & _BV(OCF2A)) node.timer2MatchA = local;
+  if (timer.tifr2 & _BV(OCF2B)) node.timer2MatchB = local;
+  timer.tifr2 = 0;
+  if (!node.sketch || node.inIsr || !node.interruptsEnabled) return NEVER;
+
+  Time due = NEVER;
+  for (bool compareB : {false, true}) {
+    if (timer2Enabled(node, compareB)) due = std::min(due, simulationTime(node, timer2Flag(node, compareB)));
+  }
+  if (due == NEVER) return NEVER;
+  if (due < node.clock) due = node.clock;
+
+  // Held off by the SoftwareSerial receive interrupt
+  for (const std::pair<Time, Time> & busy : node.softUart.rxBusy) {
+    if (due >= busy.first && due < busy.second) due = busy.second;
+  }
+  return due;
+}
+
+// Run the pending Timer2 interrupt of the running node, compare A first
+void serviceTimer2(Node & node) {
+  Time local = localTime(node, node.clock);
+  SketchFunction vector;
+  if (timer2Enabled(node, false) && timer2Flag(node, false) <= local) {
+    node.timer2MatchA = local; // Flag cleared by executing the vector
+    vector = node.sketch->timer2CompareAIsr;
+  } else {
+    node.timer2MatchB = local;
+    vector = node.sketch->timer2CompareBIsr;
+  }
+
+  Time start = node.clock;
+  node.inIsr = true;
+  advance(ISR_COST);
+  vector();
+  node.inIsr = false;
+
+  // Kept until the characters it may have held off are delivered
+  std::deque<std::pair<Time, Time>> & busy = node.softUart.timerBusy;
+  while (!busy.empty() && busy.front().second + TIMER_BUSY_KEPT < start) busy.pop_front();
+  busy.emplace_back(start, node.clock);
+}
+
+// Block the running node until just after the given time
+void waitUntil(Time when) {
+  Node * node = running;
+  if (node->clock <= when) advance(when - node->clock + 1);
+}
+
+void startShift(Node & node, uint8_t value);
+
+void shiftDone(Node & node, uint8_t value, Time start) {
+  HardwareUart & uart = node.uart;
+  uart.shifting = false;
+  uart.lastByteEnd = eventTime;
+  if (uart.sink) uart.sink(value, start, eventTime);
+
+  if (uart.udrFull) {
+    uart.udrFull = false;
+    startShift(node, uart.udr);
+    if (!uart.ring.empty()) { // UDRE interrupt refills UDR
+      uart.udr = uart.ring.front();
+      uart.ring.pop_front();
+      uart.udrFull = true;
+    }
+    if (uart.ring.empty()) node.ucsr0b &= ~_BV(UDRIE0);
+  } else {
+    uart.txc = true;
+  }
+}
+
+void startShift(Node & node, uint8_t value) {
+  HardwareUart & uart = node.uart;
+  Time start = now();
+  uart.shifting = true;
+  uart.shiftEnd = start + charTime(uart.baud);
+  Node * target = &node;
+  schedule(uart.shiftEnd, [target, value, start]() {
+    shiftDone(*target, value, start);
+  });
+}
+
+Node & runningNode() {
+  return *running;
+}
+
+// Local clock of the running node
+Time localNow() {
+  return running ? localTime(*running, running->clock) : eventTime;
+}
+
+} // namespace
+
+std::vector<SketchEntry> & registeredSketches() {
+  static std::vector<SketchEntry> sketches;
+  return sketches;
+}
+
+SketchRegistrar::SketchRegistrar(const SketchEntry & entry) {
+  registeredSketches().push_back(entry);
+}
+
+Node & addSketchNode(const SketchEntry & sketch) {
+  Node & node = addNode([]() {
+    Node * self = running;
+    self->sketch->setup();
+    self->setupDone = true;
+    while (true) {
+      self->sketch->loop();
+      advance(LOOP_COST);
+    }
+  });
+  node.sketch = &sketch;
+  return node;
+}
+
+Node & addScriptNode(std::function<void()> body) {
+  return addNode(body);
+}
+
+void schedule(Time when, std::function<void()> action) {
+  events.push(Event {when, eventSequence++, action});
+  if (running && when < horizon) horizon = when;
+}
+
+Node * current() {
+  return running;
+}
+
+Time now() {
+  return running ? running->clock : eventTime;
+}
+
+void advance(Time duration) {
+  Node * node = running;
+  if (!node) return; // Static initialisation, outside the simulation
+
+  // Timer interrupts interrupt the call at their time and add to its duration
+  Time end = node->clock + duration;
+  Time due;
+  while ((due = timer2Due(*node)) <= end) {
+    if (due > node->clock) {
+      node->clock = due;
+      if (node->clock > horizon) {
+        handOver(); // Events up to here may hold it off
+        continue;
+      }
+    }
+    Time start = node->clock;
+    serviceTimer2(*node);
+    end += node->clock - start;
+  }
+
+  node->clock = end;
+  if (node->clock > horizon) handOver();
+  serviceInterrupts(*node);
+}
+
+void sleep(Time duration) {
+  advance(duration);
+}
+
+void run(Time until) {
+  while (!scriptFinished) {
+    Node * next = nullptr;
+    Time nextClock = NEVER;
+    Time otherClock = NEVER;
+    for (auto & node : nodes) {
+      if (node->finished) continue;
+      if (node->clock < nextClock) {
+        otherClock = nextClock;
+        nextClock = node->clock;
+        next = node.get();
+      } else if (node->clock < otherClock) {
+        otherClock = node->clock;
+      }
+    }
+
+    Time nextEvent = events.empty() ? NEVER : events.top().when;
+    if (nextEvent <= nextClock) {
+      if (nextEvent > until) break;
+      Event event = events.top();
+      events.pop();
+      eventTime = event.when;
+      event.action();
+      continue;
+    }
+    if (!next || nextClock > until) break;
+
+    horizon = nextEvent;
+    if (otherClock != NEVER && otherClock + SIM_LOOKAHEAD < horizon) horizon = otherClock + SIM_LOOKAHEAD;
+    running = next;
+    swapcontext(&schedulerContext, &next->context);
+    running = nullptr;
+  }
+  if (eventTime < until && !scriptFinished) eventTime = until;
+}
+
+void deliverSerial(Node & node, uint8_t value) {
+  if (node.uart.baud == 0) return; // Not started
+  if (node.uart.rx.size() >= SERIAL_RX_BUFFER) {
+    node.uart.rxDropped++;
+    return;
+  }
+  node.uart.rx.push_back(value);
+}
+
+void deliverSoftSerial(Node & node, uint8_t value, uint32_t baud, Time start) {
+  SoftwareUart & port = node.softUart;
+  if (port.baud == 0) return; // Not started
+  if (port.baud != baud) value ^= 0xA5; // Framed at the wrong rate
+  if (start < port.txEnd && eventTime > port.txStart) value ^= 0x5A; // Interrupts were off
+
+  // A Timer2 interrupt running at the start bit holds off the receive
+  // interrupt; SoftwareSerial then samples every bit that much later and
+  // misreads the byte once it is 40 % of a bit late
+  for (const std::pair<Time, Time> & busy : port.timerBusy) {
+    if (start < busy.first || start >= busy.second) continue;
+    port.rxHeldOff++;
+    if (busy.second - start > charTime(baud) / 25) {
+      port.rxLate++;
+      value ^= 0x3C;
+    }
+  }
+  if (port.rx.size() >= SOFT_SERIAL_RX_BUFFER) {
+    port.rxDropped++;
+    return;
+  }
+  port.rx.push_back(value);
+}
+
+} // namespace sim
+
+using sim::advance;
+using sim::localNow;
+using sim::runningNode;
+
+HardwareSerial Serial;
+
+uint8_t * simUcsr0b() {
+  static uint8_t unused;
+  sim::Node * node = sim::current();
+  return node ? &node->ucsr0b : &unused;
+}
+
+SimTimer2 * simTimer2() {
+  static SimTimer2 unused;
+  sim::Node * node = sim::current();
+  return node ? &node->timer2 : &unused;
+}
+
+uint8_t simPortC() {
+  if (!sim::current()) return 0;
+  const sim::Node & node = runningNode();
+  uint8_t value = 0;
+  for (uint8_t bit = 0; bit < 6; bit++) {
+    if (node.pinLevel[A0 + bit]) value |= _BV(bit);
+  }
+  return value;
+}
+
+uint8_t simTimer2Count() {
+  if (!sim::current()) return 0;
+  return (localNow() / sim::TIMER2_TICK) % (runningNode().timer2.ocr2a + 1);
+}
+
+void simInterrupts(bool enabled) {
+  if (sim::current()) runningNode().interruptsEnabled = enabled;
+}
+
+uint32_t millis() {
+  advance(sim::CALL_COST);
+  return localNow() / sim::MILLISECOND;
+}
+
+uint32_t micros() {
+  advance(sim::CALL_COST);
+  return localNow() / sim::MICROSECOND;
+}
+
+void delay(uint32_t ms) {
+  advance(ms * sim::MILLISECOND);
+}
+
+void delayMicroseconds(uint32_t us) {
+  advance(us * sim::MICROSECOND);
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  (void) pin;
+  (void) mode;
+  advance(sim::CALL_COST);
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  advance(sim::PIN_COST);
+  if (!sim::current() || pin >= SIM_PIN_COUNT) return;
+
+  sim::Node & node = runningNode();
+  uint8_t level = value ? HIGH : LOW;
+  if (node.pinLevel[pin] == level) return;
+  node.pinLevel[pin] = level;
+  node.pinChanged[pin] = sim::now();
+  if (node.pinObserver) node.pinObserver(pin, level, sim::now());
+
+  if (node.module && pin == node.sketch->hc12SetPin) {
+    sim::Hc12Module * module = node.module;
+    sim::schedule(sim::now(), [module, level]() {
+      module->setPin(level);
+    });
+  }
+}
+
+int digitalRead(uint8_t pin) {
+  advance(sim::PIN_COST);
+  if (!sim::current() || pin >= SIM_PIN_COUNT) return LOW;
+  return runningNode().pinLevel[pin];
+}
+
+void HardwareSerial::begin(unsigned long baud) {
+  advance(sim::CALL_COST);
+  if (sim::current()) runningNode().uart.baud = baud;
+}
+
+int HardwareSerial::available() {
+  advance(sim::CALL_COST);
+  return sim::current() ? runningNode().uart.rx.size() : 0;
+}
+
+int HardwareSerial::read() {
+  advance(sim::CALL_COST);
+  if (!sim::current() || runningNode().uart.rx.empty()) return -1;
+  sim::HardwareUart & uart = runningNode().uart;
+  uint8_t value = uart.rx.front();
+  uart.rx.pop_front();
+  return value;
+}
+
+void HardwareSerial::flush() {
+  advance(sim::CALL_COST);
+  if (!sim::current()) return;
+  sim::HardwareUart & uart = runningNode().uart;
+  while (uart.shifting || uart.udrFull || !uart.ring.empty()) sim::waitUntil(uart.shiftEnd);
+}
+
+size_t HardwareSerial::write(uint8_t value) {
+  advance(sim::WRITE_COST);
+  if (!sim::current()) return 0;
+  sim::Node & node = runningNode();
+  sim::HardwareUart & uart = node.uart;
+  if (uart.baud == 0) return 0;
+
+  while (uart.ring.size() >= sim::SERIAL_TX_BUFFER - 1) sim::waitUntil(uart.shiftEnd);
+
+  uart.txc = false; // Cleared by every write, as HardwareSerial does
+  if (!uart.shifting) {
+    sim::startShift(node, value);
+  } else if (!uart.udrFull && uart.ring.empty()) {
+    uart.udr = value;
+    uart.udrFull = true;
+  } else {
+    uart.ring.push_back(value);
+    node.ucsr0b |= _BV(UDRIE0);
+  }
+  return 1;
+}
+
+void SoftwareSerial::begin(long baud) {
+  advance(sim::CALL_COST);
+  if (!sim::current()) return;
+  runningNode().softUart.baud = baud;
+  runningNode().softUart.rx.clear();
+}
+
+int SoftwareSerial::available() {
+  advance(sim::CALL_COST);
+  return sim::current() ? runningNode().softUart.rx.size() : 0;
+}
+
+int SoftwareSerial::read() {
+  advance(sim::CALL_COST);
+  if (!sim::current() || runningNode().softUart.rx.empty()) return -1;
+  sim::SoftwareUart & port = runningNode().softUart;
+  uint8_t value = port.rx.front();
+  port.rx.pop_front();
+  return value;
+}
+
+size_t SoftwareSerial::write(uint8_t value) {
+  advance(sim::CALL_COST);
+  if (!sim::current()) return 0;
+  sim::Node & node = runningNode();
+  sim::SoftwareUart & port = node.softUart;
+  if (port.baud == 0) return 0;
+
+  port.txStart = sim::now();
+  port.txEnd = port.txStart + sim::charTime(port.baud);
+  if (node.module) {
+    sim::Hc12Module * module = node.module;
+    uint32_t baud = port.baud;
+    sim::Time end = port.txEnd;
+    sim::schedule(end, [module, value, baud, end]() {
+      module->fromNode(value, baud, end);
+    });
+  }
+
+  bool enabled = node.interruptsEnabled;
+  node.interruptsEnabled = false; // Bit-banged with interrupts off
+  advance(port.txEnd - port.txStart);
+  node.interruptsEnabled = enabled;
+  return 1;
+}
@@ -0,0 +1,864 @@
+/*
+ * claycast-sim: scripted scenarios against the controller and client sketches.
+ *
+ * A Modbus master on the controller's RS485 side stands in for the HMI. Every
+ * scenario runs in a fresh process, so the sketches start from power-up.
+ * Results are printed one line per measurement as "name key=value ...".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <ClayCastModbus.h>
+#include <ClayCastHC12.h>
+#include "sim.h"
+
+#ifndef SIM_BAUD_RATE
+#define SIM_BAUD_RATE 9600 // RS485 baud of the controller sketch (set by build-sim.sh)
+#endif
+
+using namespace sim;
+
+namespace {
+
+const Time POLL_STEP = 100 * MICROSECOND; // Script polling granularity
+const Time SETUP_SETTLE = 200 * MILLISECOND;
+const Time MASTER_TIMEOUT = 500 * MILLISECOND; // HMI response timeout
+const Time FIRE_WAIT = 1 * SECOND; // DO1 pulse expected within
+const Time REFIRE_SPACING = 4500 * MILLISECOND; // Client NEXTCAST_TIME plus margin
+const Time MIN_FIRE_SPACING = 300 * MILLISECOND;
+const uint8_t MASTER_RETRIES = 2; // HMI retries after a timeout
+const double BER_SWEEP[] = {0, 1e-4, 3e-4, 1e-3, 2e-3, 5e-3}; // Bit error rates of the ber scenario
+const Time SYNC_WARMUP = 60 * SECOND; // Time beacons for a drift measurement over several sync windows
+const Time SYNC_TARGET = 1 * MILLISECOND; // Skew a synced group fire should stay within
+const uint16_t FIRE_REGISTER = 1;
+const uint16_t POLL_REGISTERS = 4;
+const uint8_t STATS_SLAVE_ADDRESS = 246; // Controller link statistics (controller.ino)
+const uint8_t CACHE_SLAVE_ADDRESS = 247; // Controller register cache (controller.ino)
+const uint8_t VIRTUAL_SLAVE_STRIDE = 2; // The board of radio port n answers 246 - 2n and 247 - 2n (controller.ino)
+const uint16_t CACHE_BLOCK_SIZE = 5; // Cache registers per client (controller.ino)
+const uint16_t CACHE_AGE_OFFSET = 4; // Age register in a client's block (controller.ino)
+const Time CACHE_AGE_UNIT = 100 * MILLISECOND;
+const uint16_t STATS_RADIO_RECEIVED = 6; // Valid radio frames register (controller.ino)
+const uint16_t STATS_FIRE_BASE = 36; // Fire status of client 1, FIRE_QUEUE_ENABLED only (controller.ino)
+const uint16_t FIRE_DELIVERED = 2; // Fire status: the client answered (controller.ino)
+const uint8_t TRIPLE_FIRES = 3; // Fires of a triple throw, each to its own client
+const uint16_t CONTACT1_REGISTER = 2; // Debounced IN1 level (client.ino)
+const uint16_t CONTACT2_REGISTER = 3; // Debounced IN2 level (client.ino)
+const uint16_t READBACK_REGISTERS = 6; // CONTACT1..CONTACT2_DELAY: a 17 byte answer, too long for the client's reply cache (client.ino)
+const uint8_t IN2_PIN = A1;
+const Time REPORT_WARMUP = 5 * SECOND; // Every client in the cache
+const Time REPORT_IDLE = 20 * SECOND; // Airtime measured with nothing changing
+const Time REPORT_READ_INTERVAL = 50 * MILLISECOND; // HMI reads of the cache
+const Time REPORT_WAIT = 5 * SECOND; // Change expected in the cache within
+const Time REPORT_SPACING = 1 * SECOND; // Random pause before a change, up to this much
+const Time RADIOS_WARMUP = 5 * SECOND; // Every client in the caches
+const Time RADIOS_WINDOW = 10 * SECOND; // Polls counted per run
+const uint8_t LINK_OFF_CHANNEL = 100; // Channel the clients' modules move to, out of the controller's reach
+const Time LINK_FALLBACK_WAIT = 2 * LINK_SILENCE_TIMEOUT * MILLISECOND; // Fallback of the controller and the clients expected within
+
+// Controller statistics registers 0.. in order, as printed
+const char * const STATS_NAMES[] = {
+  "rs485_requests", "rs485_crc_errors", "rs485_overflows", "rs485_short_frames", "rs485_responses",
+  "radio_sent", "radio_received", "radio_dropped", "radio_frame_timeouts", "radio_response_timeouts",
+  "radio_discarded_bytes", "loop_max_us_high", "loop_max_us_low"
+};
+
+struct Options {
+  uint8_t clients = 0; // 0: every client built into the simulator
+  uint8_t runs = 3;
+  std::string scenario = "all";
+  RadioConfig radio;
+  double driftPpm = 0; // Crystal error of each node, up to this much either way
+};
+
+struct Stats {
+  std::vector<double> values;
+
+  void add(double value) {
+    values.push_back(value);
+  }
+
+  double min() const {
+    return values.empty() ? 0 : *std::min_element(values.begin(), values.end());
+  }
+
+  double max() const {
+    return values.empty() ? 0 : *std::max_element(values.begin(), values.end());
+  }
+
+  double average() const {
+    double sum = 0;
+    for (double value : values) sum += value;
+    return values.empty() ? 0 : sum / values.size();
+  }
+
+  // Nearest rank
+  double percentile(double percent) const {
+    if (values.empty()) return 0;
+    std::vector<double> sorted = values;
+    std::sort(sorted.begin(), sorted.end());
+    size_t rank = (size_t) (percent / 100 * sorted.size() + 0.999999);
+    return sorted[std::max<size_t>(rank, 1) - 1];
+  }
+};
+
+double toMillis(Time duration) {
+  return (double) duration / MILLISECOND;
+}
+
+// Modbus RTU master on the RS485 line of the controller boards. The line is
+// shared: every board hears the master and the answers of the other boards.
+class ModbusMaster {
+public:
+  struct Result {
+    std::vector<uint8_t> response;
+    Time requestEnd;
+    Time responseEnd;
+    bool valid;
+  };
+
+  ModbusMaster(const std::vector<Node *> & boards, uint32_t lineBaud) : controllers(boards), baud(lineBaud) {
+    gap = modbusInterFrameMicros(baud) * MICROSECOND;
+    for (Node * controller : controllers) {
+      controller->uart.sink = [this, controller](uint8_t value, Time start, Time end) {
+        onByte(*controller, value, start, end);
+      };
+      controller->pinObserver = [this, controller](uint8_t pin, uint8_t level, Time when) {
+        onPin(*controller, pin, level, when);
+      };
+    }
+  }
+
+  // Send a request (CRC appended) and wait for the answer. Script context only.
+  Result transact(std::vector<uint8_t> request, Time timeout) {
+    request.resize(request.size() + 2);
+    modbusAppendCRC(request.data(), request.size() - 2);
+
+    received.clear();
+    truncated = false;
+    complete = false;
+    generation++;
+
+    Time start = now();
+    for (size_t i = 0; i < request.size(); i++) {
+      uint8_t value = request[i];
+      std::vector<Node *> targets = controllers;
+      schedule(start + (i + 1) * charTime(baud), [targets, value]() {
+        for (Node * target : targets) deliverSerial(*target, value);
+      });
+    }
+
+    Result result;
+    result.requestEnd = start + request.size() * charTime(baud);
+    sleep(result.requestEnd - now());
+    if (request[0] == MODBUS_BROADCAST_ADDRESS) {
+      sleep(gap);
+      result.responseEnd = result.requestEnd;
+      result.valid = true;
+      return result;
+    }
+
+    while (!complete && now() < result.requestEnd + timeout) sleep(POLL_STEP);
+    result.response = received;
+    result.responseEnd = lastByteEnd;
+    result.valid = complete && !truncated && modbusCheckCRC(received.data(), received.size()) &&
+      received[0] == request[0];
+    return result;
+  }
+
+  Stats turnaround; // Last stop bit to DE low (µs)
+  uint32_t truncatedBytes = 0; // DE released before the stop bit
+
+private:
+  std::vector<Node *> controllers;
+  uint32_t baud;
+  Time gap;
+  std::vector<uint8_t> received;
+  bool truncated = false;
+  bool complete = false;
+  uint32_t generation = 0;
+  Time lastByteEnd = 0;
+
+  void onByte(Node & controller, uint8_t value, Time start, Time end) {
+    uint8_t dePin = controller.sketch->rs485DePin;
+    if (controller.pinLevel[dePin] != HIGH || controller.pinChanged[dePin] > start) {
+      truncatedBytes++;
+      truncated = true;
+    } else {
+      for (Node * other : controllers) {
+        if (other != &controller) deliverSerial(*other, value);
+      }
+    }
+
+    received.push_back(value);
+    lastByteEnd = end;
+    uint32_t byteGeneration = ++generation;
+    schedule(end + gap, [this, byteGeneration]() {
+      if (byteGeneration == generation) complete = true;
+    });
+  }
+
+  void onPin(Node & controller, uint8_t pin, uint8_t level, Time when) {
+    if (pin != controller.sketch->rs485DePin || level != LOW) return;
+    HardwareUart & uart = controller.uart;
+    if (uart.shifting || uart.lastByteEnd == 0) return; // Counted as truncated
+    turnaround.add((double) (when - uart.lastByteEnd) / MICROSECOND);
+  }
+};
+
+std::vector<uint8_t> writeSingleRegister(uint8_t address, uint16_t reg, uint16_t value) {
+  return {address, MODBUS_FUNCTION_WRITE_SINGLE_REGISTER, (uint8_t) (reg >> 8), (uint8_t) reg,
+    (uint8_t) (value >> 8), (uint8_t) value};
+}
+
+std::vector<uint8_t> readHoldingRegisters(uint8_t address, uint16_t start, uint16_t quantity) {
+  return {address, MODBUS_FUNCTION_READ_HOLDING_REGISTERS, (uint8_t) (start >> 8), (uint8_t) start,
+    (uint8_t) (quantity >> 8), (uint8_t) quantity};
+}
+
+// 0x17 writing one register and reading others in the same transaction
+std::vector<uint8_t> readWriteRegisters(uint8_t address, uint16_t readStart, uint16_t readQuantity, uint16_t reg,
+  uint16_t value) {
+  return {address, MODBUS_FUNCTION_READ_WRITE_MULTIPLE_REGISTERS, (uint8_t) (readStart >> 8), (uint8_t) readStart,
+    (uint8_t) (readQuantity >> 8), (uint8_t) readQuantity, (uint8_t) (reg >> 8), (uint8_t) reg, 0, 1, 2,
+    (uint8_t) (value >> 8), (uint8_t) value};
+}
+
+// Controller boards, clients 1..clientCount and the master, wired together
+class World {
+public:
+  World(const Options & options, uint8_t clientCount) : air(options.radio), fires(clientCount + 1) {
+    std::mt19937 random(options.radio.seed);
+    std::uniform_real_distribution<double> chance(-1, 1);
+    for (const SketchEntry & sketch : registeredSketches()) {
+      if (sketch.address > clientCount) continue;
+      Node & node = addSketchNode(sketch);
+      if (options.driftPpm > 0) { // Own crystal, powered up at its own time
+        node.clockRate = 1 + chance(random) * options.driftPpm / 1e6;
+        node.clockPhase = (Time) ((chance(random) + 1) / 2 * SECOND);
+      }
+      modules.emplace_back(new Hc12Module(node, air));
+      node.module = modules.back().get();
+
+      if (sketch.address == 0) {
+        controllers.push_back(&node);
+        continue;
+      }
+      clients++;
+      uint8_t address = sketch.address;
+      std::vector<Time> * fireTimes = &fires[address];
+      node.pinObserver = [&node, fireTimes](uint8_t pin, uint8_t level, Time when) {
+        if (pin == node.sketch->firePin && level == HIGH) fireTimes->push_back(when);
+      };
+    }
+    std::sort(controllers.begin(), controllers.end(), [](Node * a, Node * b) {
+      return a->sketch->radioPort < b->sketch->radioPort;
+    });
+    if (!controllers.empty()) {
+      controller = controllers.front();
+      master.reset(new ModbusMaster(controllers, SIM_BAUD_RATE));
+    }
+  }
+
+  bool complete(uint8_t clientCount) const {
+    return controller && clients == clientCount;
+  }
+
+  // Script context: wait until every sketch has left setup()
+  void waitForSetup() {
+    bool done = false;
+    while (!done) {
+      sleep(MILLISECOND);
+      done = controller->setupDone;
+      for (auto & module : modules) done = done && module->node.setupDone;
+    }
+    sleep(SETUP_SETTLE);
+  }
+
+  // Script context: first DO1 pulse of a client after a time, or 0
+  Time waitForFire(uint8_t address, Time after, Time deadline) {
+    while (true) {
+      for (Time fire : fires[address]) {
+        if (fire >= after) return fire;
+      }
+      if (now() >= deadline) return 0;
+      sleep(POLL_STEP);
+    }
+  }
+
+  Node * client(uint8_t address) {
+    for (auto & module : modules) {
+      if (module->node.sketch->address == address) return &module->node;
+    }
+    return nullptr;
+  }
+
+  void printLinkStats() {
+    const RadioStats & radio = air.stats();
+    printf("radio sent=%u delivered=%u lost=%u corrupted=%u collisions=%u\n",
+      radio.bytesSent, radio.bytesDelivered, radio.bytesLost, radio.bytesCorrupted, radio.collisions);
+    printf("rs485 turnaround_us_min=%.1f turnaround_us_avg=%.1f turnaround_us_max=%.1f truncated_bytes=%u\n",
+      master->turnaround.min(), master->turnaround.average(), master->turnaround.max(), master->truncatedBytes);
+
+    // The counters of the board of radio port 0, read like the HMI would
+    const uint16_t count = sizeof(STATS_NAMES) / sizeof(STATS_NAMES[0]);
+    ModbusMaster::Result result = master->transact(readHoldingRegisters(STATS_SLAVE_ADDRESS, 0, count), MASTER_TIMEOUT);
+    if (!result.valid || result.response.size() != 5u + 2 * count) {
+      printf("controller stats=unavailable\n");
+      return;
+    }
+    printf("controller");
+    for (uint16_t i = 0; i < count; i++) {
+      printf(" %s=%u", STATS_NAMES[i], (result.response[3 + 2 * i] << 8) | result.response[4 + 2 * i]);
+    }
+    printf("\n");
+  }
+
+  Air air;
+  std::vector<Node *> controllers; // By radio port
+  Node * controller = nullptr; // Board of radio port 0
+  uint8_t clients = 0;
+  std::vector<std::unique_ptr<Hc12Module>> modules;
+  std::vector<std::vector<Time>> fires; // DO1 rising edges per slave address
+  std::unique_ptr<ModbusMaster> master;
+};
+
+// HMI write of FIRE to each client in turn, time to its DO1 pulse
+void fireScenario(World & world, const Options & options) {
+  uint8_t clients = world.clients;
+  Time spacing = std::max(MIN_FIRE_SPACING, REFIRE_SPACING / clients);
+  Stats latency;
+  Stats acknowledge;
+  uint32_t sent = 0;
+
+  for (uint8_t run = 0; run < options.runs; run++) {
+    for (uint8_t address = 1; address <= clients; address++) {
+      Time start = now();
+      ModbusMaster::Result result = world.master->transact(writeSingleRegister(address, FIRE_REGISTER, 1), MASTER_TIMEOUT);
+      sent++;
+      if (result.valid) acknowledge.add(toMillis(result.responseEnd - result.requestEnd));
+
+      Time fire = world.waitForFire(address, result.requestEnd, result.requestEnd + FIRE_WAIT);
+      if (fire) latency.add(toMillis(fire - result.requestEnd));
+
+      if (now() < start + spacing) sleep(start + spacing - now());
+    }
+  }
+
+  printf("fire clients=%u sent=%u fired=%zu acknowledged=%zu latency_ms_min=%.2f latency_ms_avg=%.2f latency_ms_max=%.2f ack_ms_avg=%.2f\n",
+    clients, sent, latency.values.size(), acknowledge.values.size(), latency.min(), latency.average(), latency.max(),
+    acknowledge.average());
+}
+
+// A fire request to each client in turn, retried like the HMI does after a
+// timeout: time from the first request to a valid answer, and the DO1 pulses
+// each request caused. Run with --loss; build with NEXTCAST_TIME=0 so that a
+// fire run twice shows as a second pulse instead of being refused.
+void retryFires(World & world, const Options & options, const char * name,
+  std::vector<uint8_t> (*fireRequest)(uint8_t address)) {
+  uint8_t clients = world.clients;
+  Time spacing = std::max(MIN_FIRE_SPACING, REFIRE_SPACING / clients);
+  Stats latency;
+  uint32_t sent = 0;
+  uint32_t requests = 0;
+  uint32_t failed = 0;
+  uint32_t fired = 0;
+  uint32_t doubleFired = 0;
+
+  for (uint8_t run = 0; run < options.runs; run++) {
+    for (uint8_t address = 1; address <= clients; address++) {
+      Time start = now();
+      Time firstEnd = 0;
+      bool answered = false;
+      for (uint8_t attempt = 0; attempt <= MASTER_RETRIES && !answered; attempt++) {
+        ModbusMaster::Result result = world.master->transact(fireRequest(address), MASTER_TIMEOUT);
+        requests++;
+        if (!firstEnd) firstEnd = result.requestEnd;
+        answered = result.valid;
+        if (answered) latency.add(toMillis(result.responseEnd - firstEnd));
+      }
+      sent++;
+      if (!answered) failed++;
+
+      sleep(FIRE_WAIT);
+      uint32_t pulses = 0;
+      for (Time fire : world.fires[address]) {
+        if (fire >= start) pulses++;
+      }
+      if (pulses > 0) fired++;
+      if (pulses > 1) doubleFired++;
+
+      if (now() < start + spacing) sleep(start + spacing - now());
+    }
+  }
+
+  printf("%s clients=%u sent=%u requests=%u failed=%u fired=%u double_fired=%u latency_ms_p50=%.2f latency_ms_p99=%.2f latency_ms_max=%.2f\n",
+    name, clients, sent, requests, failed, fired, doubleFired, latency.percentile(50), latency.percentile(99), latency.max());
+}
+
+// HMI write of FIRE (0x06)
+void retryScenario(World & world, const Options & options) {
+  retryFires(world, options, "retry", [](uint8_t address) {
+    return writeSingleRegister(address, FIRE_REGISTER, 1);
+  });
+}
+
+// FIRE written and the contacts read back in one 0x17, whose answer is too
+// long for the client to keep for a retransmit
+void readbackScenario(World & world, const Options & options) {
+  retryFires(world, options, "readback", [](uint8_t address) {
+    return readWriteRegisters(address, CONTACT1_REGISTER, READBACK_REGISTERS, FIRE_REGISTER, 1);
+  });
+}
+
+struct GroupFire {
+  uint32_t fired; // Clients that fired
+  Time requestEnd;
+  Time earliest; // First DO1 pulse, 0 if none
+  Time latest;
+};
+
+// Broadcast group fire of every client (up to 16) and their DO1 pulses
+GroupFire groupFire(World & world) {
+  uint8_t clients = std::min<uint8_t>(world.clients, 16);
+  uint16_t mask = clients >= 16 ? 0xFFFF : (1u << clients) - 1;
+  ModbusMaster::Result result = world.master->transact(
+    writeSingleRegister(MODBUS_BROADCAST_ADDRESS, GROUP_FIRE_REGISTER, mask), MASTER_TIMEOUT);
+
+  GroupFire group = {0, result.requestEnd, 0, 0};
+  for (uint8_t address = 1; address <= clients; address++) {
+    Time fire = world.waitForFire(address, result.requestEnd, result.requestEnd + FIRE_WAIT);
+    if (!fire) continue;
+    group.fired++;
+    if (!group.earliest || fire < group.earliest) group.earliest = fire;
+    if (fire > group.latest) group.latest = fire;
+  }
+  return group;
+}
+
+// Broadcast group fire of every client, spread of the DO1 pulses
+void groupScenario(World & world, const Options & options) {
+  Stats first;
+  Stats spread;
+  uint32_t fired = 0;
+
+  for (uint8_t run = 0; run < options.runs; run++) {
+    Time start = now();
+    GroupFire group = groupFire(world);
+    fired += group.fired;
+    if (group.earliest) {
+      first.add(toMillis(group.earliest - group.requestEnd));
+      spread.add(toMillis(group.latest - group.earliest));
+    }
+
+    if (now() < start + REFIRE_SPACING) sleep(start + REFIRE_SPACING - now());
+  }
+
+  printf("group clients=%u runs=%u fired=%u first_ms_avg=%.2f spread_ms_avg=%.2f spread_ms_max=%.2f\n",
+    world.clients, options.runs, fired, first.average(), spread.average(), spread.max());
+}
+
+// Group fires once the clients have synced to the controller's time beacons,
+// so they run as scheduled fires: skew of the DO1 pulses (simulation time,
+// whatever the nodes' own clocks say)
+void syncScenario(World & world, const Options & options) {
+  Stats delay;
+  Stats skew;
+  uint32_t fired = 0;
+  uint32_t within = 0;
+
+  sleep(SYNC_WARMUP);
+  for (uint8_t run = 0; run < options.runs; run++) {
+    Time start = now();
+    GroupFire group = groupFire(world);
+    fired += group.fired;
+    if (group.earliest) {
+      delay.add(toMillis(group.earliest - group.requestEnd));
+      skew.add((double) (group.latest - group.earliest) / MICROSECOND);
+      if (group.latest - group.earliest < SYNC_TARGET) within++;
+    }
+
+    if (now() < start + REFIRE_SPACING) sleep(start + REFIRE_SPACING - now());
+  }
+
+  printf("sync clients=%u runs=%u fired=%u delay_ms_avg=%.2f skew_us_avg=%.1f skew_us_max=%.1f within_1ms=%u\n",
+    world.clients, options.runs, fired, delay.average(), skew.average(), skew.max(), within);
+}
+
+// HMI reads POLL_REGISTERS from every client in turn, time per full cycle
+void pollScenario(World & world, const Options & options) {
+  uint8_t clients = world.clients;
+  Stats cycle;
+  uint32_t answered = 0;
+  uint32_t sent = 0;
+
+  for (uint8_t run = 0; run < options.runs; run++) {
+    Time start = now();
+    for (uint8_t address = 1; address <= clients; address++) {
+      ModbusMaster::Result result = world.master->transact(readHoldingRegisters(address, 0, POLL_REGISTERS), MASTER_TIMEOUT);
+      sent++;
+      if (result.valid) answered++;
+    }
+    cycle.add(toMillis(now() - start));
+  }
+
+  printf("poll clients=%u sent=%u answered=%u cycle_ms_avg=%.2f cycle_ms_max=%.2f\n",
+    clients, sent, answered, cycle.average(), cycle.max());
+}
+
+// Air bytes per second while the script sleeps for duration
+double airRate(World & world, Time duration) {
+  uint32_t sent = world.air.stats().bytesSent;
+  sleep(duration);
+  return (world.air.stats().bytesSent - sent) / ((double) duration / SECOND);
+}
+
+// Radio use with nothing changing, then IN2 of each client toggled in turn and
+// the HMI reading the controller's register cache until it shows the change:
+// time from the toggle, radio use meanwhile and cache reads left unanswered
+void reportScenario(World & world, const Options & options) {
+  uint8_t clients = world.clients;
+  Stats latency;
+  uint32_t changes = 0;
+  uint32_t seen = 0;
+  uint32_t reads = 0;
+  uint32_t unanswered = 0;
+  std::mt19937 random(options.radio.seed);
+  std::uniform_int_distribution<Time> pause(0, REPORT_SPACING);
+
+  sleep(REPORT_WARMUP);
+  double idleRate = airRate(world, REPORT_IDLE);
+
+  uint32_t sent = world.air.stats().bytesSent;
+  Time start = now();
+  for (uint8_t run = 0; run < options.runs; run++) {
+    for (uint8_t address = 1; address <= clients; address++) {
+      sleep(pause(random)); // Not in step with the controller's polls or beacons
+      Node & node = *world.client(address);
+      uint8_t level = !node.pinLevel[IN2_PIN];
+      node.pinLevel[IN2_PIN] = level;
+      Time changed = now();
+      changes++;
+
+      uint8_t cache = CACHE_SLAVE_ADDRESS - VIRTUAL_SLAVE_STRIDE * radioPort(address); // On the client's board
+      uint16_t reg = (address - 1) * CACHE_BLOCK_SIZE + CONTACT2_REGISTER;
+      while (now() < changed + REPORT_WAIT) {
+        Time read = now();
+        ModbusMaster::Result result = world.master->transact(readHoldingRegisters(cache, reg, 1), MASTER_TIMEOUT);
+        reads++;
+        if (!result.valid || result.response.size() != 7) {
+          unanswered++;
+        } else if (((result.response[3] << 8) | result.response[4]) == level) {
+          latency.add(toMillis(result.responseEnd - changed));
+          seen++;
+          break;
+        }
+        if (now() < read + REPORT_READ_INTERVAL) sleep(read + REPORT_READ_INTERVAL - now());
+      }
+    }
+  }
+  double changeRate = (world.air.stats().bytesSent - sent) / ((double) (now() - start) / SECOND);
+
+  printf("report clients=%u changes=%u seen=%u latency_ms_avg=%.2f latency_ms_max=%.2f idle_air_bps=%.1f change_air_bps=%.1f reads=%u unanswered=%u\n",
+    clients, changes, seen, latency.average(), latency.max(), idleRate, changeRate, reads, unanswered);
+}
+
+// HMI reads POLL_REGISTERS from each client in turn, without retries, at the
+// bit error rate of the options: register bytes delivered per second
+void berScenario(World & world, const Options & options) {
+  uint8_t clients = world.clients;
+  Stats latency;
+  uint32_t sent = 0;
+  uint32_t answered = 0;
+
+  Time start = now();
+  for (uint8_t run = 0; run < options.runs; run++) {
+    for (uint8_t address = 1; address <= clients; address++) {
+      ModbusMaster::Result result = world.master->transact(readHoldingRegisters(address, 0, POLL_REGISTERS), MASTER_TIMEOUT);
+      sent++;
+      if (!result.valid || result.response.size() != 5u + 2 * POLL_REGISTERS) continue;
+      answered++;
+      latency.add(toMillis(result.responseEnd - result.requestEnd));
+    }
+  }
+  double seconds = (double) (now() - start) / SECOND;
+
+  printf("ber ber=%.6f clients=%u sent=%u answered=%u goodput_bytes_per_s=%.1f latency_ms_avg=%.2f\n",
+    options.radio.bitErrorRate, clients, sent, answered, answered * 2 * POLL_REGISTERS / seconds, latency.average());
+}
+
+// One register of the virtual slave at base (STATS_SLAVE_ADDRESS or
+// CACHE_SLAVE_ADDRESS) of the board of a radio port, or -1
+int32_t readBoardRegister(World & world, uint8_t base, uint8_t port, uint16_t reg) {
+  ModbusMaster::Result result = world.master->transact(readHoldingRegisters(base - VIRTUAL_SLAVE_STRIDE * port, reg, 1), MASTER_TIMEOUT);
+  if (!result.valid || result.response.size() != 7) return -1;
+  return (result.response[3] << 8) | result.response[4];
+}
+
+// Poll answers the controller boards have received, all together
+uint32_t receivedPolls(World & world) {
+  uint32_t received = 0;
+  for (uint8_t port = 0; port < world.controllers.size(); port++) {
+    received += std::max<int32_t>(readBoardRegister(world, STATS_SLAVE_ADDRESS, port, STATS_RADIO_RECEIVED), 0);
+  }
+  return received;
+}
+
+// The boards' background cache polls with nothing else on air: poll answers
+// per second of all boards together, the time between two polls of a client
+// and the oldest cache entry the master reads from the boards
+void radiosScenario(World & world, const Options & options) {
+  uint8_t clients = world.clients;
+  Stats age;
+  uint32_t unanswered = 0;
+
+  sleep(RADIOS_WARMUP);
+  uint32_t before = receivedPolls(world);
+  Time start = now();
+  for (uint8_t run = 0; run < options.runs; run++) {
+    sleep(RADIOS_WINDOW);
+    for (uint8_t address = 1; address <= clients; address++) {
+      int32_t value = readBoardRegister(world, CACHE_SLAVE_ADDRESS, radioPort(address),
+        (address - 1) * CACHE_BLOCK_SIZE + CACHE_AGE_OFFSET);
+      if (value < 0) unanswered++;
+      else age.add(toMillis(value * CACHE_AGE_UNIT));
+    }
+  }
+  uint32_t polls = receivedPolls(world) - before;
+  double rate = polls / ((double) (now() - start) / SECOND);
+
+  printf("radios ports=%zu clients=%u polls=%u polls_per_s=%.1f refresh_ms=%.1f age_ms_max=%.0f unanswered=%u\n",
+    world.controllers.size(), clients, polls, rate, rate > 0 ? clients * 1000 / rate : 0, age.max(), unanswered);
+}
+
+// A triple throw: the HMI writes FIRE to three clients back to back. Time
+// the HMI is busy with the three writes, time from the first write to the
+// last DO1 pulse, and the deliveries the controller reports in the fire
+// status registers (FIRE_QUEUE_ENABLED builds only)
+void tripleScenario(World & world, const Options & options) {
+  uint8_t clients = world.clients;
+  uint8_t fires = std::min<uint8_t>(TRIPLE_FIRES, clients);
+  Stats busy;
+  Stats lastFire;
+  uint32_t sent = 0;
+  uint32_t acknowledged = 0;
+  uint32_t fired = 0;
+  uint32_t delivered = 0;
+  uint32_t statusUnavailable = 0;
+
+  for (uint8_t run = 0; run < options.runs; run++) {
+    uint8_t addresses[TRIPLE_FIRES];
+    for (uint8_t i = 0; i < fires; i++) addresses[i] = (run * fires + i) % clients + 1;
+
+    Time start = now();
+    Time end = start;
+    for (uint8_t i = 0; i < fires; i++) {
+      ModbusMaster::Result result = world.master->transact(writeSingleRegister(addresses[i], FIRE_REGISTER, 1), MASTER_TIMEOUT);
+      sent++;
+      if (result.valid && result.response[1] == MODBUS_FUNCTION_WRITE_SINGLE_REGISTER) acknowledged++;
+      end = result.valid ? result.responseEnd : now();
+    }
+    busy.add(toMillis(end - start));
+
+    Time last = 0;
+    bool all = true;
+    for (uint8_t i = 0; i < fires; i++) {
+      Time fire = world.waitForFire(addresses[i], start, start + FIRE_WAIT);
+      if (fire) fired++;
+      all = all && fire;
+      last = std::max(last, fire);
+    }
+    if (all) lastFire.add(toMillis(last - start));
+
+    if (now() < start + FIRE_WAIT) sleep(start + FIRE_WAIT - now());
+    for (uint8_t i = 0; i < fires; i++) {
+      int32_t status = readBoardRegister(world, STATS_SLAVE_ADDRESS, radioPort(addresses[i]), STATS_FIRE_BASE + addresses[i] - 1);
+      if (status < 0) statusUnavailable++;
+      else if ((status & 0xFF) == FIRE_DELIVERED) delivered++;
+    }
+
+    if (now() < start + REFIRE_SPACING) sleep(start + REFIRE_SPACING - now());
+  }
+
+  printf("triple clients=%u sent=%u acknowledged=%u fired=%u hmi_ms_avg=%.2f hmi_ms_max=%.2f last_fire_ms_avg=%.2f last_fire_ms_max=%.2f delivered=%u status_unavailable=%u\n",
+    clients, sent, acknowledged, fired, busy.average(), busy.max(), lastFire.average(), lastFire.max(), delivered,
+    statusUnavailable);
+}
+
+// Clients whose module is at a baud
+uint8_t clientsAtBaud(World & world, uint32_t baud) {
+  uint8_t count = 0;
+  for (auto & module : world.modules) {
+    if (module->node.sketch->address != 0 && module->baud == baud) count++;
+  }
+  return count;
+}
+
+// FIRE written to every client in turn, the writes answered
+uint8_t fireAll(World & world, const Options & options) {
+  uint8_t answered = 0;
+  for (uint8_t run = 0; run < options.runs; run++) {
+    for (uint8_t address = 1; address <= world.clients; address++) {
+      ModbusMaster::Result result = world.master->transact(writeSingleRegister(address, FIRE_REGISTER, 1), MASTER_TIMEOUT);
+      if (result.valid) answered++;
+      sleep(MIN_FIRE_SPACING);
+    }
+  }
+  return answered;
+}
+
+// Link rate negotiation and fallback; build with HC12_LINK_BAUD above
+// HC12_DEFAULT_BAUD. After setup every module should be at the negotiated
+// rate. The clients' modules then move to another channel while the master
+// keeps writing FIRE: the controller should fall back after LINK_FAIL_LIMIT
+// timeouts and the clients after LINK_SILENCE_TIMEOUT, and every client
+// should answer again at HC12_DEFAULT_BAUD once the channel is back.
+void linkScenario(World & world, const Options & options) {
+  Hc12Module & controller = *world.controller->module;
+  uint32_t negotiated = controller.baud;
+  uint8_t atRate = clientsAtBaud(world, negotiated);
+  uint8_t answered = fireAll(world, options);
+
+  std::vector<uint8_t> channels;
+  for (auto & module : world.modules) {
+    channels.push_back(module->channel);
+    if (module->node.sketch->address != 0) module->channel = LINK_OFF_CHANNEL;
+  }
+  Time cut = now();
+  Time controllerFallback = 0;
+  Time clientsFallback = 0;
+  while (now() < cut + LINK_FALLBACK_WAIT && !(controllerFallback && clientsFallback)) {
+    if (!controllerFallback) {
+      world.master->transact(writeSingleRegister(1, FIRE_REGISTER, 1), MASTER_TIMEOUT);
+      if (controller.baud == HC12_DEFAULT_BAUD) controllerFallback = now();
+    } else {
+      sleep(10 * MILLISECOND);
+    }
+    if (!clientsFallback && clientsAtBaud(world, HC12_DEFAULT_BAUD) == world.clients) clientsFallback = now();
+  }
+  for (size_t i = 0; i < world.modules.size(); i++) world.modules[i]->channel = channels[i];
+  sleep(SETUP_SETTLE); // The last client leaving its AT commands
+  uint8_t recovered = fireAll(world, options);
+
+  printf("link clients=%u baud=%u at_rate=%u answered=%u/%u fallback_baud=%u fallback_ms=%.0f client_fallback_ms=%.0f recovered=%u/%u\n",
+    world.clients, negotiated, atRate, answered, world.clients * options.runs, controller.baud,
+    controllerFallback ? toMillis(controllerFallback - cut) : -1.0, clientsFallback ? toMillis(clientsFallback - cut) : -1.0,
+    recovered, world.clients * options.runs);
+}
+
+typedef void (*Scenario)(World & world, const Options & options);
+
+// Run one scenario in a child process, so every sketch starts from power-up
+bool runScenario(Scenario scenario, const Options & options, uint8_t clients, bool linkStats) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) return false;
+
+  if (pid == 0) {
+    World world(options, clients);
+    if (!world.complete(clients)) {
+      fprintf(stderr, "Simulator was built with fewer than %u clients\n", clients);
+      _exit(1);
+    }
+    addScriptNode([&]() {
+      world.waitForSetup();
+      scenario(world, options);
+      if (linkStats) world.printLinkStats();
+    });
+    run(~(Time) 0);
+    fflush(stdout);
+    _exit(0);
+  }
+
+  int status = 0;
+  waitpid(pid, &status, 0);
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+void usage(const char * program) {
+  printf("Usage: %s [options]\n", program);
+  printf("  --scenario NAME   fire, retry, readback, triple, group, sync, poll, report, ber, radios, link or all (default all)\n");
+  printf("  --clients N       Clients on air (default: all built in)\n");
+  printf("  --runs N          Repetitions per scenario (default 3)\n");
+  printf("  --latency-ms X    HC-12 latency on top of the character time (default 5)\n");
+  printf("  --jitter-ms X     Extra latency of a burst, up to X, at all receivers alike (default 0)\n");
+  printf("  --rx-jitter-ms X  Further extra latency of a burst, up to X, per receiver (default 0)\n");
+  printf("  --drift-ppm X     Crystal error of each node, up to X either way (default 0)\n");
+  printf("  --loss P          Probability that a receiver misses a burst (default 0)\n");
+  printf("  --ber P           Bit error rate of delivered bytes (default 0)\n");
+  printf("  --seed N          Random seed (default 1)\n");
+}
+
+} // namespace
+
+int main(int argc, char ** argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    const char * option = argv[i];
+    const char * value = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (!strcmp(option, "--help")) {
+      usage(argv[0]);
+      return 0;
+    }
+    if (!value) {
+      usage(argv[0]);
+      return 1;
+    }
+    i++;
+    if (!strcmp(option, "--scenario")) options.scenario = value;
+    else if (!strcmp(option, "--clients")) options.clients = atoi(value);
+    else if (!strcmp(option, "--runs")) options.runs = atoi(value);
+    else if (!strcmp(option, "--latency-ms")) options.radio.latency = atof(value) * MILLISECOND;
+    else if (!strcmp(option, "--jitter-ms")) options.radio.jitter = atof(value) * MILLISECOND;
+    else if (!strcmp(option, "--rx-jitter-ms")) options.radio.receiverJitter = atof(value) * MILLISECOND;
+    else if (!strcmp(option, "--drift-ppm")) options.driftPpm = atof(value);
+    else if (!strcmp(option, "--loss")) options.radio.loss = atof(value);
+    else if (!strcmp(option, "--ber")) options.radio.bitErrorRate = atof(value);
+    else if (!strcmp(option, "--seed")) options.radio.seed = atoi(value);
+    else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  uint8_t built = 0;
+  for (const SketchEntry & sketch : registeredSketches()) built = std::max(built, sketch.address);
+  if (options.clients == 0 || options.clients > built) options.clients = built;
+  if (options.runs == 0) options.runs = 1;
+
+  printf("config baud=%u clients=%u runs=%u latency_ms=%.2f jitter_ms=%.2f rx_jitter_ms=%.2f drift_ppm=%.1f loss=%.4f ber=%.6f seed=%u\n",
+    SIM_BAUD_RATE, options.clients, options.runs, toMillis(options.radio.latency), toMillis(options.radio.jitter),
+    toMillis(options.radio.receiverJitter), options.driftPpm, options.radio.loss, options.radio.bitErrorRate,
+    options.radio.seed);
+
+  bool all = options.scenario == "all";
+  bool ok = true;
+  if (all || options.scenario == "fire") ok = runScenario(fireScenario, options, options.clients, true) && ok;
+  if (all || options.scenario == "retry") ok = runScenario(retryScenario, options, options.clients, true) && ok;
+  if (all || options.scenario == "readback") ok = runScenario(readbackScenario, options, options.clients, true) && ok;
+  if (all || options.scenario == "triple") ok = runScenario(tripleScenario, options, options.clients, true) && ok;
+  if (all || options.scenario == "group") ok = runScenario(groupScenario, options, options.clients, false) && ok;
+  if (all || options.scenario == "sync") ok = runScenario(syncScenario, options, options.clients, false) && ok;
+  if (all || options.scenario == "report") ok = runScenario(reportScenario, options, options.clients, false) && ok;
+  if (all || options.scenario == "ber") {
+    for (double bitErrorRate : BER_SWEEP) {
+      Options sweep = options;
+      sweep.radio.bitErrorRate = bitErrorRate;
+      ok = runScenario(berScenario, sweep, options.clients, false) && ok;
+    }
+  }
+  if (options.scenario == "link") ok = runScenario(linkScenario, options, options.clients, false) && ok;
+  if (all || options.scenario == "radios") ok = runScenario(radiosScenario, options, options.clients, false) && ok;
+  if (all || options.scenario == "poll") {
+    for (uint8_t clients = 1; clients <= options.clients; clients++) {
+      ok = runScenario(pollScenario, options, clients, false) && ok;
+    }
+  }
+  return ok ? 0 : 1;
+}
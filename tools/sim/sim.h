@@ -0,0 +1,241 @@
+/*
+ * ClayCast host simulator
+ *
+ * The controller and client sketches are compiled natively against the
+ * Arduino stand-in in this directory and run as coroutines under a
+ * conservative discrete-event scheduler:
+ * - every Arduino call costs simulated CPU time on the calling node's clock
+ * - a node runs until its clock passes the next pending event or another
+ *   node's clock plus SIM_LOOKAHEAD, then hands over to the scheduler
+ * - nodes only affect each other through events (UART characters, HC-12 air
+ *   bytes), which are always at least one character time in the future, so
+ *   no node ever sees another node's future
+ *
+ * Hardware models: USART0 with the HardwareSerial ring buffer and the TXC
+ * interrupt, Timer2 with its compare interrupts, the global interrupt flag,
+ * the RS485 driver enable, SoftwareSerial and the HC-12 module (AT commands,
+ * baud dependent air rate, latency and jitter, loss, bit errors and air
+ * collisions).
+ *
+ * Each node has its own crystal: millis(), micros() and Timer2 run on a local
+ * clock, phase + simulation time * rate, while events and measurements use the
+ * simulation time.
+ */
+
+#ifndef CLAYCAST_SIM_H
+#define CLAYCAST_SIM_H
+
+#include <stdint.h>
+#include <ucontext.h>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <random>
+#include <vector>
+#include "Arduino.h"
+
+namespace sim {
+
+typedef uint64_t Time; // Nanoseconds since power-up
+
+const Time MICROSECOND = 1000;
+const Time MILLISECOND = 1000 * MICROSECOND;
+const Time SECOND = 1000 * MILLISECOND;
+
+const Time SIM_LOOKAHEAD = 50 * MICROSECOND; // Below the shortest character time in use
+
+const uint8_t NO_PIN = 0xFF;
+
+typedef void (*SketchFunction)();
+
+// One sketch compiled into the simulator (see controller_node.cpp, client_node.cpp)
+struct SketchEntry {
+  const char * sketch; // "controller" or "client"
+  uint8_t address; // Modbus slave address, 0 for the controller
+  uint8_t radioPort; // RADIO_PORT of a controller board, the port a client is routed to
+  SketchFunction setup;
+  SketchFunction loop;
+  SketchFunction txCompleteIsr; // ISR(USART_TX_vect), or null
+  SketchFunction timer2CompareAIsr; // ISR(TIMER2_COMPA_vect), or null
+  SketchFunction timer2CompareBIsr; // ISR(TIMER2_COMPB_vect), or null
+  uint8_t hc12SetPin;
+  uint8_t rs485DePin; // NO_PIN if not used
+  uint8_t firePin; // NO_PIN if not used
+};
+
+struct SketchRegistrar {
+  explicit SketchRegistrar(const SketchEntry & entry);
+};
+
+std::vector<SketchEntry> & registeredSketches();
+
+// Ten bit character (start, 8 data, stop) at the given baud
+inline Time charTime(uint32_t baud) {
+  return 10 * SECOND / baud;
+}
+
+// Byte leaving a hardware USART: value, start of its start bit, end of its stop bit
+typedef std::function<void(uint8_t value, Time start, Time end)> ByteSink;
+
+// Pin change of a node: pin, new level, time
+typedef std::function<void(uint8_t pin, uint8_t level, Time when)> PinObserver;
+
+class Hc12Module;
+
+struct HardwareUart {
+  uint32_t baud = 0;
+  std::deque<uint8_t> rx;
+  uint32_t rxDropped = 0;
+
+  // Transmitter: shift register, UDR and the HardwareSerial ring buffer
+  bool shifting = false;
+  Time shiftEnd = 0;
+  bool udrFull = false;
+  uint8_t udr = 0;
+  std::deque<uint8_t> ring;
+  bool txc = false; // Transmit complete flag
+  Time lastByteEnd = 0;
+  ByteSink sink;
+};
+
+struct SoftwareUart {
+  uint32_t baud = 0;
+  std::deque<uint8_t> rx;
+  uint32_t rxDropped = 0;
+  Time txStart = 0; // Interrupts are off while a byte is bit-banged
+  Time txEnd = 0;
+  std::deque<std::pair<Time, Time>> rxBusy; // Incoming characters: the receive interrupt holds off the others
+  std::deque<std::pair<Time, Time>> timerBusy; // Recent Timer2 interrupts: they hold off the receive interrupt
+  uint32_t rxHeldOff = 0; // Characters whose start bit waited for a Timer2 interrupt
+  uint32_t rxLate = 0; // ... of them taken too late and misread
+};
+
+struct Node {
+  const SketchEntry * sketch = nullptr; // Null for the scenario script
+  std::function<void()> body;
+  ucontext_t context;
+  std::vector<char> stack;
+  Time clock = 0;
+  double clockRate = 1; // Local clock: clockPhase + clock * clockRate
+  Time clockPhase = 0;
+  bool setupDone = false;
+  bool finished = false;
+
+  uint8_t pinLevel[SIM_PIN_COUNT] = {};
+  Time pinChanged[SIM_PIN_COUNT] = {};
+  PinObserver pinObserver;
+
+  HardwareUart uart;
+  uint8_t ucsr0b = 0;
+  bool inIsr = false;
+  bool interruptsEnabled = true;
+
+  SimTimer2 timer2 = {};
+  Time timer2MatchA = 0; // Local time the compare flags were last cleared
+  Time timer2MatchB = 0;
+
+  SoftwareUart softUart;
+  Hc12Module * module = nullptr;
+};
+
+// Scheduler
+Node & addSketchNode(const SketchEntry & sketch);
+Node & addScriptNode(std::function<void()> body);
+void schedule(Time when, std::function<void()> action);
+void run(Time until); // Until the script finishes or until is reached
+Time now(); // Clock of the running node, or time of the current event
+Node * current();
+void sleep(Time duration); // Script node: let the simulation run
+void advance(Time duration); // Running node: spend CPU time (may hand over)
+
+// Character from a hardware USART line into a node's Serial
+void deliverSerial(Node & node, uint8_t value);
+
+// Character from the HC-12 module into a node's SoftwareSerial
+void deliverSoftSerial(Node & node, uint8_t value, uint32_t baud, Time start);
+
+struct RadioConfig {
+  Time latency = 5 * MILLISECOND; // Serial in to serial out, on top of the character time
+  Time jitter = 0; // Extra latency of a burst, up to this much, the same at every receiver
+  Time receiverJitter = 0; // Further extra latency of a burst at each receiver, up to this much
+  double loss = 0; // Probability that a receiver misses a whole burst
+  double bitErrorRate = 0; // Per delivered bit
+  uint32_t seed = 1;
+};
+
+struct RadioStats {
+  uint32_t bytesSent = 0;
+  uint32_t bytesDelivered = 0;
+  uint32_t bytesLost = 0;
+  uint32_t bytesCorrupted = 0;
+  uint32_t collisions = 0;
+};
+
+class Air;
+
+// HC-12 module wired to a node's SoftwareSerial and SET pin
+class Hc12Module {
+public:
+  Hc12Module(Node & node, Air & air);
+
+  void setPin(uint8_t level);
+  void fromNode(uint8_t value, uint32_t nodeBaud, Time end);
+  void fromAir(uint8_t value, Time arrival);
+
+  Node & node;
+  uint32_t baud = 9600;
+  uint8_t channel = 1;
+  uint8_t mode = 3;
+  bool commandMode = false;
+
+  // Burst bookkeeping for the air model
+  Time lastAirByte = 0;
+  std::vector<bool> burstLost;
+  std::vector<Time> burstDelay; // Jitter of the current burst per receiver
+  std::vector<Time> lastArrival; // Bytes of later bursts do not overtake it
+
+private:
+  Air & air;
+  std::vector<uint8_t> command;
+  uint32_t commandGeneration = 0;
+  uint32_t pendingBaud = 0;
+  Time outputFree = 0;
+
+  void runCommand();
+  void output(uint8_t value, Time earliest);
+};
+
+class Air {
+public:
+  explicit Air(const RadioConfig & config);
+
+  void attach(Hc12Module & module);
+  void transmit(Hc12Module & from, uint8_t value, Time start); // start: byte received from the node
+  const RadioStats & stats() const {
+    return counters;
+  }
+
+private:
+  struct AirByte {
+    Hc12Module * from;
+    Time start;
+    Time end;
+    bool collided;
+  };
+
+  RadioConfig config;
+  RadioStats counters;
+  std::mt19937 random;
+  std::vector<Hc12Module *> modules;
+  std::deque<std::shared_ptr<AirByte>> recent;
+
+  bool hears(const Hc12Module & receiver, const Hc12Module & sender) const;
+  uint8_t corrupt(uint8_t value, double bitErrorRate);
+};
+
+// Approximate HC-12 FU3 air rate for a serial baud
+uint32_t airRate(uint32_t baud);
+
+} // namespace sim
+
+#endif